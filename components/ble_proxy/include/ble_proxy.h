@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "esp_err.h"
+#include "sdkconfig.h"
 #include "host/ble_gatt.h"
 #include "host/ble_uuid.h"
 
@@ -69,10 +70,27 @@ typedef void (*ble_disconnect_cb_t)(uint16_t conn_handle, uint8_t reason);
 typedef void (*ble_passkey_cb_t)(uint16_t conn_handle, uint32_t passkey);
 typedef void (*ble_data_received_cb_t)(uint16_t conn_handle, const uint8_t *data, uint16_t len);
 
-// Connection management
+// Radios held at once. Each link has its own GATT handles, uplink window,
+// config cache and TCP listener on BLE_PROXY_BASE_PORT + link; the TCP
+// clients share one pool. Bounded by the NimBLE connection count.
+#if CONFIG_BT_NIMBLE_MAX_CONNECTIONS < 3
+#define BLE_PROXY_MAX_LINKS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#else
+#define BLE_PROXY_MAX_LINKS 3
+#endif
+#define BLE_PROXY_BASE_PORT 4403
+
+// Connection management. Connect takes the first free link, one attempt at
+// a time; ESP_ERR_NO_MEM when every link is in use. A bonded radio that
+// drops on its own is reconnected on the same link with backoff, its TCP
+// proxy kept up meanwhile; disconnecting the link stops that.
 esp_err_t ble_proxy_connect(const uint8_t *addr);
+esp_err_t ble_proxy_disconnect_link(uint8_t link);
+// BLE_HS_CONN_HANDLE_NONE disconnects every link
 esp_err_t ble_proxy_disconnect(uint16_t conn_handle);
-esp_err_t ble_proxy_get_connection_info(ble_connection_t *conn_info);
+esp_err_t ble_proxy_get_connection_info(uint8_t link, ble_connection_t *conn_info);
+bool ble_proxy_link_connected(uint8_t link);
+// Any link connected
 bool ble_proxy_is_connected(void);
 
 // Security/Pairing
@@ -87,22 +105,209 @@ void ble_proxy_register_passkey_cb(ble_passkey_cb_t cb);
 void ble_proxy_register_data_cb(ble_data_received_cb_t cb);
 
 // Proxy state functions
-proxy_state_t ble_proxy_get_state(void);
-bool ble_proxy_gatt_ready(void);
+proxy_state_t ble_proxy_get_state(uint8_t link);
+bool ble_proxy_gatt_ready(uint8_t link);
+
+// Connection facts the data path needs, republished whole from GAP and
+// discovery events so the TCP task reads one struct instead of NimBLE state
+typedef struct {
+    uint16_t conn_handle;       // BLE_HS_CONN_HANDLE_NONE when down
+    uint16_t mtu;               // Negotiated ATT MTU
+    uint16_t rx_val;            // Write handle toward the radio
+    uint16_t tx_val;            // Notify handle from the radio
+    uint16_t from_radio;        // Meshtastic FromRadio handle, 0 on NUS radios
+    uint8_t rx_props;           // RX characteristic properties
+    bool meshtastic;            // Meshtastic service: framed TCP stream
+    bool ready;                 // Handles found and notifications enabled
+} ble_conn_snapshot_t;
+
+void ble_proxy_get_snapshot(uint8_t link, ble_conn_snapshot_t *snapshot);
 
 // Handle accessor functions (read-only accessors for tcp_proxy.c)
-uint16_t ble_proxy_get_rx_handle(void);
-uint16_t ble_proxy_get_tx_handle(void);
+uint16_t ble_proxy_get_rx_handle(uint8_t link);
+uint16_t ble_proxy_get_tx_handle(uint8_t link);
 
 // Safe send (chunks to MTU-3, returns ESP_OK/ESP_FAIL)
-esp_err_t ble_proxy_send_data(const uint8_t *data, uint16_t len);
+esp_err_t ble_proxy_send_data(uint8_t link, const uint8_t *data, uint16_t len);
+
+// Link tuning. After connect the proxy asks for 2M PHY and 251 byte LL
+// payloads, then picks connection parameters by profile; in auto mode it
+// switches to bulk while data flows and steps down as the link idles.
+typedef enum {
+    BLE_LINK_AUTO = 0,
+    BLE_LINK_BULK,              // 7.5-15 ms interval, no latency
+    BLE_LINK_INTERACTIVE,       // 30-50 ms, no latency
+    BLE_LINK_LOW_POWER          // 100-200 ms, peripheral may skip 4 events
+} ble_link_profile_t;
+
+typedef struct {
+    ble_link_profile_t profile;     // Requested profile, AUTO if automatic
+    ble_link_profile_t active;      // Parameters last requested
+    uint8_t tx_phy;                 // 1 = 1M, 2 = 2M, 3 = Coded
+    uint8_t rx_phy;
+    uint16_t tx_octets;             // LL payload per PDU
+    uint16_t rx_octets;
+    uint16_t mtu;
+    uint32_t interval_us;
+    uint16_t latency;
+    uint32_t supervision_ms;
+    bool handles_cached;            // GATT handles restored instead of discovered
+    uint32_t discovery_ms;          // Encryption to notifications enabled
+    bool reconnecting;              // Bonded radio dropped, reconnect pending
+    uint8_t reconnect_attempts;     // Attempts since the drop
+    uint32_t reconnect_ms;          // Drop to connected, last reconnect
+    uint32_t oversize_drops;        // FromRadio values too long for a frame, dropped
+} ble_link_info_t;
+
+esp_err_t ble_proxy_set_link_profile(uint8_t link, ble_link_profile_t profile);
+void ble_proxy_get_link_info(uint8_t link, ble_link_info_t *info);
+const char *ble_link_profile_name(ble_link_profile_t profile);
+
+// Called by the TCP task on every pass, busy when data moved since the last call
+void ble_proxy_link_tick(uint8_t link, bool busy);
+
+// Uplink counters
+typedef struct {
+    uint32_t bytes;             // Bytes written to the radio
+    uint32_t bytes_per_sec;     // Over the last second with traffic
+    uint32_t stalls;            // Writes deferred for lack of host buffers
+    uint8_t credits;            // Writes the link takes before the next response
+} ble_tx_stats_t;
+
+// Flow-controlled write toward the radio, chunked to the MTU. Takes what the
+// link has credits for and returns the byte count, 0 when the window is full
+// and -1 when not connected; the TCP proxy is woken once credits come back.
+int ble_proxy_write(uint8_t link, const uint8_t *data, uint16_t len);
+
+// Meshtastic stream framing: 0x94 0xC3, big endian length, then one
+// ToRadio/FromRadio protobuf. Over BLE each protobuf is one attribute value.
+#define MESHTASTIC_START1       0x94
+#define MESHTASTIC_START2       0xC3
+#define MESHTASTIC_HEADER_LEN   4
+#define MESHTASTIC_FRAME_MAX    512
+
+// Write one whole ToRadio protobuf as a single (long if needed) write
+// request. Returns len once issued, 0 while the previous one is unanswered
+// and -1 when not connected.
+int ble_proxy_write_frame(uint8_t link, const uint8_t *data, uint16_t len);
+bool ble_proxy_write_ready(uint8_t link);
+void ble_proxy_get_tx_stats(uint8_t link, ble_tx_stats_t *stats);
 
 // Test function
 void test_meshtastic_communication(void);
 
-// TCP proxy functions (safe to call multiple times)
-void start_tcp_proxy(void);
-void stop_tcp_proxy(void);
-void tcp_forward_ble_data(uint8_t *data, uint16_t len);
+// TCP proxy fan-out counters, per link
+typedef struct {
+    uint16_t port;
+    bool listening;
+    uint8_t clients;
+    uint16_t backlog;           // Notifications queued for the slowest client
+    uint32_t notifications;     // Notifications queued for TCP
+    uint32_t bytes_sent;        // Bytes delivered to clients
+    uint32_t pool_drops;        // Lost because the buffers were exhausted
+    uint32_t client_drops;      // Skipped for clients that fell behind
+    uint32_t slow_closes;       // Clients closed for not reading
+    uint32_t frames_in;         // Meshtastic frames from clients written to the radio
+    uint32_t frames_out;        // FromRadio packets framed for clients
+    uint32_t resync_bytes;      // Client bytes outside a valid frame
+} tcp_proxy_stats_t;
+
+// Meshtastic config cache. The first want_config_id is forwarded and the
+// radio's config and NodeDB replay is captured instead of broadcast; later
+// requests are answered from the capture, which keyed FromRadio packets
+// keep current. Clients replay it through a cursor, then get their own
+// config_complete_id. Each link has its own cache.
+typedef enum {
+    MESH_CONFIG_FORWARD = 0,    // Cache unusable, pass the request to the radio
+    MESH_CONFIG_CAPTURE,        // Forward it and replay the capture it starts
+    MESH_CONFIG_CACHED          // Answer locally
+} mesh_config_action_t;
+
+typedef struct {
+    uint32_t rec;               // Record being sent
+    uint16_t off;               // Bytes of its frame already sent
+} mesh_cache_cursor_t;
+
+typedef struct {
+    bool valid;
+    bool capturing;
+    uint16_t records;
+    uint32_t bytes;
+    uint8_t readers;            // Clients replaying
+    uint32_t hits;              // Requests answered locally
+    uint32_t captures;
+    uint32_t overflow_drops;
+    uint32_t age_s;
+} mesh_cache_stats_t;
+
+esp_err_t mesh_cache_init(void);
+
+// Radio disconnected, rebooted or reconfigured: recapture on the next request
+void mesh_cache_invalidate(uint8_t link);
+
+// Record a FromRadio packet, false if it belongs to a capture and must not be broadcast
+bool mesh_cache_from_radio(uint8_t link, const uint8_t *data, uint16_t len);
+
+// Inspect a client's ToRadio frame, true for want_config_id with its nonce
+bool mesh_cache_check_to_radio(uint8_t link, const uint8_t *data, uint16_t len, uint32_t *config_id);
+
+// Handle a want_config_id, every action but FORWARD registers a reader
+mesh_config_action_t mesh_cache_want_config(uint8_t link);
+void mesh_cache_release(uint8_t link);
+
+// Next framed bytes for a reader, NULL when none are ready; done once the
+// cursor is at the end and no capture is running
+const uint8_t *mesh_cache_peek(uint8_t link, mesh_cache_cursor_t *cur, uint16_t *len, bool *done);
+void mesh_cache_advance(uint8_t link, mesh_cache_cursor_t *cur, uint16_t sent);
+
+// Frame a FromRadio config_complete_id into frame (at least 10 bytes), returns its length
+uint16_t mesh_config_complete_frame(uint32_t config_id, uint8_t *frame);
+void mesh_cache_get_stats(uint8_t link, mesh_cache_stats_t *stats);
+
+// GATT handles of bonded radios, kept in NVS so a reconnect skips service
+// discovery. An entry is used when the peer's Database Hash (0x2B2A) still
+// matches, or for peers without one when the cached CCCD reads back as a
+// CCCD; otherwise full discovery runs and the entry is replaced. Only the
+// NimBLE host task calls these.
+#define GATT_CACHE_SLOTS 4
+#define GATT_DB_HASH_LEN 16
+
+typedef struct {
+    uint8_t addr[6];
+    bool has_db_hash;
+    bool meshtastic;
+    uint8_t db_hash[GATT_DB_HASH_LEN];
+    uint16_t svc_start;
+    uint16_t svc_end;
+    uint16_t tx_val;
+    uint16_t rx_val;
+    uint16_t tx_cccd;
+    uint16_t from_radio;
+    uint8_t tx_props;
+    uint8_t rx_props;
+    uint32_t sequence;          // Store order, 0 marks a free slot
+} gatt_cache_entry_t;
+
+bool gatt_cache_lookup(const uint8_t *addr, gatt_cache_entry_t *entry);
+void gatt_cache_store(const gatt_cache_entry_t *entry);
+void gatt_cache_forget(const uint8_t *addr);
+
+struct os_mbuf;
+
+// TCP proxy functions (safe to call multiple times). Start opens the link's
+// listener, stop closes it and its clients; neither waits on the TCP task.
+void start_tcp_proxy(uint8_t link);
+void stop_tcp_proxy(uint8_t link);
+
+// Queue a notification for every TCP client of the link, called from the
+// NimBLE host task; the data is copied and the call never waits on a socket
+void tcp_forward_ble_data(uint8_t link, const struct os_mbuf *om);
+
+// Same for one FromRadio protobuf, sent to clients with the stream header
+void tcp_forward_from_radio(uint8_t link, const uint8_t *data, uint16_t len);
+void tcp_proxy_get_stats(uint8_t link, tcp_proxy_stats_t *stats);
+
+// Make the TCP task look at its queues again, safe from any task
+void tcp_proxy_wake(void);
 
 #endif // BLE_PROXY_H
\ No newline at end of file
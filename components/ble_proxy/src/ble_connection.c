@@ -1,13 +1,20 @@
 #include "ble_proxy.h"
 #include "esp_log.h"
+#include "host/ble_hs.h"
 #include "host/ble_sm.h"
 #include "host/ble_gap.h"
 #include "host/ble_gatt.h"
 #include "host/ble_store.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include <string.h>
 
 static const char *TAG = "BLE_CONN";
 
+#ifndef MIN
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+
 // EXPLICIT SECURITY MANAGER AVAILABILITY CHECK
 static bool check_security_manager_available(void) {
     static bool checked = false;
@@ -60,27 +67,25 @@ typedef struct {
     uint16_t tx_val;    // TX value handle (device->ESP notify)
     uint16_t rx_val;    // RX value handle (ESP->device write)
     uint16_t tx_cccd;   // CCCD descriptor handle
+    uint16_t from_radio_val;    // Meshtastic FromRadio, read until empty after each fromNum notify
     uint8_t tx_props;   // TX characteristic properties (for indicate vs notify)
+    uint8_t rx_props;   // RX characteristic properties (write requests give flow control)
     bool have_serial_service;   // found target service (NUS or Meshtastic)
+    bool meshtastic;            // Meshtastic service, characteristics picked by UUID
     bool chars_done;            // characteristics discovery finished
     bool dsc_done;              // descriptor discovery finished
     bool encrypted;             // link is encrypted
     bool notify_enabled;        // CCCD write completed successfully
 } uart_ctx_t;
 
-static uart_ctx_t uart = {
-    .conn_handle = BLE_HS_CONN_HANDLE_NONE
-};
-
 // Proxy state management (simplified)
-static volatile proxy_state_t s_state = PROXY_IDLE;
-static volatile conn_state_t conn_state = CONN_STATE_IDLE;
 static uint16_t pending_conn_handle = BLE_HS_CONN_HANDLE_NONE;
 static bool passkey_injected = false;
 
 // Service and characteristic UUIDs
 static ble_uuid128_t UUID_NUS_SVC, UUID_NUS_TX, UUID_NUS_RX;
 static ble_uuid128_t UUID_MESH_SVC; // Meshtastic 6ba1b218-15a8-461f-9fa8-5dcae273eafd
+static ble_uuid128_t UUID_MESH_TORADIO, UUID_MESH_FROMRADIO, UUID_MESH_FROMNUM;
 
 static void init_uuids(void) {
     static bool inited = false;
@@ -90,31 +95,11 @@ static void init_uuids(void) {
     ble_uuid_from_str((ble_uuid_any_t*)&UUID_NUS_TX,   "6e400003-b5a3-f393-e0a9-e50e24dcca9e");
     ble_uuid_from_str((ble_uuid_any_t*)&UUID_NUS_RX,   "6e400002-b5a3-f393-e0a9-e50e24dcca9e");
     ble_uuid_from_str((ble_uuid_any_t*)&UUID_MESH_SVC, "6ba1b218-15a8-461f-9fa8-5dcae273eafd");
+    ble_uuid_from_str((ble_uuid_any_t*)&UUID_MESH_TORADIO,   "f75c76d2-129e-4dad-a1dd-7866124401e7");
+    ble_uuid_from_str((ble_uuid_any_t*)&UUID_MESH_FROMRADIO, "2c55e69e-4993-11ed-b878-0242ac120002");
+    ble_uuid_from_str((ble_uuid_any_t*)&UUID_MESH_FROMNUM,   "ed9da18c-a800-4f66-a670-aa7547e34453");
 }
 
-// State accessor functions
-proxy_state_t ble_proxy_get_state(void) {
-    return s_state;
-}
-
-bool ble_proxy_gatt_ready(void) {
-    return uart.chars_done && uart.tx_val && uart.rx_val && uart.notify_enabled;
-}
-
-uint16_t ble_proxy_get_rx_handle(void) {
-    return uart.rx_val;
-}
-
-uint16_t ble_proxy_get_tx_handle(void) {
-    return uart.tx_val;
-}
-
-// Connection state
-static ble_connection_t current_conn = {
-    .conn_handle = BLE_HS_CONN_HANDLE_NONE,
-    .state = BLE_STATE_IDLE
-};
-
 // Callbacks
 static ble_connect_cb_t connect_callback = NULL;
 static ble_disconnect_cb_t disconnect_callback = NULL;
@@ -129,6 +114,194 @@ static ble_data_received_cb_t data_callback = NULL;
 // Connection callback
 static int ble_proxy_gap_connect_event(struct ble_gap_event *event, void *arg);
 
+// TCP to BLE writer. Write commands go out while credits last. When the RX
+// characteristic also takes write requests, the last credit of a window is
+// spent on one: its response means the peer has processed every write
+// before it, so the window refills once per round trip and throughput
+// follows the connection interval instead of a fixed delay.
+#define BLE_TX_WINDOW 8
+#define BLE_TX_RATE_WINDOW_US 1000000
+
+typedef struct {
+    uint8_t credits;
+    uint32_t bytes;
+    uint32_t stalls;
+    uint32_t rate_bytes;
+    int64_t rate_start_us;
+    uint32_t bytes_per_sec;
+} ble_tx_state_t;
+
+// Connection parameter profiles, intervals in 1.25 ms units, timeout in 10 ms
+#define LINK_IDLE_US (10 * 1000000LL)       // Idle this long before leaving bulk
+#define LINK_SLEEP_US (120 * 1000000LL)     // And this long before low power
+#define LINK_DLE_OCTETS 251
+#define LINK_DLE_TIME_US 2120
+#define LINK_RETRY_US (2 * 1000000LL)       // Wait after a failed request, doubles each time
+#define LINK_RETRY_MAX 4                    // Failures in a row before the peer is taken to refuse
+
+// Reconnect to a bonded radio that dropped. Each attempt is a directed
+// connection with the initiator scanning continuously, so the radio's first
+// advertisement after a reboot is answered; the gap between attempts
+// doubles up to the cap to leave the air to WiFi, and the link is given up
+// after a while.
+#define RECONNECT_ATTEMPT_MS 3000
+#define RECONNECT_FIRST_GAP_MS 100
+#define RECONNECT_MAX_GAP_MS 15000
+#define RECONNECT_BUSY_MS 250               // Another link is connecting
+#define RECONNECT_GIVE_UP_US (10 * 60 * 1000000LL)
+
+static const struct {
+    const char *name;
+    struct ble_gap_upd_params params;
+} link_profiles[] = {
+    [BLE_LINK_AUTO]        = { "auto",        { 0 } },
+    [BLE_LINK_BULK]        = { "bulk",        { .itvl_min = 6,  .itvl_max = 12,  .latency = 0, .supervision_timeout = 400 } },
+    [BLE_LINK_INTERACTIVE] = { "interactive", { .itvl_min = 24, .itvl_max = 40,  .latency = 0, .supervision_timeout = 400 } },
+    [BLE_LINK_LOW_POWER]   = { "low_power",   { .itvl_min = 80, .itvl_max = 160, .latency = 4, .supervision_timeout = 600 } },
+};
+
+// Everything that belongs to one radio. The slot index is the link number
+// the TCP proxy and web status use; the host task owns all of it except
+// the snapshot and tx counters, which other tasks read under the locks.
+typedef struct {
+    ble_connection_t conn;
+    uart_ctx_t uart;
+    ble_conn_snapshot_t snapshot;   // Published copy of the fields other tasks read
+    volatile proxy_state_t state;
+    volatile conn_state_t conn_state;
+    ble_tx_state_t tx;
+    esp_timer_handle_t tx_retry_timer;
+    ble_link_info_t info;
+    int64_t busy_us;
+
+    // Automatic profile changes back off after a failed request, and stop
+    // once the peer has refused the same profile LINK_RETRY_MAX times
+    bool profile_pending;           // Update requested, CONN_UPDATE not seen yet
+    ble_link_profile_t profile_prev; // In effect before the pending request
+    ble_link_profile_t failed_profile;
+    uint8_t profile_fails;
+    int64_t profile_retry_us;
+
+    // Meshtastic FromRadio queue. A fromNum notify means packets are waiting;
+    // FromRadio is read until the radio returns an empty value, each packet
+    // going to TCP as one frame.
+    uint8_t from_radio_buf[MESHTASTIC_FRAME_MAX];
+    uint16_t from_radio_len;
+    bool from_radio_oversize;   // Value ran past the buffer, dropped once read
+    bool from_radio_draining;
+    bool from_radio_again;      // Notified during a drain
+
+    // Handle cache: the peer's Database Hash read this connection, and the
+    // stored entry while it is being checked
+    uint8_t db_hash[GATT_DB_HASH_LEN];
+    bool has_db_hash;
+    gatt_cache_entry_t cached;
+    int64_t discovery_start_us;
+
+    // Auto reconnect, info.reconnecting from the drop until the link is ready
+    esp_timer_handle_t reconnect_timer;
+    uint8_t peer_addr_type;
+    int64_t dropped_us;
+} proxy_link_t;
+
+static proxy_link_t links[BLE_PROXY_MAX_LINKS] = {
+    [0 ... BLE_PROXY_MAX_LINKS - 1] = {
+        .conn = { .conn_handle = BLE_HS_CONN_HANDLE_NONE, .state = BLE_STATE_IDLE },
+        .uart = { .conn_handle = BLE_HS_CONN_HANDLE_NONE },
+        .snapshot = { .conn_handle = BLE_HS_CONN_HANDLE_NONE, .mtu = 23 },
+        .tx = { .credits = BLE_TX_WINDOW },
+        .info = {
+            .profile = BLE_LINK_AUTO,
+            .active = BLE_LINK_INTERACTIVE,
+            .tx_phy = 1,
+            .rx_phy = 1,
+            .tx_octets = 27,
+            .rx_octets = 27,
+            .mtu = 23
+        }
+    }
+};
+static portMUX_TYPE snapshot_lock = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE tx_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static proxy_link_t *get_link(uint8_t link) {
+    return link < BLE_PROXY_MAX_LINKS ? &links[link] : NULL;
+}
+
+static uint8_t link_index(const proxy_link_t *l) {
+    return l - links;
+}
+
+static proxy_link_t *link_by_handle(uint16_t conn_handle) {
+    for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+        if (links[i].conn.state != BLE_STATE_IDLE && links[i].conn.conn_handle == conn_handle) {
+            return &links[i];
+        }
+    }
+    return NULL;
+}
+
+// State accessor functions
+proxy_state_t ble_proxy_get_state(uint8_t link) {
+    proxy_link_t *l = get_link(link);
+    return l ? l->state : PROXY_IDLE;
+}
+
+void ble_proxy_get_snapshot(uint8_t link, ble_conn_snapshot_t *out) {
+    proxy_link_t *l = get_link(link);
+    if (!l) {
+        *out = (ble_conn_snapshot_t){ .conn_handle = BLE_HS_CONN_HANDLE_NONE, .mtu = 23 };
+        return;
+    }
+    taskENTER_CRITICAL(&snapshot_lock);
+    *out = l->snapshot;
+    taskEXIT_CRITICAL(&snapshot_lock);
+}
+
+bool ble_proxy_gatt_ready(uint8_t link) {
+    ble_conn_snapshot_t snap;
+    ble_proxy_get_snapshot(link, &snap);
+    return snap.ready;
+}
+
+uint16_t ble_proxy_get_rx_handle(uint8_t link) {
+    ble_conn_snapshot_t snap;
+    ble_proxy_get_snapshot(link, &snap);
+    return snap.rx_val;
+}
+
+uint16_t ble_proxy_get_tx_handle(uint8_t link) {
+    ble_conn_snapshot_t snap;
+    ble_proxy_get_snapshot(link, &snap);
+    return snap.tx_val;
+}
+
+// Rebuild the snapshot from the host task's state
+static void publish_snapshot(proxy_link_t *l) {
+    bool up = l->conn.state == BLE_STATE_CONNECTED;
+    ble_conn_snapshot_t next = {
+        .conn_handle = up ? l->uart.conn_handle : BLE_HS_CONN_HANDLE_NONE,
+        .mtu = up ? l->info.mtu : 23,
+        .rx_val = up ? l->uart.rx_val : 0,
+        .tx_val = up ? l->uart.tx_val : 0,
+        .from_radio = up ? l->uart.from_radio_val : 0,
+        .rx_props = up ? l->uart.rx_props : 0,
+        .meshtastic = up && l->uart.meshtastic,
+        .ready = up && l->uart.chars_done && l->uart.tx_val && l->uart.rx_val && l->uart.notify_enabled &&
+                 (!l->uart.meshtastic || l->uart.from_radio_val)
+    };
+
+    taskENTER_CRITICAL(&snapshot_lock);
+    l->snapshot = next;
+    taskEXIT_CRITICAL(&snapshot_lock);
+}
+
+static void reset_tx_window(proxy_link_t *l) {
+    taskENTER_CRITICAL(&tx_lock);
+    l->tx = (ble_tx_state_t){ .credits = BLE_TX_WINDOW };
+    taskEXIT_CRITICAL(&tx_lock);
+}
+
 
 
 
@@ -148,22 +321,170 @@ static int on_disc_svc(uint16_t conn_handle, const struct ble_gatt_error *error,
 static int on_disc_chr(uint16_t conn_handle, const struct ble_gatt_error *error, const struct ble_gatt_chr *chr, void *arg);
 static int on_disc_dsc(uint16_t ch, const struct ble_gatt_error *err, uint16_t chr_def_handle, const struct ble_gatt_dsc *dsc, void *arg);
 static int on_cccd_written(uint16_t ch, const struct ble_gatt_error *err, struct ble_gatt_attr *attr, void *arg);
+static int write_cccd(proxy_link_t *l);
 
 
 // Forward declarations for new discovery callbacks
 static int on_disc_svc(uint16_t conn_handle, const struct ble_gatt_error *error, const struct ble_gatt_svc *service, void *arg);
 static int on_disc_chr(uint16_t conn_handle, const struct ble_gatt_error *error, const struct ble_gatt_chr *chr, void *arg);
 
+// Back off before asking for profile again, give up after LINK_RETRY_MAX in a row
+static void note_profile_failure(proxy_link_t *l, ble_link_profile_t profile) {
+    if (l->failed_profile != profile) {
+        l->failed_profile = profile;
+        l->profile_fails = 0;
+    }
+    if (l->profile_fails < UINT8_MAX) {
+        l->profile_fails++;
+    }
+    int shift = l->profile_fails - 1 < 4 ? l->profile_fails - 1 : 4;
+    l->profile_retry_us = esp_timer_get_time() + (LINK_RETRY_US << shift);
+    if (l->profile_fails == LINK_RETRY_MAX) {
+        ESP_LOGW(TAG, "Link %d: peer refused profile %s %d times, not asking again",
+                 link_index(l), link_profiles[profile].name, LINK_RETRY_MAX);
+    }
+}
+
+// Directed connection to the link's peer
+static int gap_connect(proxy_link_t *l, uint8_t addr_type, int32_t duration_ms) {
+    ble_addr_t peer_addr = { .type = addr_type };
+    memcpy(peer_addr.val, l->conn.peer_addr, 6);
+
+    // Connection parameters optimized for Meshtastic per NimBLE docs.
+    // Auto mode connects in bulk, the radio dumps its config and node DB first.
+    ble_link_profile_t start = l->info.profile == BLE_LINK_AUTO ? BLE_LINK_BULK : l->info.profile;
+    struct ble_gap_conn_params conn_params = {
+        .scan_itvl = 0x0010,      // 16 * 0.625ms = 10ms
+        .scan_window = 0x0010,    // 16 * 0.625ms = 10ms
+        .itvl_min = link_profiles[start].params.itvl_min,
+        .itvl_max = link_profiles[start].params.itvl_max,
+        .latency = link_profiles[start].params.latency,
+        .supervision_timeout = link_profiles[start].params.supervision_timeout,
+        .min_ce_len = 0,
+        .max_ce_len = 0
+    };
+    l->info.active = start;
+    l->busy_us = esp_timer_get_time();
+    l->profile_pending = false;
+    l->failed_profile = BLE_LINK_AUTO;
+    l->profile_fails = 0;
+
+    int rc = ble_gap_connect(BLE_OWN_ADDR_PUBLIC, &peer_addr, duration_ms, &conn_params,
+                             ble_proxy_gap_connect_event, l);
+    if (rc == 0) {
+        l->peer_addr_type = addr_type;
+    }
+    return rc;
+}
+
+static void reconnect_cb(void *arg);
+
+// Stop trying, the link's TCP clients go with it
+static void end_reconnect(proxy_link_t *l) {
+    if (l->reconnect_timer) {
+        esp_timer_stop(l->reconnect_timer);
+    }
+    if (l->info.reconnecting) {
+        l->info.reconnecting = false;
+        stop_tcp_proxy(link_index(l));
+    }
+}
+
+static void schedule_reconnect(proxy_link_t *l, uint32_t delay_ms) {
+    if (!l->reconnect_timer) {
+        const esp_timer_create_args_t args = { .callback = reconnect_cb, .arg = l, .name = "ble_reconnect" };
+        if (esp_timer_create(&args, &l->reconnect_timer) != ESP_OK) {
+            end_reconnect(l);
+            return;
+        }
+    }
+    esp_timer_stop(l->reconnect_timer);
+    esp_timer_start_once(l->reconnect_timer, (uint64_t)delay_ms * 1000);
+}
+
+// Gap before the next attempt, doubling per attempt made
+static uint32_t reconnect_gap_ms(const proxy_link_t *l) {
+    uint8_t n = l->info.reconnect_attempts ? l->info.reconnect_attempts - 1 : 0;
+    return MIN((uint32_t)RECONNECT_FIRST_GAP_MS << MIN(n, 8), RECONNECT_MAX_GAP_MS);
+}
+
+// Runs on the timer task, the host calls are thread safe as for web connects
+static void reconnect_cb(void *arg) {
+    proxy_link_t *l = arg;
+    if (!l->info.reconnecting || l->conn.state != BLE_STATE_IDLE) {
+        return;
+    }
+
+    if (esp_timer_get_time() - l->dropped_us > RECONNECT_GIVE_UP_US) {
+        ESP_LOGW(TAG, "Link %d: radio not back after %u attempts, giving up",
+                 link_index(l), l->info.reconnect_attempts);
+        end_reconnect(l);
+        return;
+    }
+
+    // The host runs one connection attempt at a time
+    for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+        if (links[i].conn.state == BLE_STATE_CONNECTING) {
+            schedule_reconnect(l, RECONNECT_BUSY_MS);
+            return;
+        }
+    }
+
+    if (l->info.reconnect_attempts < UINT8_MAX) {
+        l->info.reconnect_attempts++;
+    }
+    l->conn.state = BLE_STATE_CONNECTING;
+    l->state = PROXY_CONNECTING;
+    ESP_LOGI(TAG, "Link %d reconnect attempt %u", link_index(l), l->info.reconnect_attempts);
+
+    int rc = gap_connect(l, l->peer_addr_type, RECONNECT_ATTEMPT_MS);
+    if (rc != 0) {
+        // A scan or a web connect has the host
+        ESP_LOGW(TAG, "Link %d reconnect not started: %d", link_index(l), rc);
+        l->conn.state = BLE_STATE_IDLE;
+        l->state = PROXY_IDLE;
+        schedule_reconnect(l, reconnect_gap_ms(l));
+    }
+}
+
 // Connect to a BLE device
 esp_err_t ble_proxy_connect(const uint8_t *addr) {
     init_uuids();
 
-    if (current_conn.state != BLE_STATE_IDLE) {
-        ESP_LOGW(TAG, "Already connected or connecting");
-        return ESP_ERR_INVALID_STATE;
+    // The host runs one connection attempt at a time
+    proxy_link_t *l = NULL;
+    proxy_link_t *waiting = NULL;
+    for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+        if (links[i].conn.state == BLE_STATE_CONNECTING) {
+            ESP_LOGW(TAG, "Connection attempt already in progress");
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (links[i].conn.state != BLE_STATE_IDLE && memcmp(links[i].conn.peer_addr, addr, 6) == 0) {
+            ESP_LOGW(TAG, "Already connected to this device (link %d)", i);
+            return ESP_ERR_INVALID_STATE;
+        }
+        // A link waiting to reconnect stays with its radio
+        if (links[i].info.reconnecting) {
+            if (memcmp(links[i].conn.peer_addr, addr, 6) == 0) {
+                waiting = &links[i];
+            }
+            continue;
+        }
+        if (!l && links[i].conn.state == BLE_STATE_IDLE) {
+            l = &links[i];
+        }
+    }
+    if (waiting) {
+        // Try now instead of at the next backoff step
+        esp_timer_stop(waiting->reconnect_timer);
+        l = waiting;
+    }
+    if (!l) {
+        ESP_LOGW(TAG, "All %d links in use", BLE_PROXY_MAX_LINKS);
+        return ESP_ERR_NO_MEM;
     }
 
-    ESP_LOGI(TAG, "Connecting to %02X:%02X:%02X:%02X:%02X:%02X",
+    ESP_LOGI(TAG, "Connecting link %d to %02X:%02X:%02X:%02X:%02X:%02X", link_index(l),
              addr[5], addr[4], addr[3], addr[2], addr[1], addr[0]);
 
     // CRITICAL: Cancel any ongoing discovery first
@@ -174,43 +495,27 @@ esp_err_t ble_proxy_connect(const uint8_t *addr) {
 
     vTaskDelay(pdMS_TO_TICKS(100));
 
-    // Set up peer address
-    ble_addr_t peer_addr;
-    memcpy(peer_addr.val, addr, 6);
-    peer_addr.type = BLE_ADDR_RANDOM;  // Most Meshtastic devices use RANDOM
+    l->conn.state = BLE_STATE_CONNECTING;
+    l->state = PROXY_CONNECTING;
+    l->uart = (uart_ctx_t){.conn_handle = BLE_HS_CONN_HANDLE_NONE};
+    memcpy(l->conn.peer_addr, addr, 6);
 
-    current_conn.state = BLE_STATE_CONNECTING;
-    s_state = PROXY_CONNECTING;
-    uart = (uart_ctx_t){.conn_handle = BLE_HS_CONN_HANDLE_NONE};
-    memcpy(current_conn.peer_addr, addr, 6);
-
-    // Connection parameters optimized for Meshtastic per NimBLE docs
-    struct ble_gap_conn_params conn_params = {
-        .scan_itvl = 0x0010,      // 16 * 0.625ms = 10ms
-        .scan_window = 0x0010,    // 16 * 0.625ms = 10ms
-        .itvl_min = 24,           // 24 * 1.25ms = 30ms (iOS compatible)
-        .itvl_max = 40,           // 40 * 1.25ms = 50ms
-        .latency = 0,             // No latency for responsiveness
-        .supervision_timeout = 400, // 400 * 10ms = 4 seconds
-        .min_ce_len = 0,
-        .max_ce_len = 0
-    };
-
-    rc = ble_gap_connect(BLE_OWN_ADDR_PUBLIC, &peer_addr, 30000, &conn_params,
-                        ble_proxy_gap_connect_event, NULL);
+    // Most Meshtastic devices use RANDOM
+    rc = gap_connect(l, BLE_ADDR_RANDOM, 30000);
 
     if (rc == BLE_HS_EINVAL) {
         // Try public address as fallback
         ESP_LOGW(TAG, "Random address failed, trying public...");
-        peer_addr.type = BLE_ADDR_PUBLIC;
-        rc = ble_gap_connect(BLE_OWN_ADDR_PUBLIC, &peer_addr, 30000, &conn_params,
-                            ble_proxy_gap_connect_event, NULL);
+        rc = gap_connect(l, BLE_ADDR_PUBLIC, 30000);
     }
 
     if (rc != 0) {
         ESP_LOGE(TAG, "Connection failed: %d", rc);
-        current_conn.state = BLE_STATE_IDLE;
-        s_state = PROXY_IDLE;
+        l->conn.state = BLE_STATE_IDLE;
+        l->state = PROXY_IDLE;
+        if (l->info.reconnecting) {
+            schedule_reconnect(l, reconnect_gap_ms(l));
+        }
         return ESP_FAIL;
     }
 
@@ -218,17 +523,32 @@ esp_err_t ble_proxy_connect(const uint8_t *addr) {
 }
 
 // Disconnect
-esp_err_t ble_proxy_disconnect(uint16_t conn_handle) {
-    if (conn_handle == BLE_HS_CONN_HANDLE_NONE) {
-        conn_handle = current_conn.conn_handle;
+esp_err_t ble_proxy_disconnect_link(uint8_t link) {
+    proxy_link_t *l = get_link(link);
+    if (!l) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    if (conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+    // Disconnecting a radio that dropped means not waiting for it any more
+    bool was_reconnecting = l->info.reconnecting;
+    end_reconnect(l);
+    if (was_reconnecting && l->conn.state == BLE_STATE_IDLE) {
+        return ESP_OK;
+    }
+
+    if (l->conn.state == BLE_STATE_CONNECTING) {
+        // Not connected yet, stop the attempt instead
+        int rc = ble_gap_conn_cancel();
+        return rc == 0 || rc == BLE_HS_EALREADY ? ESP_OK : ESP_FAIL;
+    }
+
+    uint16_t conn_handle = l->conn.conn_handle;
+    if (l->conn.state == BLE_STATE_IDLE || conn_handle == BLE_HS_CONN_HANDLE_NONE) {
         return ESP_ERR_INVALID_STATE;
     }
 
-    ESP_LOGI(TAG, "Disconnecting handle %d", conn_handle);
-    current_conn.state = BLE_STATE_DISCONNECTING;
+    ESP_LOGI(TAG, "Disconnecting link %u, handle %d", link, conn_handle);
+    l->conn.state = BLE_STATE_DISCONNECTING;
 
     int rc = ble_gap_terminate(conn_handle, BLE_ERR_REM_USER_CONN_TERM);
     if (rc != 0 && rc != BLE_HS_EALREADY) {
@@ -239,23 +559,42 @@ esp_err_t ble_proxy_disconnect(uint16_t conn_handle) {
     return ESP_OK;
 }
 
+esp_err_t ble_proxy_disconnect(uint16_t conn_handle) {
+    if (conn_handle != BLE_HS_CONN_HANDLE_NONE) {
+        proxy_link_t *l = link_by_handle(conn_handle);
+        return l ? ble_proxy_disconnect_link(link_index(l)) : ESP_ERR_NOT_FOUND;
+    }
+
+    // No handle means every link
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+    for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+        if ((links[i].conn.state != BLE_STATE_IDLE || links[i].info.reconnecting) &&
+            ble_proxy_disconnect_link(i) == ESP_OK) {
+            ret = ESP_OK;
+        }
+    }
+    return ret;
+}
+
 // Service discovery callback - only pick target service & start char discovery
 static int on_disc_svc(uint16_t ch, const struct ble_gatt_error *err, const struct ble_gatt_svc *svc, void *arg)
 {
+    proxy_link_t *l = arg;
     if (err->status == 0 && svc) {
         // Is this NUS or Meshtastic?
         bool is_nus  = (ble_uuid_cmp(&svc->uuid.u, &UUID_NUS_SVC.u)  == 0);
         bool is_mesh = (ble_uuid_cmp(&svc->uuid.u, &UUID_MESH_SVC.u) == 0);
 
         if (is_nus || is_mesh) {
-            uart.have_serial_service = true;
-            uart.svc_start = svc->start_handle;
-            uart.svc_end   = svc->end_handle ? svc->end_handle : (svc->start_handle + 20); // guard
+            l->uart.have_serial_service = true;
+            l->uart.meshtastic = is_mesh;
+            l->uart.svc_start = svc->start_handle;
+            l->uart.svc_end   = svc->end_handle ? svc->end_handle : (svc->start_handle + 20); // guard
             ESP_LOGI(TAG, "Target service found (%s): handles %u-%u",
-                     is_nus ? "NUS" : "Meshtastic", uart.svc_start, uart.svc_end);
+                     is_nus ? "NUS" : "Meshtastic", l->uart.svc_start, l->uart.svc_end);
 
             // Kick char discovery for this service range
-            ble_gattc_disc_all_chrs(ch, uart.svc_start, uart.svc_end, on_disc_chr, NULL);
+            ble_gattc_disc_all_chrs(ch, l->uart.svc_start, l->uart.svc_end, on_disc_chr, l);
             return 0; // keep pumping; NimBLE will call EDONE when done
         }
 
@@ -276,31 +615,51 @@ static int on_disc_svc(uint16_t ch, const struct ble_gatt_error *err, const stru
 // Characteristic discovery callback - decide here by properties
 static int on_disc_chr(uint16_t ch, const struct ble_gatt_error *err, const struct ble_gatt_chr *chr, void *arg)
 {
+    proxy_link_t *l = arg;
+    if (err->status == 0 && chr && l->uart.meshtastic) {
+        // fromNum is writable and notifies too, so go by UUID here
+        if (ble_uuid_cmp(&chr->uuid.u, &UUID_MESH_TORADIO.u) == 0) {
+            l->uart.rx_val = chr->val_handle;
+            l->uart.rx_props = chr->properties;
+            ESP_LOGI(TAG, "ToRadio   val_handle = %u", chr->val_handle);
+        } else if (ble_uuid_cmp(&chr->uuid.u, &UUID_MESH_FROMNUM.u) == 0) {
+            l->uart.tx_val = chr->val_handle;
+            l->uart.tx_props = chr->properties;
+            ESP_LOGI(TAG, "fromNum   val_handle = %u", chr->val_handle);
+        } else if (ble_uuid_cmp(&chr->uuid.u, &UUID_MESH_FROMRADIO.u) == 0) {
+            l->uart.from_radio_val = chr->val_handle;
+            ESP_LOGI(TAG, "FromRadio val_handle = %u", chr->val_handle);
+        }
+        return 0;
+    }
+
     if (err->status == 0 && chr) {
         // TX = NOTIFY/INDICATE (device->ESP), RX = WRITE or WRITE_NO_RSP (ESP->device)
         if (chr->properties & (BLE_GATT_CHR_PROP_NOTIFY | BLE_GATT_CHR_PROP_INDICATE)) {
-            uart.tx_val = chr->val_handle;
-            uart.tx_props = chr->properties;  // store properties
+            l->uart.tx_val = chr->val_handle;
+            l->uart.tx_props = chr->properties;  // store properties
             const char* type = (chr->properties & BLE_GATT_CHR_PROP_NOTIFY) ? "notify" : "indicate";
             ESP_LOGI(TAG, "TX (%s) val_handle = %u (def=%u)", type, chr->val_handle, chr->def_handle);
         }
 
         if (chr->properties & (BLE_GATT_CHR_PROP_WRITE | BLE_GATT_CHR_PROP_WRITE_NO_RSP)) {
-            uart.rx_val = chr->val_handle;
-            ESP_LOGI(TAG, "RX (write)  val_handle = %u", uart.rx_val);
+            l->uart.rx_val = chr->val_handle;
+            l->uart.rx_props = chr->properties;
+            ESP_LOGI(TAG, "RX (write)  val_handle = %u", l->uart.rx_val);
         }
 
         return 0;
     }
 
     if (err->status == BLE_HS_EDONE) {
-        uart.chars_done = true;
+        l->uart.chars_done = true;
+        publish_snapshot(l);
         ESP_LOGI(TAG, "Characteristic discovery complete");
 
         // Now discover descriptors for TX characteristic if we found one
-        if (uart.tx_val) {
+        if (l->uart.tx_val) {
             ESP_LOGI(TAG, "Discovering descriptors for TX characteristic...");
-            ble_gattc_disc_all_dscs(ch, uart.tx_val, uart.svc_end, on_disc_dsc, NULL);
+            ble_gattc_disc_all_dscs(ch, l->uart.tx_val, l->uart.svc_end, on_disc_dsc, l);
         } else {
             ESP_LOGW(TAG, "No TX characteristic found");
         }
@@ -315,49 +674,277 @@ static int on_disc_chr(uint16_t ch, const struct ble_gatt_error *err, const stru
 static int on_disc_dsc(uint16_t ch, const struct ble_gatt_error *err,
                        uint16_t chr_val_handle, const struct ble_gatt_dsc *dsc, void *arg)
 {
+    proxy_link_t *l = arg;
     if (err->status == 0 && dsc) {
-        if (ble_uuid_u16(&dsc->uuid.u) == 0x2902) {
-            uart.tx_cccd = dsc->handle;
+        // The first CCCD after the TX value belongs to it, later ones to other characteristics
+        if (ble_uuid_u16(&dsc->uuid.u) == 0x2902 && !l->uart.tx_cccd) {
+            l->uart.tx_cccd = dsc->handle;
             ESP_LOGI(TAG, "Found CCCD at handle %u", dsc->handle);
         }
         return 0;
     }
 
     if (err->status == BLE_HS_EDONE) {
-        uart.dsc_done = true;
+        l->uart.dsc_done = true;
         ESP_LOGI(TAG, "Descriptor discovery complete");
 
-        if (!uart.tx_cccd) {
+        if (!l->uart.tx_cccd) {
             ESP_LOGW(TAG, "No CCCD found");
             return 0;
         }
 
         // Don't check encryption - just try to write
         // The stack will handle pairing if needed
-        ESP_LOGI(TAG, "Writing CCCD...");
-        uint8_t cccd_val[2] = {0x01, 0x00};
-        return ble_gattc_write_flat(ch, uart.tx_cccd, cccd_val,
-                                    sizeof(cccd_val), on_cccd_written, NULL);
+        return write_cccd(l);
     }
 
     ESP_LOGE(TAG, "Descriptor discovery error: %d", err->status);
     return 0;
 }
 
+static int write_cccd(proxy_link_t *l) {
+    ESP_LOGI(TAG, "Writing CCCD...");
+    uint8_t cccd_val[2] = {0x01, 0x00};
+    return ble_gattc_write_flat(l->uart.conn_handle, l->uart.tx_cccd, cccd_val,
+                                sizeof(cccd_val), on_cccd_written, l);
+}
+
+// Full service, characteristic and descriptor discovery
+static void start_discovery(proxy_link_t *l) {
+    uint16_t conn_handle = l->uart.conn_handle;
+    l->uart = (uart_ctx_t){ .conn_handle = conn_handle, .encrypted = true };
+    l->info.handles_cached = false;
+    ESP_LOGI(TAG, "🔍 Starting service discovery...");
+    int rc = ble_gattc_disc_all_svcs(conn_handle, on_disc_svc, l);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Service discovery failed to start: %d", rc);
+    }
+}
+
+// Take the handles from the checked cache entry and go straight to the CCCD
+static void restore_handles(proxy_link_t *l) {
+    const gatt_cache_entry_t *e = &l->cached;
+    l->uart.have_serial_service = true;
+    l->uart.meshtastic = e->meshtastic;
+    l->uart.svc_start = e->svc_start;
+    l->uart.svc_end = e->svc_end;
+    l->uart.tx_val = e->tx_val;
+    l->uart.rx_val = e->rx_val;
+    l->uart.tx_cccd = e->tx_cccd;
+    l->uart.from_radio_val = e->from_radio;
+    l->uart.tx_props = e->tx_props;
+    l->uart.rx_props = e->rx_props;
+    l->uart.chars_done = l->uart.dsc_done = true;
+    l->info.handles_cached = true;
+    publish_snapshot(l);
+
+    ESP_LOGI(TAG, "Link %d using cached handles (TX=%u RX=%u CCCD=%u), discovery skipped",
+             link_index(l), e->tx_val, e->rx_val, e->tx_cccd);
+    if (write_cccd(l) != 0) {
+        gatt_cache_forget(l->conn.peer_addr);
+        start_discovery(l);
+    }
+}
+
+// The peer itself answered, as opposed to a disconnect or timeout, so a
+// failed check says something about the cached handles
+static bool att_answered(int status) {
+    return status == 0 || (status >= BLE_HS_ERR_ATT_BASE && status < BLE_HS_ERR_HCI_BASE);
+}
+
+// Remember what discovery found, bonded peers only
+static void save_handles(proxy_link_t *l) {
+    struct ble_gap_conn_desc desc;
+    if (ble_gap_conn_find(l->uart.conn_handle, &desc) != 0 || !desc.sec_state.bonded) {
+        return;
+    }
+
+    gatt_cache_entry_t e = {
+        .has_db_hash = l->has_db_hash,
+        .meshtastic = l->uart.meshtastic,
+        .svc_start = l->uart.svc_start,
+        .svc_end = l->uart.svc_end,
+        .tx_val = l->uart.tx_val,
+        .rx_val = l->uart.rx_val,
+        .tx_cccd = l->uart.tx_cccd,
+        .from_radio = l->uart.from_radio_val,
+        .tx_props = l->uart.tx_props,
+        .rx_props = l->uart.rx_props
+    };
+    memcpy(e.addr, l->conn.peer_addr, sizeof(e.addr));
+    memcpy(e.db_hash, l->db_hash, sizeof(e.db_hash));
+    gatt_cache_store(&e);
+}
+
+// Without a Database Hash the cached CCCD has to read back as one
+static int on_cccd_check(uint16_t ch, const struct ble_gatt_error *err,
+                         struct ble_gatt_attr *attr, void *arg) {
+    proxy_link_t *l = arg;
+    uint8_t val[2];
+    if (l->conn.state != BLE_STATE_CONNECTED) {
+        return 0;
+    }
+    if (err->status == 0 && attr && OS_MBUF_PKTLEN(attr->om) == sizeof(val) &&
+        os_mbuf_copydata(attr->om, 0, sizeof(val), val) == 0 && val[0] <= 3 && val[1] == 0) {
+        restore_handles(l);
+        return 0;
+    }
+
+    ESP_LOGI(TAG, "Cached handles failed the check (%d), rediscovering", err->status);
+    if (att_answered(err->status)) {
+        gatt_cache_forget(l->conn.peer_addr);
+    }
+    start_discovery(l);
+    return 0;
+}
+
+// Database Hash read, then cached handles or full discovery
+static int on_db_hash(uint16_t ch, const struct ble_gatt_error *err,
+                      struct ble_gatt_attr *attr, void *arg) {
+    proxy_link_t *l = arg;
+    if (err->status == 0 && attr) {
+        if (OS_MBUF_PKTLEN(attr->om) == sizeof(l->db_hash)) {
+            os_mbuf_copydata(attr->om, 0, sizeof(l->db_hash), l->db_hash);
+            l->has_db_hash = true;
+        }
+        return 0;
+    }
+
+    // Done, or an ATT error from a peer without the characteristic
+    if (l->conn.state != BLE_STATE_CONNECTED) {
+        return 0;
+    }
+    if (err->status != BLE_HS_EDONE && !att_answered(err->status)) {
+        start_discovery(l);
+    } else if (!gatt_cache_lookup(l->conn.peer_addr, &l->cached)) {
+        start_discovery(l);
+    } else if (l->cached.has_db_hash || l->has_db_hash) {
+        if (l->cached.has_db_hash && l->has_db_hash &&
+            memcmp(l->cached.db_hash, l->db_hash, sizeof(l->db_hash)) == 0) {
+            restore_handles(l);
+        } else {
+            ESP_LOGI(TAG, "Database hash changed, rediscovering");
+            gatt_cache_forget(l->conn.peer_addr);
+            start_discovery(l);
+        }
+    } else if (ble_gattc_read(ch, l->cached.tx_cccd, on_cccd_check, l) != 0) {
+        start_discovery(l);
+    }
+    return 0;
+}
+
+// After encryption: try the handle cache before discovering
+static void start_gatt(proxy_link_t *l) {
+    l->has_db_hash = false;
+    l->discovery_start_us = esp_timer_get_time();
+    int rc = ble_gattc_read_by_uuid(l->uart.conn_handle, 1, 0xFFFF, BLE_UUID16_DECLARE(0x2B2A), on_db_hash, l);
+    if (rc != 0) {
+        start_discovery(l);
+    }
+}
+
+// FromRadio drain, everything here runs on the host task
+static void read_from_radio(proxy_link_t *l);
+
+static int on_from_radio_read(uint16_t ch, const struct ble_gatt_error *err,
+                              struct ble_gatt_attr *attr, void *arg) {
+    proxy_link_t *l = arg;
+    if (err->status == 0 && attr) {
+        // Values longer than the MTU arrive in pieces
+        uint16_t len = OS_MBUF_PKTLEN(attr->om);
+        if (attr->offset + len <= sizeof(l->from_radio_buf)) {
+            os_mbuf_copydata(attr->om, 0, len, l->from_radio_buf + attr->offset);
+            l->from_radio_len = attr->offset + len;
+        } else {
+            l->from_radio_oversize = true;
+        }
+        return 0;
+    }
+
+    if (err->status != BLE_HS_EDONE) {
+        ESP_LOGW(TAG, "FromRadio read failed: %d", err->status);
+        l->from_radio_draining = false;
+        return 0;
+    }
+
+    if (l->from_radio_oversize) {
+        // Clients would get a truncated protobuf, skip it and read on
+        l->info.oversize_drops++;
+        ESP_LOGW(TAG, "FromRadio value on link %d exceeds %d bytes, dropped",
+                 link_index(l), MESHTASTIC_FRAME_MAX);
+        read_from_radio(l);
+    } else if (l->from_radio_len) {
+        tcp_forward_from_radio(link_index(l), l->from_radio_buf, l->from_radio_len);
+        if (data_callback != NULL) {
+            data_callback(ch, l->from_radio_buf, l->from_radio_len);
+        }
+        read_from_radio(l);
+    } else if (l->from_radio_again) {
+        l->from_radio_again = false;
+        read_from_radio(l);
+    } else {
+        l->from_radio_draining = false;
+    }
+    return 0;
+}
+
+static void read_from_radio(proxy_link_t *l) {
+    l->from_radio_len = 0;
+    l->from_radio_oversize = false;
+    l->from_radio_draining = true;
+    int rc = ble_gattc_read_long(l->uart.conn_handle, l->uart.from_radio_val, 0, on_from_radio_read, l);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "FromRadio read not started: %d", rc);
+        l->from_radio_draining = false;
+    }
+}
+
+static void drain_from_radio(proxy_link_t *l) {
+    if (l->from_radio_draining) {
+        l->from_radio_again = true;
+        return;
+    }
+    l->from_radio_again = false;
+    read_from_radio(l);
+}
+
 // CCCD write completion callback
 static int on_cccd_written(uint16_t ch, const struct ble_gatt_error *err, struct ble_gatt_attr *attr, void *arg)
 {
+    proxy_link_t *l = arg;
     if (err->status == 0) {
-        uart.notify_enabled = true;
-        ESP_LOGI(TAG, "🔔 Notifications enabled (CCCD=%u)", attr->handle);
+        l->uart.notify_enabled = true;
+        publish_snapshot(l);
+        l->info.discovery_ms = (uint32_t)((esp_timer_get_time() - l->discovery_start_us) / 1000);
+        ESP_LOGI(TAG, "🔔 Notifications enabled (CCCD=%u) %lu ms after encryption%s", attr->handle,
+                 l->info.discovery_ms, l->info.handles_cached ? ", handles from cache" : "");
+        if (!l->info.handles_cached) {
+            save_handles(l);
+        }
+        if (l->info.reconnecting) {
+            l->info.reconnecting = false;
+            l->info.reconnect_ms = (uint32_t)((esp_timer_get_time() - l->dropped_us) / 1000);
+            ESP_LOGI(TAG, "Link %d back %lu ms after the drop, %u attempts",
+                     link_index(l), l->info.reconnect_ms, l->info.reconnect_attempts);
+        }
 
         // Now check if we have everything we need to start TCP proxy
-        if (uart.tx_val && uart.rx_val && uart.notify_enabled) {
-            ESP_LOGI(TAG, "✅ Serial over BLE ready (TX=%u RX=%u CCCD=%u). Starting TCP proxy…",
-                     uart.tx_val, uart.rx_val, uart.tx_cccd);
-            extern void start_tcp_proxy(void);
-            start_tcp_proxy();
+        if (l->uart.tx_val && l->uart.rx_val && l->uart.notify_enabled) {
+            ESP_LOGI(TAG, "✅ Serial over BLE ready on link %d (TX=%u RX=%u CCCD=%u). Starting TCP proxy…",
+                     link_index(l), l->uart.tx_val, l->uart.rx_val, l->uart.tx_cccd);
+            start_tcp_proxy(link_index(l));
+
+            // Packets may have queued before notifications were on
+            if (l->uart.meshtastic && l->uart.from_radio_val) {
+                drain_from_radio(l);
+            }
+        }
+    } else if (l->info.handles_cached && l->conn.state == BLE_STATE_CONNECTED) {
+        ESP_LOGW(TAG, "CCCD write to cached handle failed (%d), rediscovering", err->status);
+        if (att_answered(err->status)) {
+            gatt_cache_forget(l->conn.peer_addr);
         }
+        start_discovery(l);
     } else {
         ESP_LOGE(TAG, "CCCD write failed (%d) on %u", err->status, attr ? attr->handle : 0);
     }
@@ -366,35 +953,53 @@ static int on_cccd_written(uint16_t ch, const struct ble_gatt_error *err, struct
 
 // Fix the GAP event handler
 static int ble_proxy_gap_connect_event(struct ble_gap_event *event, void *arg) {
+    proxy_link_t *l = arg;
     struct ble_gap_conn_desc desc;
     int rc;
 
     switch (event->type) {
     case BLE_GAP_EVENT_CONNECT:
         if (event->connect.status == 0) {
-            ESP_LOGI(TAG, "✅ Connected, handle=%d", event->connect.conn_handle);
-            current_conn.conn_handle = event->connect.conn_handle;
-            current_conn.state = BLE_STATE_CONNECTED;
-            conn_state = CONN_STATE_CONNECTED;
+            ESP_LOGI(TAG, "✅ Link %d connected, handle=%d", link_index(l), event->connect.conn_handle);
+            l->conn.conn_handle = event->connect.conn_handle;
+            l->conn.state = BLE_STATE_CONNECTED;
+            l->conn_state = CONN_STATE_CONNECTED;
 
             // Initialize UART context
-            uart = (uart_ctx_t){0};
-            uart.conn_handle = event->connect.conn_handle;
+            l->uart = (uart_ctx_t){0};
+            l->uart.conn_handle = event->connect.conn_handle;
+            reset_tx_window(l);
+            publish_snapshot(l);
 
             // Store handle for passkey injection
             pending_conn_handle = event->connect.conn_handle;
             passkey_injected = false;
 
+            // Faster PHY and longer LL packets, both optional for the peer
+            rc = ble_gap_set_prefered_le_phy(event->connect.conn_handle, BLE_GAP_LE_PHY_2M_MASK,
+                                             BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY);
+            if (rc != 0) {
+                ESP_LOGW(TAG, "2M PHY request failed: %d", rc);
+            }
+            rc = ble_gap_set_data_len(event->connect.conn_handle, LINK_DLE_OCTETS, LINK_DLE_TIME_US);
+            if (rc != 0) {
+                ESP_LOGW(TAG, "Data length request failed: %d", rc);
+            }
+
             // Exchange MTU first (important for Meshtastic)
             ESP_LOGI(TAG, "📏 Exchanging MTU...");
             ble_gattc_exchange_mtu(event->connect.conn_handle, NULL, NULL);
-            conn_state = CONN_STATE_MTU_EXCHANGED;
+            l->conn_state = CONN_STATE_MTU_EXCHANGED;
 
-            // Wait before initiating security (critical for stability)
-            vTaskDelay(pdMS_TO_TICKS(1000));
+            // Wait before initiating security (critical for stability).
+            // A reconnecting radio is bonded, encryption resumes from the
+            // stored keys without pairing, so there is nothing to wait for.
+            if (!l->info.reconnecting) {
+                vTaskDelay(pdMS_TO_TICKS(1000));
+            }
 
             // Now initiate security
-            conn_state = CONN_STATE_SECURING;
+            l->conn_state = CONN_STATE_SECURING;
             ESP_LOGI(TAG, "🔐 Initiating security...");
             rc = ble_gap_security_initiate(event->connect.conn_handle);
             if (rc != 0) {
@@ -403,14 +1008,21 @@ static int ble_proxy_gap_connect_event(struct ble_gap_event *event, void *arg) {
             }
 
             if (connect_callback) {
-                connect_callback(current_conn.conn_handle, current_conn.peer_addr);
+                connect_callback(l->conn.conn_handle, l->conn.peer_addr);
             }
         } else {
-            ESP_LOGE(TAG, "Connection failed: status=%d", event->connect.status);
-            conn_state = CONN_STATE_IDLE;
-            current_conn.state = BLE_STATE_IDLE;
-            current_conn.conn_handle = BLE_HS_CONN_HANDLE_NONE;
-            pending_conn_handle = BLE_HS_CONN_HANDLE_NONE;
+            if (l->info.reconnecting) {
+                ESP_LOGI(TAG, "Link %d reconnect attempt ended: status=%d", link_index(l), event->connect.status);
+            } else {
+                ESP_LOGE(TAG, "Connection failed: status=%d", event->connect.status);
+            }
+            l->conn_state = CONN_STATE_IDLE;
+            l->conn.state = BLE_STATE_IDLE;
+            l->conn.conn_handle = BLE_HS_CONN_HANDLE_NONE;
+            l->state = PROXY_IDLE;
+            if (l->info.reconnecting) {
+                schedule_reconnect(l, reconnect_gap_ms(l));
+            }
         }
         break;
 
@@ -470,35 +1082,63 @@ static int ble_proxy_gap_connect_event(struct ble_gap_event *event, void *arg) {
         return 0;  // Important: return 0 from the event handler
 
     case BLE_GAP_EVENT_DISCONNECT:
-        ESP_LOGW(TAG, "Disconnected: reason=%d", event->disconnect.reason);
+        ESP_LOGW(TAG, "Link %d disconnected: reason=%d", link_index(l), event->disconnect.reason);
         if (disconnect_callback != NULL) {
-            disconnect_callback(current_conn.conn_handle, event->disconnect.reason);
-        }
-        stop_tcp_proxy();
-        current_conn.state = BLE_STATE_IDLE;
-        current_conn.conn_handle = BLE_HS_CONN_HANDLE_NONE;
-        s_state = PROXY_IDLE;
-        conn_state = CONN_STATE_IDLE;
-        uart = (uart_ctx_t){0};
+            disconnect_callback(l->conn.conn_handle, event->disconnect.reason);
+        }
+        if (pending_conn_handle == event->disconnect.conn.conn_handle) {
+            pending_conn_handle = BLE_HS_CONN_HANDLE_NONE;
+        }
+
+        // A bonded radio dropping on its own, a reboot after flashing say, is
+        // reconnected and keeps its TCP clients. So is one that drops again
+        // before a reconnect finished; asked for disconnects are not.
+        bool reconnect = l->conn.state == BLE_STATE_CONNECTED &&
+                         (event->disconnect.conn.sec_state.bonded || l->info.reconnecting);
+        if (!reconnect) {
+            end_reconnect(l);
+            stop_tcp_proxy(link_index(l));
+        }
+        l->conn.state = BLE_STATE_IDLE;
+        l->conn.conn_handle = BLE_HS_CONN_HANDLE_NONE;
+        l->state = PROXY_IDLE;
+        l->conn_state = CONN_STATE_IDLE;
+        l->uart = (uart_ctx_t){0};
+        l->from_radio_draining = l->from_radio_again = false;
+        mesh_cache_invalidate(link_index(l));
+        l->info.tx_phy = l->info.rx_phy = 1;
+        l->info.tx_octets = l->info.rx_octets = 27;
+        l->info.mtu = 23;
+        l->info.handles_cached = false;
+        l->info.discovery_ms = 0;
+        publish_snapshot(l);
+
+        if (reconnect) {
+            if (!l->info.reconnecting) {
+                l->info.reconnecting = true;
+                l->info.reconnect_attempts = 0;
+                l->dropped_us = esp_timer_get_time();
+            }
+            ESP_LOGI(TAG, "Link %d: reconnecting to the bonded radio", link_index(l));
+            schedule_reconnect(l, l->info.reconnect_attempts ? reconnect_gap_ms(l) : RECONNECT_FIRST_GAP_MS);
+        }
         break;
 
     case BLE_GAP_EVENT_ENC_CHANGE:
         ESP_LOGI(TAG, "🔒 Encryption change: status=%d", event->enc_change.status);
         if (event->enc_change.status == 0) {
-            uart.encrypted = true;
-            conn_state = CONN_STATE_ENCRYPTED;
+            l->uart.encrypted = true;
+            l->conn_state = CONN_STATE_ENCRYPTED;
             ESP_LOGI(TAG, "✅ Link encrypted successfully");
 
-            // Wait a bit for stability
-            vTaskDelay(pdMS_TO_TICKS(500));
-
-            // Start service discovery
-            conn_state = CONN_STATE_DISCOVERING;
-            ESP_LOGI(TAG, "🔍 Starting service discovery...");
-            rc = ble_gattc_disc_all_svcs(uart.conn_handle, on_disc_svc, NULL);
-            if (rc != 0) {
-                ESP_LOGE(TAG, "Service discovery failed to start: %d", rc);
+            // Wait a bit for stability, not when resuming a known radio
+            if (!l->info.reconnecting) {
+                vTaskDelay(pdMS_TO_TICKS(500));
             }
+
+            // Cached handles when still valid, else service discovery
+            l->conn_state = CONN_STATE_DISCOVERING;
+            start_gatt(l);
         } else {
             ESP_LOGE(TAG, "❌ Encryption failed: %d (0x%02X)",
                     event->enc_change.status, event->enc_change.status);
@@ -525,20 +1165,24 @@ static int ble_proxy_gap_connect_event(struct ble_gap_event *event, void *arg) {
         uint16_t len = OS_MBUF_PKTLEN(event->notify_rx.om);
         if (!len) break;
 
-        uint8_t buf[512];
-        if (len > sizeof(buf)) len = sizeof(buf);
-        os_mbuf_copydata(event->notify_rx.om, 0, len, buf);
-
-        ESP_LOGI(TAG, "BLE ← notify: %u bytes from handle %d", len, event->notify_rx.attr_handle);
+        ESP_LOGD(TAG, "BLE ← notify: %u bytes from handle %d", len, event->notify_rx.attr_handle);
 
-        // Log first few bytes for debugging
-        ESP_LOG_BUFFER_HEX(TAG, buf, len < 16 ? len : 16);
+        // Meshtastic only notifies a counter, the packets are read from FromRadio
+        if (l->uart.meshtastic) {
+            if (event->notify_rx.attr_handle == l->uart.tx_val && l->uart.from_radio_val) {
+                drain_from_radio(l);
+            }
+            break;
+        }
 
-        // Forward to TCP
-        tcp_forward_ble_data(buf, len);
+        // Queued for the TCP task, this is the host task and must not block
+        tcp_forward_ble_data(link_index(l), event->notify_rx.om);
 
         if (data_callback != NULL) {
-            data_callback(current_conn.conn_handle, buf, len);
+            uint8_t buf[512];
+            if (len > sizeof(buf)) len = sizeof(buf);
+            os_mbuf_copydata(event->notify_rx.om, 0, len, buf);
+            data_callback(l->conn.conn_handle, buf, len);
         }
         break;
     }
@@ -549,6 +1193,7 @@ static int ble_proxy_gap_connect_event(struct ble_gap_event *event, void *arg) {
         if (rc == 0) {
             ble_store_util_delete_peer(&desc.peer_id_addr);
         }
+        gatt_cache_forget(l->conn.peer_addr);
         return BLE_GAP_REPEAT_PAIRING_RETRY;
 
     // Fix the typo - it's PARING not PAIRING in NimBLE headers
@@ -556,11 +1201,11 @@ static int ble_proxy_gap_connect_event(struct ble_gap_event *event, void *arg) {
         ESP_LOGI(TAG, "🎉 Pairing complete! Status: %d", event->pairing_complete.status);
         if (event->pairing_complete.status == 0) {
             ESP_LOGI(TAG, "✅ Pairing successful - devices are now bonded");
-            conn_state = CONN_STATE_ENCRYPTED;
+            l->conn_state = CONN_STATE_ENCRYPTED;
         } else {
             ESP_LOGE(TAG, "❌ Pairing failed with status: %d (0x%02X)",
                     event->pairing_complete.status, event->pairing_complete.status);
-            conn_state = CONN_STATE_CONNECTED;
+            l->conn_state = CONN_STATE_CONNECTED;
         }
         break;
 
@@ -569,10 +1214,54 @@ static int ble_proxy_gap_connect_event(struct ble_gap_event *event, void *arg) {
                 event->subscribe.cur_notify, event->subscribe.cur_indicate);
         if (event->subscribe.cur_notify) {
             ESP_LOGI(TAG, "✅ Notifications successfully enabled!");
-            s_state = PROXY_RUNNING;
-            conn_state = CONN_STATE_READY;
-            start_tcp_proxy();
+            l->state = PROXY_RUNNING;
+            l->conn_state = CONN_STATE_READY;
+            start_tcp_proxy(link_index(l));
+        }
+        break;
+
+    case BLE_GAP_EVENT_CONN_UPDATE:
+        if (event->conn_update.status == 0 &&
+            ble_gap_conn_find(event->conn_update.conn_handle, &desc) == 0) {
+            ESP_LOGI(TAG, "Connection interval %u.%02u ms, latency %u, timeout %u ms",
+                     desc.conn_itvl * 5 / 4, (desc.conn_itvl * 125) % 100,
+                     desc.conn_latency, desc.supervision_timeout * 10);
+            if (l->profile_pending && l->failed_profile == l->info.active) {
+                l->failed_profile = BLE_LINK_AUTO;
+                l->profile_fails = 0;
+            }
+        } else {
+            ESP_LOGW(TAG, "Connection update failed: %d", event->conn_update.status);
+            if (l->profile_pending) {
+                // The old parameters are still in effect
+                ble_link_profile_t refused = l->info.active;
+                l->info.active = l->profile_prev;
+                note_profile_failure(l, refused);
+            }
         }
+        l->profile_pending = false;
+        break;
+
+    case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+        if (event->phy_updated.status == 0) {
+            l->info.tx_phy = event->phy_updated.tx_phy;
+            l->info.rx_phy = event->phy_updated.rx_phy;
+            ESP_LOGI(TAG, "PHY tx=%uM rx=%uM", l->info.tx_phy, l->info.rx_phy);
+        }
+        break;
+
+#ifdef BLE_GAP_EVENT_DATA_LEN_CHG
+    case BLE_GAP_EVENT_DATA_LEN_CHG:
+        l->info.tx_octets = event->data_len_chg.max_tx_octets;
+        l->info.rx_octets = event->data_len_chg.max_rx_octets;
+        ESP_LOGI(TAG, "LL data length tx=%u rx=%u", l->info.tx_octets, l->info.rx_octets);
+        break;
+#endif
+
+    case BLE_GAP_EVENT_MTU:
+        l->info.mtu = event->mtu.value;
+        publish_snapshot(l);
+        ESP_LOGI(TAG, "MTU %u", l->info.mtu);
         break;
 
     default:
@@ -583,6 +1272,86 @@ static int ble_proxy_gap_connect_event(struct ble_gap_event *event, void *arg) {
     return 0;
 }
 
+// Ask the peer for a profile's connection parameters
+static esp_err_t apply_link_profile(proxy_link_t *l, ble_link_profile_t profile) {
+    if (l->conn.state != BLE_STATE_CONNECTED) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int rc = ble_gap_update_params(l->conn.conn_handle, &link_profiles[profile].params);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Link profile %s not requested: %d", link_profiles[profile].name, rc);
+        note_profile_failure(l, profile);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Link %d profile %s -> %s", link_index(l),
+             link_profiles[l->info.active].name, link_profiles[profile].name);
+    l->profile_prev = l->info.active;
+    l->profile_pending = true;
+    l->info.active = profile;
+    return ESP_OK;
+}
+
+esp_err_t ble_proxy_set_link_profile(uint8_t link, ble_link_profile_t profile) {
+    proxy_link_t *l = get_link(link);
+    if (!l || profile > BLE_LINK_LOW_POWER) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // An explicit choice gets a fresh set of attempts
+    l->info.profile = profile;
+    l->busy_us = esp_timer_get_time();
+    l->failed_profile = BLE_LINK_AUTO;
+    l->profile_fails = 0;
+    if (l->conn.state != BLE_STATE_CONNECTED) {
+        return ESP_OK;
+    }
+    return apply_link_profile(l, profile == BLE_LINK_AUTO ? BLE_LINK_BULK : profile);
+}
+
+void ble_proxy_link_tick(uint8_t link, bool busy) {
+    proxy_link_t *l = get_link(link);
+    if (!l || l->info.profile != BLE_LINK_AUTO || l->conn.state != BLE_STATE_CONNECTED) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (busy) {
+        l->busy_us = now;
+    }
+    int64_t idle = now - l->busy_us;
+    ble_link_profile_t want = idle < LINK_IDLE_US ? BLE_LINK_BULK :
+                              idle < LINK_SLEEP_US ? BLE_LINK_INTERACTIVE : BLE_LINK_LOW_POWER;
+    bool held_off = want == l->failed_profile &&
+                    (l->profile_fails >= LINK_RETRY_MAX || now < l->profile_retry_us);
+    if (want != l->info.active && !l->profile_pending && !held_off) {
+        apply_link_profile(l, want);
+    }
+}
+
+void ble_proxy_get_link_info(uint8_t link, ble_link_info_t *info) {
+    proxy_link_t *l = get_link(link);
+    if (!l) {
+        memset(info, 0, sizeof(*info));
+        return;
+    }
+    *info = l->info;
+    info->interval_us = 0;
+    info->latency = 0;
+    info->supervision_ms = 0;
+
+    struct ble_gap_conn_desc desc;
+    if (l->conn.state == BLE_STATE_CONNECTED && ble_gap_conn_find(l->conn.conn_handle, &desc) == 0) {
+        info->interval_us = desc.conn_itvl * 1250;
+        info->latency = desc.conn_latency;
+        info->supervision_ms = desc.supervision_timeout * 10;
+    }
+}
+
+const char *ble_link_profile_name(ble_link_profile_t profile) {
+    return profile <= BLE_LINK_LOW_POWER ? link_profiles[profile].name : "unknown";
+}
+
 
 // Characteristic discovery callback
 // Removed unused function ble_proxy_on_chr_disc
@@ -606,16 +1375,27 @@ void ble_proxy_register_data_cb(ble_data_received_cb_t cb) {
 }
 
 // Get connection info
-esp_err_t ble_proxy_get_connection_info(ble_connection_t *conn_info) {
-    if (conn_info) {
-        *conn_info = current_conn;
+esp_err_t ble_proxy_get_connection_info(uint8_t link, ble_connection_t *conn_info) {
+    proxy_link_t *l = get_link(link);
+    if (l && conn_info) {
+        *conn_info = l->conn;
         return ESP_OK;
     }
     return ESP_ERR_INVALID_ARG;
 }
 
+bool ble_proxy_link_connected(uint8_t link) {
+    proxy_link_t *l = get_link(link);
+    return l && l->conn.state == BLE_STATE_CONNECTED;
+}
+
 bool ble_proxy_is_connected(void) {
-    return current_conn.state == BLE_STATE_CONNECTED;
+    for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+        if (links[i].conn.state == BLE_STATE_CONNECTED) {
+            return true;
+        }
+    }
+    return false;
 }
 
 esp_err_t ble_proxy_input_passkey(uint16_t conn_handle, uint32_t passkey) {
@@ -625,21 +1405,22 @@ esp_err_t ble_proxy_input_passkey(uint16_t conn_handle, uint32_t passkey) {
         return ESP_ERR_NOT_SUPPORTED;
     }
 
-    // Validate connection state
-    if (conn_state < CONN_STATE_CONNECTED || conn_state > CONN_STATE_PAIRING) {
-        ESP_LOGE(TAG, "Cannot input passkey in state %d", conn_state);
-        return ESP_ERR_INVALID_STATE;
-    }
-
     if (conn_handle == 0) {
         conn_handle = pending_conn_handle;
     }
 
-    if (conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+    proxy_link_t *l = link_by_handle(conn_handle);
+    if (conn_handle == BLE_HS_CONN_HANDLE_NONE || !l) {
         ESP_LOGE(TAG, "No valid connection handle for passkey");
         return ESP_ERR_INVALID_STATE;
     }
 
+    // Validate connection state
+    if (l->conn_state < CONN_STATE_CONNECTED || l->conn_state > CONN_STATE_PAIRING) {
+        ESP_LOGE(TAG, "Cannot input passkey in state %d", l->conn_state);
+        return ESP_ERR_INVALID_STATE;
+    }
+
     struct ble_sm_io io = {
         .action = BLE_SM_IOACT_INPUT,
         .passkey = passkey
@@ -672,7 +1453,7 @@ esp_err_t ble_proxy_confirm_passkey(uint16_t conn_handle, bool confirm) {
     }
 
     if (conn_handle == BLE_HS_CONN_HANDLE_NONE) {
-        conn_handle = current_conn.conn_handle;
+        conn_handle = pending_conn_handle;
     }
 
     struct ble_sm_io io = {
@@ -690,26 +1471,198 @@ esp_err_t ble_proxy_confirm_passkey(uint16_t conn_handle, bool confirm) {
     return ESP_OK;
 }
 
+// Write request answered, the whole window is free again
+static int on_tx_window_done(uint16_t ch, const struct ble_gatt_error *err,
+                             struct ble_gatt_attr *attr, void *arg) {
+    proxy_link_t *l = arg;
+    if (err->status != 0) {
+        ESP_LOGW(TAG, "Uplink write request failed: %d", err->status);
+    }
+    taskENTER_CRITICAL(&tx_lock);
+    l->tx.credits = BLE_TX_WINDOW;
+    taskEXIT_CRITICAL(&tx_lock);
+    tcp_proxy_wake();
+    return 0;
+}
+
+static void tx_retry_cb(void *arg) {
+    tcp_proxy_wake();
+}
+
+// Host buffers ran out, try again one connection interval later
+static void schedule_tx_retry(proxy_link_t *l) {
+    if (!l->tx_retry_timer) {
+        const esp_timer_create_args_t args = { .callback = tx_retry_cb, .arg = l, .name = "ble_tx_retry" };
+        if (esp_timer_create(&args, &l->tx_retry_timer) != ESP_OK) {
+            return;
+        }
+    }
+
+    uint32_t interval_us = 30000;
+    struct ble_gap_conn_desc desc;
+    ble_conn_snapshot_t conn;
+    ble_proxy_get_snapshot(link_index(l), &conn);
+    if (ble_gap_conn_find(conn.conn_handle, &desc) == 0) {
+        interval_us = desc.conn_itvl * 1250;
+    }
+    esp_timer_stop(l->tx_retry_timer);
+    esp_timer_start_once(l->tx_retry_timer, interval_us);
+}
+
+static void account_tx(proxy_link_t *l, uint16_t len) {
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&tx_lock);
+    l->tx.bytes += len;
+    if (now - l->tx.rate_start_us >= BLE_TX_RATE_WINDOW_US) {
+        if (now - l->tx.rate_start_us < 2 * BLE_TX_RATE_WINDOW_US) {
+            l->tx.bytes_per_sec = (uint32_t)(l->tx.rate_bytes * 1000000LL / (now - l->tx.rate_start_us));
+        }
+        l->tx.rate_start_us = now;
+        l->tx.rate_bytes = 0;
+    }
+    l->tx.rate_bytes += len;
+    taskEXIT_CRITICAL(&tx_lock);
+}
+
+bool ble_proxy_write_ready(uint8_t link) {
+    proxy_link_t *l = get_link(link);
+    return l && l->tx.credits > 0;
+}
+
+int ble_proxy_write(uint8_t link, const uint8_t *data, uint16_t len) {
+    proxy_link_t *l = get_link(link);
+    ble_conn_snapshot_t conn;
+    ble_proxy_get_snapshot(link, &conn);
+    if (!l || conn.conn_handle == BLE_HS_CONN_HANDLE_NONE || !conn.rx_val) {
+        return -1;
+    }
+
+    uint16_t payload = conn.mtu - 3;
+    if (payload < 20 || payload > 244) {
+        payload = payload < 20 ? 20 : 244;
+    }
+    bool has_requests = (conn.rx_props & BLE_GATT_CHR_PROP_WRITE) != 0;
+    bool has_commands = (conn.rx_props & BLE_GATT_CHR_PROP_WRITE_NO_RSP) != 0 || !conn.rx_props;
+
+    int taken = 0;
+    while (taken < len) {
+        taskENTER_CRITICAL(&tx_lock);
+        uint8_t credits = l->tx.credits;
+        taskEXIT_CRITICAL(&tx_lock);
+        if (!credits) {
+            break;
+        }
+
+        uint16_t chunk = MIN(len - taken, payload);
+        bool request = has_requests && (credits == 1 || !has_commands);
+        int rc = request ?
+            ble_gattc_write_flat(conn.conn_handle, conn.rx_val, data + taken, chunk, on_tx_window_done, l) :
+            ble_gattc_write_no_rsp_flat(conn.conn_handle, conn.rx_val, data + taken, chunk);
+        if (rc == BLE_HS_ENOMEM) {
+            taskENTER_CRITICAL(&tx_lock);
+            l->tx.stalls++;
+            taskEXIT_CRITICAL(&tx_lock);
+            schedule_tx_retry(l);
+            break;
+        }
+        if (rc != 0) {
+            ESP_LOGW(TAG, "Uplink write failed: %d", rc);
+            return taken ? taken : -1;
+        }
+
+        // Without write requests the window never drains, pacing is left to ENOMEM
+        if (has_requests) {
+            taskENTER_CRITICAL(&tx_lock);
+            l->tx.credits = request ? 0 : l->tx.credits - 1;
+            taskEXIT_CRITICAL(&tx_lock);
+        }
+        account_tx(l, chunk);
+        taken += chunk;
+    }
+    return taken;
+}
+
+int ble_proxy_write_frame(uint8_t link, const uint8_t *data, uint16_t len) {
+    proxy_link_t *l = get_link(link);
+    ble_conn_snapshot_t conn;
+    ble_proxy_get_snapshot(link, &conn);
+    if (!l || conn.conn_handle == BLE_HS_CONN_HANDLE_NONE || !conn.rx_val || len > MESHTASTIC_FRAME_MAX) {
+        return -1;
+    }
+
+    // Always a write request: the radio handles ToRadio in order and the
+    // response returns the window, so one frame is in flight at a time
+    taskENTER_CRITICAL(&tx_lock);
+    bool idle = l->tx.credits == BLE_TX_WINDOW;
+    taskEXIT_CRITICAL(&tx_lock);
+    if (!idle) {
+        return 0;
+    }
+
+    int rc;
+    if (len <= conn.mtu - 3) {
+        rc = ble_gattc_write_flat(conn.conn_handle, conn.rx_val, data, len, on_tx_window_done, l);
+    } else {
+        struct os_mbuf *om = ble_hs_mbuf_from_flat(data, len);
+        rc = om ? ble_gattc_write_long(conn.conn_handle, conn.rx_val, 0, om, on_tx_window_done, l) :
+                  BLE_HS_ENOMEM;
+    }
+    if (rc == BLE_HS_ENOMEM) {
+        taskENTER_CRITICAL(&tx_lock);
+        l->tx.stalls++;
+        taskEXIT_CRITICAL(&tx_lock);
+        schedule_tx_retry(l);
+        return 0;
+    }
+    if (rc != 0) {
+        ESP_LOGW(TAG, "ToRadio write failed: %d", rc);
+        return -1;
+    }
+
+    taskENTER_CRITICAL(&tx_lock);
+    l->tx.credits = 0;
+    taskEXIT_CRITICAL(&tx_lock);
+    account_tx(l, len);
+    return len;
+}
+
+void ble_proxy_get_tx_stats(uint8_t link, ble_tx_stats_t *stats) {
+    proxy_link_t *l = get_link(link);
+    if (!l) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&tx_lock);
+    stats->bytes = l->tx.bytes;
+    stats->bytes_per_sec = now - l->tx.rate_start_us < 2 * BLE_TX_RATE_WINDOW_US ? l->tx.bytes_per_sec : 0;
+    stats->stalls = l->tx.stalls;
+    stats->credits = l->tx.credits;
+    taskEXIT_CRITICAL(&tx_lock);
+}
+
 // Write helper - simple and clean
-esp_err_t ble_proxy_send_data(const uint8_t *data, uint16_t len) {
-    if (!ble_proxy_is_connected() || !uart.rx_val) {
+esp_err_t ble_proxy_send_data(uint8_t link, const uint8_t *data, uint16_t len) {
+    ble_conn_snapshot_t conn;
+    ble_proxy_get_snapshot(link, &conn);
+    if (conn.conn_handle == BLE_HS_CONN_HANDLE_NONE || !conn.rx_val) {
         return ESP_ERR_INVALID_STATE;
     }
 
-    int rc = ble_gattc_write_no_rsp_flat(uart.conn_handle, uart.rx_val, data, len);
+    int rc = ble_gattc_write_no_rsp_flat(conn.conn_handle, conn.rx_val, data, len);
     return rc == 0 ? ESP_OK : ESP_FAIL;
 }
 
 // Test function to verify data communication
 void test_meshtastic_communication(void) {
-    if (current_conn.state != BLE_STATE_CONNECTED) {
+    if (!ble_proxy_link_connected(0)) {
         ESP_LOGW(TAG, "Cannot test - not connected");
         return;
     }
 
     // Send a simple test message (Meshtastic protocol would go here)
     const char *test_msg = "Hello Meshtastic!";
-    esp_err_t ret = ble_proxy_send_data((uint8_t*)test_msg, strlen(test_msg));
+    esp_err_t ret = ble_proxy_send_data(0, (uint8_t*)test_msg, strlen(test_msg));
     if (ret == ESP_OK) {
         ESP_LOGI(TAG, "Test message sent successfully");
     } else {
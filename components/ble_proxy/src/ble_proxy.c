@@ -394,6 +394,11 @@ esp_err_t ble_proxy_init(void) {
     memset(discovered_devices, 0, sizeof(discovered_devices));
     ESP_LOGI(TAG, "Device tracking initialized");
 
+    // Config replay cache shared by Meshtastic TCP clients
+    if (mesh_cache_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Config cache unavailable, want_config goes to the radio");
+    }
+
     // Start NimBLE host task
     ESP_LOGI(TAG, "Starting NimBLE host task...");
     nimble_port_freertos_init(nimble_host_task);
@@ -0,0 +1,110 @@
+// gatt_cache.c - Discovered GATT handles of bonded radios, kept across reboots
+#include "ble_proxy.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include <string.h>
+
+static const char *TAG = "GATT_CACHE";
+
+#define GATT_CACHE_NVS_NAMESPACE "ble_gatt"
+#define GATT_CACHE_NVS_KEY       "handles"
+#define GATT_CACHE_VERSION       1
+
+typedef struct {
+    uint32_t version;
+    uint32_t sequence;
+    gatt_cache_entry_t entries[GATT_CACHE_SLOTS];
+} gatt_cache_list_t;
+
+static gatt_cache_list_t list;
+static bool loaded = false;
+
+static void save_list(void) {
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(GATT_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(handle, GATT_CACHE_NVS_KEY, &list, sizeof(list));
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save handle cache: %s", esp_err_to_name(ret));
+    }
+}
+
+static void load_list(void) {
+    if (loaded) {
+        return;
+    }
+    loaded = true;
+
+    nvs_handle_t handle;
+    size_t len = sizeof(list);
+    esp_err_t ret = nvs_open(GATT_CACHE_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_get_blob(handle, GATT_CACHE_NVS_KEY, &list, &len);
+        nvs_close(handle);
+    }
+
+    if (ret != ESP_OK || len != sizeof(list) || list.version != GATT_CACHE_VERSION) {
+        memset(&list, 0, sizeof(list));
+        list.version = GATT_CACHE_VERSION;
+    }
+}
+
+static gatt_cache_entry_t *find(const uint8_t *addr) {
+    for (int i = 0; i < GATT_CACHE_SLOTS; i++) {
+        if (list.entries[i].sequence && memcmp(list.entries[i].addr, addr, 6) == 0) {
+            return &list.entries[i];
+        }
+    }
+    return NULL;
+}
+
+bool gatt_cache_lookup(const uint8_t *addr, gatt_cache_entry_t *entry) {
+    load_list();
+    gatt_cache_entry_t *found = find(addr);
+    if (found) {
+        *entry = *found;
+    }
+    return found != NULL;
+}
+
+void gatt_cache_store(const gatt_cache_entry_t *entry) {
+    load_list();
+
+    // Same peer, else a free slot, else the least recently stored
+    gatt_cache_entry_t *slot = find(entry->addr);
+    for (int i = 0; !slot && i < GATT_CACHE_SLOTS; i++) {
+        if (!list.entries[i].sequence) {
+            slot = &list.entries[i];
+        }
+    }
+    if (!slot) {
+        slot = &list.entries[0];
+        for (int i = 1; i < GATT_CACHE_SLOTS; i++) {
+            if (list.entries[i].sequence < slot->sequence) {
+                slot = &list.entries[i];
+            }
+        }
+    }
+
+    *slot = *entry;
+    slot->sequence = ++list.sequence;
+    save_list();
+    ESP_LOGI(TAG, "Stored handles for %02X:%02X:%02X:%02X:%02X:%02X%s",
+             entry->addr[5], entry->addr[4], entry->addr[3], entry->addr[2], entry->addr[1], entry->addr[0],
+             entry->has_db_hash ? " with database hash" : "");
+}
+
+void gatt_cache_forget(const uint8_t *addr) {
+    load_list();
+    gatt_cache_entry_t *found = find(addr);
+    if (found) {
+        memset(found, 0, sizeof(*found));
+        save_list();
+    }
+}
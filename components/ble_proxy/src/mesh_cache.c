@@ -0,0 +1,432 @@
+// mesh_cache.c - Meshtastic config and NodeDB replay cache for TCP clients
+#include "ble_proxy.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "MESH_CACHE";
+
+#define MESH_CACHE_SIZE         (20 * 1024)     // Enough for config plus ~100 nodes
+#define MESH_CACHE_MAX_AGE_US   (15 * 60 * 1000000LL)
+#define MESH_CAPTURE_TIMEOUT_US (60 * 1000000LL)
+
+// FromRadio / ToRadio field numbers (meshtastic/mesh.proto)
+#define FROMRADIO_ID                1
+#define FROMRADIO_MY_INFO           3
+#define FROMRADIO_NODE_INFO         4
+#define FROMRADIO_CONFIG            5
+#define FROMRADIO_CONFIG_COMPLETE   7
+#define FROMRADIO_REBOOTED          8
+#define FROMRADIO_MODULE_CONFIG     9
+#define FROMRADIO_CHANNEL           10
+#define FROMRADIO_METADATA          13
+#define FROMRADIO_FILE_INFO         15
+#define FROMRADIO_DEVICEUI_CONFIG   17
+#define TORADIO_PACKET              1
+#define TORADIO_WANT_CONFIG_ID      3
+#define MESHPACKET_DECODED          4
+#define DATA_PORTNUM                1
+#define PORTNUM_ADMIN_APP           6
+
+// Records are appended as [flags][type][key:4][0x94 0xC3 len16 payload], so
+// the framed bytes go to sockets as they are. An update marks the older
+// record dead instead of moving data, which keeps the bytes a client is
+// part way through intact; dead records are compacted out only while no
+// client is replaying.
+#define REC_DEAD    0x01
+#define REC_KEYED   0x02
+#define REC_HDR_LEN 6
+
+typedef enum {
+    CACHE_EMPTY = 0,
+    CACHE_CAPTURING,
+    CACHE_VALID
+} cache_state_t;
+
+// One per link, the buffer is allocated on the link's first capture
+typedef struct {
+    uint8_t *cache;
+    uint32_t used;
+    cache_state_t state;
+    bool stale;                 // Radio rebooted or was reconfigured
+    int64_t captured_us;        // Capture start, then completion
+    uint8_t readers;
+    uint32_t hits;
+    uint32_t captures;
+    uint32_t overflow_drops;
+} mesh_cache_t;
+
+static SemaphoreHandle_t cache_mutex = NULL;
+static mesh_cache_t caches[BLE_PROXY_MAX_LINKS];
+
+// Minimal protobuf reader, enough to walk fields of one message
+typedef struct {
+    uint32_t field;
+    uint8_t wire;
+    uint64_t value;             // Varint value
+    const uint8_t *data;        // Length delimited payload
+    uint32_t len;
+} pb_field_t;
+
+static bool pb_varint(const uint8_t **p, const uint8_t *end, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t b = *(*p)++;
+        *value |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool pb_next(const uint8_t **p, const uint8_t *end, pb_field_t *f) {
+    uint64_t tag;
+    if (*p >= end || !pb_varint(p, end, &tag)) {
+        return false;
+    }
+    f->field = tag >> 3;
+    f->wire = tag & 7;
+    f->data = NULL;
+    f->len = 0;
+
+    switch (f->wire) {
+        case 0:
+            return pb_varint(p, end, &f->value);
+        case 1:
+        case 5: {
+            uint32_t size = f->wire == 1 ? 8 : 4;
+            if ((uint32_t)(end - *p) < size) {
+                return false;
+            }
+            *p += size;
+            return true;
+        }
+        case 2:
+            if (!pb_varint(p, end, &f->value) || f->value > (uint64_t)(end - *p)) {
+                return false;
+            }
+            f->data = *p;
+            f->len = f->value;
+            *p += f->len;
+            return true;
+    }
+    return false;
+}
+
+// Value of a varint field, 0 when absent as proto3 leaves defaults out
+static uint32_t pb_find_varint(const uint8_t *data, uint32_t len, uint32_t field) {
+    const uint8_t *p = data;
+    pb_field_t f;
+    while (pb_next(&p, data + len, &f)) {
+        if (f.field == field && f.wire == 0) {
+            return f.value;
+        }
+    }
+    return 0;
+}
+
+// Number of the first field, which names the oneof member of a config section
+static uint32_t pb_first_field(const uint8_t *data, uint32_t len) {
+    const uint8_t *p = data;
+    pb_field_t f;
+    return pb_next(&p, data + len, &f) ? f.field : 0;
+}
+
+// Identity of a cached packet: its oneof field and what it describes
+static bool cache_key(uint32_t type, const pb_field_t *f, uint32_t *key) {
+    switch (type) {
+        case FROMRADIO_MY_INFO:
+        case FROMRADIO_METADATA:
+        case FROMRADIO_DEVICEUI_CONFIG:
+            *key = 0;
+            return true;
+        case FROMRADIO_NODE_INFO:
+            *key = pb_find_varint(f->data, f->len, 1);      // NodeInfo.num
+            return true;
+        case FROMRADIO_CONFIG:
+        case FROMRADIO_MODULE_CONFIG:
+            *key = pb_first_field(f->data, f->len);         // Which section
+            return true;
+        case FROMRADIO_CHANNEL:
+            *key = pb_find_varint(f->data, f->len, 1);      // Channel.index
+            return true;
+        case FROMRADIO_FILE_INFO:
+            return false;
+    }
+    return false;
+}
+
+static bool is_config_type(uint32_t type) {
+    uint32_t key;
+    pb_field_t none = {0};
+    return type == FROMRADIO_FILE_INFO || cache_key(type, &none, &key);
+}
+
+static uint16_t rec_frame_len(const mesh_cache_t *m, uint32_t rec) {
+    return MESHTASTIC_HEADER_LEN + ((m->cache[rec + REC_HDR_LEN + 2] << 8) | m->cache[rec + REC_HDR_LEN + 3]);
+}
+
+// Drop dead records, caller holds the mutex and there are no readers
+static void compact(mesh_cache_t *m) {
+    uint32_t out = 0;
+    for (uint32_t rec = 0; rec < m->used; ) {
+        uint32_t size = REC_HDR_LEN + rec_frame_len(m, rec);
+        if (!(m->cache[rec] & REC_DEAD)) {
+            memmove(m->cache + out, m->cache + rec, size);
+            out += size;
+        }
+        rec += size;
+    }
+    ESP_LOGD(TAG, "Compacted %lu -> %lu bytes", m->used, out);
+    m->used = out;
+}
+
+// Give up on a capture the radio never completed, caller holds the mutex
+static void check_capture_timeout(mesh_cache_t *m) {
+    if (m->state == CACHE_CAPTURING && esp_timer_get_time() - m->captured_us > MESH_CAPTURE_TIMEOUT_US) {
+        ESP_LOGW(TAG, "Capture timed out after %lu bytes", m->used);
+        m->state = CACHE_EMPTY;
+    }
+}
+
+// Caller holds the mutex
+static void store(mesh_cache_t *m, uint32_t type, bool keyed, uint32_t key, const uint8_t *data, uint16_t len) {
+    uint32_t size = REC_HDR_LEN + MESHTASTIC_HEADER_LEN + len;
+    if (m->used + size > MESH_CACHE_SIZE && m->readers == 0) {
+        compact(m);
+    }
+    if (m->used + size > MESH_CACHE_SIZE) {
+        m->overflow_drops++;
+        ESP_LOGW(TAG, "Cache full, type %lu not kept", type);
+        return;
+    }
+
+    for (uint32_t rec = 0; keyed && rec < m->used; rec += REC_HDR_LEN + rec_frame_len(m, rec)) {
+        uint32_t rec_key;
+        memcpy(&rec_key, m->cache + rec + 2, sizeof(rec_key));
+        if ((m->cache[rec] & (REC_KEYED | REC_DEAD)) == REC_KEYED && m->cache[rec + 1] == type && rec_key == key) {
+            m->cache[rec] |= REC_DEAD;
+        }
+    }
+
+    uint8_t *rec = m->cache + m->used;
+    rec[0] = keyed ? REC_KEYED : 0;
+    rec[1] = type;
+    memcpy(rec + 2, &key, sizeof(key));
+    rec[6] = MESHTASTIC_START1;
+    rec[7] = MESHTASTIC_START2;
+    rec[8] = len >> 8;
+    rec[9] = len & 0xFF;
+    memcpy(rec + REC_HDR_LEN + MESHTASTIC_HEADER_LEN, data, len);
+    m->used += size;
+}
+
+esp_err_t mesh_cache_init(void) {
+    if (!cache_mutex) {
+        cache_mutex = xSemaphoreCreateMutex();
+    }
+    return cache_mutex ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void mesh_cache_invalidate(uint8_t link) {
+    if (!cache_mutex || link >= BLE_PROXY_MAX_LINKS) {
+        return;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    caches[link].stale = true;
+    xSemaphoreGive(cache_mutex);
+}
+
+bool mesh_cache_from_radio(uint8_t link, const uint8_t *data, uint16_t len) {
+    if (!cache_mutex || link >= BLE_PROXY_MAX_LINKS) {
+        return true;
+    }
+    mesh_cache_t *m = &caches[link];
+
+    // The packet is named by its first field after the id
+    const uint8_t *p = data;
+    pb_field_t f;
+    uint32_t type = 0;
+    while (pb_next(&p, data + len, &f)) {
+        if (f.field != FROMRADIO_ID) {
+            type = f.field;
+            break;
+        }
+    }
+    if (!type) {
+        return true;
+    }
+
+    bool forward = true;
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    check_capture_timeout(m);
+
+    if (type == FROMRADIO_REBOOTED) {
+        m->stale = true;
+    } else if (type == FROMRADIO_CONFIG_COMPLETE && m->state == CACHE_CAPTURING) {
+        // Each client gets its own completion with its nonce
+        m->state = CACHE_VALID;
+        m->captured_us = esp_timer_get_time();
+        forward = false;
+        ESP_LOGI(TAG, "Config captured: %lu bytes", m->used);
+    } else if (is_config_type(type) && m->cache && m->state != CACHE_EMPTY) {
+        uint32_t key = 0;
+        bool keyed = cache_key(type, &f, &key);
+        if (keyed || m->state == CACHE_CAPTURING) {
+            store(m, type, keyed, key, data, len);
+        }
+        // Config replays go only to the clients that asked
+        forward = m->state != CACHE_CAPTURING;
+    }
+    xSemaphoreGive(cache_mutex);
+    return forward;
+}
+
+bool mesh_cache_check_to_radio(uint8_t link, const uint8_t *data, uint16_t len, uint32_t *config_id) {
+    const uint8_t *p = data;
+    pb_field_t f;
+    while (pb_next(&p, data + len, &f)) {
+        if (f.field == TORADIO_WANT_CONFIG_ID && f.wire == 0) {
+            *config_id = f.value;
+            return true;
+        }
+
+        // Admin traffic may change what the radio would report
+        if (f.field == TORADIO_PACKET && f.wire == 2) {
+            const uint8_t *q = f.data;
+            pb_field_t g;
+            while (pb_next(&q, f.data + f.len, &g)) {
+                if (g.field == MESHPACKET_DECODED && g.wire == 2 &&
+                    pb_find_varint(g.data, g.len, DATA_PORTNUM) == PORTNUM_ADMIN_APP) {
+                    mesh_cache_invalidate(link);
+                }
+            }
+        }
+    }
+    return false;
+}
+
+mesh_config_action_t mesh_cache_want_config(uint8_t link) {
+    if (!cache_mutex || link >= BLE_PROXY_MAX_LINKS) {
+        return MESH_CONFIG_FORWARD;
+    }
+    mesh_cache_t *m = &caches[link];
+
+    mesh_config_action_t action = MESH_CONFIG_CACHED;
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    check_capture_timeout(m);
+    int64_t now = esp_timer_get_time();
+    bool expired = m->state == CACHE_VALID && now - m->captured_us > MESH_CACHE_MAX_AGE_US;
+
+    // A new capture rewrites the buffer, so only with nobody replaying it
+    if ((m->state == CACHE_EMPTY || m->stale || expired) && m->readers == 0) {
+        if (!m->cache) {
+            m->cache = malloc(MESH_CACHE_SIZE);
+        }
+        if (m->cache) {
+            m->used = 0;
+            m->stale = false;
+            m->state = CACHE_CAPTURING;
+            m->captured_us = now;
+            m->captures++;
+            action = MESH_CONFIG_CAPTURE;
+            ESP_LOGI(TAG, "Capturing radio config on link %u", link);
+        } else {
+            ESP_LOGW(TAG, "No memory for the config cache");
+            action = MESH_CONFIG_FORWARD;
+        }
+    } else if (m->state == CACHE_EMPTY || m->stale) {
+        // Capture timed out, or the radio changed, while others still replay
+        // the old one. Ask the radio rather than hand out config we know is wrong.
+        action = MESH_CONFIG_FORWARD;
+    } else {
+        m->hits++;
+    }
+
+    if (action != MESH_CONFIG_FORWARD) {
+        m->readers++;
+    }
+    xSemaphoreGive(cache_mutex);
+    return action;
+}
+
+void mesh_cache_release(uint8_t link) {
+    mesh_cache_t *m = &caches[link];
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    if (m->readers) {
+        m->readers--;
+    }
+    xSemaphoreGive(cache_mutex);
+}
+
+const uint8_t *mesh_cache_peek(uint8_t link, mesh_cache_cursor_t *cur, uint16_t *len, bool *done) {
+    mesh_cache_t *m = &caches[link];
+    const uint8_t *next = NULL;
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    check_capture_timeout(m);
+    if (cur->off == 0) {
+        while (cur->rec < m->used && (m->cache[cur->rec] & REC_DEAD)) {
+            cur->rec += REC_HDR_LEN + rec_frame_len(m, cur->rec);
+        }
+    }
+    if (cur->rec < m->used) {
+        next = m->cache + cur->rec + REC_HDR_LEN + cur->off;
+        *len = rec_frame_len(m, cur->rec) - cur->off;
+    }
+    *done = !next && m->state != CACHE_CAPTURING;
+    xSemaphoreGive(cache_mutex);
+    return next;
+}
+
+void mesh_cache_advance(uint8_t link, mesh_cache_cursor_t *cur, uint16_t sent) {
+    mesh_cache_t *m = &caches[link];
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    cur->off += sent;
+    if (cur->off >= rec_frame_len(m, cur->rec)) {
+        cur->rec += REC_HDR_LEN + rec_frame_len(m, cur->rec);
+        cur->off = 0;
+    }
+    xSemaphoreGive(cache_mutex);
+}
+
+uint16_t mesh_config_complete_frame(uint32_t config_id, uint8_t *frame) {
+    uint16_t len = MESHTASTIC_HEADER_LEN;
+    frame[len++] = FROMRADIO_CONFIG_COMPLETE << 3;
+    do {
+        frame[len] = config_id & 0x7F;
+        config_id >>= 7;
+        frame[len++] |= config_id ? 0x80 : 0;
+    } while (config_id);
+
+    frame[0] = MESHTASTIC_START1;
+    frame[1] = MESHTASTIC_START2;
+    frame[2] = 0;
+    frame[3] = len - MESHTASTIC_HEADER_LEN;
+    return len;
+}
+
+void mesh_cache_get_stats(uint8_t link, mesh_cache_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (!cache_mutex || link >= BLE_PROXY_MAX_LINKS) {
+        return;
+    }
+    mesh_cache_t *m = &caches[link];
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    out->valid = m->state == CACHE_VALID && !m->stale;
+    out->capturing = m->state == CACHE_CAPTURING;
+    out->bytes = m->used;
+    for (uint32_t rec = 0; rec < m->used; rec += REC_HDR_LEN + rec_frame_len(m, rec)) {
+        out->records += !(m->cache[rec] & REC_DEAD);
+    }
+    out->readers = m->readers;
+    out->hits = m->hits;
+    out->captures = m->captures;
+    out->overflow_drops = m->overflow_drops;
+    out->age_s = m->state == CACHE_VALID ? (uint32_t)((esp_timer_get_time() - m->captured_us) / 1000000) : 0;
+    xSemaphoreGive(cache_mutex);
+}
@@ -4,23 +4,92 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
-#include "host/ble_gap.h"
-#include "host/ble_att.h"
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "esp_timer.h"
+#include "esp_vfs_eventfd.h"
+#include "os/os_mbuf.h"
 
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 
 static const char *TAG = "TCP_PROXY";
-static volatile bool proxy_running = false;
 static TaskHandle_t tcp_task_handle = NULL;
-static int server_sock = -1;
+static portMUX_TYPE task_lock = portMUX_INITIALIZER_UNLOCKED;
 // Reduce memory usage for ESP32-C3
-#define TCP_BUFFER_SIZE 128  // Further reduced for C3
-#define MAX_CLIENTS 2        // Reduce from 4 to 2
-static int clients[MAX_CLIENTS] = {-1, -1};
-static SemaphoreHandle_t clients_mutex = NULL;
+#define TCP_BUFFER_SIZE 512  // One read, written out as the BLE link takes it
+#define MAX_CLIENTS 4        // Shared by all links, needs CONFIG_LWIP_MAX_SOCKETS headroom next to httpd
+
+// BLE to TCP fan-out. Each notification is copied once into an mbuf from
+// our own pool (the host msys pool is only a few blocks) and shared by all
+// clients through a ring; an entry is freed once every client has sent it.
+#define FANOUT_SLOTS 32
+#define FANOUT_BLOCK_SIZE 256
+#define FANOUT_BLOCKS 32
+#define FANOUT_MEMBLOCK_SIZE (FANOUT_BLOCK_SIZE + sizeof(struct os_mbuf) + sizeof(struct os_mbuf_pkthdr))
+#define CLIENT_QUEUE_MAX 24     // Backlog before a client loses its oldest entries
+#define CLIENT_STALL_MS 5000    // A client with data queued that accepts nothing this long is closed
+
+typedef struct {
+    struct os_mbuf *om;
+    uint8_t refs;               // Clients that still have to send it
+} fanout_entry_t;
+
+typedef struct {
+    int fd;
+    uint8_t link;               // Radio behind the port it connected to
+    uint32_t next;              // Sequence of the next entry to send
+    uint16_t offset;            // Bytes of that entry already sent
+    int64_t progress_us;        // Last send that made progress, or data queued when idle
+    bool closing;               // Evicted by forward(), holds no entries, the TCP task closes it
+    // Meshtastic frame being assembled, the payload goes to frame_bufs
+    uint8_t hdr[MESHTASTIC_HEADER_LEN];
+    uint8_t hdr_len;
+    uint16_t frame_len;
+    uint16_t frame_have;
+    // Cached config sent ahead of live traffic after want_config_id
+    bool replaying;
+    mesh_cache_cursor_t cursor;
+    uint8_t done[10];           // This client's config_complete_id frame
+    uint8_t done_len;
+    uint8_t done_off;
+} tcp_client_t;
+
+// One listener per BLE link. The host task only flips enabled and bumps
+// generation; the TCP task opens and closes the port to match, so a radio
+// reconnecting on the same link never inherits the old clients.
+typedef struct {
+    volatile bool enabled;
+    volatile uint32_t generation;
+    uint32_t open_generation;
+    int server_sock;
+    fanout_entry_t ring[FANOUT_SLOTS];
+    uint32_t ring_head;         // Sequence of the next entry pushed
+    uint32_t ring_tail;         // Oldest entry still held
+    tcp_proxy_stats_t stats;
+    uint32_t last_traffic;
+
+    // TCP to BLE data read but not yet taken by the link. The link's clients
+    // are not read while it is pending, so a full link pushes back on their
+    // TCP windows. On a Meshtastic radio it is one whole frame, left in the
+    // client's frame buffer.
+    uint8_t uplink_buf[TCP_BUFFER_SIZE];
+    const uint8_t *uplink_data;
+    uint16_t uplink_len;
+    uint16_t uplink_off;
+    bool uplink_framed;
+} tcp_link_t;
+
+static tcp_client_t clients[MAX_CLIENTS] = {[0 ... MAX_CLIENTS - 1] = {.fd = -1}};
+static tcp_link_t links[BLE_PROXY_MAX_LINKS] = {[0 ... BLE_PROXY_MAX_LINKS - 1] = {.server_sock = -1}};
+static SemaphoreHandle_t clients_mutex = NULL;     // Rings and client cursors
+static int wake_fd = -1;        // Wakes the select loop when entries arrive
+static struct os_mempool fanout_mempool;
+static struct os_mbuf_pool fanout_pool;
+static os_membuf_t *fanout_mem = NULL;
+static uint8_t frame_bufs[MAX_CLIENTS][MESHTASTIC_FRAME_MAX];
 
 // Thread-safe client management
 static void lock_clients(void) {
@@ -35,165 +104,646 @@ static void unlock_clients(void) {
     }
 }
 
+// One client finished or gave up on entry seq, caller holds the lock
+static void release_entry(tcp_link_t *l, uint32_t seq) {
+    fanout_entry_t *e = &l->ring[seq % FANOUT_SLOTS];
+    if (e->refs && --e->refs == 0) {
+        os_mbuf_free_chain(e->om);
+        e->om = NULL;
+    }
+    while (l->ring_tail != l->ring_head && !l->ring[l->ring_tail % FANOUT_SLOTS].om) {
+        l->ring_tail++;
+    }
+}
+
+// Client still taking entries from link, caller holds the lock
+static bool client_on(int idx, uint8_t link) {
+    return clients[idx].fd >= 0 && !clients[idx].closing && clients[idx].link == link;
+}
+
 static void close_client(int idx) {
-    if (idx >= 0 && idx < MAX_CLIENTS && clients[idx] >= 0) {
-        close(clients[idx]);
-        clients[idx] = -1;
+    if (idx >= 0 && idx < MAX_CLIENTS && clients[idx].fd >= 0) {
+        tcp_link_t *l = &links[clients[idx].link];
+
+        // Detach under the lock so forward() can't hand this client a reference
+        lock_clients();
+        if (!clients[idx].closing) {
+            for (uint32_t seq = clients[idx].next; seq != l->ring_head; seq++) {
+                release_entry(l, seq);
+            }
+        }
+        int fd = clients[idx].fd;
+        clients[idx].fd = -1;
+        clients[idx].closing = false;
+        unlock_clients();
+
+        if (clients[idx].replaying) {
+            clients[idx].replaying = false;
+            mesh_cache_release(clients[idx].link);
+        }
+        close(fd);
         ESP_LOGI(TAG, "Client %d disconnected", idx);
     }
 }
 
-// Thread-safe BLE data forwarding
-void tcp_forward_ble_data(uint8_t *data, uint16_t len) {
-    if (!proxy_running || !data || len == 0) {
-        ESP_LOGW(TAG, "Cannot forward: proxy=%d, data=%p, len=%d",
-                proxy_running, data, len);
-        return;
+// Skip whole entries a client has not started, caller holds the lock
+static void drop_entries(tcp_client_t *c, uint32_t count) {
+    tcp_link_t *l = &links[c->link];
+    while (count-- && c->next != l->ring_head && c->offset == 0) {
+        release_entry(l, c->next++);
+        l->stats.client_drops++;
+    }
+}
+
+// Give up on a client part way through the oldest entry so the ring can move
+// for everyone else, caller holds the lock
+static void evict_client(int idx) {
+    tcp_client_t *c = &clients[idx];
+    tcp_link_t *l = &links[c->link];
+    while (c->next != l->ring_head) {
+        release_entry(l, c->next++);
     }
+    c->offset = 0;
+    c->closing = true;
+    l->stats.slow_closes++;
+}
 
-    ESP_LOGI(TAG, "Forwarding %d bytes from BLE to TCP clients", len);
-    ESP_LOG_BUFFER_HEX(TAG, data, len < 16 ? len : 16);
+// Runs on the NimBLE host task: copy once, queue for every client, never block
+// on sockets. The data comes from om or, if that is NULL, from data; framed
+// puts the Meshtastic stream header in front.
+static bool forward(uint8_t link, const struct os_mbuf *om, const uint8_t *data, uint16_t len, bool framed) {
+    if (link >= BLE_PROXY_MAX_LINKS || !fanout_mem || !clients_mutex || len == 0) {
+        return false;
+    }
+    tcp_link_t *l = &links[link];
 
     lock_clients();
-    int sent_count = 0;
+    uint8_t attached = 0;
+    uint8_t idle = 0;           // Clients with nothing queued before this entry
     for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clients[i] >= 0) {
-            int n = send(clients[i], data, len, MSG_NOSIGNAL);
-            if (n < 0) {
-                ESP_LOGW(TAG, "Client %d send failed: %s", i, strerror(errno));
-                close_client(i);
-            } else if (n != len) {
-                ESP_LOGW(TAG, "Client %d partial send: %d/%d bytes", i, n, len);
-            } else {
-                ESP_LOGI(TAG, "Sent %d bytes to client %d", n, i);
-                sent_count++;
+        if (client_on(i, link)) {
+            attached++;
+            if (clients[i].next == l->ring_head && !clients[i].replaying) {
+                idle |= 1 << i;
             }
         }
     }
-    if (sent_count == 0) {
-        ESP_LOGW(TAG, "No clients to forward BLE data to!");
+    if (!attached) {
+        unlock_clients();
+        ESP_LOGD(TAG, "No clients for %u bytes from link %u", len, link);
+        return false;
     }
-    unlock_clients();
-}
 
-static void close_all_connections(void) {
-    lock_clients();
-    if (server_sock >= 0) {
-        close(server_sock);
-        server_sock = -1;
-        ESP_LOGI(TAG, "Server socket closed");
+    // Ring full: clients still on the oldest entry skip it, or lose the
+    // connection if they are part way through it
+    if (l->ring_head - l->ring_tail == FANOUT_SLOTS) {
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (client_on(i, link) && clients[i].next == l->ring_tail) {
+                if (clients[i].offset == 0) {
+                    drop_entries(&clients[i], 1);
+                } else {
+                    ESP_LOGW(TAG, "Client %d stuck part way through the oldest entry, closing", i);
+                    evict_client(i);
+                    attached--;
+                }
+            }
+        }
+    }
+    if (!attached) {
+        unlock_clients();
+        return false;
+    }
+    if (l->ring_head - l->ring_tail == FANOUT_SLOTS) {
+        unlock_clients();
+        l->stats.pool_drops++;
+        ESP_LOGW(TAG, "Fan-out ring full, dropped %u bytes", len);
+        return false;
+    }
+
+    const uint8_t header[MESHTASTIC_HEADER_LEN] = { MESHTASTIC_START1, MESHTASTIC_START2, len >> 8, len & 0xFF };
+    struct os_mbuf *copy = os_mbuf_get_pkthdr(&fanout_pool, 0);
+    if (!copy || (framed && os_mbuf_append(copy, header, sizeof(header)) != 0) ||
+        (om ? os_mbuf_appendfrom(copy, om, 0, len) : os_mbuf_append(copy, data, len)) != 0) {
+        if (copy) {
+            os_mbuf_free_chain(copy);
+        }
+        unlock_clients();
+        l->stats.pool_drops++;
+        ESP_LOGW(TAG, "Fan-out pool exhausted, dropped %u bytes", len);
+        return false;
     }
 
+    l->ring[l->ring_head % FANOUT_SLOTS] = (fanout_entry_t){ .om = copy, .refs = attached };
+    l->ring_head++;
+    l->stats.notifications++;
+
+    // The stall clock only runs while something is queued
+    int64_t now = esp_timer_get_time();
     for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clients[i] >= 0) {
-            close_client(i);
+        if (idle & (1 << i)) {
+            clients[i].progress_us = now;
+        }
+    }
+
+    // Bound each client's backlog by dropping its oldest unstarted entries
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        uint32_t backlog = l->ring_head - clients[i].next;
+        if (client_on(i, link) && backlog > CLIENT_QUEUE_MAX) {
+            drop_entries(&clients[i], backlog - CLIENT_QUEUE_MAX);
         }
     }
     unlock_clients();
+
+    tcp_proxy_wake();
+    return true;
 }
 
-static bool add_client(int client_fd) {
+void tcp_forward_ble_data(uint8_t link, const struct os_mbuf *om) {
+    forward(link, om, NULL, om ? OS_MBUF_PKTLEN(om) : 0, false);
+}
+
+void tcp_forward_from_radio(uint8_t link, const uint8_t *data, uint16_t len) {
+    // Captured config goes only to the clients replaying it
+    if (!mesh_cache_from_radio(link, data, len)) {
+        tcp_proxy_wake();
+        return;
+    }
+    if (forward(link, NULL, data, len, true)) {
+        links[link].stats.frames_out++;
+    }
+}
+
+void tcp_proxy_wake(void) {
+    if (wake_fd >= 0) {
+        uint64_t one = 1;
+        write(wake_fd, &one, sizeof(one));
+    }
+}
+
+// Hand pending uplink data to the BLE writer
+static void flush_uplink(uint8_t link) {
+    tcp_link_t *l = &links[link];
+    if (l->uplink_off == l->uplink_len) {
+        return;
+    }
+    // Held while a dropped radio is reconnected, it goes out once the link is back
+    if (!ble_proxy_gatt_ready(link)) {
+        return;
+    }
+
+    int n = l->uplink_framed ? ble_proxy_write_frame(link, l->uplink_data, l->uplink_len) :
+                               ble_proxy_write(link, l->uplink_data + l->uplink_off, l->uplink_len - l->uplink_off);
+    if (n < 0) {
+        ESP_LOGW(TAG, "Link %u not writable, dropped %u bytes", link, l->uplink_len - l->uplink_off);
+        l->uplink_off = l->uplink_len;
+    } else {
+        l->uplink_off += n;
+        l->stats.frames_in += l->uplink_framed && n > 0;
+    }
+    if (l->uplink_off == l->uplink_len) {
+        l->uplink_off = l->uplink_len = 0;
+    }
+}
+
+// The header bytes so far can start a frame
+static bool header_valid(const tcp_client_t *c) {
+    return c->hdr[0] == MESHTASTIC_START1 &&
+           (c->hdr_len < 2 || c->hdr[1] == MESHTASTIC_START2) &&
+           (c->hdr_len < 4 || ((c->hdr[2] << 8) | c->hdr[3]) <= MESHTASTIC_FRAME_MAX);
+}
+
+// Read toward the client's next Meshtastic frame, never past its end, so
+// the following frame stays in the socket while this one waits for the
+// link. Returns the recv() result, complete once the payload is whole.
+static int recv_frame(int idx, bool *complete) {
+    tcp_client_t *c = &clients[idx];
+    *complete = false;
+
+    if (c->hdr_len < MESHTASTIC_HEADER_LEN) {
+        int n = recv(c->fd, c->hdr + c->hdr_len, MESHTASTIC_HEADER_LEN - c->hdr_len, 0);
+        if (n <= 0) {
+            return n;
+        }
+        // Wake bytes and garbage are skipped until a plausible header lines up
+        c->hdr_len += n;
+        while (c->hdr_len && !header_valid(c)) {
+            memmove(c->hdr, c->hdr + 1, --c->hdr_len);
+            links[c->link].stats.resync_bytes++;
+        }
+        if (c->hdr_len == MESHTASTIC_HEADER_LEN) {
+            c->frame_len = (c->hdr[2] << 8) | c->hdr[3];
+            c->frame_have = 0;
+            if (c->frame_len == 0) {
+                c->hdr_len = 0;
+            }
+        }
+        return n;
+    }
+
+    int n = recv(c->fd, frame_bufs[idx] + c->frame_have, c->frame_len - c->frame_have, 0);
+    if (n > 0) {
+        c->frame_have += n;
+        if (c->frame_have == c->frame_len) {
+            c->hdr_len = 0;
+            *complete = true;
+        }
+    }
+    return n;
+}
+
+// Answer a want_config_id, false if it has to go to the radio
+static bool start_replay(tcp_client_t *c, uint32_t config_id) {
+    if (c->replaying) {
+        // Repeated request, the replay under way answers it
+        if (c->done_off == 0) {
+            c->done_len = mesh_config_complete_frame(config_id, c->done);
+        }
+        return true;
+    }
+
+    mesh_config_action_t action = mesh_cache_want_config(c->link);
+    if (action == MESH_CONFIG_FORWARD) {
+        return false;
+    }
+    c->replaying = true;
+    c->cursor = (mesh_cache_cursor_t){0};
+    c->done_len = mesh_config_complete_frame(config_id, c->done);
+    c->done_off = 0;
+    return action == MESH_CONFIG_CACHED;
+}
+
+// Replay bytes are ready to send
+static bool replay_ready(tcp_client_t *c) {
+    uint16_t len;
+    bool done;
+    return c->replaying && (mesh_cache_peek(c->link, &c->cursor, &len, &done) || done);
+}
+
+// Send the cached config, then the completion, false if the client is gone
+static bool drain_replay(int idx) {
+    tcp_client_t *c = &clients[idx];
+    while (c->replaying) {
+        uint16_t len;
+        bool done;
+        const uint8_t *data = mesh_cache_peek(c->link, &c->cursor, &len, &done);
+        if (!data && !done) {
+            // Capture still arriving, not a stall
+            c->progress_us = esp_timer_get_time();
+            return true;
+        }
+        if (!data) {
+            data = c->done + c->done_off;
+            len = c->done_len - c->done_off;
+        }
+
+        int n = send(c->fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ESP_LOGW(TAG, "Client %d send failed: %s", idx, strerror(errno));
+                return false;
+            }
+            return true;
+        }
+        c->progress_us = esp_timer_get_time();
+        links[c->link].stats.bytes_sent += n;
+
+        if (done) {
+            c->done_off += n;
+            if (c->done_off == c->done_len) {
+                c->replaying = false;
+                mesh_cache_release(c->link);
+                ESP_LOGI(TAG, "Client %d config replay complete", idx);
+            }
+        } else {
+            mesh_cache_advance(c->link, &c->cursor, n);
+        }
+        if (n < len) {
+            return true;
+        }
+    }
+    return true;
+}
+
+// Send what the socket takes without blocking, false if the client is gone
+static bool drain_client(int idx) {
+    tcp_client_t *c = &clients[idx];
+    tcp_link_t *l = &links[c->link];
+    bool alive = true;
+
+    if (c->closing) {
+        return false;
+    }
+
+    // Live traffic waits behind a config replay
+    if (c->replaying && !drain_replay(idx)) {
+        return false;
+    }
+
     lock_clients();
-    bool added = false;
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clients[i] < 0) {
-            clients[i] = client_fd;
-            ESP_LOGI(TAG, "Client %d connected (fd=%d)", i, client_fd);
-            added = true;
+    while (!c->replaying && c->next != l->ring_head) {
+        fanout_entry_t *e = &l->ring[c->next % FANOUT_SLOTS];
+        struct os_mbuf *m = e->om;
+        uint16_t skip = c->offset;
+        while (m && skip >= m->om_len) {
+            skip -= m->om_len;
+            m = SLIST_NEXT(m, om_next);
+        }
+
+        bool blocked = false;
+        while (m) {
+            int want = m->om_len - skip;
+            int n = send(c->fd, m->om_data + skip, want, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n < 0) {
+                alive = errno == EAGAIN || errno == EWOULDBLOCK;
+                if (!alive) {
+                    ESP_LOGW(TAG, "Client %d send failed: %s", idx, strerror(errno));
+                }
+                blocked = true;
+                break;
+            }
+            c->offset += n;
+            c->progress_us = esp_timer_get_time();
+            l->stats.bytes_sent += n;
+            if (n < want) {
+                blocked = true;
+                break;
+            }
+            skip = 0;
+            m = SLIST_NEXT(m, om_next);
+        }
+        if (blocked) {
             break;
         }
+
+        c->offset = 0;
+        release_entry(l, c->next++);
+    }
+
+    if (alive && (c->next != l->ring_head || c->replaying) &&
+        esp_timer_get_time() - c->progress_us > CLIENT_STALL_MS * 1000LL) {
+        ESP_LOGW(TAG, "Client %d stalled with %lu entries queued", idx, l->ring_head - c->next);
+        l->stats.slow_closes++;
+        alive = false;
     }
     unlock_clients();
-    return added;
+    return alive;
 }
 
-static void tcp_task(void *param) {
-    ESP_LOGI(TAG, "TCP proxy starting (optimized for ESP32-C3)...");
+// Close a link's port and its clients, dropping what they had queued
+static void close_link(uint8_t link) {
+    tcp_link_t *l = &links[link];
+    if (l->server_sock >= 0) {
+        close(l->server_sock);
+        l->server_sock = -1;
+        ESP_LOGI(TAG, "Port %d closed", BLE_PROXY_BASE_PORT + link);
+    }
 
-    // Create mutex for client management
-    clients_mutex = xSemaphoreCreateMutex();
-    if (!clients_mutex) {
-        ESP_LOGE(TAG, "Failed to create clients mutex");
-        proxy_running = false;
-        vTaskDelete(NULL);
-        return;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0 && clients[i].link == link) {
+            close_client(i);
+        }
     }
 
-    // Initialize client array
+    // Entries pushed with no client left to send them
     lock_clients();
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        clients[i] = -1;
+    while (l->ring_tail != l->ring_head) {
+        fanout_entry_t *e = &l->ring[l->ring_tail++ % FANOUT_SLOTS];
+        os_mbuf_free_chain(e->om);
+        *e = (fanout_entry_t){0};
     }
     unlock_clients();
+    l->uplink_len = l->uplink_off = 0;
+}
+
+// Listen on the link's port, false with the link disabled if that fails
+static bool open_link(uint8_t link) {
+    tcp_link_t *l = &links[link];
+    uint16_t port = BLE_PROXY_BASE_PORT + link;
+
+    lock_clients();
+    l->ring_head = l->ring_tail = 0;
+    memset(&l->stats, 0, sizeof(l->stats));
+    l->uplink_data = l->uplink_buf;
+    l->uplink_len = l->uplink_off = 0;
+    l->open_generation = l->generation;
+    unlock_clients();
 
     // Create server socket
-    server_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_sock < 0) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
         ESP_LOGE(TAG, "Failed to create server socket: %s", strerror(errno));
-        proxy_running = false;
-        vTaskDelete(NULL);
-        return;
+        l->enabled = false;
+        return false;
     }
 
     // Set socket options
     int opt = 1;
-    if (setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         ESP_LOGW(TAG, "Failed to set SO_REUSEADDR: %s", strerror(errno));
     }
 
     // Set non-blocking mode for accept
-    int flags = fcntl(server_sock, F_GETFL, 0);
+    int flags = fcntl(sock, F_GETFL, 0);
     if (flags >= 0) {
-        fcntl(server_sock, F_SETFL, flags | O_NONBLOCK);
+        fcntl(sock, F_SETFL, flags | O_NONBLOCK);
     }
 
     // Bind to address
     struct sockaddr_in addr = {
         .sin_family = AF_INET,
-        .sin_port = htons(4403),
+        .sin_port = htons(port),
         .sin_addr.s_addr = INADDR_ANY
     };
 
-    if (bind(server_sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        ESP_LOGE(TAG, "Failed to bind to port 4403: %s", strerror(errno));
-        close(server_sock);
-        server_sock = -1;
-        proxy_running = false;
-        vTaskDelete(NULL);
-        return;
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        ESP_LOGE(TAG, "Failed to bind to port %u: %s", port, strerror(errno));
+        close(sock);
+        l->enabled = false;
+        return false;
     }
 
     // Listen for connections
-    if (listen(server_sock, MAX_CLIENTS) < 0) {
+    if (listen(sock, MAX_CLIENTS) < 0) {
         ESP_LOGE(TAG, "Failed to listen: %s", strerror(errno));
-        close(server_sock);
-        server_sock = -1;
-        proxy_running = false;
+        close(sock);
+        l->enabled = false;
+        return false;
+    }
+
+    l->server_sock = sock;
+    ESP_LOGI(TAG, "📡 TCP proxy listening on :%u for link %u - Ready for Meshtastic apps", port, link);
+    return true;
+}
+
+// Bring the ports in line with the links the BLE side has enabled,
+// returns how many are open
+static int sync_links(void) {
+    int open = 0;
+    for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+        tcp_link_t *l = &links[i];
+        if (l->server_sock >= 0 && (!l->enabled || l->open_generation != l->generation)) {
+            close_link(i);
+        }
+        if (l->enabled && l->server_sock < 0) {
+            open_link(i);
+        }
+        open += l->server_sock >= 0;
+    }
+    return open;
+}
+
+static bool add_client(uint8_t link, int client_fd) {
+    bool added = false;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].fd < 0) {
+            // Writes are non-blocking, the select loop waits for room
+            int flags = fcntl(client_fd, F_GETFL, 0);
+            if (flags >= 0) {
+                fcntl(client_fd, F_SETFL, flags | O_NONBLOCK);
+            }
+
+            lock_clients();
+            clients[i] = (tcp_client_t){
+                .fd = client_fd,
+                .link = link,
+                .next = links[link].ring_head,
+                .progress_us = esp_timer_get_time()
+            };
+            unlock_clients();
+            ESP_LOGI(TAG, "Client %d connected to link %u (fd=%d)", i, link, client_fd);
+            added = true;
+            break;
+        }
+    }
+    return added;
+}
+
+// Buffers for the fan-out, kept once allocated since NimBLE registers the pool
+static esp_err_t init_fanout_pool(void) {
+    if (fanout_mem) {
+        return ESP_OK;
+    }
+
+    fanout_mem = malloc(OS_MEMPOOL_BYTES(FANOUT_BLOCKS, FANOUT_MEMBLOCK_SIZE));
+    if (!fanout_mem) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (os_mempool_init(&fanout_mempool, FANOUT_BLOCKS, FANOUT_MEMBLOCK_SIZE,
+                        fanout_mem, "tcp_fanout") != 0 ||
+        os_mbuf_pool_init(&fanout_pool, &fanout_mempool, FANOUT_MEMBLOCK_SIZE, FANOUT_BLOCKS) != 0) {
+        free(fanout_mem);
+        fanout_mem = NULL;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void tcp_proxy_get_stats(uint8_t link, tcp_proxy_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (link >= BLE_PROXY_MAX_LINKS) {
+        return;
+    }
+    tcp_link_t *l = &links[link];
+
+    lock_clients();
+    *out = l->stats;
+    out->port = BLE_PROXY_BASE_PORT + link;
+    out->listening = l->server_sock >= 0;
+    out->clients = 0;
+    out->backlog = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (client_on(i, link)) {
+            out->clients++;
+            if (l->ring_head - clients[i].next > out->backlog) {
+                out->backlog = l->ring_head - clients[i].next;
+            }
+        }
+    }
+    unlock_clients();
+}
+
+// Task exits once no link is enabled, unless a start raced in
+static bool task_may_exit(void) {
+    bool idle = true;
+    taskENTER_CRITICAL(&task_lock);
+    for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+        idle &= !links[i].enabled;
+    }
+    if (idle) {
+        tcp_task_handle = NULL;
+    }
+    taskEXIT_CRITICAL(&task_lock);
+    return idle;
+}
+
+static void tcp_task(void *param) {
+    ESP_LOGI(TAG, "TCP proxy starting (optimized for ESP32-C3)...");
+
+    // Create mutex for client management, kept for the next start
+    if (!clients_mutex) {
+        clients_mutex = xSemaphoreCreateMutex();
+    }
+
+    esp_vfs_eventfd_config_t eventfd_cfg = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    esp_err_t err = esp_vfs_eventfd_register(&eventfd_cfg);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to register eventfd: %s", esp_err_to_name(err));
+    }
+    if (wake_fd < 0) {
+        wake_fd = eventfd(0, 0);
+    }
+    if (!clients_mutex || wake_fd < 0 || init_fanout_pool() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up BLE fan-out");
+        for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+            links[i].enabled = false;
+        }
+        task_may_exit();
         vTaskDelete(NULL);
         return;
     }
 
-    proxy_running = true;
-    ESP_LOGI(TAG, "📡 TCP proxy listening on :4403 - Ready for Meshtastic apps");
+    // Main proxy loop, one select over every link's port and clients
+    while (1) {
+        if (sync_links() == 0 && task_may_exit()) {
+            break;
+        }
 
-    // Main proxy loop
-    while (proxy_running) {
-        fd_set read_fds, except_fds;
+        ble_conn_snapshot_t conn[BLE_PROXY_MAX_LINKS];
+        fd_set read_fds, write_fds, except_fds;
         FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
         FD_ZERO(&except_fds);
 
-        FD_SET(server_sock, &read_fds);
-        FD_SET(server_sock, &except_fds);
-        int maxfd = server_sock;
+        FD_SET(wake_fd, &read_fds);
+        int maxfd = wake_fd;
+        for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+            ble_proxy_get_snapshot(i, &conn[i]);
+            if (links[i].server_sock >= 0) {
+                FD_SET(links[i].server_sock, &read_fds);
+                FD_SET(links[i].server_sock, &except_fds);
+                if (links[i].server_sock > maxfd) {
+                    maxfd = links[i].server_sock;
+                }
+            }
+        }
 
-        // Add client sockets to fd_set
+        // Add client sockets to fd_set, waiting for room only where data is queued
+        // and reading only once the last uplink data of their link has gone out
+        // and the link is ready, so clients of a reconnecting radio just wait.
+        // Only this task changes the fds, the lock guards the ring cursors.
         lock_clients();
         for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (clients[i] >= 0) {
-                FD_SET(clients[i], &read_fds);
-                FD_SET(clients[i], &except_fds);
-                if (clients[i] > maxfd) {
-                    maxfd = clients[i];
+            if (clients[i].fd >= 0) {
+                tcp_link_t *l = &links[clients[i].link];
+                if (l->uplink_len == 0 && conn[clients[i].link].ready) {
+                    FD_SET(clients[i].fd, &read_fds);
+                }
+                FD_SET(clients[i].fd, &except_fds);
+                if (clients[i].replaying ? replay_ready(&clients[i]) : clients[i].next != l->ring_head) {
+                    FD_SET(clients[i].fd, &write_fds);
+                }
+                if (clients[i].fd > maxfd) {
+                    maxfd = clients[i].fd;
                 }
             }
         }
@@ -201,153 +751,175 @@ static void tcp_task(void *param) {
 
         // Wait for activity with timeout
         struct timeval tv = {.tv_sec = 1, .tv_usec = 0};
-        int activity = select(maxfd + 1, &read_fds, NULL, &except_fds, &tv);
+        int activity = select(maxfd + 1, &read_fds, &write_fds, &except_fds, &tv);
 
         if (activity < 0) {
             if (errno != EINTR) {
                 ESP_LOGE(TAG, "Select error: %s", strerror(errno));
-                break;
+                vTaskDelay(pdMS_TO_TICKS(100));
             }
             continue;
         }
 
+        if (FD_ISSET(wake_fd, &read_fds)) {
+            uint64_t count;
+            read(wake_fd, &count, sizeof(count));
+        }
+
+        for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+            tcp_link_t *l = &links[i];
+            if (l->server_sock < 0) {
+                continue;
+            }
+
+            // Credits may have come back
+            flush_uplink(i);
+
+            // Link parameters follow traffic in either direction
+            ble_tx_stats_t tx_stats;
+            ble_proxy_get_tx_stats(i, &tx_stats);
+            uint32_t traffic = l->stats.notifications + tx_stats.bytes;
+            ble_proxy_link_tick(i, traffic != l->last_traffic);
+            l->last_traffic = traffic;
+        }
+
+        // Push queued notifications, also on timeout so stalled clients get noticed
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0 && !drain_client(i)) {
+                close_client(i);
+            }
+        }
+
         if (activity == 0) {
-            continue; // Timeout - check proxy_running
+            continue; // Timeout - check the links again
         }
 
-        // Handle new connections
-        if (FD_ISSET(server_sock, &read_fds)) {
-            struct sockaddr_in client_addr;
-            socklen_t addr_len = sizeof(client_addr);
-            int client_fd = accept(server_sock, (struct sockaddr*)&client_addr, &addr_len);
+        // Handle new connections and server socket exceptions
+        for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+            int server_sock = links[i].server_sock;
+            if (server_sock < 0) {
+                continue;
+            }
 
-            if (client_fd >= 0) {
-                if (!add_client(client_fd)) {
-                    ESP_LOGW(TAG, "Max clients reached, rejecting connection");
-                    close(client_fd);
-                } else {
-                    ESP_LOGI(TAG, "Client connected from %s:%d",
-                             inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+            if (FD_ISSET(server_sock, &read_fds)) {
+                struct sockaddr_in client_addr;
+                socklen_t addr_len = sizeof(client_addr);
+                int client_fd = accept(server_sock, (struct sockaddr*)&client_addr, &addr_len);
+
+                if (client_fd >= 0) {
+                    if (!add_client(i, client_fd)) {
+                        ESP_LOGW(TAG, "Max clients reached, rejecting connection");
+                        close(client_fd);
+                    } else {
+                        ESP_LOGI(TAG, "Client connected from %s:%d",
+                                 inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+                    }
+                } else if (errno != EWOULDBLOCK && errno != EAGAIN) {
+                    ESP_LOGW(TAG, "Accept failed: %s", strerror(errno));
                 }
-            } else if (errno != EWOULDBLOCK && errno != EAGAIN) {
-                ESP_LOGW(TAG, "Accept failed: %s", strerror(errno));
             }
-        }
 
-        // Handle server socket exceptions
-        if (FD_ISSET(server_sock, &except_fds)) {
-            ESP_LOGE(TAG, "Server socket exception");
-            break;
+            // Reopened on the next pass while the link stays enabled
+            if (FD_ISSET(server_sock, &except_fds)) {
+                ESP_LOGE(TAG, "Server socket exception on link %d", i);
+                close_link(i);
+            }
         }
 
         // Handle client data and exceptions
-        lock_clients();
         for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (clients[i] < 0) continue;
+            if (clients[i].fd < 0) continue;
 
             // Check for exceptions first
-            if (FD_ISSET(clients[i], &except_fds)) {
+            if (FD_ISSET(clients[i].fd, &except_fds)) {
                 ESP_LOGW(TAG, "Client %d exception", i);
                 close_client(i);
                 continue;
             }
 
-            // Handle client data with proper chunking
-            if (FD_ISSET(clients[i], &read_fds)) {
-                uint8_t buf[TCP_BUFFER_SIZE];
-                int n = recv(clients[i], buf, sizeof(buf), 0);
-
-                if (n > 0) {
-                    ESP_LOGD(TAG, "TCP->BLE: %d bytes", n);
-
-                    // Chunk for BLE MTU (important from NimBLE docs)
-                    size_t offset = 0;
-                    size_t mtu_size = 20;  // Default, will be updated
-
-                    // Get actual MTU if available from BLE proxy
-                    ble_connection_t conn_info;
-                    if (ble_proxy_get_connection_info(&conn_info) == ESP_OK &&
-                        conn_info.conn_handle != BLE_HS_CONN_HANDLE_NONE) {
-                        struct ble_gap_conn_desc desc;
-                        if (ble_gap_conn_find(conn_info.conn_handle, &desc) == 0) {
-                            mtu_size = ble_att_mtu(conn_info.conn_handle) - 3;
-                            if (mtu_size > 244) mtu_size = 244;  // Cap at max
-                        }
+            // Read only while nothing is waiting for the BLE link. Meshtastic
+            // radios get whole ToRadio frames, others the raw byte stream.
+            uint8_t link = clients[i].link;
+            tcp_link_t *l = &links[link];
+            if (l->uplink_len == 0 && FD_ISSET(clients[i].fd, &read_fds)) {
+                bool complete = false;
+                int n = conn[link].meshtastic ? recv_frame(i, &complete) :
+                                                recv(clients[i].fd, l->uplink_buf, sizeof(l->uplink_buf), 0);
+
+                if (n > 0 && conn[link].meshtastic) {
+                    // want_config_id is answered from the config cache when it can be
+                    uint32_t config_id;
+                    if (complete && mesh_cache_check_to_radio(link, frame_bufs[i], clients[i].frame_len, &config_id) &&
+                        start_replay(&clients[i], config_id)) {
+                        ESP_LOGI(TAG, "Client %d config request %lu served from cache", i, config_id);
+                        complete = false;
                     }
-
-                    while (offset < n && ble_proxy_is_connected()) {
-                        size_t chunk = MIN(n - offset, mtu_size);
-                        esp_err_t ret = ble_proxy_send_data(buf + offset, chunk);
-                        if (ret != ESP_OK) {
-                            ESP_LOGW(TAG, "BLE send failed at offset %d", offset);
-                            break;
-                        }
-                        offset += chunk;
-                        if (offset < n) {
-                            vTaskDelay(pdMS_TO_TICKS(5));  // Small delay
-                        }
+                    if (complete) {
+                        ESP_LOGD(TAG, "TCP->BLE: frame of %u bytes", clients[i].frame_len);
+                        l->uplink_data = frame_bufs[i];
+                        l->uplink_len = clients[i].frame_len;
+                        l->uplink_framed = true;
+                        flush_uplink(link);
                     }
+                } else if (n > 0) {
+                    ESP_LOGD(TAG, "TCP->BLE: %d bytes", n);
+                    l->uplink_data = l->uplink_buf;
+                    l->uplink_len = n;
+                    l->uplink_framed = false;
+                    flush_uplink(link);
                 } else if (n == 0) {
                     ESP_LOGI(TAG, "Client %d disconnected normally", i);
                     close_client(i);
-                } else {
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
                     ESP_LOGW(TAG, "Client %d recv error: %s", i, strerror(errno));
                     close_client(i);
                 }
             }
         }
-        unlock_clients();
     }
 
-    // Cleanup
-    ESP_LOGI(TAG, "TCP proxy shutting down...");
-    close_all_connections();
-
-    if (clients_mutex) {
-        vSemaphoreDelete(clients_mutex);
-        clients_mutex = NULL;
-    }
-
-    tcp_task_handle = NULL;
     ESP_LOGI(TAG, "TCP proxy task terminated");
     vTaskDelete(NULL);
 }
 
-void start_tcp_proxy(void) {
-    if (proxy_running || tcp_task_handle != NULL) {
-        ESP_LOGW(TAG, "TCP proxy already running");
+void start_tcp_proxy(uint8_t link) {
+    if (link >= BLE_PROXY_MAX_LINKS) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&task_lock);
+    bool was_enabled = links[link].enabled;
+    links[link].enabled = true;
+    bool running = tcp_task_handle != NULL;
+    taskEXIT_CRITICAL(&task_lock);
+
+    if (running) {
+        if (!was_enabled) {
+            ESP_LOGI(TAG, "Starting TCP proxy for link %u...", link);
+        }
+        tcp_proxy_wake();
         return;
     }
 
-    ESP_LOGI(TAG, "Starting TCP proxy...");
+    ESP_LOGI(TAG, "Starting TCP proxy for link %u...", link);
     // Smaller stack for ESP32-C3 (from 8192 to 3072)
     BaseType_t ret = xTaskCreate(tcp_task, "tcp_proxy", 3072, NULL, 5, &tcp_task_handle);
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create TCP proxy task");
         tcp_task_handle = NULL;
+        links[link].enabled = false;
     }
 }
 
-void stop_tcp_proxy(void) {
-    if (!proxy_running && tcp_task_handle == NULL) {
+// Runs on the NimBLE host task from the disconnect event, so it only asks
+// the TCP task to close the port instead of waiting for it
+void stop_tcp_proxy(uint8_t link) {
+    if (link >= BLE_PROXY_MAX_LINKS || !links[link].enabled) {
         return;
     }
 
-    ESP_LOGI(TAG, "Stopping TCP proxy...");
-    proxy_running = false;
-
-    // Wait for task to finish (with timeout)
-    if (tcp_task_handle) {
-        for (int i = 0; i < 50 && tcp_task_handle != NULL; i++) {
-            vTaskDelay(pdMS_TO_TICKS(100));
-        }
-
-        if (tcp_task_handle != NULL) {
-            ESP_LOGW(TAG, "Force terminating TCP proxy task");
-            vTaskDelete(tcp_task_handle);
-            tcp_task_handle = NULL;
-        }
-    }
-
-    ESP_LOGI(TAG, "TCP proxy stopped");
-}
\ No newline at end of file
+    ESP_LOGI(TAG, "Stopping TCP proxy for link %u...", link);
+    links[link].enabled = false;
+    links[link].generation++;
+    tcp_proxy_wake();
+}
@@ -0,0 +1,53 @@
+#ifndef FW_BACKUP_H
+#define FW_BACKUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "swd_flash.h"
+#include "fw_cache.h"
+
+// Full copies of target flash. The range is block read over SWD into the
+// stage area, then stored as a backup entry in
+// the image cache, so blank pages and pages unchanged since an earlier
+// backup cost nothing. Restore programs the entry like any cached image.
+#define FW_BACKUP_MAX       3
+#define FW_BACKUP_DESC_LEN  32
+
+typedef struct {
+    uint8_t sha256[FW_CACHE_SHA_LEN];   // Cache entry holding the pages
+    uint32_t addr;
+    uint32_t size;
+    uint32_t crc32;             // CRC32 of the range as read
+    uint32_t sequence;          // Increases with every backup, 0 marks a free record
+    uint32_t stored_bytes;      // Flash used by pages new in this backup
+    uint16_t page_count;
+    uint16_t shared_pages;      // Pages shared with earlier entries
+    uint16_t blank_pages;
+    uint16_t reserved;
+    char description[FW_BACKUP_DESC_LEN];
+} fw_backup_info_t;
+
+// Load the backup list and register with flash_safety, call after fw_cache_init
+esp_err_t fw_backup_init(void);
+
+// Back up a page aligned range of target flash, target must be connected.
+// The oldest backup is dropped once FW_BACKUP_MAX are held. ESP_ERR_INVALID_STATE
+// while the stage holds a committed image, fw_stage_clear() it first to go ahead.
+esp_err_t fw_backup_create(uint32_t addr, uint32_t size, const char *description,
+                           flash_progress_cb progress, fw_backup_info_t *info);
+
+// Program backup index (0 is the newest) back to the target. Only pages
+// whose target CRC differs from the backup's page table are rewritten.
+esp_err_t fw_backup_restore(int index, flash_progress_cb progress);
+
+// Same, limited to the pages in [addr, addr + size)
+esp_err_t fw_backup_restore_range(int index, uint32_t addr, uint32_t size, flash_progress_cb progress);
+
+// Copy up to max backups, newest first, returns the count
+int fw_backup_list(fw_backup_info_t *backups, int max);
+
+// Remove backup index, its pages go once nothing else shares them
+esp_err_t fw_backup_delete(int index);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef FW_CACHE_H
+#define FW_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "swd_flash.h"
+#include "fw_manifest.h"
+
+// Image cache in the "fwstore" partition after the stage area. Images are
+// keyed by SHA-256 over (page address, page data) of every image page, so the
+// same firmware always maps to the same entry whatever file format it came in.
+// Pages are stored heatshrink compressed, blank pages take no space, and a
+// page already stored at the same address by another entry is shared rather
+// than stored again. The least recently used entries are evicted when space
+// runs out, backup entries only go when their backup is deleted.
+#define FW_CACHE_MAX_ENTRIES    16
+#define FW_CACHE_SHA_LEN        32
+#define FW_CACHE_HS_WINDOW      11
+#define FW_CACHE_HS_LOOKAHEAD   4
+
+typedef struct {
+    uint8_t sha256[FW_CACHE_SHA_LEN];
+    uint16_t page_count;
+    uint32_t image_bytes;       // Data bytes of the original upload
+    uint32_t stored_bytes;      // Flash used by the entry
+    uint32_t last_used;         // Higher is more recent
+    uint16_t shared_pages;      // Pages stored by reference to another entry
+    bool backup;                // Held by a target backup, never evicted
+} fw_cache_info_t;
+
+// Load the index, call after fw_stage_init
+esp_err_t fw_cache_init(void);
+
+// Store the committed stage image, evicting old entries if needed.
+// sha256 receives the image key, an existing entry is just marked used.
+// Backup entries are kept until deleted.
+esp_err_t fw_cache_add_staged(uint8_t sha256[FW_CACHE_SHA_LEN], bool backup);
+
+// Copy up to max entries, most recently used first, returns the count
+int fw_cache_list(fw_cache_info_t *entries, int max);
+
+// Program a cached image, key is a hex SHA-256 or a unique prefix (8+ chars)
+esp_err_t fw_cache_flash(const char *sha_hex, flash_progress_cb progress);
+
+// Program only the pages in [addr, addr + size), and with changed_only only
+// those whose target CRC differs from the page table. Each programmed page
+// must read back with its table CRC, else ESP_ERR_INVALID_CRC.
+esp_err_t fw_cache_flash_range(const char *sha_hex, uint32_t addr, uint32_t size,
+                               bool changed_only, flash_progress_cb progress);
+
+// Copy the page CRC table of a cached image. count receives the page count,
+// ESP_ERR_INVALID_SIZE if it exceeds max.
+esp_err_t fw_cache_get_manifest(const char *sha_hex, fw_page_crc_t *pages, uint16_t max, uint16_t *count);
+
+// Compare a cached image with the target. Differing pages go to changed with
+// their target CRC, count receives how many differ, even beyond max.
+esp_err_t fw_cache_diff_target(const char *sha_hex, fw_page_crc_t *changed, uint16_t max,
+                               uint16_t *count, flash_progress_cb progress);
+
+// Remove a cached image, ESP_ERR_NOT_ALLOWED while a backup holds it
+esp_err_t fw_cache_delete(const char *sha_hex);
+
+// Mark or release an entry as held by a backup
+esp_err_t fw_cache_set_backup(const uint8_t sha256[FW_CACHE_SHA_LEN], bool backup);
+
+// Describe the entry with this key
+esp_err_t fw_cache_get_info(const uint8_t sha256[FW_CACHE_SHA_LEN], fw_cache_info_t *info);
+
+// Total and free cache space in bytes
+void fw_cache_get_space(uint32_t *total, uint32_t *free_bytes);
+
+// Format a key as 64 hex characters
+void fw_cache_sha_to_hex(const uint8_t sha256[FW_CACHE_SHA_LEN], char hex[2 * FW_CACHE_SHA_LEN + 1]);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef FW_MANIFEST_H
+#define FW_MANIFEST_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "swd_flash.h"
+
+// Per-page CRC tables. Every cache entry (and so every backup) keeps one,
+// and the same table can be read from the live target, so changed pages
+// are found without transferring whole images.
+typedef struct {
+    uint32_t addr;
+    uint32_t crc32;             // esp_crc32_le(0, ...) over the whole page
+} fw_page_crc_t;
+
+// CRC of one target page read over SWD, target must be connected
+esp_err_t fw_manifest_target_page(uint32_t addr, uint32_t *crc32);
+
+// Fill in crc32 for each entry from the target, addr must already be set
+esp_err_t fw_manifest_read_target(fw_page_crc_t *pages, uint16_t count, flash_progress_cb progress);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef FW_STAGE_H
+#define FW_STAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "swd_flash.h"
+
+// Staging area in the "fwstore" partition. It mirrors the target flash one
+// 4KB sector per nRF52 page so pages can be mapped and written as-is:
+//   sector 0        : header (state, page map, per-page CRC32)
+//   sector 1..256   : target pages 0x00000-0xFF000
+//   sector 257      : UICR page
+#define FW_STORE_PARTITION_LABEL  "fwstore"
+#define FW_STORE_PARTITION_SUBTYPE 0x40
+
+#define FW_STAGE_PAGE_SIZE    NRF52_FLASH_PAGE_SIZE
+#define FW_STAGE_FLASH_PAGES  (NRF52_FLASH_SIZE / FW_STAGE_PAGE_SIZE)
+#define FW_STAGE_UICR_PAGE    FW_STAGE_FLASH_PAGES
+#define FW_STAGE_PAGES        (FW_STAGE_FLASH_PAGES + 1)
+#define FW_STAGE_AREA_SIZE    ((FW_STAGE_PAGES + 1) * FW_STAGE_PAGE_SIZE)
+
+typedef struct {
+    bool valid;                 // Committed and validated image present
+    uint16_t page_count;        // Pages holding image data
+    uint32_t image_bytes;       // Data bytes received while staging
+    uint32_t min_addr;
+    uint32_t max_addr;          // Exclusive
+    uint32_t image_crc;         // CRC32 over the page CRC table
+} fw_stage_info_t;
+
+// Open the partition, call once at startup
+esp_err_t fw_stage_init(void);
+
+// Start a new image, the previous one is invalidated. The calling task owns
+// the stage until fw_stage_abort(), ESP_ERR_INVALID_STATE if another task does.
+esp_err_t fw_stage_begin(void);
+
+// Add image data at a target address (flash or UICR only)
+esp_err_t fw_stage_write(uint32_t addr, const uint8_t *data, size_t len);
+
+// Write out the last page, validate the image and mark it valid.
+// ESP_ERR_NOT_ALLOWED if a page touches a protected region and allow_protected is false.
+esp_err_t fw_stage_commit(bool allow_protected);
+
+// Drop the image being staged and give up the stage, a no-op for non-owners
+void fw_stage_abort(void);
+
+// Invalidate the committed image, ESP_ERR_INVALID_STATE if another task owns the stage
+esp_err_t fw_stage_clear(void);
+
+// Describe the committed image. This and the other readers below fail with
+// ESP_ERR_INVALID_STATE while another task owns the stage.
+esp_err_t fw_stage_get_info(fw_stage_info_t *info);
+
+// Program the committed image from mapped flash, pages are CRC-checked first
+esp_err_t fw_stage_flash(flash_progress_cb progress);
+
+// Erase one target page and program its non-blank words, page must be word aligned
+esp_err_t fw_stage_program_page(uint32_t addr, const uint8_t *page, uint32_t *written);
+
+// Called for each committed page in address order, an error stops the walk
+typedef esp_err_t (*fw_stage_page_cb_t)(uint32_t addr, const uint8_t *page, uint32_t crc32, void *ctx);
+
+// Walk the committed image through mapped flash
+esp_err_t fw_stage_for_each_page(fw_stage_page_cb_t callback, void *ctx);
+
+// Long loops here, in fw_cache and in fw_backup poll check between pages and
+// stop with ESP_ERR_INVALID_STATE once it returns true, NULL disables it
+void fw_stage_set_cancel_check(bool (*check)(void));
+
+// True once the registered check asks the running operation to stop
+bool fw_stage_cancelled(void);
+
+// Protected region that made the last commit fail, NULL if none
+const char* fw_stage_get_reject_reason(void);
+
+#endif
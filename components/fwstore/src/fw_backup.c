@@ -0,0 +1,344 @@
+// fw_backup.c - Full target flash backups stored in the image cache
+#include "fw_backup.h"
+#include "fw_stage.h"
+#include "flash_safety.h"
+#include "swd_mem.h"
+#include "esp_log.h"
+#include "esp_crc.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "FW_BACKUP";
+
+#define FW_BACKUP_NVS_NAMESPACE "fw_backup"
+#define FW_BACKUP_NVS_KEY       "list"
+#define FW_BACKUP_LIST_VERSION  1
+
+typedef struct {
+    uint32_t version;
+    uint32_t sequence;
+    fw_backup_info_t records[FW_BACKUP_MAX];
+} fw_backup_list_t;
+
+static fw_backup_list_t backup_list;
+static SemaphoreHandle_t list_mutex;    // Backup jobs and web handlers share the list
+
+static void lock_list(void) {
+    if (list_mutex) {
+        xSemaphoreTake(list_mutex, portMAX_DELAY);
+    }
+}
+
+static void unlock_list(void) {
+    if (list_mutex) {
+        xSemaphoreGive(list_mutex);
+    }
+}
+
+static esp_err_t save_list(void) {
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(FW_BACKUP_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = nvs_set_blob(handle, FW_BACKUP_NVS_KEY, &backup_list, sizeof(backup_list));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save backup list: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+static void load_list(void) {
+    nvs_handle_t handle;
+    size_t len = sizeof(backup_list);
+    esp_err_t ret = nvs_open(FW_BACKUP_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_get_blob(handle, FW_BACKUP_NVS_KEY, &backup_list, &len);
+        nvs_close(handle);
+    }
+
+    if (ret != ESP_OK || len != sizeof(backup_list) || backup_list.version != FW_BACKUP_LIST_VERSION) {
+        memset(&backup_list, 0, sizeof(backup_list));
+        backup_list.version = FW_BACKUP_LIST_VERSION;
+        return;
+    }
+
+    // Drop records whose cache entry is gone, e.g. after the partition was erased
+    for (int i = 0; i < FW_BACKUP_MAX; i++) {
+        fw_backup_info_t *rec = &backup_list.records[i];
+        fw_cache_info_t entry;
+        if (rec->sequence && fw_cache_get_info(rec->sha256, &entry) != ESP_OK) {
+            ESP_LOGW(TAG, "Backup %lu lost its cache entry", rec->sequence);
+            memset(rec, 0, sizeof(*rec));
+        }
+    }
+}
+
+// Record slot of list position index, newest first, -1 if out of range
+static int record_at(int index) {
+    int order[FW_BACKUP_MAX];
+    int count = 0;
+
+    for (int i = 0; i < FW_BACKUP_MAX; i++) {
+        if (!backup_list.records[i].sequence) {
+            continue;
+        }
+        int j = count++;
+        while (j > 0 && backup_list.records[order[j - 1]].sequence < backup_list.records[i].sequence) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    return index >= 0 && index < count ? order[index] : -1;
+}
+
+// Forget a record, the cache entry goes once no other record uses it
+static esp_err_t drop_record(int slot) {
+    fw_backup_info_t *rec = &backup_list.records[slot];
+    bool shared = false;
+    for (int i = 0; i < FW_BACKUP_MAX; i++) {
+        if (i != slot && backup_list.records[i].sequence &&
+            memcmp(backup_list.records[i].sha256, rec->sha256, FW_CACHE_SHA_LEN) == 0) {
+            shared = true;
+        }
+    }
+
+    if (!shared) {
+        char hex[2 * FW_CACHE_SHA_LEN + 1];
+        fw_cache_sha_to_hex(rec->sha256, hex);
+        fw_cache_set_backup(rec->sha256, false);
+        fw_cache_delete(hex);
+    }
+
+    ESP_LOGI(TAG, "Dropped backup %lu (%s)", rec->sequence, rec->description);
+    memset(rec, 0, sizeof(*rec));
+    return save_list();
+}
+
+static bool page_is_blank(const uint8_t *page) {
+    const uint32_t *words = (const uint32_t *)page;
+    for (int i = 0; i < FW_STAGE_PAGE_SIZE / 4; i++) {
+        if (words[i] != 0xFFFFFFFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t fw_backup_create(uint32_t addr, uint32_t size, const char *description,
+                           flash_progress_cb progress, fw_backup_info_t *info) {
+    if ((addr | size) & (FW_STAGE_PAGE_SIZE - 1) || size == 0 || addr + size > NRF52_FLASH_SIZE) {
+        ESP_LOGE(TAG, "Range 0x%08lX+%lu is not whole flash pages", addr, size);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The read goes through the stage, which must not cost a staged image
+    fw_stage_info_t staged;
+    if (fw_stage_get_info(&staged) == ESP_OK) {
+        ESP_LOGW(TAG, "Stage holds a %lu byte image, not backing up over it", staged.image_bytes);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ESP_LOGI(TAG, "Backing up 0x%08lX-0x%08lX", addr, addr + size);
+
+    // Word aligned so block reads land directly in the buffer
+    uint32_t *page = malloc(FW_STAGE_PAGE_SIZE);
+    if (!page) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    fw_backup_info_t rec = {
+        .addr = addr,
+        .size = size,
+        .page_count = size / FW_STAGE_PAGE_SIZE
+    };
+    strncpy(rec.description, description ? description : "Backup", sizeof(rec.description) - 1);
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = fw_stage_begin();
+
+    // Blank pages are staged too, so a restore erases them again
+    for (uint32_t offset = 0; offset < size && ret == ESP_OK; offset += FW_STAGE_PAGE_SIZE) {
+        ret = fw_stage_cancelled() ? ESP_ERR_INVALID_STATE :
+              swd_mem_read_block32(addr + offset, page, FW_STAGE_PAGE_SIZE / 4);
+        if (ret == ESP_OK) {
+            rec.crc32 = esp_crc32_le(rec.crc32, (const uint8_t *)page, FW_STAGE_PAGE_SIZE);
+            rec.blank_pages += page_is_blank((const uint8_t *)page);
+            ret = fw_stage_write(addr + offset, (const uint8_t *)page, FW_STAGE_PAGE_SIZE);
+        }
+        if (ret == ESP_OK && progress) {
+            progress(offset + FW_STAGE_PAGE_SIZE, size, "Reading");
+        }
+    }
+    free(page);
+
+    uint32_t read_ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+    if (ret == ESP_OK) {
+        ret = fw_stage_commit(true);
+    } else if (fw_stage_cancelled()) {
+        ESP_LOGW(TAG, "Backup cancelled");
+    } else {
+        ESP_LOGE(TAG, "Target read failed: %s", esp_err_to_name(ret));
+    }
+    if (ret == ESP_OK) {
+        ret = fw_cache_add_staged(rec.sha256, true);
+    }
+    // Give the stage back to uploads however far we got
+    fw_stage_abort();
+
+    fw_cache_info_t entry;
+    if (ret == ESP_OK) {
+        ret = fw_cache_get_info(rec.sha256, &entry);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Backup failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    lock_list();
+
+    // An identical earlier backup shares the whole entry
+    rec.stored_bytes = entry.stored_bytes;
+    rec.shared_pages = entry.shared_pages;
+    for (int i = 0; i < FW_BACKUP_MAX; i++) {
+        if (backup_list.records[i].sequence &&
+            memcmp(backup_list.records[i].sha256, rec.sha256, FW_CACHE_SHA_LEN) == 0) {
+            rec.stored_bytes = 0;
+            rec.shared_pages = rec.page_count - rec.blank_pages;
+        }
+    }
+
+    // Make room by dropping the oldest backup
+    int slot = -1;
+    for (int i = 0; i < FW_BACKUP_MAX && slot < 0; i++) {
+        if (!backup_list.records[i].sequence) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        slot = record_at(FW_BACKUP_MAX - 1);
+        if (memcmp(backup_list.records[slot].sha256, rec.sha256, FW_CACHE_SHA_LEN) != 0) {
+            drop_record(slot);
+        }
+    }
+
+    rec.sequence = ++backup_list.sequence;
+    backup_list.records[slot] = rec;
+    ret = save_list();
+    unlock_list();
+
+    ESP_LOGI(TAG, "Backup %lu: %u pages (%u blank, %u shared) in %lu ms, %lu bytes stored, CRC=0x%08lX",
+             rec.sequence, rec.page_count, rec.blank_pages, rec.shared_pages,
+             read_ms, rec.stored_bytes, rec.crc32);
+    if (info) {
+        *info = rec;
+    }
+    return ret;
+}
+
+esp_err_t fw_backup_restore(int index, flash_progress_cb progress) {
+    return fw_backup_restore_range(index, 0, UINT32_MAX, progress);
+}
+
+esp_err_t fw_backup_restore_range(int index, uint32_t addr, uint32_t size, flash_progress_cb progress) {
+    // Copy the record so the list isn't held while the target is flashed
+    lock_list();
+    int slot = record_at(index);
+    fw_backup_info_t rec;
+    if (slot >= 0) {
+        rec = backup_list.records[slot];
+    }
+    unlock_list();
+    if (slot < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char hex[2 * FW_CACHE_SHA_LEN + 1];
+    fw_cache_sha_to_hex(rec.sha256, hex);
+
+    ESP_LOGI(TAG, "Restoring backup %lu (%s), changed pages of 0x%08lX-0x%08lX",
+             rec.sequence, rec.description,
+             addr > rec.addr ? addr : rec.addr, rec.addr + rec.size);
+
+    // Pages the target still holds unchanged are skipped
+    esp_err_t ret = fw_cache_flash_range(hex, addr, size, true, progress);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Restore failed: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+int fw_backup_list(fw_backup_info_t *backups, int max) {
+    int count = 0;
+    lock_list();
+    for (int slot; count < max && (slot = record_at(count)) >= 0; count++) {
+        backups[count] = backup_list.records[slot];
+    }
+    unlock_list();
+    return count;
+}
+
+esp_err_t fw_backup_delete(int index) {
+    lock_list();
+    int slot = record_at(index);
+    esp_err_t ret = slot < 0 ? ESP_ERR_NOT_FOUND : drop_record(slot);
+    unlock_list();
+    return ret;
+}
+
+// flash_safety entry points
+static esp_err_t safety_create(uint32_t addr, uint32_t size, const char *description) {
+    return fw_backup_create(addr, size, description, NULL, NULL);
+}
+
+static esp_err_t safety_restore(uint32_t backup_index) {
+    return fw_backup_restore(backup_index, NULL);
+}
+
+static esp_err_t safety_list(void) {
+    fw_backup_info_t backups[FW_BACKUP_MAX];
+    int count = fw_backup_list(backups, FW_BACKUP_MAX);
+    for (int i = 0; i < count; i++) {
+        ESP_LOGI(TAG, "[%d] %s: 0x%08lX+%lu CRC=0x%08lX, %lu bytes stored",
+                 i, backups[i].description, backups[i].addr, backups[i].size,
+                 backups[i].crc32, backups[i].stored_bytes);
+    }
+    return count ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t fw_backup_init(void) {
+    static const flash_backup_ops_t ops = {
+        .create = safety_create,
+        .restore = safety_restore,
+        .list = safety_list
+    };
+
+    if (!list_mutex) {
+        list_mutex = xSemaphoreCreateMutex();
+        if (!list_mutex) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    load_list();
+    flash_safety_set_backup_ops(&ops);
+
+    int count = 0;
+    for (int i = 0; i < FW_BACKUP_MAX; i++) {
+        count += backup_list.records[i].sequence != 0;
+    }
+    ESP_LOGI(TAG, "%d target backups held", count);
+    return ESP_OK;
+}
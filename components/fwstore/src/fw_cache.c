@@ -0,0 +1,1086 @@
+// fw_cache.c - Content-addressed cache of compressed target images
+#include "fw_cache.h"
+#include "fw_stage.h"
+#include "fw_manifest.h"
+#include "hs_encoder.h"
+#include "decomp_stream.h"
+#include "esp_partition.h"
+#include "esp_log.h"
+#include "esp_crc.h"
+#include "nvs.h"
+#include "mbedtls/sha256.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "FW_CACHE";
+
+#define FW_CACHE_BASE           FW_STAGE_AREA_SIZE
+#define FW_CACHE_SECTOR_SIZE    FW_STAGE_PAGE_SIZE
+#define FW_CACHE_ENTRY_MAGIC    0x48434746  // "FGCH"
+#define FW_CACHE_INDEX_VERSION  2
+#define FW_CACHE_NVS_NAMESPACE  "fwcache"
+#define FW_CACHE_NVS_KEY        "index"
+#define FW_CACHE_MIN_PREFIX     8
+
+typedef enum {
+    FW_CACHE_CODEC_BLANK = 0,   // All 0xFF, nothing stored
+    FW_CACHE_CODEC_RAW,
+    FW_CACHE_CODEC_HEATSHRINK
+} fw_cache_codec_t;
+
+// Page data lives in another entry, offset is from the start of the cache area
+#define FW_CACHE_CODEC_REF      0x8000
+
+#define FW_CACHE_FLAG_BACKUP    0x01    // Never evicted, removed with its backup
+#define FW_CACHE_FLAG_HIDDEN    0x02    // Deleted, kept while other entries share its pages
+
+// On-flash entry: header, page table, then page data
+typedef struct {
+    uint32_t magic;
+    uint8_t sha256[FW_CACHE_SHA_LEN];
+    uint16_t page_count;
+    uint8_t window_bits;
+    uint8_t lookahead_bits;
+    uint32_t image_bytes;
+    uint32_t data_len;
+    uint32_t table_crc;         // CRC32 of the page table
+} fw_cache_entry_header_t;
+
+typedef struct {
+    uint32_t addr;
+    uint32_t crc32;             // CRC32 of the decoded page
+    uint32_t offset;            // From the start of the entry
+    uint16_t len;
+    uint16_t codec;
+} fw_cache_page_t;
+
+// Index kept in NVS, sector_count 0 marks a free slot
+typedef struct {
+    uint8_t sha256[FW_CACHE_SHA_LEN];
+    uint16_t first_sector;
+    uint16_t sector_count;
+    uint32_t image_bytes;
+    uint32_t stored_bytes;
+    uint32_t last_used;
+    uint16_t page_count;
+    uint16_t shared_pages;      // Pages stored by reference
+    uint16_t ref_mask;          // Slots holding data this entry references
+    uint8_t flags;
+    uint8_t reserved;
+} fw_cache_slot_t;
+
+typedef struct {
+    uint32_t version;
+    uint32_t use_counter;
+    fw_cache_slot_t slots[FW_CACHE_MAX_ENTRIES];
+} fw_cache_index_t;
+
+// State shared by the two passes over the staged image
+typedef struct {
+    mbedtls_sha256_context sha;
+    hs_encoder_t *encoder;
+    fw_cache_page_t *table;
+    uint16_t capacity;
+    uint16_t count;
+    uint16_t written;
+    uint32_t data_len;
+    uint32_t entry_offset;
+    uint8_t *buffer;
+    const uint8_t *cache_base;  // Mapped cache area, for finding shared pages
+    uint16_t ref_mask;
+    uint16_t shared;
+} cache_build_t;
+
+typedef struct {
+    uint8_t *out;
+    size_t len;
+} decode_target_t;
+
+static const esp_partition_t *cache_partition = NULL;
+static uint16_t cache_sectors = 0;
+static fw_cache_index_t cache_index;
+
+// The index is shared by the web server and the flash job task. Every
+// fw_cache_* entry point holds the mutex; a cache flash releases it while
+// programming, its entry and the ones it shares pages with stay pinned in
+// busy_mask, so a delete meanwhile only hides them.
+static SemaphoreHandle_t cache_mutex = NULL;
+static uint16_t busy_mask = 0;
+
+static void lock_cache(void) {
+    if (cache_mutex) {
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    }
+}
+
+static void unlock_cache(void) {
+    if (cache_mutex) {
+        xSemaphoreGive(cache_mutex);
+    }
+}
+
+static esp_err_t save_index(void) {
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(FW_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = nvs_set_blob(handle, FW_CACHE_NVS_KEY, &cache_index, sizeof(cache_index));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save index: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+static void load_index(void) {
+    nvs_handle_t handle;
+    size_t len = sizeof(cache_index);
+    esp_err_t ret = nvs_open(FW_CACHE_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_get_blob(handle, FW_CACHE_NVS_KEY, &cache_index, &len);
+        nvs_close(handle);
+    }
+
+    if (ret != ESP_OK || len != sizeof(cache_index) || cache_index.version != FW_CACHE_INDEX_VERSION) {
+        memset(&cache_index, 0, sizeof(cache_index));
+        cache_index.version = FW_CACHE_INDEX_VERSION;
+        return;
+    }
+
+    // Drop entries that no longer fit, e.g. after a partition table change
+    for (int i = 0; i < FW_CACHE_MAX_ENTRIES; i++) {
+        fw_cache_slot_t *slot = &cache_index.slots[i];
+        if (slot->sector_count && slot->first_sector + slot->sector_count > cache_sectors) {
+            memset(slot, 0, sizeof(*slot));
+        }
+    }
+}
+
+static int hex_nibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Slot for a hex key or prefix, -1 if not found, -2 if the prefix is ambiguous
+static int find_slot_hex(const char *hex) {
+    size_t len = hex ? strlen(hex) : 0;
+    if (len < FW_CACHE_MIN_PREFIX || len > 2 * FW_CACHE_SHA_LEN) {
+        return -1;
+    }
+
+    int found = -1;
+    for (int i = 0; i < FW_CACHE_MAX_ENTRIES; i++) {
+        const fw_cache_slot_t *slot = &cache_index.slots[i];
+        if (!slot->sector_count || (slot->flags & FW_CACHE_FLAG_HIDDEN)) {
+            continue;
+        }
+
+        size_t n = 0;
+        for (; n < len; n++) {
+            int nibble = hex_nibble(hex[n]);
+            uint8_t byte = slot->sha256[n / 2];
+            if (nibble < 0 || nibble != ((n & 1) ? (byte & 0x0F) : (byte >> 4))) {
+                break;
+            }
+        }
+
+        if (n == len) {
+            if (found >= 0) {
+                return -2;
+            }
+            found = i;
+        }
+    }
+    return found;
+}
+
+static int find_slot_sha(const uint8_t sha256[FW_CACHE_SHA_LEN]) {
+    for (int i = 0; i < FW_CACHE_MAX_ENTRIES; i++) {
+        if (cache_index.slots[i].sector_count &&
+            memcmp(cache_index.slots[i].sha256, sha256, FW_CACHE_SHA_LEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void touch_slot(int idx) {
+    cache_index.slots[idx].last_used = ++cache_index.use_counter;
+}
+
+// Lowest start sector where count sectors fit between existing entries
+static bool find_gap(uint16_t count, uint16_t *first) {
+    bool found = false;
+
+    // A gap can only start at the beginning or right after an entry
+    for (int c = -1; c < FW_CACHE_MAX_ENTRIES; c++) {
+        uint32_t start = 0;
+        if (c >= 0) {
+            const fw_cache_slot_t *slot = &cache_index.slots[c];
+            if (!slot->sector_count) {
+                continue;
+            }
+            start = slot->first_sector + slot->sector_count;
+        }
+        if (start + count > cache_sectors || (found && start >= *first)) {
+            continue;
+        }
+
+        bool overlaps = false;
+        for (int i = 0; i < FW_CACHE_MAX_ENTRIES && !overlaps; i++) {
+            const fw_cache_slot_t *slot = &cache_index.slots[i];
+            overlaps = slot->sector_count &&
+                       start < (uint32_t)slot->first_sector + slot->sector_count &&
+                       slot->first_sector < start + count;
+        }
+
+        if (!overlaps) {
+            *first = start;
+            found = true;
+        }
+    }
+    return found;
+}
+
+static bool slot_referenced(int idx, uint16_t pinned) {
+    if ((pinned | busy_mask) & (1 << idx)) {
+        return true;
+    }
+    for (int i = 0; i < FW_CACHE_MAX_ENTRIES; i++) {
+        if (i != idx && cache_index.slots[i].sector_count &&
+            (cache_index.slots[i].ref_mask & (1 << idx))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Free hidden entries nothing references any more, true if any went
+static bool free_hidden(uint16_t pinned) {
+    bool any = false;
+    bool freed = true;
+    while (freed) {
+        freed = false;
+        for (int i = 0; i < FW_CACHE_MAX_ENTRIES; i++) {
+            fw_cache_slot_t *slot = &cache_index.slots[i];
+            if (slot->sector_count && (slot->flags & FW_CACHE_FLAG_HIDDEN) && !slot_referenced(i, pinned)) {
+                memset(slot, 0, sizeof(*slot));
+                freed = any = true;
+            }
+        }
+    }
+    return any;
+}
+
+// Drop an entry. Its sectors stay in use while other entries (or the
+// pinned ones of an entry being built, or a flash in progress) share its pages.
+static void remove_slot(int idx, uint16_t pinned) {
+    cache_index.slots[idx].flags |= FW_CACHE_FLAG_HIDDEN;
+    free_hidden(pinned);
+}
+
+// Find room for a new entry, evicting least recently used entries as needed.
+// Backups are never evicted and pinned entries keep their sectors.
+static esp_err_t allocate_entry(uint16_t count, uint16_t pinned, uint16_t *first, int *slot_idx) {
+    if (count > cache_sectors) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (;;) {
+        int free_slot = -1;
+        for (int i = 0; i < FW_CACHE_MAX_ENTRIES && free_slot < 0; i++) {
+            if (!cache_index.slots[i].sector_count) {
+                free_slot = i;
+            }
+        }
+
+        if (free_slot >= 0 && find_gap(count, first)) {
+            *slot_idx = free_slot;
+            return ESP_OK;
+        }
+
+        int victim = -1;
+        for (int i = 0; i < FW_CACHE_MAX_ENTRIES; i++) {
+            const fw_cache_slot_t *slot = &cache_index.slots[i];
+            if (slot->sector_count && !(slot->flags & (FW_CACHE_FLAG_HIDDEN | FW_CACHE_FLAG_BACKUP)) &&
+                (victim < 0 || slot->last_used < cache_index.slots[victim].last_used)) {
+                victim = i;
+            }
+        }
+        if (victim < 0) {
+            return ESP_ERR_NO_MEM;
+        }
+
+        char hex[2 * FW_CACHE_SHA_LEN + 1];
+        fw_cache_sha_to_hex(cache_index.slots[victim].sha256, hex);
+        ESP_LOGI(TAG, "Evicting %.16s (%u sectors)", hex, cache_index.slots[victim].sector_count);
+        remove_slot(victim, pinned);
+    }
+}
+
+static bool page_is_blank(const uint8_t *page) {
+    const uint32_t *words = (const uint32_t *)page;
+    for (int i = 0; i < FW_STAGE_PAGE_SIZE / 4; i++) {
+        if (words[i] != 0xFFFFFFFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static esp_err_t decode_output(const uint8_t *data, size_t len, void *ctx) {
+    decode_target_t *t = (decode_target_t *)ctx;
+    if (t->len + len > FW_STAGE_PAGE_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(t->out + t->len, data, len);
+    t->len += len;
+    return ESP_OK;
+}
+
+static uint32_t area_size(void) {
+    return (uint32_t)cache_sectors * FW_CACHE_SECTOR_SIZE;
+}
+
+static esp_err_t map_area(const uint8_t **area, esp_partition_mmap_handle_t *map) {
+    return esp_partition_mmap(cache_partition, FW_CACHE_BASE, area_size(),
+                              ESP_PARTITION_MMAP_DATA, (const void **)area, map);
+}
+
+// Expand one page of the entry at entry_offset in the mapped area and check its CRC
+static esp_err_t decode_page(const fw_cache_entry_header_t *hdr, const fw_cache_page_t *p,
+                             const uint8_t *area, uint32_t entry_offset, uint8_t *out) {
+    uint32_t offset = (p->codec & FW_CACHE_CODEC_REF) ? p->offset : entry_offset + p->offset;
+    if (offset + p->len > area_size()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const uint8_t *src = area + offset;
+    esp_err_t ret = ESP_OK;
+
+    switch (p->codec & ~FW_CACHE_CODEC_REF) {
+        case FW_CACHE_CODEC_BLANK:
+            memset(out, 0xFF, FW_STAGE_PAGE_SIZE);
+            break;
+
+        case FW_CACHE_CODEC_RAW:
+            if (p->len != FW_STAGE_PAGE_SIZE) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            memcpy(out, src, FW_STAGE_PAGE_SIZE);
+            break;
+
+        case FW_CACHE_CODEC_HEATSHRINK: {
+            decomp_config_t cfg = {
+                .type = DECOMP_HEATSHRINK,
+                .hs_window_bits = hdr->window_bits,
+                .hs_lookahead_bits = hdr->lookahead_bits
+            };
+            decode_target_t target = { .out = out };
+            decomp_stream_t *d = decomp_stream_create(&cfg, decode_output, &target);
+            if (!d) {
+                return ESP_ERR_NO_MEM;
+            }
+            ret = decomp_stream_feed(d, src, p->len);
+            if (ret == ESP_OK) {
+                ret = decomp_stream_finish(d);
+            }
+            decomp_stream_free(d);
+            if (ret == ESP_OK && target.len != FW_STAGE_PAGE_SIZE) {
+                ret = ESP_ERR_INVALID_SIZE;
+            }
+            break;
+        }
+
+        default:
+            return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (ret == ESP_OK && esp_crc32_le(0, out, FW_STAGE_PAGE_SIZE) != p->crc32) {
+        ret = ESP_ERR_INVALID_CRC;
+    }
+    return ret;
+}
+
+// Slot whose sectors hold the given area offset
+static int owner_slot(uint32_t offset) {
+    uint32_t sector = offset / FW_CACHE_SECTOR_SIZE;
+    for (int i = 0; i < FW_CACHE_MAX_ENTRIES; i++) {
+        const fw_cache_slot_t *slot = &cache_index.slots[i];
+        if (slot->sector_count && sector >= slot->first_sector &&
+            sector < (uint32_t)slot->first_sector + slot->sector_count) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Look for the same page at the same address in a stored entry. Tables are
+// in address order, and a CRC match is confirmed byte for byte.
+static bool find_shared_page(cache_build_t *b, uint32_t addr, const uint8_t *page,
+                             uint32_t crc32, fw_cache_page_t *out) {
+    for (int i = 0; i < FW_CACHE_MAX_ENTRIES; i++) {
+        const fw_cache_slot_t *slot = &cache_index.slots[i];
+        if (!slot->sector_count) {
+            continue;
+        }
+
+        uint32_t entry_offset = (uint32_t)slot->first_sector * FW_CACHE_SECTOR_SIZE;
+        const fw_cache_entry_header_t *hdr = (const fw_cache_entry_header_t *)(b->cache_base + entry_offset);
+        const fw_cache_page_t *table = (const fw_cache_page_t *)(hdr + 1);
+        if (hdr->magic != FW_CACHE_ENTRY_MAGIC || hdr->page_count != slot->page_count) {
+            continue;
+        }
+
+        int lo = 0;
+        int hi = hdr->page_count - 1;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            if (table[mid].addr < addr) {
+                lo = mid + 1;
+            } else if (table[mid].addr > addr) {
+                hi = mid - 1;
+            } else {
+                lo = mid;
+                break;
+            }
+        }
+        if (lo >= hdr->page_count || table[lo].addr != addr) {
+            continue;
+        }
+
+        const fw_cache_page_t *match = &table[lo];
+        if (match->crc32 != crc32 || (match->codec & ~FW_CACHE_CODEC_REF) == FW_CACHE_CODEC_BLANK ||
+            decode_page(hdr, match, b->cache_base, entry_offset, b->buffer) != ESP_OK ||
+            memcmp(b->buffer, page, FW_STAGE_PAGE_SIZE) != 0) {
+            continue;
+        }
+
+        uint32_t offset = (match->codec & FW_CACHE_CODEC_REF) ? match->offset : entry_offset + match->offset;
+        int owner = owner_slot(offset);
+        if (owner < 0) {
+            continue;
+        }
+
+        out->codec = match->codec | FW_CACHE_CODEC_REF;
+        out->offset = offset;
+        out->len = match->len;
+        b->ref_mask |= 1 << owner;
+        return true;
+    }
+    return false;
+}
+
+// Pass 1: hash the image and size every page
+static esp_err_t plan_page(uint32_t addr, const uint8_t *page, uint32_t crc32, void *ctx) {
+    cache_build_t *b = (cache_build_t *)ctx;
+    uint8_t addr_le[4] = { addr, addr >> 8, addr >> 16, addr >> 24 };
+
+    if (b->count == b->capacity) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    mbedtls_sha256_update(&b->sha, addr_le, sizeof(addr_le));
+    mbedtls_sha256_update(&b->sha, page, FW_STAGE_PAGE_SIZE);
+
+    fw_cache_page_t *p = &b->table[b->count++];
+    p->addr = addr;
+    p->crc32 = crc32;
+    p->offset = b->data_len;
+
+    if (page_is_blank(page)) {
+        p->codec = FW_CACHE_CODEC_BLANK;
+        p->len = 0;
+    } else if (b->cache_base && find_shared_page(b, addr, page, crc32, p)) {
+        // Unchanged since an earlier image or backup, costs nothing
+        b->shared++;
+        return ESP_OK;
+    } else {
+        // Pages that do not shrink are stored raw
+        size_t len = hs_encoder_run(b->encoder, page, FW_STAGE_PAGE_SIZE, NULL, FW_STAGE_PAGE_SIZE - 1);
+        p->codec = len ? FW_CACHE_CODEC_HEATSHRINK : FW_CACHE_CODEC_RAW;
+        p->len = len ? len : FW_STAGE_PAGE_SIZE;
+    }
+
+    b->data_len += p->len;
+    return ESP_OK;
+}
+
+// Pass 2: compress again and write the page data
+static esp_err_t store_page(uint32_t addr, const uint8_t *page, uint32_t crc32, void *ctx) {
+    cache_build_t *b = (cache_build_t *)ctx;
+    if (b->written == b->count) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const fw_cache_page_t *p = &b->table[b->written++];
+
+    if (p->addr != addr || p->crc32 != crc32) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (p->codec == FW_CACHE_CODEC_BLANK || (p->codec & FW_CACHE_CODEC_REF)) {
+        return ESP_OK;
+    }
+
+    // Source is mapped flash, which cannot be read while flash is being written
+    if (p->codec == FW_CACHE_CODEC_RAW) {
+        memcpy(b->buffer, page, FW_STAGE_PAGE_SIZE);
+    } else if (hs_encoder_run(b->encoder, page, FW_STAGE_PAGE_SIZE, b->buffer, FW_STAGE_PAGE_SIZE) != p->len) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return esp_partition_write(cache_partition, b->entry_offset + p->offset, b->buffer, p->len);
+}
+
+esp_err_t fw_cache_init(void) {
+    cache_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                               FW_STORE_PARTITION_SUBTYPE,
+                                               FW_STORE_PARTITION_LABEL);
+    if (!cache_partition || cache_partition->size <= FW_CACHE_BASE) {
+        ESP_LOGW(TAG, "No space for an image cache");
+        cache_partition = NULL;
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    cache_mutex = xSemaphoreCreateMutex();
+    if (!cache_mutex) {
+        cache_partition = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    cache_sectors = (cache_partition->size - FW_CACHE_BASE) / FW_CACHE_SECTOR_SIZE;
+    load_index();
+
+    uint32_t total, free_bytes;
+    fw_cache_get_space(&total, &free_bytes);
+    ESP_LOGI(TAG, "Image cache: %lu KB, %lu KB free", total / 1024, free_bytes / 1024);
+    return ESP_OK;
+}
+
+static esp_err_t cache_add_staged(uint8_t sha256[FW_CACHE_SHA_LEN], bool backup) {
+    if (!cache_partition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    fw_stage_info_t info;
+    esp_err_t ret = fw_stage_get_info(&info);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    cache_build_t b = { .capacity = info.page_count };
+    esp_partition_mmap_handle_t map;
+    b.table = calloc(info.page_count, sizeof(fw_cache_page_t));
+    b.buffer = malloc(FW_STAGE_PAGE_SIZE);
+    b.encoder = hs_encoder_create(FW_CACHE_HS_WINDOW, FW_CACHE_HS_LOOKAHEAD, FW_STAGE_PAGE_SIZE);
+    if (!b.table || !b.buffer || !b.encoder) {
+        ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    // Without the mapping every page is stored, just without sharing
+    if (map_area(&b.cache_base, &map) != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot map cache, page sharing disabled");
+        b.cache_base = NULL;
+    }
+
+    mbedtls_sha256_init(&b.sha);
+    mbedtls_sha256_starts(&b.sha, 0);
+    ret = fw_stage_for_each_page(plan_page, &b);
+    mbedtls_sha256_finish(&b.sha, sha256);
+    mbedtls_sha256_free(&b.sha);
+    if (ret != ESP_OK || b.count != info.page_count) {
+        ret = ret != ESP_OK ? ret : ESP_ERR_INVALID_STATE;
+        goto cleanup;
+    }
+
+    char hex[2 * FW_CACHE_SHA_LEN + 1];
+    fw_cache_sha_to_hex(sha256, hex);
+
+    int existing = find_slot_sha(sha256);
+    if (existing >= 0) {
+        ESP_LOGI(TAG, "Image %.16s already cached", hex);
+        cache_index.slots[existing].flags &= ~FW_CACHE_FLAG_HIDDEN;
+        if (backup) {
+            cache_index.slots[existing].flags |= FW_CACHE_FLAG_BACKUP;
+        }
+        touch_slot(existing);
+        ret = save_index();
+        goto cleanup;
+    }
+
+    uint32_t table_len = b.count * sizeof(fw_cache_page_t);
+    uint32_t data_start = sizeof(fw_cache_entry_header_t) + table_len;
+    for (int i = 0; i < b.count; i++) {
+        if (!(b.table[i].codec & FW_CACHE_CODEC_REF)) {
+            b.table[i].offset += data_start;
+        }
+    }
+
+    uint32_t entry_len = data_start + b.data_len;
+    uint16_t sectors = (entry_len + FW_CACHE_SECTOR_SIZE - 1) / FW_CACHE_SECTOR_SIZE;
+    uint16_t first;
+    int slot_idx;
+    ret = allocate_entry(sectors, b.ref_mask, &first, &slot_idx);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Image needs %u sectors, cache has %u", sectors, cache_sectors);
+        goto cleanup;
+    }
+
+    b.entry_offset = FW_CACHE_BASE + (uint32_t)first * FW_CACHE_SECTOR_SIZE;
+    ret = esp_partition_erase_range(cache_partition, b.entry_offset,
+                                    (uint32_t)sectors * FW_CACHE_SECTOR_SIZE);
+    if (ret == ESP_OK) {
+        ret = esp_partition_write(cache_partition, b.entry_offset + sizeof(fw_cache_entry_header_t),
+                                  b.table, table_len);
+    }
+    if (ret == ESP_OK) {
+        ret = fw_stage_for_each_page(store_page, &b);
+    }
+
+    // Header goes last so an interrupted write never looks like a valid entry
+    if (ret == ESP_OK) {
+        fw_cache_entry_header_t hdr = {
+            .magic = FW_CACHE_ENTRY_MAGIC,
+            .page_count = b.count,
+            .window_bits = FW_CACHE_HS_WINDOW,
+            .lookahead_bits = FW_CACHE_HS_LOOKAHEAD,
+            .image_bytes = info.image_bytes,
+            .data_len = b.data_len,
+            .table_crc = esp_crc32_le(0, (const uint8_t *)b.table, table_len)
+        };
+        memcpy(hdr.sha256, sha256, FW_CACHE_SHA_LEN);
+        ret = esp_partition_write(cache_partition, b.entry_offset, &hdr, sizeof(hdr));
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store image: %s", esp_err_to_name(ret));
+        // Entries evicted to make room are gone either way, shared ones are released now
+        for (int i = 0; i < FW_CACHE_MAX_ENTRIES; i++) {
+            if ((b.ref_mask & (1 << i)) && (cache_index.slots[i].flags & FW_CACHE_FLAG_HIDDEN)) {
+                remove_slot(i, 0);
+            }
+        }
+        save_index();
+        goto cleanup;
+    }
+
+    fw_cache_slot_t *slot = &cache_index.slots[slot_idx];
+    memcpy(slot->sha256, sha256, FW_CACHE_SHA_LEN);
+    slot->first_sector = first;
+    slot->sector_count = sectors;
+    slot->image_bytes = info.image_bytes;
+    slot->stored_bytes = entry_len;
+    slot->page_count = b.count;
+    slot->shared_pages = b.shared;
+    slot->ref_mask = b.ref_mask;
+    slot->flags = backup ? FW_CACHE_FLAG_BACKUP : 0;
+    touch_slot(slot_idx);
+    ret = save_index();
+
+    ESP_LOGI(TAG, "Cached %.16s: %u pages (%u shared), %lu -> %lu bytes at sector %u",
+             hex, b.count, b.shared, (uint32_t)b.count * FW_STAGE_PAGE_SIZE, entry_len, first);
+
+cleanup:
+    if (b.cache_base) {
+        esp_partition_munmap(map);
+    }
+    hs_encoder_free(b.encoder);
+    free(b.buffer);
+    free(b.table);
+    return ret;
+}
+
+// Map the cache area and check the entry in slot idx, caller unmaps
+static esp_err_t open_entry(int idx, const uint8_t **area, esp_partition_mmap_handle_t *map,
+                            const fw_cache_entry_header_t **hdr, const fw_cache_page_t **table) {
+    // Shared pages live in other entries, so map the whole cache area
+    const fw_cache_slot_t *slot = &cache_index.slots[idx];
+    uint32_t entry_offset = (uint32_t)slot->first_sector * FW_CACHE_SECTOR_SIZE;
+    uint32_t entry_size = (uint32_t)slot->sector_count * FW_CACHE_SECTOR_SIZE;
+    esp_err_t ret = map_area(area, map);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    const uint8_t *entry = *area + entry_offset;
+    *hdr = (const fw_cache_entry_header_t *)entry;
+    *table = (const fw_cache_page_t *)(entry + sizeof(**hdr));
+    uint32_t table_len = (*hdr)->page_count * sizeof(fw_cache_page_t);
+
+    if ((*hdr)->magic != FW_CACHE_ENTRY_MAGIC ||
+        memcmp((*hdr)->sha256, slot->sha256, FW_CACHE_SHA_LEN) != 0 ||
+        sizeof(**hdr) + table_len > entry_size ||
+        esp_crc32_le(0, (const uint8_t *)*table, table_len) != (*hdr)->table_crc) {
+        ESP_LOGE(TAG, "Cache entry %d is corrupt", idx);
+        esp_partition_munmap(*map);
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+static int lookup_hex(const char *sha_hex, esp_err_t *err) {
+    int idx = cache_partition ? find_slot_hex(sha_hex) : -1;
+    *err = !cache_partition ? ESP_ERR_INVALID_STATE :
+           idx == -2 ? ESP_ERR_INVALID_ARG : ESP_ERR_NOT_FOUND;
+    return idx;
+}
+
+esp_err_t fw_cache_flash(const char *sha_hex, flash_progress_cb progress) {
+    return fw_cache_flash_range(sha_hex, 0, UINT32_MAX, false, progress);
+}
+
+// Done reading a pinned entry: unpin, free what was deleted meanwhile
+static void unpin_entry(uint16_t pinned, int idx, bool used) {
+    lock_cache();
+    busy_mask &= ~pinned;
+    bool changed = free_hidden(0);
+    if (used && cache_index.slots[idx].sector_count) {
+        touch_slot(idx);
+        changed = true;
+    }
+    if (changed) {
+        save_index();
+    }
+    unlock_cache();
+}
+
+esp_err_t fw_cache_flash_range(const char *sha_hex, uint32_t addr, uint32_t size,
+                               bool changed_only, flash_progress_cb progress) {
+    // Pin the entry, and those it shares pages with, for the whole flash
+    esp_err_t ret;
+    lock_cache();
+    int idx = lookup_hex(sha_hex, &ret);
+    if (idx < 0) {
+        unlock_cache();
+        return ret;
+    }
+
+    const uint8_t *area;
+    esp_partition_mmap_handle_t map;
+    const fw_cache_entry_header_t *hdr;
+    const fw_cache_page_t *table;
+    ret = open_entry(idx, &area, &map, &hdr, &table);
+    if (ret != ESP_OK) {
+        unlock_cache();
+        return ret;
+    }
+    uint32_t entry_offset = (uint32_t)cache_index.slots[idx].first_sector * FW_CACHE_SECTOR_SIZE;
+    uint16_t pinned = (1 << idx) | cache_index.slots[idx].ref_mask;
+    busy_mask |= pinned;
+    unlock_cache();
+
+    uint8_t *page = malloc(FW_STAGE_PAGE_SIZE);
+    fw_page_crc_t *todo = calloc(hdr->page_count, sizeof(fw_page_crc_t));
+    if (!page || !todo) {
+        free(page);
+        free(todo);
+        esp_partition_munmap(map);
+        unpin_entry(pinned, idx, false);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Pages in range, remembering their table index in crc32 until the target is read
+    uint16_t count = 0;
+    uint64_t end = (uint64_t)addr + size;
+    for (int i = 0; i < hdr->page_count; i++) {
+        if (table[i].addr >= addr && table[i].addr < end) {
+            todo[count].addr = table[i].addr;
+            todo[count++].crc32 = i;
+        }
+    }
+
+    // Decode everything once before the target is touched
+    for (int i = 0; i < count && ret == ESP_OK; i++) {
+        const fw_cache_page_t *p = &table[todo[i].crc32];
+        ret = decode_page(hdr, p, area, entry_offset, page);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Cached page 0x%08lX is corrupt: %s", p->addr, esp_err_to_name(ret));
+        }
+    }
+
+    // Drop pages the target already holds
+    uint16_t selected = count;
+    if (ret == ESP_OK && changed_only) {
+        uint16_t kept = 0;
+        for (int i = 0; i < count && ret == ESP_OK; i++) {
+            uint32_t crc32;
+            ret = fw_stage_cancelled() ? ESP_ERR_INVALID_STATE : fw_manifest_target_page(todo[i].addr, &crc32);
+            if (ret == ESP_OK && crc32 != table[todo[i].crc32].crc32) {
+                todo[kept++] = todo[i];
+            }
+            if (ret == ESP_OK && progress) {
+                progress((i + 1) * FW_STAGE_PAGE_SIZE, (uint32_t)count * FW_STAGE_PAGE_SIZE, "Comparing");
+            }
+        }
+        count = kept;
+    }
+
+    uint32_t total = (uint32_t)count * FW_STAGE_PAGE_SIZE;
+    uint32_t written = 0;
+    for (int i = 0; i < count && ret == ESP_OK; i++) {
+        const fw_cache_page_t *p = &table[todo[i].crc32];
+        if (fw_stage_cancelled()) {
+            ESP_LOGW(TAG, "Cancelled after %d of %u pages", i, count);
+            ret = ESP_ERR_INVALID_STATE;
+            break;
+        }
+        ret = decode_page(hdr, p, area, entry_offset, page);
+        if (ret == ESP_OK) {
+            ret = fw_stage_program_page(p->addr, page, &written);
+        }
+
+        // A programmed page reads back with its manifest CRC, as every page
+        // the compare above kept out must have. A mismatch means the write
+        // or the target CRC read is wrong, either way the diff can't be trusted.
+        uint32_t crc32;
+        if (ret == ESP_OK) {
+            ret = fw_manifest_target_page(p->addr, &crc32);
+        }
+        if (ret == ESP_OK && crc32 != p->crc32) {
+            ESP_LOGE(TAG, "Page 0x%08lX reads back CRC %08lX, manifest has %08lX", p->addr, crc32, p->crc32);
+            ret = ESP_ERR_INVALID_CRC;
+        }
+        if (ret == ESP_OK && progress) {
+            progress((i + 1) * FW_STAGE_PAGE_SIZE, total, "Flashing");
+        }
+    }
+
+    uint16_t page_count = hdr->page_count;
+    free(todo);
+    free(page);
+    esp_partition_munmap(map);
+
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Flashed cached image: %u of %u pages (%u in range), %lu bytes programmed",
+                 count, page_count, selected, written);
+    }
+    unpin_entry(pinned, idx, ret == ESP_OK);
+    return ret;
+}
+
+static esp_err_t cache_get_manifest(const char *sha_hex, fw_page_crc_t *pages, uint16_t max, uint16_t *count) {
+    esp_err_t ret;
+    int idx = lookup_hex(sha_hex, &ret);
+    if (idx < 0) {
+        return ret;
+    }
+
+    const uint8_t *area;
+    esp_partition_mmap_handle_t map;
+    const fw_cache_entry_header_t *hdr;
+    const fw_cache_page_t *table;
+    ret = open_entry(idx, &area, &map, &hdr, &table);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    *count = hdr->page_count;
+    for (int i = 0; i < hdr->page_count && i < max; i++) {
+        pages[i].addr = table[i].addr;
+        pages[i].crc32 = table[i].crc32;
+    }
+    esp_partition_munmap(map);
+    return *count > max ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+esp_err_t fw_cache_diff_target(const char *sha_hex, fw_page_crc_t *changed, uint16_t max,
+                               uint16_t *count, flash_progress_cb progress) {
+    esp_err_t ret;
+    lock_cache();
+    int idx = lookup_hex(sha_hex, &ret);
+    uint16_t page_count = idx >= 0 ? cache_index.slots[idx].page_count : 0;
+    unlock_cache();
+    if (idx < 0) {
+        return ret;
+    }
+
+    // The table is copied out, the target is read without the lock
+    fw_page_crc_t *image = calloc(page_count, sizeof(fw_page_crc_t));
+    fw_page_crc_t *target = calloc(page_count, sizeof(fw_page_crc_t));
+    if (!image || !target) {
+        free(image);
+        free(target);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = fw_cache_get_manifest(sha_hex, image, page_count, &page_count);
+    if (ret == ESP_OK) {
+        memcpy(target, image, page_count * sizeof(fw_page_crc_t));
+        ret = fw_manifest_read_target(target, page_count, progress);
+    }
+
+    // changed receives the target CRC of each differing page
+    *count = 0;
+    for (int i = 0; i < page_count && ret == ESP_OK; i++) {
+        if (target[i].crc32 != image[i].crc32) {
+            if (*count < max) {
+                changed[*count] = target[i];
+            }
+            (*count)++;
+        }
+    }
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "%u of %u pages differ from the target", *count, page_count);
+    }
+
+    free(image);
+    free(target);
+    return ret;
+}
+
+static esp_err_t cache_delete(const char *sha_hex) {
+    int idx = find_slot_hex(sha_hex);
+    if (idx < 0) {
+        return idx == -2 ? ESP_ERR_INVALID_ARG : ESP_ERR_NOT_FOUND;
+    }
+
+    if (cache_index.slots[idx].flags & FW_CACHE_FLAG_BACKUP) {
+        return ESP_ERR_NOT_ALLOWED;
+    }
+
+    remove_slot(idx, 0);
+    return save_index();
+}
+
+static esp_err_t cache_set_backup(const uint8_t sha256[FW_CACHE_SHA_LEN], bool backup) {
+    int idx = find_slot_sha(sha256);
+    if (idx < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (backup) {
+        cache_index.slots[idx].flags |= FW_CACHE_FLAG_BACKUP;
+    } else {
+        cache_index.slots[idx].flags &= ~FW_CACHE_FLAG_BACKUP;
+    }
+    return save_index();
+}
+
+static int cache_list(fw_cache_info_t *entries, int max) {
+    int count = 0;
+
+    for (int i = 0; i < FW_CACHE_MAX_ENTRIES; i++) {
+        const fw_cache_slot_t *slot = &cache_index.slots[i];
+        if (!slot->sector_count || (slot->flags & FW_CACHE_FLAG_HIDDEN)) {
+            continue;
+        }
+
+        // Insertion sort, most recently used first
+        int j = count < max ? count++ : max;
+        while (j > 0 && entries[j - 1].last_used < slot->last_used) {
+            if (j < max) {
+                entries[j] = entries[j - 1];
+            }
+            j--;
+        }
+        if (j < max) {
+            memcpy(entries[j].sha256, slot->sha256, FW_CACHE_SHA_LEN);
+            entries[j].page_count = slot->page_count;
+            entries[j].image_bytes = slot->image_bytes;
+            entries[j].stored_bytes = slot->stored_bytes;
+            entries[j].last_used = slot->last_used;
+            entries[j].shared_pages = slot->shared_pages;
+            entries[j].backup = (slot->flags & FW_CACHE_FLAG_BACKUP) != 0;
+        }
+    }
+    return count;
+}
+
+static esp_err_t cache_get_info(const uint8_t sha256[FW_CACHE_SHA_LEN], fw_cache_info_t *info) {
+    int idx = find_slot_sha(sha256);
+    if (idx < 0 || (cache_index.slots[idx].flags & FW_CACHE_FLAG_HIDDEN)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const fw_cache_slot_t *slot = &cache_index.slots[idx];
+    memcpy(info->sha256, slot->sha256, FW_CACHE_SHA_LEN);
+    info->page_count = slot->page_count;
+    info->image_bytes = slot->image_bytes;
+    info->stored_bytes = slot->stored_bytes;
+    info->last_used = slot->last_used;
+    info->shared_pages = slot->shared_pages;
+    info->backup = (slot->flags & FW_CACHE_FLAG_BACKUP) != 0;
+    return ESP_OK;
+}
+
+static void cache_get_space(uint32_t *total, uint32_t *free_bytes) {
+    uint32_t used = 0;
+    for (int i = 0; i < FW_CACHE_MAX_ENTRIES; i++) {
+        used += cache_index.slots[i].sector_count;
+    }
+
+    if (total) {
+        *total = (uint32_t)cache_sectors * FW_CACHE_SECTOR_SIZE;
+    }
+    if (free_bytes) {
+        *free_bytes = (uint32_t)(cache_sectors - used) * FW_CACHE_SECTOR_SIZE;
+    }
+}
+
+void fw_cache_sha_to_hex(const uint8_t sha256[FW_CACHE_SHA_LEN], char hex[2 * FW_CACHE_SHA_LEN + 1]) {
+    for (int i = 0; i < FW_CACHE_SHA_LEN; i++) {
+        snprintf(hex + 2 * i, 3, "%02x", sha256[i]);
+    }
+}
+
+// Entry points, each under the index lock
+esp_err_t fw_cache_add_staged(uint8_t sha256[FW_CACHE_SHA_LEN], bool backup) {
+    lock_cache();
+    esp_err_t ret = cache_add_staged(sha256, backup);
+    unlock_cache();
+    return ret;
+}
+
+esp_err_t fw_cache_get_manifest(const char *sha_hex, fw_page_crc_t *pages, uint16_t max, uint16_t *count) {
+    lock_cache();
+    esp_err_t ret = cache_get_manifest(sha_hex, pages, max, count);
+    unlock_cache();
+    return ret;
+}
+
+esp_err_t fw_cache_delete(const char *sha_hex) {
+    lock_cache();
+    esp_err_t ret = cache_delete(sha_hex);
+    unlock_cache();
+    return ret;
+}
+
+esp_err_t fw_cache_set_backup(const uint8_t sha256[FW_CACHE_SHA_LEN], bool backup) {
+    lock_cache();
+    esp_err_t ret = cache_set_backup(sha256, backup);
+    unlock_cache();
+    return ret;
+}
+
+int fw_cache_list(fw_cache_info_t *entries, int max) {
+    lock_cache();
+    int count = cache_list(entries, max);
+    unlock_cache();
+    return count;
+}
+
+esp_err_t fw_cache_get_info(const uint8_t sha256[FW_CACHE_SHA_LEN], fw_cache_info_t *info) {
+    lock_cache();
+    esp_err_t ret = cache_get_info(sha256, info);
+    unlock_cache();
+    return ret;
+}
+
+void fw_cache_get_space(uint32_t *total, uint32_t *free_bytes) {
+    lock_cache();
+    cache_get_space(total, free_bytes);
+    unlock_cache();
+}
@@ -0,0 +1,50 @@
+// fw_manifest.c - Per-page CRC tables of target flash
+#include "fw_manifest.h"
+#include "fw_stage.h"
+#include "swd_mem.h"
+#include "esp_log.h"
+#include "esp_crc.h"
+#include <stdlib.h>
+
+static const char *TAG = "FW_MANIFEST";
+
+static esp_err_t read_page_crc(uint32_t addr, uint32_t *buffer, uint32_t *crc32) {
+    esp_err_t ret = swd_mem_read_block32(addr, buffer, FW_STAGE_PAGE_SIZE / 4);
+    if (ret == ESP_OK) {
+        *crc32 = esp_crc32_le(0, (const uint8_t *)buffer, FW_STAGE_PAGE_SIZE);
+    }
+    return ret;
+}
+
+esp_err_t fw_manifest_target_page(uint32_t addr, uint32_t *crc32) {
+    fw_page_crc_t page = { .addr = addr };
+    esp_err_t ret = fw_manifest_read_target(&page, 1, NULL);
+    *crc32 = page.crc32;
+    return ret;
+}
+
+esp_err_t fw_manifest_read_target(fw_page_crc_t *pages, uint16_t count, flash_progress_cb progress) {
+    uint32_t *buffer = malloc(FW_STAGE_PAGE_SIZE);
+    if (!buffer) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = ESP_OK;
+    uint32_t total = (uint32_t)count * FW_STAGE_PAGE_SIZE;
+    for (uint16_t i = 0; i < count && ret == ESP_OK; i++) {
+        if (pages[i].addr & (FW_STAGE_PAGE_SIZE - 1)) {
+            ret = ESP_ERR_INVALID_ARG;
+            break;
+        }
+        ret = read_page_crc(pages[i].addr, buffer, &pages[i].crc32);
+        if (ret == ESP_OK && progress) {
+            progress((i + 1) * FW_STAGE_PAGE_SIZE, total, "Comparing");
+        }
+    }
+    free(buffer);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Target page CRC read failed: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
@@ -0,0 +1,571 @@
+// fw_stage.c - Stage images in ESP32 flash, then program the target from mapped memory
+#include "fw_stage.h"
+#include "flash_safety.h"
+#include "flash_telemetry.h"
+#include "nrf52_hal.h"
+#include "esp_partition.h"
+#include "esp_log.h"
+#include "esp_crc.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "FW_STAGE";
+
+#define FW_STAGE_MAGIC      0x47545346  // "FSTG"
+#define FW_STAGE_VERSION    1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t page_count;
+    uint32_t image_bytes;
+    uint32_t min_addr;
+    uint32_t max_addr;
+    uint8_t page_map[((FW_STAGE_PAGES + 31) / 32) * 4];
+    uint32_t page_crc[FW_STAGE_PAGES];
+    uint32_t header_crc;    // CRC32 of everything above
+} fw_stage_header_t;
+
+static const esp_partition_t *stage_partition = NULL;
+static fw_stage_header_t *stage_header = NULL;  // RAM copy while staging
+static uint8_t *page_buffer = NULL;             // Page being assembled
+static int current_page = -1;
+static const char *reject_reason = NULL;
+
+// One task owns the stage from begin until abort; readers hold it per call
+static TaskHandle_t stage_owner = NULL;
+static portMUX_TYPE owner_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Take the stage for the calling task, *held says whether it already had it
+static esp_err_t claim_stage(bool *held) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    esp_err_t ret = ESP_OK;
+
+    taskENTER_CRITICAL(&owner_lock);
+    *held = stage_owner == self;
+    if (!stage_owner) {
+        stage_owner = self;
+    } else if (stage_owner != self) {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    taskEXIT_CRITICAL(&owner_lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Stage area in use by another task");
+    }
+    return ret;
+}
+
+static void release_stage(void) {
+    taskENTER_CRITICAL(&owner_lock);
+    if (stage_owner == xTaskGetCurrentTaskHandle()) {
+        stage_owner = NULL;
+    }
+    taskEXIT_CRITICAL(&owner_lock);
+}
+
+static bool (*cancel_check)(void) = NULL;
+
+static bool owns_stage(void) {
+    return stage_owner == xTaskGetCurrentTaskHandle();
+}
+
+static void free_buffers(void) {
+    free(stage_header);
+    free(page_buffer);
+    stage_header = NULL;
+    page_buffer = NULL;
+    current_page = -1;
+}
+
+static int page_index(uint32_t addr) {
+    if (addr < NRF52_FLASH_SIZE) {
+        return addr / FW_STAGE_PAGE_SIZE;
+    }
+    if (addr >= UICR_BASE && addr < UICR_BASE + FW_STAGE_PAGE_SIZE) {
+        return FW_STAGE_UICR_PAGE;
+    }
+    return -1;
+}
+
+static uint32_t page_address(int idx) {
+    return idx == FW_STAGE_UICR_PAGE ? UICR_BASE : (uint32_t)idx * FW_STAGE_PAGE_SIZE;
+}
+
+static uint32_t sector_offset(int idx) {
+    return (uint32_t)(idx + 1) * FW_STAGE_PAGE_SIZE;
+}
+
+static bool page_staged(const fw_stage_header_t *hdr, int idx) {
+    return (hdr->page_map[idx / 8] & (1 << (idx % 8))) != 0;
+}
+
+static uint32_t header_crc(const fw_stage_header_t *hdr) {
+    return esp_crc32_le(0, (const uint8_t *)hdr, offsetof(fw_stage_header_t, header_crc));
+}
+
+// Read and check the committed header
+static esp_err_t load_header(fw_stage_header_t *hdr) {
+    esp_err_t ret = esp_partition_read(stage_partition, 0, hdr, sizeof(*hdr));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (hdr->magic != FW_STAGE_MAGIC || hdr->version != FW_STAGE_VERSION) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (hdr->header_crc != header_crc(hdr)) {
+        ESP_LOGE(TAG, "Stage header CRC mismatch");
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    return ESP_OK;
+}
+
+// Write the assembled page into its sector
+static esp_err_t flush_page(void) {
+    if (current_page < 0) {
+        return ESP_OK;
+    }
+
+    uint32_t offset = sector_offset(current_page);
+    esp_err_t ret = esp_partition_erase_range(stage_partition, offset, FW_STAGE_PAGE_SIZE);
+    if (ret == ESP_OK) {
+        ret = esp_partition_write(stage_partition, offset, page_buffer, FW_STAGE_PAGE_SIZE);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to stage page 0x%08lX: %s",
+                 page_address(current_page), esp_err_to_name(ret));
+        return ret;
+    }
+
+    if (!page_staged(stage_header, current_page)) {
+        stage_header->page_map[current_page / 8] |= 1 << (current_page % 8);
+        stage_header->page_count++;
+    }
+    stage_header->page_crc[current_page] = esp_crc32_le(0, page_buffer, FW_STAGE_PAGE_SIZE);
+
+    current_page = -1;
+    return ESP_OK;
+}
+
+// Make idx the page being assembled, reloading it if data revisits a staged page
+static esp_err_t load_page(int idx) {
+    esp_err_t ret = flush_page();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (page_staged(stage_header, idx)) {
+        ret = esp_partition_read(stage_partition, sector_offset(idx), page_buffer, FW_STAGE_PAGE_SIZE);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    } else {
+        memset(page_buffer, 0xFF, FW_STAGE_PAGE_SIZE);
+    }
+
+    current_page = idx;
+    return ESP_OK;
+}
+
+esp_err_t fw_stage_init(void) {
+    stage_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                               FW_STORE_PARTITION_SUBTYPE,
+                                               FW_STORE_PARTITION_LABEL);
+    if (!stage_partition) {
+        ESP_LOGW(TAG, "No '%s' partition, staging disabled", FW_STORE_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (stage_partition->size < FW_STAGE_AREA_SIZE) {
+        ESP_LOGE(TAG, "Partition too small: %lu < %d", stage_partition->size, FW_STAGE_AREA_SIZE);
+        stage_partition = NULL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ESP_LOGI(TAG, "Stage area at 0x%08lX (%d KB)", stage_partition->address, FW_STAGE_AREA_SIZE / 1024);
+    return ESP_OK;
+}
+
+esp_err_t fw_stage_begin(void) {
+    if (!stage_partition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    bool held;
+    esp_err_t ret = claim_stage(&held);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    free_buffers();
+
+    stage_header = calloc(1, sizeof(fw_stage_header_t));
+    page_buffer = malloc(FW_STAGE_PAGE_SIZE);
+    if (!stage_header || !page_buffer) {
+        fw_stage_abort();
+        return ESP_ERR_NO_MEM;
+    }
+    stage_header->min_addr = UINT32_MAX;
+    reject_reason = NULL;
+
+    // Invalidate the previous image before any page is overwritten
+    ret = esp_partition_erase_range(stage_partition, 0, FW_STAGE_PAGE_SIZE);
+    if (ret != ESP_OK) {
+        fw_stage_abort();
+    }
+    return ret;
+}
+
+esp_err_t fw_stage_write(uint32_t addr, const uint8_t *data, size_t len) {
+    if (!stage_header || !owns_stage()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    while (len > 0) {
+        int idx = page_index(addr);
+        if (idx < 0) {
+            ESP_LOGE(TAG, "Address 0x%08lX outside target flash", addr);
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        if (idx != current_page) {
+            esp_err_t ret = load_page(idx);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+
+        uint32_t offset = addr & (FW_STAGE_PAGE_SIZE - 1);
+        size_t chunk = FW_STAGE_PAGE_SIZE - offset;
+        if (chunk > len) {
+            chunk = len;
+        }
+
+        memcpy(page_buffer + offset, data, chunk);
+
+        if (addr < stage_header->min_addr) {
+            stage_header->min_addr = addr;
+        }
+        if (addr + chunk > stage_header->max_addr) {
+            stage_header->max_addr = addr + chunk;
+        }
+        stage_header->image_bytes += chunk;
+
+        addr += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t fw_stage_commit(bool allow_protected) {
+    if (!stage_header || !owns_stage()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = flush_page();
+    if (ret != ESP_OK) {
+        free_buffers();
+        return ret;
+    }
+
+    if (stage_header->page_count == 0) {
+        ESP_LOGE(TAG, "Image is empty");
+        free_buffers();
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Bounds check every page against the protected regions
+    for (int idx = 0; idx < FW_STAGE_PAGES && !allow_protected; idx++) {
+        const char *region = NULL;
+        if (page_staged(stage_header, idx) &&
+            flash_safety_touches_protected(page_address(idx), FW_STAGE_PAGE_SIZE, &region)) {
+            ESP_LOGE(TAG, "Page 0x%08lX is in protected region %s", page_address(idx), region);
+            reject_reason = region;
+            free_buffers();
+            return ESP_ERR_NOT_ALLOWED;
+        }
+    }
+
+    // Read every sector back through the cache before declaring the image good
+    const uint8_t *base = NULL;
+    esp_partition_mmap_handle_t map;
+    ret = esp_partition_mmap(stage_partition, 0, FW_STAGE_AREA_SIZE,
+                             ESP_PARTITION_MMAP_DATA, (const void **)&base, &map);
+    if (ret != ESP_OK) {
+        free_buffers();
+        return ret;
+    }
+
+    for (int idx = 0; idx < FW_STAGE_PAGES; idx++) {
+        if (page_staged(stage_header, idx) &&
+            esp_crc32_le(0, base + sector_offset(idx), FW_STAGE_PAGE_SIZE) != stage_header->page_crc[idx]) {
+            ESP_LOGE(TAG, "Staged page 0x%08lX failed readback", page_address(idx));
+            ret = ESP_ERR_INVALID_CRC;
+            break;
+        }
+    }
+    esp_partition_munmap(map);
+
+    if (ret == ESP_OK) {
+        stage_header->magic = FW_STAGE_MAGIC;
+        stage_header->version = FW_STAGE_VERSION;
+        stage_header->header_crc = header_crc(stage_header);
+        ret = esp_partition_write(stage_partition, 0, stage_header, sizeof(fw_stage_header_t));
+    }
+
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Staged %u pages, %lu bytes (0x%08lX-0x%08lX)",
+                 stage_header->page_count, stage_header->image_bytes,
+                 stage_header->min_addr, stage_header->max_addr);
+    }
+
+    free_buffers();
+    return ret;
+}
+
+void fw_stage_abort(void) {
+    // Another task's image is not ours to drop
+    if (!owns_stage()) {
+        return;
+    }
+    free_buffers();
+    release_stage();
+}
+
+esp_err_t fw_stage_clear(void) {
+    if (!stage_partition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    bool held;
+    esp_err_t ret = claim_stage(&held);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = esp_partition_erase_range(stage_partition, 0, FW_STAGE_PAGE_SIZE);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Staged image cleared");
+    }
+    if (!held) {
+        release_stage();
+    }
+    return ret;
+}
+
+static esp_err_t stage_get_info(fw_stage_info_t *info) {
+    if (!stage_partition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    fw_stage_header_t *hdr = malloc(sizeof(fw_stage_header_t));
+    if (!hdr) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = load_header(hdr);
+    if (ret == ESP_OK) {
+        info->valid = true;
+        info->page_count = hdr->page_count;
+        info->image_bytes = hdr->image_bytes;
+        info->min_addr = hdr->min_addr;
+        info->max_addr = hdr->max_addr;
+        info->image_crc = esp_crc32_le(0, (const uint8_t *)hdr->page_crc, sizeof(hdr->page_crc));
+    }
+
+    free(hdr);
+    return ret;
+}
+
+esp_err_t fw_stage_program_page(uint32_t addr, const uint8_t *page, uint32_t *written) {
+    const uint32_t *words = (const uint32_t *)page;
+
+    // Erased words at either end of the page need no programming
+    uint32_t first = 0;
+    uint32_t last = FW_STAGE_PAGE_SIZE / 4;
+    while (first < last && words[first] == 0xFFFFFFFF) first++;
+    while (last > first && words[last - 1] == 0xFFFFFFFF) last--;
+
+    esp_err_t ret = swd_flash_erase_page(addr);
+    flash_telemetry_page_erased(addr, ret == ESP_OK);
+    if (ret == ESP_OK && last > first) {
+        ret = swd_flash_write_buffer(addr + first * 4, (const uint8_t *)(words + first),
+                                     (last - first) * 4, NULL);
+        if (written) {
+            *written += (last - first) * 4;
+        }
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to program page 0x%08lX: %s", addr, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+static esp_err_t stage_flash(flash_progress_cb progress) {
+    if (!stage_partition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    fw_stage_header_t *hdr = malloc(sizeof(fw_stage_header_t));
+    if (!hdr) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = load_header(hdr);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "No valid staged image");
+        free(hdr);
+        return ret;
+    }
+
+    const uint8_t *base = NULL;
+    esp_partition_mmap_handle_t map;
+    ret = esp_partition_mmap(stage_partition, 0, FW_STAGE_AREA_SIZE,
+                             ESP_PARTITION_MMAP_DATA, (const void **)&base, &map);
+    if (ret != ESP_OK) {
+        free(hdr);
+        return ret;
+    }
+
+    // Check the whole image before the target is touched
+    for (int idx = 0; idx < FW_STAGE_PAGES && ret == ESP_OK; idx++) {
+        if (page_staged(hdr, idx) &&
+            esp_crc32_le(0, base + sector_offset(idx), FW_STAGE_PAGE_SIZE) != hdr->page_crc[idx]) {
+            ESP_LOGE(TAG, "Staged page 0x%08lX is corrupt", page_address(idx));
+            ret = ESP_ERR_INVALID_CRC;
+        }
+    }
+
+    int64_t start = esp_timer_get_time();
+    uint32_t total = (uint32_t)hdr->page_count * FW_STAGE_PAGE_SIZE;
+    uint32_t done = 0;
+    uint32_t written = 0;
+
+    for (int idx = 0; idx < FW_STAGE_PAGES && ret == ESP_OK; idx++) {
+        if (!page_staged(hdr, idx)) {
+            continue;
+        }
+        if (fw_stage_cancelled()) {
+            ESP_LOGW(TAG, "Cancelled after %lu of %lu bytes", done, total);
+            ret = ESP_ERR_INVALID_STATE;
+            break;
+        }
+
+        // Mapped flash is word aligned, so pages go to the SWD bus without a copy
+        ret = fw_stage_program_page(page_address(idx), base + sector_offset(idx), &written);
+        if (ret != ESP_OK) {
+            break;
+        }
+
+        done += FW_STAGE_PAGE_SIZE;
+        if (progress) {
+            progress(done, total, "Flashing");
+        }
+    }
+
+    esp_partition_munmap(map);
+    free(hdr);
+
+    if (ret == ESP_OK) {
+        uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+        ESP_LOGI(TAG, "Flashed %lu bytes from stage in %lu ms (%lu KB/s)", written, elapsed_ms,
+                 elapsed_ms ? (uint32_t)((uint64_t)written * 1000 / 1024 / elapsed_ms) : 0);
+    }
+    return ret;
+}
+
+static esp_err_t stage_for_each_page(fw_stage_page_cb_t callback, void *ctx) {
+    if (!stage_partition || !callback) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    fw_stage_header_t *hdr = malloc(sizeof(fw_stage_header_t));
+    if (!hdr) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = load_header(hdr);
+    const uint8_t *base = NULL;
+    esp_partition_mmap_handle_t map;
+    if (ret == ESP_OK) {
+        ret = esp_partition_mmap(stage_partition, 0, FW_STAGE_AREA_SIZE,
+                                 ESP_PARTITION_MMAP_DATA, (const void **)&base, &map);
+    }
+    if (ret != ESP_OK) {
+        free(hdr);
+        return ret;
+    }
+
+    // Flash pages first, UICR last, so the order matches target addresses
+    for (int idx = 0; idx < FW_STAGE_PAGES && ret == ESP_OK; idx++) {
+        if (page_staged(hdr, idx)) {
+            ret = callback(page_address(idx), base + sector_offset(idx), hdr->page_crc[idx], ctx);
+        }
+    }
+
+    esp_partition_munmap(map);
+    free(hdr);
+    return ret;
+}
+
+// Readers hold the stage for the call so a new upload can't erase it underneath
+
+esp_err_t fw_stage_get_info(fw_stage_info_t *info) {
+    if (!info) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(info, 0, sizeof(*info));
+
+    bool held;
+    esp_err_t ret = claim_stage(&held);
+    if (ret == ESP_OK) {
+        ret = stage_get_info(info);
+        if (!held) {
+            release_stage();
+        }
+    }
+    return ret;
+}
+
+esp_err_t fw_stage_flash(flash_progress_cb progress) {
+    bool held;
+    esp_err_t ret = claim_stage(&held);
+    if (ret == ESP_OK) {
+        ret = stage_flash(progress);
+        if (!held) {
+            release_stage();
+        }
+    }
+    return ret;
+}
+
+esp_err_t fw_stage_for_each_page(fw_stage_page_cb_t callback, void *ctx) {
+    bool held;
+    esp_err_t ret = claim_stage(&held);
+    if (ret == ESP_OK) {
+        ret = stage_for_each_page(callback, ctx);
+        if (!held) {
+            release_stage();
+        }
+    }
+    return ret;
+}
+
+void fw_stage_set_cancel_check(bool (*check)(void)) {
+    cancel_check = check;
+}
+
+bool fw_stage_cancelled(void) {
+    return cancel_check && cancel_check();
+}
+
+const char* fw_stage_get_reject_reason(void) {
+    return reject_reason;
+}
@@ -0,0 +1,52 @@
+#ifndef BIN_PARSER_H
+#define BIN_PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Framed binary image produced by the web UI from HEX/UF2 files:
+//   header  : "MRFB", version, flags, extent count, total bytes, table CRC32
+//   table   : extent_count x { addr, len, crc32 }
+//   payload : extent data, in table order
+// All fields little endian, CRC32 is the zlib/IEEE polynomial.
+#define BIN_MAGIC           "MRFB"
+#define BIN_VERSION         1
+#define BIN_HEADER_SIZE     16
+#define BIN_EXTENT_SIZE     12
+#define BIN_MAX_EXTENTS     256
+
+typedef struct {
+    uint32_t addr;
+    uint32_t len;
+    uint32_t crc32;
+} bin_extent_t;
+
+// Stream parser context
+typedef struct bin_stream_parser bin_stream_parser_t;
+
+// Called once with the full extent table before any data
+typedef esp_err_t (*bin_plan_callback_t)(const bin_extent_t *extents, uint16_t count,
+                                         uint32_t total_bytes, void *ctx);
+
+// Callback for each chunk of extent data
+typedef void (*bin_data_callback_t)(uint32_t addr, const uint8_t *data, size_t len, void *ctx);
+
+// Check for the framed binary magic at the start of a buffer
+bool bin_stream_is_bin(const uint8_t *data, size_t len);
+
+// Create stream parser
+bin_stream_parser_t* bin_stream_create(bin_plan_callback_t plan_callback,
+                                       bin_data_callback_t data_callback, void *user_ctx);
+
+// Parse chunk of framed data, fails with ESP_ERR_INVALID_CRC on a bad extent
+esp_err_t bin_stream_parse(bin_stream_parser_t *parser, const uint8_t *data, size_t len);
+
+// Check that every extent was received
+esp_err_t bin_stream_finish(bin_stream_parser_t *parser);
+
+// Free parser
+void bin_stream_free(bin_stream_parser_t *parser);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef DECOMP_STREAM_H
+#define DECOMP_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Supported upload encodings
+typedef enum {
+    DECOMP_NONE = 0,
+    DECOMP_GZIP,        // RFC 1952, CRC32 and size checked
+    DECOMP_ZLIB,        // RFC 1950, Adler-32 checked
+    DECOMP_DEFLATE,     // Raw RFC 1951, or zlib if a zlib header is found
+    DECOMP_HEATSHRINK   // heatshrink LZSS bit stream
+} decomp_type_t;
+
+// Heatshrink defaults match the heatshrink CLI (-w 11 -l 4)
+#define DECOMP_HS_WINDOW_DEFAULT     11
+#define DECOMP_HS_LOOKAHEAD_DEFAULT  4
+#define DECOMP_HS_WINDOW_MAX         14
+
+typedef struct {
+    decomp_type_t type;
+    uint8_t hs_window_bits;     // heatshrink -w, 0 for default
+    uint8_t hs_lookahead_bits;  // heatshrink -l, 0 for default
+} decomp_config_t;
+
+// Stream decompressor context
+typedef struct decomp_stream decomp_stream_t;
+
+// Callback for each chunk of decompressed data, an error stops the stream
+typedef esp_err_t (*decomp_output_callback_t)(const uint8_t *data, size_t len, void *ctx);
+
+// Map an encoding name ("gzip", "deflate", "zlib", "heatshrink") to a type
+decomp_type_t decomp_type_from_name(const char *name);
+
+// Name of an encoding for logs and status messages
+const char* decomp_type_name(decomp_type_t type);
+
+// Create stream decompressor
+decomp_stream_t* decomp_stream_create(const decomp_config_t *config,
+                                      decomp_output_callback_t callback, void *user_ctx);
+
+// Decompress chunk of input data
+esp_err_t decomp_stream_feed(decomp_stream_t *stream, const uint8_t *data, size_t len);
+
+// Check the stream ended cleanly and its trailer matched
+esp_err_t decomp_stream_finish(decomp_stream_t *stream);
+
+// Free decompressor
+void decomp_stream_free(decomp_stream_t *stream);
+
+// Compressed bytes consumed and decompressed bytes produced so far
+uint32_t decomp_stream_get_in_bytes(decomp_stream_t *stream);
+uint32_t decomp_stream_get_out_bytes(decomp_stream_t *stream);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef ELF_PARSER_H
+#define ELF_PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Bytes buffered from the start of the file until the program headers are known
+#define ELF_SEEK_AHEAD_SIZE (8 * 1024)
+
+// Maximum number of PT_LOAD segments forwarded from one file
+#define ELF_MAX_SEGMENTS 16
+
+// Stream parser context
+typedef struct elf_stream_parser elf_stream_parser_t;
+
+// Callback for each chunk of segment data, addr is the physical (load) address
+typedef void (*elf_data_callback_t)(uint32_t addr, const uint8_t *data, size_t len, void *ctx);
+
+// Check for the ELF magic at the start of a buffer
+bool elf_stream_is_elf(const uint8_t *data, size_t len);
+
+// Create stream parser
+elf_stream_parser_t* elf_stream_create(elf_data_callback_t callback, void *user_ctx);
+
+// Parse chunk of ELF data
+esp_err_t elf_stream_parse(elf_stream_parser_t *parser, const uint8_t *data, size_t len);
+
+// Check that all PT_LOAD data was received
+esp_err_t elf_stream_finish(elf_stream_parser_t *parser);
+
+// Reset parser for new file
+void elf_stream_reset(elf_stream_parser_t *parser);
+
+// Free parser
+void elf_stream_free(elf_stream_parser_t *parser);
+
+// Total PT_LOAD file bytes, valid once the program headers are parsed
+uint32_t elf_stream_get_load_size(elf_stream_parser_t *parser);
+
+#endif
@@ -45,4 +45,10 @@ void hex_stream_free(hex_stream_parser_t *parser);
 // Get current extended address
 uint32_t hex_stream_get_base_addr(hex_stream_parser_t *parser);
 
+// Lines dropped for bad checksums or syntax since the last reset
+uint32_t hex_stream_get_error_count(hex_stream_parser_t *parser);
+
+// True once the EOF record has been parsed
+bool hex_stream_is_complete(hex_stream_parser_t *parser);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef HS_ENCODER_H
+#define HS_ENCODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Heatshrink-compatible LZSS encoder for small blocks (e.g. one flash page).
+// Output decodes with decomp_stream (DECOMP_HEATSHRINK) using the same
+// window and lookahead bits; each block is an independent stream.
+
+typedef struct hs_encoder hs_encoder_t;
+
+// Create an encoder for blocks of up to max_block bytes
+hs_encoder_t* hs_encoder_create(uint8_t window_bits, uint8_t lookahead_bits, size_t max_block);
+
+// Compress one block. out may be NULL to only measure the size.
+// Returns the compressed size, or 0 if it would exceed out_cap.
+size_t hs_encoder_run(hs_encoder_t *enc, const uint8_t *in, size_t len,
+                      uint8_t *out, size_t out_cap);
+
+// Free encoder
+void hs_encoder_free(hs_encoder_t *enc);
+
+#endif
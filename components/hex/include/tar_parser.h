@@ -0,0 +1,41 @@
+#ifndef TAR_PARSER_H
+#define TAR_PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Streaming reader for ustar/GNU tar archives. Only regular files are
+// reported, directories and pax/long-name headers are skipped.
+#define TAR_BLOCK_SIZE      512
+#define TAR_NAME_MAX        100
+
+// Stream parser context
+typedef struct tar_stream_parser tar_stream_parser_t;
+
+typedef struct {
+    // Start of a file, an error stops the parse
+    esp_err_t (*begin)(const char *name, uint32_t size, void *ctx);
+    // File contents in arrival order
+    esp_err_t (*data)(const uint8_t *data, size_t len, void *ctx);
+    // All of the file has been delivered
+    esp_err_t (*end)(void *ctx);
+} tar_callbacks_t;
+
+// Create stream parser
+tar_stream_parser_t* tar_stream_create(const tar_callbacks_t *callbacks, void *user_ctx);
+
+// Parse chunk of archive data
+esp_err_t tar_stream_parse(tar_stream_parser_t *parser, const uint8_t *data, size_t len);
+
+// Check that the archive ended on a file boundary
+esp_err_t tar_stream_finish(tar_stream_parser_t *parser);
+
+// Regular files seen so far
+uint32_t tar_stream_get_file_count(tar_stream_parser_t *parser);
+
+// Free parser
+void tar_stream_free(tar_stream_parser_t *parser);
+
+#endif
@@ -0,0 +1,224 @@
+#include "bin_parser.h"
+#include "esp_log.h"
+#include "esp_crc.h"
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "BIN_PARSER";
+
+typedef enum {
+    BIN_STATE_HEADER = 0,
+    BIN_STATE_TABLE,
+    BIN_STATE_DATA,
+    BIN_STATE_DONE,
+    BIN_STATE_ERROR
+} bin_state_t;
+
+struct bin_stream_parser {
+    bin_state_t state;
+    uint8_t header[BIN_HEADER_SIZE];
+    uint32_t header_len;
+    bin_extent_t *extents;
+    uint16_t extent_count;
+    uint32_t table_len;
+    uint32_t table_crc;
+    uint32_t total_bytes;
+    uint16_t current;
+    uint32_t extent_pos;
+    uint32_t crc;
+    bin_plan_callback_t plan_callback;
+    bin_data_callback_t data_callback;
+    void *user_ctx;
+};
+
+static uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool bin_stream_is_bin(const uint8_t *data, size_t len) {
+    return len >= 4 && memcmp(data, BIN_MAGIC, 4) == 0;
+}
+
+static esp_err_t parse_header(bin_stream_parser_t *parser) {
+    const uint8_t *h = parser->header;
+
+    if (!bin_stream_is_bin(h, BIN_HEADER_SIZE)) {
+        ESP_LOGE(TAG, "Bad magic");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (h[4] != BIN_VERSION) {
+        ESP_LOGE(TAG, "Unsupported version %d", h[4]);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    parser->extent_count = h[6] | (h[7] << 8);
+    parser->total_bytes = rd32(h + 8);
+    parser->table_crc = rd32(h + 12);
+
+    if (parser->extent_count == 0 || parser->extent_count > BIN_MAX_EXTENTS) {
+        ESP_LOGE(TAG, "Bad extent count %u", parser->extent_count);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    parser->extents = malloc(parser->extent_count * sizeof(bin_extent_t));
+    if (!parser->extents) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+// Table bytes are decoded in place as they arrive
+static void parse_table_byte(bin_stream_parser_t *parser, uint8_t c) {
+    uint32_t idx = parser->table_len / BIN_EXTENT_SIZE;
+    uint32_t field = (parser->table_len % BIN_EXTENT_SIZE) / 4;
+    uint32_t shift = (parser->table_len % 4) * 8;
+    uint32_t *value = field == 0 ? &parser->extents[idx].addr :
+                      field == 1 ? &parser->extents[idx].len : &parser->extents[idx].crc32;
+
+    if (shift == 0) {
+        *value = 0;
+    }
+    *value |= (uint32_t)c << shift;
+
+    parser->crc = esp_crc32_le(parser->crc, &c, 1);
+    parser->table_len++;
+}
+
+static esp_err_t check_table(bin_stream_parser_t *parser) {
+    if (parser->crc != parser->table_crc) {
+        ESP_LOGE(TAG, "Extent table CRC mismatch: 0x%08lX != 0x%08lX", parser->crc, parser->table_crc);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    uint32_t sum = 0;
+    for (int i = 0; i < parser->extent_count; i++) {
+        const bin_extent_t *e = &parser->extents[i];
+        if (e->len == 0 || e->addr + e->len < e->addr) {
+            ESP_LOGE(TAG, "Bad extent %d: 0x%08lX+%lu", i, e->addr, e->len);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        sum += e->len;
+    }
+
+    if (sum != parser->total_bytes) {
+        ESP_LOGE(TAG, "Extent sizes add up to %lu, header says %lu", sum, parser->total_bytes);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ESP_LOGI(TAG, "%u extents, %lu bytes", parser->extent_count, parser->total_bytes);
+    return ESP_OK;
+}
+
+bin_stream_parser_t* bin_stream_create(bin_plan_callback_t plan_callback,
+                                       bin_data_callback_t data_callback, void *user_ctx) {
+    bin_stream_parser_t *parser = calloc(1, sizeof(bin_stream_parser_t));
+    if (parser) {
+        parser->plan_callback = plan_callback;
+        parser->data_callback = data_callback;
+        parser->user_ctx = user_ctx;
+    }
+    return parser;
+}
+
+esp_err_t bin_stream_parse(bin_stream_parser_t *parser, const uint8_t *data, size_t len) {
+    if (!parser) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+
+    while (len > 0 && ret == ESP_OK) {
+        switch (parser->state) {
+            case BIN_STATE_HEADER:
+                parser->header[parser->header_len++] = *data++;
+                len--;
+                if (parser->header_len == BIN_HEADER_SIZE) {
+                    ret = parse_header(parser);
+                    parser->state = BIN_STATE_TABLE;
+                }
+                break;
+
+            case BIN_STATE_TABLE:
+                parse_table_byte(parser, *data++);
+                len--;
+                if (parser->table_len == (uint32_t)parser->extent_count * BIN_EXTENT_SIZE) {
+                    ret = check_table(parser);
+                    if (ret == ESP_OK && parser->plan_callback) {
+                        ret = parser->plan_callback(parser->extents, parser->extent_count,
+                                                    parser->total_bytes, parser->user_ctx);
+                    }
+                    parser->crc = 0;
+                    parser->state = BIN_STATE_DATA;
+                }
+                break;
+
+            case BIN_STATE_DATA: {
+                const bin_extent_t *e = &parser->extents[parser->current];
+                uint32_t chunk = e->len - parser->extent_pos;
+                if (chunk > len) {
+                    chunk = len;
+                }
+
+                parser->crc = esp_crc32_le(parser->crc, data, chunk);
+                if (parser->data_callback) {
+                    parser->data_callback(e->addr + parser->extent_pos, data, chunk, parser->user_ctx);
+                }
+
+                parser->extent_pos += chunk;
+                data += chunk;
+                len -= chunk;
+
+                if (parser->extent_pos == e->len) {
+                    if (parser->crc != e->crc32) {
+                        ESP_LOGE(TAG, "Extent %u at 0x%08lX: CRC 0x%08lX != 0x%08lX",
+                                 parser->current, e->addr, parser->crc, e->crc32);
+                        ret = ESP_ERR_INVALID_CRC;
+                        break;
+                    }
+                    parser->crc = 0;
+                    parser->extent_pos = 0;
+                    if (++parser->current == parser->extent_count) {
+                        parser->state = BIN_STATE_DONE;
+                    }
+                }
+                break;
+            }
+
+            case BIN_STATE_DONE:
+                ESP_LOGW(TAG, "Ignoring %u trailing bytes", (unsigned)len);
+                len = 0;
+                break;
+
+            default:
+                return ESP_FAIL;
+        }
+    }
+
+    if (ret != ESP_OK) {
+        parser->state = BIN_STATE_ERROR;
+    }
+    return ret;
+}
+
+esp_err_t bin_stream_finish(bin_stream_parser_t *parser) {
+    if (!parser) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (parser->state != BIN_STATE_DONE) {
+        ESP_LOGE(TAG, "Image truncated (%u/%u extents)", parser->current, parser->extent_count);
+        return parser->state == BIN_STATE_ERROR ? ESP_FAIL : ESP_ERR_INVALID_SIZE;
+    }
+
+    return ESP_OK;
+}
+
+void bin_stream_free(bin_stream_parser_t *parser) {
+    if (parser) {
+        free(parser->extents);
+        free(parser);
+    }
+}
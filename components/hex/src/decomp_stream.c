@@ -0,0 +1,501 @@
+#include "decomp_stream.h"
+#include "esp_log.h"
+#include "esp_crc.h"
+#include "rom/miniz.h"
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+
+static const char *TAG = "DECOMP";
+
+#define HS_OUT_BUF_SIZE 512
+
+// Gzip header flags
+#define GZ_FHCRC    0x02
+#define GZ_FEXTRA   0x04
+#define GZ_FNAME    0x08
+#define GZ_FCOMMENT 0x10
+
+typedef enum {
+    GZ_HEADER = 0,
+    GZ_EXTRA_LEN,
+    GZ_EXTRA,
+    GZ_NAME,
+    GZ_COMMENT,
+    GZ_HCRC,
+    GZ_BODY,
+    GZ_TRAILER
+} gz_state_t;
+
+typedef enum {
+    HS_TAG = 0,
+    HS_LITERAL,
+    HS_INDEX,
+    HS_COUNT
+} hs_state_t;
+
+struct decomp_stream {
+    decomp_type_t type;
+    decomp_output_callback_t callback;
+    void *user_ctx;
+    uint32_t in_bytes;
+    uint32_t out_bytes;
+    bool done;
+
+    // Gzip wrapper / deflate header detection
+    gz_state_t gz_state;
+    uint8_t hdr[10];
+    uint8_t hdr_len;
+    uint8_t gz_flags;
+    uint16_t gz_skip;
+    uint32_t crc;
+
+    // Inflate (ROM miniz) with a wrapping 32 KB dictionary
+    tinfl_decompressor *inflator;
+    uint8_t *dict;
+    size_t dict_ofs;
+    uint32_t tinfl_flags;
+
+    // Heatshrink
+    uint8_t *window;
+    uint16_t window_mask;
+    uint16_t head;
+    uint8_t hs_window_bits;
+    uint8_t hs_lookahead_bits;
+    hs_state_t hs_state;
+    uint16_t hs_acc;
+    uint8_t hs_bits_left;
+    uint16_t hs_index;
+    uint8_t *out_buf;
+    size_t out_len;
+};
+
+decomp_type_t decomp_type_from_name(const char *name) {
+    if (!name) {
+        return DECOMP_NONE;
+    }
+    if (strcasecmp(name, "gzip") == 0 || strcasecmp(name, "x-gzip") == 0) {
+        return DECOMP_GZIP;
+    }
+    if (strcasecmp(name, "zlib") == 0) {
+        return DECOMP_ZLIB;
+    }
+    if (strcasecmp(name, "deflate") == 0) {
+        return DECOMP_DEFLATE;
+    }
+    if (strcasecmp(name, "heatshrink") == 0 || strcasecmp(name, "hs") == 0) {
+        return DECOMP_HEATSHRINK;
+    }
+    return DECOMP_NONE;
+}
+
+const char* decomp_type_name(decomp_type_t type) {
+    switch (type) {
+        case DECOMP_GZIP:       return "gzip";
+        case DECOMP_ZLIB:       return "zlib";
+        case DECOMP_DEFLATE:    return "deflate";
+        case DECOMP_HEATSHRINK: return "heatshrink";
+        default:                return "none";
+    }
+}
+
+// Pass decompressed bytes on, tracking size and gzip CRC
+static esp_err_t emit(decomp_stream_t *d, const uint8_t *data, size_t len) {
+    if (len == 0) {
+        return ESP_OK;
+    }
+    d->out_bytes += len;
+    if (d->type == DECOMP_GZIP) {
+        d->crc = esp_crc32_le(d->crc, data, len);
+    }
+    return d->callback ? d->callback(data, len, d->user_ctx) : ESP_OK;
+}
+
+// Run input through tinfl, returns bytes consumed
+static esp_err_t inflate_feed(decomp_stream_t *d, const uint8_t *data, size_t len, size_t *consumed) {
+    size_t used = 0;
+
+    while (!d->done && used < len) {
+        size_t in_size = len - used;
+        size_t out_size = TINFL_LZ_DICT_SIZE - d->dict_ofs;
+
+        tinfl_status status = tinfl_decompress(d->inflator, data + used, &in_size,
+                                               d->dict, d->dict + d->dict_ofs, &out_size,
+                                               d->tinfl_flags | TINFL_FLAG_HAS_MORE_INPUT);
+        used += in_size;
+
+        esp_err_t ret = emit(d, d->dict + d->dict_ofs, out_size);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        d->dict_ofs = (d->dict_ofs + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+
+        if (status == TINFL_STATUS_DONE) {
+            d->done = true;
+        } else if (status == TINFL_STATUS_ADLER32_MISMATCH) {
+            ESP_LOGE(TAG, "Adler-32 mismatch");
+            return ESP_ERR_INVALID_CRC;
+        } else if (status < 0) {
+            ESP_LOGE(TAG, "Inflate failed (%d) at input byte %lu", status, d->in_bytes + used);
+            return ESP_ERR_INVALID_ARG;
+        } else if (in_size == 0 && out_size == 0) {
+            break;
+        }
+    }
+
+    // tinfl may still hold output after the last input byte
+    while (!d->done) {
+        size_t in_size = 0;
+        size_t out_size = TINFL_LZ_DICT_SIZE - d->dict_ofs;
+        tinfl_status status = tinfl_decompress(d->inflator, NULL, &in_size,
+                                               d->dict, d->dict + d->dict_ofs, &out_size,
+                                               d->tinfl_flags | TINFL_FLAG_HAS_MORE_INPUT);
+        esp_err_t ret = emit(d, d->dict + d->dict_ofs, out_size);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        d->dict_ofs = (d->dict_ofs + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+
+        if (status == TINFL_STATUS_DONE) {
+            d->done = true;
+        } else if (status != TINFL_STATUS_HAS_MORE_OUTPUT) {
+            break;
+        }
+    }
+
+    *consumed = used;
+    return ESP_OK;
+}
+
+// Gzip member: header, deflate body, CRC32 + ISIZE trailer
+static esp_err_t gzip_feed(decomp_stream_t *d, const uint8_t *data, size_t len) {
+    size_t pos = 0;
+
+    while (pos < len) {
+        uint8_t c = data[pos];
+
+        switch (d->gz_state) {
+            case GZ_HEADER:
+                d->hdr[d->hdr_len++] = c;
+                pos++;
+                if (d->hdr_len < 10) {
+                    break;
+                }
+                if (d->hdr[0] != 0x1F || d->hdr[1] != 0x8B || d->hdr[2] != 8) {
+                    ESP_LOGE(TAG, "Not a gzip stream");
+                    return ESP_ERR_INVALID_ARG;
+                }
+                d->gz_flags = d->hdr[3];
+                d->hdr_len = 0;
+                d->gz_state = GZ_EXTRA_LEN;
+                break;
+
+            case GZ_EXTRA_LEN:
+                if (!(d->gz_flags & GZ_FEXTRA)) {
+                    d->gz_state = GZ_NAME;
+                    break;
+                }
+                d->hdr[d->hdr_len++] = c;
+                pos++;
+                if (d->hdr_len == 2) {
+                    d->gz_skip = d->hdr[0] | (d->hdr[1] << 8);
+                    d->gz_state = GZ_EXTRA;
+                }
+                break;
+
+            case GZ_EXTRA:
+                if (d->gz_skip == 0) {
+                    d->gz_state = GZ_NAME;
+                    break;
+                }
+                d->gz_skip--;
+                pos++;
+                break;
+
+            case GZ_NAME:
+                if (!(d->gz_flags & GZ_FNAME)) {
+                    d->gz_state = GZ_COMMENT;
+                    break;
+                }
+                pos++;
+                if (c == 0) {
+                    d->gz_flags &= ~GZ_FNAME;
+                    d->gz_state = GZ_COMMENT;
+                }
+                break;
+
+            case GZ_COMMENT:
+                if (!(d->gz_flags & GZ_FCOMMENT)) {
+                    d->gz_skip = (d->gz_flags & GZ_FHCRC) ? 2 : 0;
+                    d->gz_state = GZ_HCRC;
+                    break;
+                }
+                pos++;
+                if (c == 0) {
+                    d->gz_flags &= ~GZ_FCOMMENT;
+                }
+                break;
+
+            case GZ_HCRC:
+                if (d->gz_skip == 0) {
+                    d->gz_state = GZ_BODY;
+                    break;
+                }
+                d->gz_skip--;
+                pos++;
+                break;
+
+            case GZ_BODY: {
+                size_t consumed = 0;
+                esp_err_t ret = inflate_feed(d, data + pos, len - pos, &consumed);
+                if (ret != ESP_OK) {
+                    return ret;
+                }
+                pos += consumed;
+                if (d->done) {
+                    d->done = false;
+                    d->hdr_len = 0;
+                    d->gz_state = GZ_TRAILER;
+                }
+                break;
+            }
+
+            case GZ_TRAILER: {
+                if (d->hdr_len < 8) {
+                    d->hdr[d->hdr_len++] = c;
+                }
+                pos++;
+                if (d->hdr_len == 8 && !d->done) {
+                    uint32_t crc = d->hdr[0] | (d->hdr[1] << 8) |
+                                   (d->hdr[2] << 16) | ((uint32_t)d->hdr[3] << 24);
+                    uint32_t isize = d->hdr[4] | (d->hdr[5] << 8) |
+                                     (d->hdr[6] << 16) | ((uint32_t)d->hdr[7] << 24);
+                    if (crc != d->crc || isize != d->out_bytes) {
+                        ESP_LOGE(TAG, "Gzip trailer mismatch: crc 0x%08lX/0x%08lX, size %lu/%lu",
+                                 crc, d->crc, isize, d->out_bytes);
+                        return ESP_ERR_INVALID_CRC;
+                    }
+                    d->done = true;
+                }
+                break;
+            }
+        }
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t hs_put(decomp_stream_t *d, uint8_t c) {
+    d->window[d->head & d->window_mask] = c;
+    d->head++;
+    d->out_buf[d->out_len++] = c;
+    if (d->out_len == HS_OUT_BUF_SIZE) {
+        esp_err_t ret = emit(d, d->out_buf, d->out_len);
+        d->out_len = 0;
+        return ret;
+    }
+    return ESP_OK;
+}
+
+// Heatshrink: tag bit 1 = 8-bit literal, 0 = back-reference of
+// (window_bits index, lookahead_bits count), both stored minus one
+static esp_err_t heatshrink_feed(decomp_stream_t *d, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint8_t byte = data[i];
+
+        for (uint8_t mask = 0x80; mask; mask >>= 1) {
+            uint8_t bit = (byte & mask) ? 1 : 0;
+
+            if (d->hs_state == HS_TAG) {
+                d->hs_acc = 0;
+                if (bit) {
+                    d->hs_state = HS_LITERAL;
+                    d->hs_bits_left = 8;
+                } else {
+                    d->hs_state = HS_INDEX;
+                    d->hs_bits_left = d->hs_window_bits;
+                }
+                continue;
+            }
+
+            d->hs_acc = (d->hs_acc << 1) | bit;
+            if (--d->hs_bits_left > 0) {
+                continue;
+            }
+
+            esp_err_t ret = ESP_OK;
+            switch (d->hs_state) {
+                case HS_LITERAL:
+                    ret = hs_put(d, (uint8_t)d->hs_acc);
+                    d->hs_state = HS_TAG;
+                    break;
+
+                case HS_INDEX:
+                    d->hs_index = d->hs_acc + 1;
+                    d->hs_acc = 0;
+                    d->hs_bits_left = d->hs_lookahead_bits;
+                    d->hs_state = HS_COUNT;
+                    break;
+
+                case HS_COUNT: {
+                    uint16_t count = d->hs_acc + 1;
+                    for (uint16_t n = 0; n < count && ret == ESP_OK; n++) {
+                        ret = hs_put(d, d->window[(d->head - d->hs_index) & d->window_mask]);
+                    }
+                    d->hs_state = HS_TAG;
+                    break;
+                }
+
+                default:
+                    break;
+            }
+
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+    }
+
+    // Hand over what this chunk produced
+    esp_err_t ret = emit(d, d->out_buf, d->out_len);
+    d->out_len = 0;
+    return ret;
+}
+
+decomp_stream_t* decomp_stream_create(const decomp_config_t *config,
+                                      decomp_output_callback_t callback, void *user_ctx) {
+    if (!config || config->type == DECOMP_NONE) {
+        return NULL;
+    }
+
+    decomp_stream_t *d = calloc(1, sizeof(decomp_stream_t));
+    if (!d) {
+        return NULL;
+    }
+
+    d->type = config->type;
+    d->callback = callback;
+    d->user_ctx = user_ctx;
+
+    if (d->type == DECOMP_HEATSHRINK) {
+        d->hs_window_bits = config->hs_window_bits ? config->hs_window_bits : DECOMP_HS_WINDOW_DEFAULT;
+        d->hs_lookahead_bits = config->hs_lookahead_bits ? config->hs_lookahead_bits : DECOMP_HS_LOOKAHEAD_DEFAULT;
+
+        if (d->hs_window_bits < 4 || d->hs_window_bits > DECOMP_HS_WINDOW_MAX ||
+            d->hs_lookahead_bits < 3 || d->hs_lookahead_bits >= d->hs_window_bits) {
+            ESP_LOGE(TAG, "Invalid heatshrink parameters w=%d l=%d",
+                     d->hs_window_bits, d->hs_lookahead_bits);
+            free(d);
+            return NULL;
+        }
+
+        d->window_mask = (1 << d->hs_window_bits) - 1;
+        d->window = calloc(1, 1 << d->hs_window_bits);
+        d->out_buf = malloc(HS_OUT_BUF_SIZE);
+        if (!d->window || !d->out_buf) {
+            decomp_stream_free(d);
+            return NULL;
+        }
+        ESP_LOGD(TAG, "Heatshrink stream: window=%d lookahead=%d",
+                 d->hs_window_bits, d->hs_lookahead_bits);
+        return d;
+    }
+
+    d->inflator = malloc(sizeof(tinfl_decompressor));
+    d->dict = malloc(TINFL_LZ_DICT_SIZE);
+    if (!d->inflator || !d->dict) {
+        decomp_stream_free(d);
+        return NULL;
+    }
+    tinfl_init(d->inflator);
+
+    if (d->type == DECOMP_ZLIB) {
+        d->tinfl_flags = TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32;
+    }
+
+    ESP_LOGI(TAG, "%s stream, %d byte window", decomp_type_name(d->type), TINFL_LZ_DICT_SIZE);
+    return d;
+}
+
+esp_err_t decomp_stream_feed(decomp_stream_t *d, const uint8_t *data, size_t len) {
+    if (!d || (!data && len)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    d->in_bytes += len;
+
+    switch (d->type) {
+        case DECOMP_GZIP:
+            return gzip_feed(d, data, len);
+
+        case DECOMP_HEATSHRINK:
+            return heatshrink_feed(d, data, len);
+
+        case DECOMP_DEFLATE:
+            // HTTP "deflate" is zlib wrapped, but raw streams are common too
+            if (d->hdr_len < 2) {
+                while (d->hdr_len < 2 && len > 0) {
+                    d->hdr[d->hdr_len++] = *data++;
+                    len--;
+                }
+                if (d->hdr_len < 2) {
+                    return ESP_OK;
+                }
+                uint16_t cmf_flg = (d->hdr[0] << 8) | d->hdr[1];
+                if ((d->hdr[0] & 0x0F) == 8 && (cmf_flg % 31) == 0) {
+                    d->tinfl_flags = TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32;
+                    ESP_LOGI(TAG, "Deflate stream has zlib header");
+                }
+                size_t consumed;
+                esp_err_t ret = inflate_feed(d, d->hdr, 2, &consumed);
+                if (ret != ESP_OK) {
+                    return ret;
+                }
+            }
+            // fall through
+
+        case DECOMP_ZLIB: {
+            size_t consumed = 0;
+            esp_err_t ret = inflate_feed(d, data, len, &consumed);
+            if (ret == ESP_OK && consumed < len) {
+                ESP_LOGW(TAG, "Ignoring %u bytes after end of stream", (unsigned)(len - consumed));
+            }
+            return ret;
+        }
+
+        default:
+            return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+esp_err_t decomp_stream_finish(decomp_stream_t *d) {
+    if (!d) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (d->type != DECOMP_HEATSHRINK && !d->done) {
+        ESP_LOGE(TAG, "%s stream truncated after %lu bytes", decomp_type_name(d->type), d->in_bytes);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ESP_LOGD(TAG, "%s: %lu -> %lu bytes", decomp_type_name(d->type), d->in_bytes, d->out_bytes);
+    return ESP_OK;
+}
+
+void decomp_stream_free(decomp_stream_t *d) {
+    if (d) {
+        free(d->inflator);
+        free(d->dict);
+        free(d->window);
+        free(d->out_buf);
+        free(d);
+    }
+}
+
+uint32_t decomp_stream_get_in_bytes(decomp_stream_t *d) {
+    return d ? d->in_bytes : 0;
+}
+
+uint32_t decomp_stream_get_out_bytes(decomp_stream_t *d) {
+    return d ? d->out_bytes : 0;
+}
@@ -0,0 +1,314 @@
+#include "elf_parser.h"
+#include "esp_log.h"
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "ELF_PARSER";
+
+#define ELF_HEADER_SIZE     52
+#define ELF_PHDR_SIZE       32
+#define ELF_CLASS_32        1
+#define ELF_DATA_LSB        1
+#define ELF_MACHINE_ARM     40
+#define ELF_PT_LOAD         1
+
+typedef struct {
+    uint32_t offset;
+    uint32_t paddr;
+    uint32_t filesz;
+} elf_segment_t;
+
+typedef enum {
+    ELF_STATE_HEADER = 0,   // Buffering ELF header and program headers
+    ELF_STATE_STREAM,       // Forwarding segment data as it arrives
+    ELF_STATE_DONE,         // All segments forwarded, ignoring the rest
+    ELF_STATE_ERROR
+} elf_state_t;
+
+struct elf_stream_parser {
+    elf_state_t state;
+    uint8_t *seek_buf;
+    uint32_t seek_len;
+    uint32_t headers_end;
+    uint32_t file_pos;
+    elf_segment_t segments[ELF_MAX_SEGMENTS];
+    int segment_count;
+    int current_segment;
+    uint32_t load_size;
+    elf_data_callback_t callback;
+    void *user_ctx;
+};
+
+static uint16_t rd16(const uint8_t *p) {
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool elf_stream_is_elf(const uint8_t *data, size_t len) {
+    return len >= 4 && data[0] == 0x7F && data[1] == 'E' &&
+           data[2] == 'L' && data[3] == 'F';
+}
+
+// Validate ELF header and work out how much of the file holds the program headers
+static esp_err_t parse_elf_header(elf_stream_parser_t *parser) {
+    const uint8_t *h = parser->seek_buf;
+
+    if (!elf_stream_is_elf(h, parser->seek_len)) {
+        ESP_LOGE(TAG, "Bad ELF magic");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (h[4] != ELF_CLASS_32 || h[5] != ELF_DATA_LSB) {
+        ESP_LOGE(TAG, "Only little-endian ELF32 is supported (class=%d, data=%d)", h[4], h[5]);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint16_t machine = rd16(h + 18);
+    if (machine != ELF_MACHINE_ARM) {
+        ESP_LOGW(TAG, "Unexpected e_machine %u (expected ARM)", machine);
+    }
+
+    uint32_t phoff = rd32(h + 28);
+    uint16_t phentsize = rd16(h + 42);
+    uint16_t phnum = rd16(h + 44);
+
+    if (phnum == 0) {
+        ESP_LOGE(TAG, "No program headers");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (phentsize < ELF_PHDR_SIZE) {
+        ESP_LOGE(TAG, "Bad program header size %u", phentsize);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // 64-bit so a huge e_phoff can't wrap back into the window
+    uint64_t end = (uint64_t)phoff + (uint64_t)phentsize * phnum;
+    if (phoff < ELF_HEADER_SIZE || end > ELF_SEEK_AHEAD_SIZE) {
+        ESP_LOGE(TAG, "Program headers at 0x%lX-0x%llX outside seek-ahead window (%d bytes)",
+                 phoff, end, ELF_SEEK_AHEAD_SIZE);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    parser->headers_end = (uint32_t)end;
+    return ESP_OK;
+}
+
+// Collect PT_LOAD segments and sort them by file offset
+static esp_err_t parse_program_headers(elf_stream_parser_t *parser) {
+    const uint8_t *h = parser->seek_buf;
+    uint32_t phoff = rd32(h + 28);
+    uint16_t phentsize = rd16(h + 42);
+    uint16_t phnum = rd16(h + 44);
+
+    parser->segment_count = 0;
+    parser->load_size = 0;
+
+    for (int i = 0; i < phnum; i++) {
+        const uint8_t *ph = h + phoff + (uint32_t)i * phentsize;
+        uint32_t type = rd32(ph + 0);
+        uint32_t offset = rd32(ph + 4);
+        uint32_t paddr = rd32(ph + 12);
+        uint32_t filesz = rd32(ph + 16);
+
+        if (type != ELF_PT_LOAD || filesz == 0) {
+            continue;
+        }
+
+        // Segment ends are computed in 32 bits later on, they must not wrap
+        if ((uint64_t)offset + filesz > UINT32_MAX || (uint64_t)paddr + filesz > UINT32_MAX ||
+            (uint64_t)parser->load_size + filesz > UINT32_MAX) {
+            ESP_LOGE(TAG, "PT_LOAD at offset 0x%08lX paddr 0x%08lX size %lu wraps around",
+                     offset, paddr, filesz);
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        if (parser->segment_count >= ELF_MAX_SEGMENTS) {
+            ESP_LOGE(TAG, "Too many PT_LOAD segments (max %d)", ELF_MAX_SEGMENTS);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+
+        ESP_LOGI(TAG, "PT_LOAD: offset=0x%08lX paddr=0x%08lX size=%lu", offset, paddr, filesz);
+
+        // Insertion sort keeps the table ordered by file offset
+        int j = parser->segment_count++;
+        while (j > 0 && parser->segments[j - 1].offset > offset) {
+            parser->segments[j] = parser->segments[j - 1];
+            j--;
+        }
+        parser->segments[j].offset = offset;
+        parser->segments[j].paddr = paddr;
+        parser->segments[j].filesz = filesz;
+        parser->load_size += filesz;
+    }
+
+    if (parser->segment_count == 0) {
+        ESP_LOGE(TAG, "No loadable segments");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (int i = 1; i < parser->segment_count; i++) {
+        const elf_segment_t *prev = &parser->segments[i - 1];
+        if (parser->segments[i].offset < prev->offset + prev->filesz) {
+            ESP_LOGE(TAG, "Overlapping segments at file offset 0x%08lX",
+                     parser->segments[i].offset);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+    }
+
+    ESP_LOGI(TAG, "%d loadable segments, %lu bytes", parser->segment_count, parser->load_size);
+    return ESP_OK;
+}
+
+// Forward the part of [pos, pos + len) that falls inside loadable segments
+static void forward_data(elf_stream_parser_t *parser, uint32_t pos, const uint8_t *data, size_t len) {
+    uint32_t end = pos + len;
+
+    while (parser->current_segment < parser->segment_count && pos < end) {
+        const elf_segment_t *seg = &parser->segments[parser->current_segment];
+        uint32_t seg_end = seg->offset + seg->filesz;
+
+        if (end <= seg->offset) {
+            return;
+        }
+
+        uint32_t from = pos > seg->offset ? pos : seg->offset;
+        uint32_t to = end < seg_end ? end : seg_end;
+
+        if (to > from && parser->callback) {
+            parser->callback(seg->paddr + (from - seg->offset),
+                             data + (from - pos), to - from, parser->user_ctx);
+        }
+
+        if (to < seg_end) {
+            return;
+        }
+
+        parser->current_segment++;
+        data += to - pos;
+        pos = to;
+    }
+
+    if (parser->current_segment >= parser->segment_count) {
+        parser->state = ELF_STATE_DONE;
+    }
+}
+
+elf_stream_parser_t* elf_stream_create(elf_data_callback_t callback, void *user_ctx) {
+    elf_stream_parser_t *parser = calloc(1, sizeof(elf_stream_parser_t));
+    if (!parser) {
+        return NULL;
+    }
+
+    parser->seek_buf = malloc(ELF_SEEK_AHEAD_SIZE);
+    if (!parser->seek_buf) {
+        free(parser);
+        return NULL;
+    }
+
+    parser->callback = callback;
+    parser->user_ctx = user_ctx;
+    return parser;
+}
+
+esp_err_t elf_stream_parse(elf_stream_parser_t *parser, const uint8_t *data, size_t len) {
+    if (!parser) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (parser->state == ELF_STATE_ERROR) {
+        return ESP_FAIL;
+    }
+
+    if (parser->state == ELF_STATE_HEADER) {
+        // Buffer until the ELF header and the whole program header table are in
+        uint32_t need = parser->headers_end ? parser->headers_end : ELF_HEADER_SIZE;
+        while (len > 0 && parser->state == ELF_STATE_HEADER) {
+            uint32_t take = need - parser->seek_len;
+            if (take > len) {
+                take = len;
+            }
+            memcpy(parser->seek_buf + parser->seek_len, data, take);
+            parser->seek_len += take;
+            parser->file_pos += take;
+            data += take;
+            len -= take;
+
+            if (parser->seek_len < need) {
+                return ESP_OK;
+            }
+
+            esp_err_t ret;
+            if (parser->headers_end == 0) {
+                ret = parse_elf_header(parser);
+                need = parser->headers_end;
+            } else {
+                ret = parse_program_headers(parser);
+                if (ret == ESP_OK) {
+                    parser->state = ELF_STATE_STREAM;
+                    // Segment bytes that arrived with the headers
+                    forward_data(parser, 0, parser->seek_buf, parser->seek_len);
+                }
+            }
+
+            if (ret != ESP_OK) {
+                parser->state = ELF_STATE_ERROR;
+                return ret;
+            }
+        }
+    }
+
+    if (parser->state == ELF_STATE_STREAM && len > 0) {
+        forward_data(parser, parser->file_pos, data, len);
+    }
+
+    parser->file_pos += len;
+    return ESP_OK;
+}
+
+esp_err_t elf_stream_finish(elf_stream_parser_t *parser) {
+    if (!parser) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (parser->state == ELF_STATE_ERROR) {
+        return ESP_FAIL;
+    }
+
+    if (parser->state != ELF_STATE_DONE) {
+        ESP_LOGE(TAG, "ELF truncated at %lu bytes (%d/%d segments complete)",
+                 parser->file_pos, parser->current_segment, parser->segment_count);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ESP_LOGI(TAG, "ELF complete: %lu file bytes, %lu load bytes",
+             parser->file_pos, parser->load_size);
+    return ESP_OK;
+}
+
+void elf_stream_reset(elf_stream_parser_t *parser) {
+    if (parser) {
+        parser->state = ELF_STATE_HEADER;
+        parser->seek_len = 0;
+        parser->headers_end = 0;
+        parser->file_pos = 0;
+        parser->segment_count = 0;
+        parser->current_segment = 0;
+        parser->load_size = 0;
+    }
+}
+
+void elf_stream_free(elf_stream_parser_t *parser) {
+    if (parser) {
+        free(parser->seek_buf);
+        free(parser);
+    }
+}
+
+uint32_t elf_stream_get_load_size(elf_stream_parser_t *parser) {
+    return parser ? parser->load_size : 0;
+}
@@ -14,6 +14,8 @@ struct hex_stream_parser {
     void *user_ctx;
     uint32_t line_count;
     uint32_t data_bytes;
+    uint32_t error_count;
+    bool eof_seen;
 };
 
 static uint8_t hex_char_to_byte(char c) {
@@ -121,6 +123,7 @@ esp_err_t hex_stream_parse(hex_stream_parser_t *parser, const uint8_t *data, siz
                             break;
                             
                         case HEX_TYPE_EOF:
+                            parser->eof_seen = true;
                             ESP_LOGI(TAG, "EOF record found. Lines: %lu, Data bytes: %lu",
                                     parser->line_count, parser->data_bytes);
                             if (parser->callback) {
@@ -147,6 +150,7 @@ esp_err_t hex_stream_parse(hex_stream_parser_t *parser, const uint8_t *data, siz
                             break;
                     }
                 } else {
+                    parser->error_count++;
                     ESP_LOGE(TAG, "Failed to parse line %lu: %s", 
                             parser->line_count + 1, (char*)parser->line_buffer);
                 }
@@ -157,6 +161,7 @@ esp_err_t hex_stream_parse(hex_stream_parser_t *parser, const uint8_t *data, siz
             parser->line_buffer[parser->line_pos++] = c;
         } else {
             ESP_LOGE(TAG, "Line too long");
+            parser->error_count++;
             parser->line_pos = 0;
         }
     }
@@ -171,6 +176,8 @@ void hex_stream_reset(hex_stream_parser_t *parser) {
         parser->line_pos = 0;
         parser->line_count = 0;
         parser->data_bytes = 0;
+        parser->error_count = 0;
+        parser->eof_seen = false;
     }
 }
 
@@ -180,4 +187,11 @@ void hex_stream_free(hex_stream_parser_t *parser) {
 
 uint32_t hex_stream_get_base_addr(hex_stream_parser_t *parser) {
     return parser ? (parser->extended_addr + parser->segment_addr) : 0;
-}
\ No newline at end of file
+}
+uint32_t hex_stream_get_error_count(hex_stream_parser_t *parser) {
+    return parser ? parser->error_count : 0;
+}
+
+bool hex_stream_is_complete(hex_stream_parser_t *parser) {
+    return parser && parser->eof_seen;
+}
@@ -0,0 +1,151 @@
+#include "hs_encoder.h"
+#include "decomp_stream.h"
+#include "esp_log.h"
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "HS_ENCODER";
+
+#define HS_HASH_BITS    12
+#define HS_HASH_SIZE    (1 << HS_HASH_BITS)
+#define HS_CHAIN_LIMIT  64      // Candidates tried per position
+
+struct hs_encoder {
+    uint8_t window_bits;
+    uint8_t lookahead_bits;
+    size_t max_block;
+    int16_t *head;              // Most recent position for each hash
+    int16_t *prev;              // Previous position with the same hash
+};
+
+typedef struct {
+    uint8_t *out;
+    size_t cap;
+    size_t len;
+    uint8_t acc;
+    uint8_t bits;
+    bool overflow;
+} bit_writer_t;
+
+static void put_bits(bit_writer_t *w, uint16_t value, uint8_t count) {
+    while (count--) {
+        w->acc = (w->acc << 1) | ((value >> count) & 1);
+        if (++w->bits == 8) {
+            if (w->len >= w->cap) {
+                w->overflow = true;
+            } else if (w->out) {
+                w->out[w->len] = w->acc;
+            }
+            w->len++;
+            w->acc = 0;
+            w->bits = 0;
+        }
+    }
+}
+
+static uint16_t hash2(const uint8_t *p) {
+    return ((p[0] << 4) ^ p[1]) & (HS_HASH_SIZE - 1);
+}
+
+hs_encoder_t* hs_encoder_create(uint8_t window_bits, uint8_t lookahead_bits, size_t max_block) {
+    if (window_bits < 4 || window_bits > DECOMP_HS_WINDOW_MAX ||
+        lookahead_bits < 3 || lookahead_bits >= window_bits || max_block > INT16_MAX) {
+        ESP_LOGE(TAG, "Invalid parameters w=%d l=%d block=%u",
+                 window_bits, lookahead_bits, (unsigned)max_block);
+        return NULL;
+    }
+
+    hs_encoder_t *enc = calloc(1, sizeof(hs_encoder_t));
+    if (!enc) {
+        return NULL;
+    }
+
+    enc->window_bits = window_bits;
+    enc->lookahead_bits = lookahead_bits;
+    enc->max_block = max_block;
+    enc->head = malloc(HS_HASH_SIZE * sizeof(int16_t));
+    enc->prev = malloc(max_block * sizeof(int16_t));
+    if (!enc->head || !enc->prev) {
+        hs_encoder_free(enc);
+        return NULL;
+    }
+    return enc;
+}
+
+// Greedy parse with hash chains, a back-reference is used whenever it is
+// shorter than the same bytes sent as literals
+size_t hs_encoder_run(hs_encoder_t *enc, const uint8_t *in, size_t len,
+                      uint8_t *out, size_t out_cap) {
+    if (!enc || len > enc->max_block) {
+        return 0;
+    }
+
+    bit_writer_t w = { .out = out, .cap = out_cap };
+    size_t max_dist = (size_t)1 << enc->window_bits;
+    size_t max_len = (size_t)1 << enc->lookahead_bits;
+    size_t ref_bits = 1 + enc->window_bits + enc->lookahead_bits;
+
+    memset(enc->head, 0xFF, HS_HASH_SIZE * sizeof(int16_t));
+
+    size_t i = 0;
+    while (i < len && !w.overflow) {
+        size_t best_len = 0;
+        size_t best_dist = 0;
+
+        if (i + 1 < len) {
+            size_t limit = len - i < max_len ? len - i : max_len;
+            int16_t cand = enc->head[hash2(in + i)];
+            for (int n = 0; cand >= 0 && n < HS_CHAIN_LIMIT; n++, cand = enc->prev[cand]) {
+                size_t dist = i - cand;
+                if (dist > max_dist) {
+                    break;
+                }
+                size_t m = 0;
+                while (m < limit && in[cand + m] == in[i + m]) {
+                    m++;
+                }
+                if (m > best_len) {
+                    best_len = m;
+                    best_dist = dist;
+                    if (m == limit) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        size_t step = 1;
+        if (best_len * 9 > ref_bits) {
+            put_bits(&w, 0, 1);
+            put_bits(&w, best_dist - 1, enc->window_bits);
+            put_bits(&w, best_len - 1, enc->lookahead_bits);
+            step = best_len;
+        } else {
+            put_bits(&w, 1, 1);
+            put_bits(&w, in[i], 8);
+        }
+
+        for (size_t end = i + step; i < end; i++) {
+            if (i + 1 < len) {
+                uint16_t h = hash2(in + i);
+                enc->prev[i] = enc->head[h];
+                enc->head[h] = (int16_t)i;
+            }
+        }
+    }
+
+    // Zero padding never completes a back-reference, so the decoder ignores it
+    if (w.bits) {
+        put_bits(&w, 0, 8 - w.bits);
+    }
+
+    return w.overflow ? 0 : w.len;
+}
+
+void hs_encoder_free(hs_encoder_t *enc) {
+    if (enc) {
+        free(enc->head);
+        free(enc->prev);
+        free(enc);
+    }
+}
@@ -0,0 +1,215 @@
+#include "tar_parser.h"
+#include "esp_log.h"
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "TAR_PARSER";
+
+typedef enum {
+    TAR_STATE_HEADER = 0,
+    TAR_STATE_DATA,
+    TAR_STATE_PAD,
+    TAR_STATE_DONE,
+    TAR_STATE_ERROR
+} tar_state_t;
+
+struct tar_stream_parser {
+    tar_state_t state;
+    uint8_t header[TAR_BLOCK_SIZE];
+    uint32_t header_len;
+    uint32_t remaining;         // File bytes left in the current entry
+    uint32_t pad;               // Bytes up to the next block boundary
+    bool report;                // Current entry goes to the callbacks
+    uint8_t zero_blocks;
+    uint32_t file_count;
+    tar_callbacks_t callbacks;
+    void *user_ctx;
+};
+
+static uint32_t parse_octal(const uint8_t *field, size_t len) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < len && field[i]; i++) {
+        if (field[i] == ' ') {
+            continue;
+        }
+        if (field[i] < '0' || field[i] > '7') {
+            break;
+        }
+        value = (value << 3) | (field[i] - '0');
+    }
+    return value;
+}
+
+static bool header_checksum_ok(const uint8_t *h) {
+    uint32_t expected = parse_octal(h + 148, 8);
+    uint32_t sum = 0;
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        sum += (i >= 148 && i < 156) ? ' ' : h[i];
+    }
+    return sum == expected;
+}
+
+static esp_err_t parse_header(tar_stream_parser_t *parser) {
+    const uint8_t *h = parser->header;
+
+    // Two zero blocks end the archive
+    bool zero = true;
+    for (int i = 0; i < TAR_BLOCK_SIZE && zero; i++) {
+        zero = h[i] == 0;
+    }
+    if (zero) {
+        if (++parser->zero_blocks == 2) {
+            parser->state = TAR_STATE_DONE;
+        }
+        return ESP_OK;
+    }
+    parser->zero_blocks = 0;
+
+    if (!header_checksum_ok(h)) {
+        ESP_LOGE(TAG, "Bad header checksum");
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    uint32_t size = parse_octal(h + 124, 12);
+    char type = h[156];
+    parser->remaining = size;
+    parser->pad = (TAR_BLOCK_SIZE - (size % TAR_BLOCK_SIZE)) % TAR_BLOCK_SIZE;
+    parser->report = type == '0' || type == '\0';
+
+    if (parser->report) {
+        // ustar splits long paths into prefix and name, only the base name matters here
+        char name[TAR_NAME_MAX + 1];
+        memcpy(name, h, TAR_NAME_MAX);
+        name[TAR_NAME_MAX] = '\0';
+
+        parser->file_count++;
+        ESP_LOGI(TAG, "File %s (%lu bytes)", name, size);
+        esp_err_t ret = parser->callbacks.begin(name, size, parser->user_ctx);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    } else {
+        ESP_LOGD(TAG, "Skipping entry type '%c' (%lu bytes)", type, size);
+    }
+
+    if (size == 0) {
+        parser->state = TAR_STATE_HEADER;
+        return parser->report ? parser->callbacks.end(parser->user_ctx) : ESP_OK;
+    }
+    parser->state = TAR_STATE_DATA;
+    return ESP_OK;
+}
+
+tar_stream_parser_t* tar_stream_create(const tar_callbacks_t *callbacks, void *user_ctx) {
+    if (!callbacks || !callbacks->begin || !callbacks->data || !callbacks->end) {
+        return NULL;
+    }
+
+    tar_stream_parser_t *parser = calloc(1, sizeof(tar_stream_parser_t));
+    if (!parser) {
+        return NULL;
+    }
+
+    parser->callbacks = *callbacks;
+    parser->user_ctx = user_ctx;
+    return parser;
+}
+
+esp_err_t tar_stream_parse(tar_stream_parser_t *parser, const uint8_t *data, size_t len) {
+    if (!parser) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (len > 0) {
+        esp_err_t ret = ESP_OK;
+
+        switch (parser->state) {
+            case TAR_STATE_HEADER: {
+                size_t chunk = TAR_BLOCK_SIZE - parser->header_len;
+                if (chunk > len) {
+                    chunk = len;
+                }
+                memcpy(parser->header + parser->header_len, data, chunk);
+                parser->header_len += chunk;
+                data += chunk;
+                len -= chunk;
+
+                if (parser->header_len == TAR_BLOCK_SIZE) {
+                    parser->header_len = 0;
+                    ret = parse_header(parser);
+                }
+                break;
+            }
+
+            case TAR_STATE_DATA: {
+                size_t chunk = parser->remaining < len ? parser->remaining : len;
+                if (parser->report) {
+                    ret = parser->callbacks.data(data, chunk, parser->user_ctx);
+                }
+                parser->remaining -= chunk;
+                data += chunk;
+                len -= chunk;
+
+                if (ret == ESP_OK && parser->remaining == 0) {
+                    parser->state = parser->pad ? TAR_STATE_PAD : TAR_STATE_HEADER;
+                    if (parser->report) {
+                        ret = parser->callbacks.end(parser->user_ctx);
+                    }
+                }
+                break;
+            }
+
+            case TAR_STATE_PAD: {
+                size_t chunk = parser->pad < len ? parser->pad : len;
+                parser->pad -= chunk;
+                data += chunk;
+                len -= chunk;
+                if (parser->pad == 0) {
+                    parser->state = TAR_STATE_HEADER;
+                }
+                break;
+            }
+
+            case TAR_STATE_DONE:
+                // Trailing blocks after the end marker are padding
+                return ESP_OK;
+
+            case TAR_STATE_ERROR:
+                return ESP_FAIL;
+        }
+
+        if (ret != ESP_OK) {
+            parser->state = TAR_STATE_ERROR;
+            return ret;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t tar_stream_finish(tar_stream_parser_t *parser) {
+    if (!parser) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Some tools leave out the end marker, a clean block boundary is enough
+    if (parser->state == TAR_STATE_DONE ||
+        (parser->state == TAR_STATE_HEADER && parser->header_len == 0)) {
+        if (parser->file_count == 0) {
+            ESP_LOGE(TAG, "Archive holds no files");
+            return ESP_ERR_NOT_FOUND;
+        }
+        return ESP_OK;
+    }
+
+    ESP_LOGE(TAG, "Archive truncated");
+    return ESP_ERR_INVALID_SIZE;
+}
+
+uint32_t tar_stream_get_file_count(tar_stream_parser_t *parser) {
+    return parser ? parser->file_count : 0;
+}
+
+void tar_stream_free(tar_stream_parser_t *parser) {
+    free(parser);
+}
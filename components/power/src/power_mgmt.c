@@ -4,12 +4,15 @@
 #include "driver/gpio.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include "error_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "esp_adc/adc_oneshot.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
+#include <stdio.h>
+#include <string.h>
 
 static const char *TAG = "POWER_MGMT";
 static power_config_t power_config = {0};
@@ -259,6 +262,7 @@ void power_restore_after_sleep(void) {
 esp_err_t power_enter_deep_sleep(uint32_t duration_sec) {
     ESP_LOGI(TAG, "Entering deep sleep for %lu seconds", (unsigned long)duration_sec);
     power_prepare_for_sleep();
+    error_log_flush();
     current_state = SYSTEM_STATE_DEEP_SLEEP;
     esp_sleep_enable_timer_wakeup(duration_sec * 1000000ULL);
     esp_deep_sleep_start();
@@ -292,14 +296,10 @@ esp_err_t power_log_error(const char *error_msg) {
     if (!error_msg) {
         return ESP_ERR_INVALID_ARG;
     }
-    ESP_LOGE(TAG, "Error logged: %s", error_msg);
-    nvs_handle_t nvs;
-    esp_err_t ret = nvs_open("error_log", NVS_READWRITE, &nvs);
-    if (ret == ESP_OK) {
-        nvs_set_str(nvs, "last_error", error_msg);
-        nvs_commit(nvs);
-        nvs_close(nvs);
-    }
+    // Text goes to the console only, the persistent log keeps its id
+    uint32_t id = error_log_text_id(error_msg);
+    ESP_LOGE(TAG, "Error logged [%08lX]: %s", id, error_msg);
+    error_log_record(ERROR_LOG_POWER, ESP_FAIL, id);
     return ESP_OK;
 }
 
@@ -346,23 +346,31 @@ esp_err_t power_get_last_errors(char *buffer, size_t size) {
     if (!buffer || size == 0) {
         return ESP_ERR_INVALID_ARG;
     }
-    nvs_handle_t nvs;
-    esp_err_t ret = nvs_open("error_log", NVS_READONLY, &nvs);
-    if (ret == ESP_OK) {
-        size_t length = size;
-        ret = nvs_get_str(nvs, "last_error", buffer, &length);
-        nvs_close(nvs);
+    // Newest records that fit, one per line, oldest first
+    buffer[0] = '\0';
+    size_t used = 0;
+    uint32_t cursor = 0;
+    error_log_entry_t entry;
+    while (error_log_next(&cursor, &entry)) {
+        char line[96];
+        int len = error_log_format(&entry, line, sizeof(line));
+        if (len + 1 >= (int)size) {
+            continue;
+        }
+        while (used + len + 1 >= size) {
+            // Drop the oldest line to make room
+            char *next = strchr(buffer, '\n');
+            size_t drop = next ? (size_t)(next - buffer) + 1 : used;
+            memmove(buffer, buffer + drop, used - drop + 1);
+            used -= drop;
+        }
+        used += snprintf(buffer + used, size - used, "%s\n", line);
     }
-    return ret;
+    return used ? ESP_OK : ESP_ERR_NOT_FOUND;
 }
 
 void power_clear_error_log(void) {
-    nvs_handle_t nvs;
-    if (nvs_open("error_log", NVS_READWRITE, &nvs) == ESP_OK) {
-        nvs_erase_all(nvs);
-        nvs_commit(nvs);
-        nvs_close(nvs);
-    }
+    error_log_clear();
 }
 
 system_state_t power_get_state(void) {
@@ -6,7 +6,14 @@
 #include "esp_err.h"
 #include "swd_flash.h"
 
-// Backup operations
+// Backup operations, stored by whoever registered with flash_safety_set_backup_ops
+typedef struct {
+    esp_err_t (*create)(uint32_t addr, uint32_t size, const char *description);
+    esp_err_t (*restore)(uint32_t backup_index);    // 0 is the newest
+    esp_err_t (*list)(void);
+} flash_backup_ops_t;
+
+void flash_safety_set_backup_ops(const flash_backup_ops_t *ops);
 esp_err_t create_firmware_backup(uint32_t addr, uint32_t size, const char *description);
 esp_err_t restore_firmware_backup(uint32_t backup_index);
 esp_err_t list_firmware_backups(void);
@@ -20,6 +27,9 @@ esp_err_t safe_flash_erase(uint32_t addr, uint32_t size, bool force);
 esp_err_t safe_flash_write(uint32_t addr, const uint8_t *data, uint32_t size);
 esp_err_t atomic_firmware_update(const firmware_update_t *update, bool create_backup);
 
+// True if the range overlaps MBR, SoftDevice or UICR, region_name is set to the first hit
+bool flash_safety_touches_protected(uint32_t addr, uint32_t size, const char **region_name);
+
 // Recovery
 esp_err_t enter_recovery_mode(void);
 esp_err_t check_recovery_trigger(void);
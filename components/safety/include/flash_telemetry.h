@@ -0,0 +1,58 @@
+#ifndef FLASH_TELEMETRY_H
+#define FLASH_TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "swd_flash.h"
+
+// Per-target wear and operation history, keyed by the nRF52 FICR DEVICEID.
+// Counters are batched in RAM for the attached target and written to NVS
+// only when enough has changed, a failure was seen, the target changes or
+// flash_telemetry_flush is called.
+#define FLASH_TELEMETRY_MAX_TARGETS     8
+#define FLASH_TELEMETRY_PAGES           ((NRF52_FLASH_SIZE / NRF52_FLASH_PAGE_SIZE) + 1)   // + UICR
+#define FLASH_TELEMETRY_FLUSH_ERASES    128     // Page erases batched before a write
+#define FLASH_TELEMETRY_FLUSH_SEC       900     // Or this long after the first unsaved change
+
+typedef struct {
+    uint64_t device_id;
+    uint32_t sessions;          // Times the target was attached
+    uint32_t flash_count;       // Completed flash operations
+    uint32_t flash_failures;
+    uint32_t page_erases;       // Page erases, a mass erase counts every page
+    uint32_t erase_failures;
+    uint32_t verify_failures;
+    uint32_t mass_erases;
+    uint32_t last_flash_time;   // Unix time, uptime seconds if the clock was never set
+    uint32_t last_flash_ms;
+    uint32_t total_flash_ms;
+    uint16_t max_page_erases;   // Most worn page
+    uint16_t max_page_index;
+} flash_target_stats_t;
+
+// Load the list of known targets
+esp_err_t flash_telemetry_init(void);
+
+// Read DEVICEID from the connected target and make it current, saving the previous one
+esp_err_t flash_telemetry_attach(void);
+
+// Recording, ignored until a target is attached
+void flash_telemetry_page_erased(uint32_t addr, bool success);
+void flash_telemetry_mass_erased(bool success);
+void flash_telemetry_verify_failed(uint32_t addr);
+void flash_telemetry_flash_done(bool success, uint32_t duration_ms);
+
+// Write pending counters to NVS
+esp_err_t flash_telemetry_flush(void);
+
+// Stats of the attached target, ESP_ERR_INVALID_STATE if none
+esp_err_t flash_telemetry_current(flash_target_stats_t *stats);
+
+// Erase counts of the attached target, pages index by address / page size, UICR last
+esp_err_t flash_telemetry_page_counts(uint16_t counts[FLASH_TELEMETRY_PAGES]);
+
+// Stats of every known target, most recently attached first, returns the count
+int flash_telemetry_list(flash_target_stats_t *targets, int max);
+
+#endif
@@ -23,19 +23,8 @@ static const protected_region_t protected_regions[] = {
     {0x00001000, 0x00008000, "SoftDevice", true},       // If SoftDevice present
 };
 
-// Backup management structure
-typedef struct {
-    uint32_t magic;
-    uint32_t version;
-    uint32_t fw_size;
-    uint32_t fw_crc32;
-    uint32_t backup_addr;
-    uint32_t timestamp;
-    char description[64];
-} firmware_backup_t;
-
-#define BACKUP_MAGIC 0xBAC0FFEE
-#define MAX_BACKUPS 3
+// Backup storage, registered by the firmware store
+static const flash_backup_ops_t *backup_ops = NULL;
 
 // Check if address is in protected region
 static bool is_protected_region(uint32_t addr, uint32_t size, bool *needs_confirmation) {
@@ -56,80 +45,47 @@ static bool is_protected_region(uint32_t addr, uint32_t size, bool *needs_confir
     return false;
 }
 
+// Public check used to validate staged images before they reach the target
+bool flash_safety_touches_protected(uint32_t addr, uint32_t size, const char **region_name) {
+    uint32_t end_addr = addr + size - 1;
+
+    for (size_t i = 0; i < sizeof(protected_regions)/sizeof(protected_regions[0]); i++) {
+        const protected_region_t *region = &protected_regions[i];
+        if (!(end_addr < region->start || addr > region->end)) {
+            if (region_name) {
+                *region_name = region->name;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void flash_safety_set_backup_ops(const flash_backup_ops_t *ops) {
+    backup_ops = ops;
+}
+
 // Create firmware backup before flashing
 esp_err_t create_firmware_backup(uint32_t addr, uint32_t size, const char *description) {
-    ESP_LOGI(TAG, "Creating backup of 0x%08lX size %lu", addr, size);
-    
-    // Allocate buffer for backup (in chunks to avoid memory issues)
-    const uint32_t chunk_size = 4096;
-    uint8_t *buffer = malloc(chunk_size);
-    if (!buffer) {
-        ESP_LOGE(TAG, "Failed to allocate backup buffer");
-        return ESP_ERR_NO_MEM;
+    if (!backup_ops) {
+        ESP_LOGW(TAG, "No backup storage, cannot back up 0x%08lX", addr);
+        return ESP_ERR_NOT_SUPPORTED;
     }
-    
-    // Calculate CRC while reading
-    uint32_t crc = 0;
-    uint32_t remaining = size;
-    uint32_t current_addr = addr;
-    
-    while (remaining > 0) {
-        uint32_t to_read = (remaining > chunk_size) ? chunk_size : remaining;
-        
-        // Read chunk
-        esp_err_t ret = swd_mem_read_buffer(current_addr, buffer, to_read);
-        if (ret != ESP_OK) {
-            free(buffer);
-            ESP_LOGE(TAG, "Failed to read firmware for backup");
-            return ret;
-        }
-        
-        // Update CRC
-        crc = esp_crc32_le(crc, buffer, to_read);
-        
-        current_addr += to_read;
-        remaining -= to_read;
-    }
-    
-    // Store backup metadata in NVS
-    nvs_handle_t nvs;
-    esp_err_t ret = nvs_open("fw_backup", NVS_READWRITE, &nvs);
-    if (ret != ESP_OK) {
-        free(buffer);
-        return ret;
+    return backup_ops->create(addr, size, description);
+}
+
+esp_err_t restore_firmware_backup(uint32_t backup_index) {
+    if (!backup_ops) {
+        return ESP_ERR_NOT_SUPPORTED;
     }
-    
-    firmware_backup_t backup = {
-        .magic = BACKUP_MAGIC,
-        .version = 1,
-        .fw_size = size,
-        .fw_crc32 = crc,
-        .backup_addr = addr,
-        .timestamp = esp_log_timestamp()
-    };
-    strncpy(backup.description, description, sizeof(backup.description) - 1);
-    
-    // Rotate backups (keep last N)
-    char key[16];
-    for (int i = MAX_BACKUPS - 1; i > 0; i--) {
-        snprintf(key, sizeof(key), "backup_%d", i - 1);
-        size_t length = sizeof(firmware_backup_t);
-        firmware_backup_t old_backup;
-        
-        if (nvs_get_blob(nvs, key, &old_backup, &length) == ESP_OK) {
-            snprintf(key, sizeof(key), "backup_%d", i);
-            nvs_set_blob(nvs, key, &old_backup, sizeof(firmware_backup_t));
-        }
+    return backup_ops->restore(backup_index);
+}
+
+esp_err_t list_firmware_backups(void) {
+    if (!backup_ops) {
+        return ESP_ERR_NOT_SUPPORTED;
     }
-    
-    // Store new backup as backup_0
-    ret = nvs_set_blob(nvs, "backup_0", &backup, sizeof(firmware_backup_t));
-    nvs_commit(nvs);
-    nvs_close(nvs);
-    
-    free(buffer);
-    ESP_LOGI(TAG, "Backup created: CRC=0x%08lX", crc);
-    return ret;
+    return backup_ops->list();
 }
 
 // Verify firmware integrity
@@ -270,8 +226,9 @@ esp_err_t atomic_firmware_update(const firmware_update_t *update, bool create_ba
 rollback:
     if (update_state.rollback_available) {
         ESP_LOGW(TAG, "Attempting rollback...");
-        // Implement rollback from backup
-        // This would read the backup and restore it
+        if (restore_firmware_backup(0) != ESP_OK) {
+            ESP_LOGE(TAG, "Rollback failed, target left partially written");
+        }
     }
     update_state.stage = 0;
     return ret;
@@ -317,30 +274,13 @@ void update_flash_health(bool operation_success, bool is_write) {
 esp_err_t enter_recovery_mode(void) {
     ESP_LOGW(TAG, "Entering emergency recovery mode");
     
-    // Try to restore from most recent backup
-    nvs_handle_t nvs;
-    esp_err_t ret = nvs_open("fw_backup", NVS_READONLY, &nvs);
+    // Restore the most recent backup
+    esp_err_t ret = restore_firmware_backup(0);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "No backups available");
+        ESP_LOGE(TAG, "No usable backup: %s", esp_err_to_name(ret));
         return ret;
     }
     
-    firmware_backup_t backup;
-    size_t length = sizeof(firmware_backup_t);
-    
-    ret = nvs_get_blob(nvs, "backup_0", &backup, &length);
-    nvs_close(nvs);
-    
-    if (ret != ESP_OK || backup.magic != BACKUP_MAGIC) {
-        ESP_LOGE(TAG, "Invalid backup");
-        return ESP_ERR_INVALID_STATE;
-    }
-    
-    ESP_LOGI(TAG, "Found backup: %s (size=%lu, CRC=0x%08lX)", 
-             backup.description, backup.fw_size, backup.fw_crc32);
-    
-    // Here you would implement the actual restore process
-    // This is a placeholder for the restore logic
-    
+    ESP_LOGI(TAG, "Most recent backup restored");
     return ESP_OK;
 }
\ No newline at end of file
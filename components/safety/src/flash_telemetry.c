@@ -0,0 +1,391 @@
+// flash_telemetry.c - Persistent per-target wear and operation counters
+#include "flash_telemetry.h"
+#include "swd_core.h"
+#include "swd_mem.h"
+#include "nrf52_hal.h"
+#include "error_log.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const char *TAG = "FLASH_TELEM";
+
+#define TELEMETRY_NVS_NAMESPACE "flash_telem"
+#define TELEMETRY_INDEX_KEY     "targets"
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_VALID_TIME    1600000000  // Earlier clock values are uptime, not wall time
+
+// Index of known targets, record i is stored under key "t<i>"
+typedef struct {
+    uint32_t version;
+    uint32_t attach_counter;
+    struct {
+        uint64_t device_id;
+        uint32_t last_attach;   // attach_counter value, 0 marks a free slot
+    } slots[FLASH_TELEMETRY_MAX_TARGETS];
+} telemetry_index_t;
+
+typedef struct {
+    uint32_t version;
+    flash_target_stats_t stats;
+    uint16_t page_erases[FLASH_TELEMETRY_PAGES];
+} telemetry_record_t;
+
+static telemetry_index_t index_data;
+static telemetry_record_t *current = NULL;
+static int current_slot = -1;       // -1 while no target is attached
+static SemaphoreHandle_t telemetry_mutex = NULL;
+
+// Pending changes since the last save
+static uint32_t pending_erases = 0;
+static bool pending_failure = false;
+static int64_t first_pending_us = 0;
+
+static void record_key(int slot, char key[8]) {
+    snprintf(key, 8, "t%d", slot);
+}
+
+static esp_err_t save_blob(const char *key, const void *data, size_t len) {
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(TELEMETRY_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_set_blob(handle, key, data, len);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return ret;
+}
+
+static esp_err_t load_blob(const char *key, void *data, size_t len) {
+    nvs_handle_t handle;
+    size_t got = len;
+    esp_err_t ret = nvs_open(TELEMETRY_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_get_blob(handle, key, data, &got);
+    nvs_close(handle);
+    return ret == ESP_OK && got != len ? ESP_ERR_INVALID_SIZE : ret;
+}
+
+static bool load_record(int slot, telemetry_record_t *rec) {
+    char key[8];
+    record_key(slot, key);
+    return load_blob(key, rec, sizeof(*rec)) == ESP_OK && rec->version == TELEMETRY_VERSION &&
+           rec->stats.device_id == index_data.slots[slot].device_id;
+}
+
+// Caller holds the mutex
+static esp_err_t flush_locked(void) {
+    if (current_slot < 0 || (!pending_erases && !pending_failure && !first_pending_us)) {
+        return ESP_OK;
+    }
+
+    char key[8];
+    record_key(current_slot, key);
+    esp_err_t ret = save_blob(key, current, sizeof(*current));
+    if (ret == ESP_OK) {
+        ret = save_blob(TELEMETRY_INDEX_KEY, &index_data, sizeof(index_data));
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save telemetry: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    pending_erases = 0;
+    pending_failure = false;
+    first_pending_us = 0;
+    return ESP_OK;
+}
+
+// Note a change and save once the batch is big or old enough, caller holds the mutex
+static void changed_locked(bool failure) {
+    if (!first_pending_us) {
+        first_pending_us = esp_timer_get_time();
+    }
+    pending_failure |= failure;
+
+    if (pending_failure || pending_erases >= FLASH_TELEMETRY_FLUSH_ERASES ||
+        esp_timer_get_time() - first_pending_us >= (int64_t)FLASH_TELEMETRY_FLUSH_SEC * 1000000) {
+        flush_locked();
+    }
+}
+
+static void count_page(uint32_t index) {
+    uint16_t *count = &current->page_erases[index];
+    if (*count < UINT16_MAX) {
+        (*count)++;
+    }
+    if (*count > current->stats.max_page_erases) {
+        current->stats.max_page_erases = *count;
+        current->stats.max_page_index = index;
+    }
+}
+
+esp_err_t flash_telemetry_init(void) {
+    if (telemetry_mutex) {
+        return ESP_OK;
+    }
+
+    telemetry_mutex = xSemaphoreCreateMutex();
+    if (!telemetry_mutex) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (load_blob(TELEMETRY_INDEX_KEY, &index_data, sizeof(index_data)) != ESP_OK ||
+        index_data.version != TELEMETRY_VERSION) {
+        memset(&index_data, 0, sizeof(index_data));
+        index_data.version = TELEMETRY_VERSION;
+    }
+
+    int known = 0;
+    for (int i = 0; i < FLASH_TELEMETRY_MAX_TARGETS; i++) {
+        known += index_data.slots[i].last_attach != 0;
+    }
+    ESP_LOGI(TAG, "Telemetry for %d targets", known);
+    return ESP_OK;
+}
+
+esp_err_t flash_telemetry_attach(void) {
+    if (!telemetry_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t id0, id1;
+    esp_err_t ret = swd_mem_read32(FICR_DEVICEID0, &id0);
+    if (ret == ESP_OK) {
+        ret = swd_mem_read32(FICR_DEVICEID1, &id1);
+    }
+
+    xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    if (ret != ESP_OK) {
+        // Locked or absent, nothing is counted until a target is identified
+        flush_locked();
+        current_slot = -1;
+        xSemaphoreGive(telemetry_mutex);
+        ESP_LOGW(TAG, "Cannot read DEVICEID: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    uint64_t device_id = ((uint64_t)id1 << 32) | id0;
+
+    if (current_slot >= 0 && current->stats.device_id == device_id) {
+        xSemaphoreGive(telemetry_mutex);
+        return ESP_OK;
+    }
+
+    flush_locked();
+    current_slot = -1;
+    if (!current) {
+        current = malloc(sizeof(*current));
+        if (!current) {
+            xSemaphoreGive(telemetry_mutex);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    // Known target, else a free slot, else the least recently attached one
+    int slot = -1;
+    for (int i = 0; i < FLASH_TELEMETRY_MAX_TARGETS && slot < 0; i++) {
+        if (index_data.slots[i].last_attach && index_data.slots[i].device_id == device_id) {
+            slot = i;
+        }
+    }
+    bool known = slot >= 0;
+    for (int i = 0; i < FLASH_TELEMETRY_MAX_TARGETS && slot < 0; i++) {
+        if (!index_data.slots[i].last_attach) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        slot = 0;
+        for (int i = 1; i < FLASH_TELEMETRY_MAX_TARGETS; i++) {
+            if (index_data.slots[i].last_attach < index_data.slots[slot].last_attach) {
+                slot = i;
+            }
+        }
+        ESP_LOGI(TAG, "Forgetting target %08lX%08lX",
+                 (uint32_t)(index_data.slots[slot].device_id >> 32),
+                 (uint32_t)index_data.slots[slot].device_id);
+    }
+
+    if (!known || !load_record(slot, current)) {
+        memset(current, 0, sizeof(*current));
+        current->version = TELEMETRY_VERSION;
+        current->stats.device_id = device_id;
+    }
+    index_data.slots[slot].device_id = device_id;
+    index_data.slots[slot].last_attach = ++index_data.attach_counter;
+    current_slot = slot;
+    current->stats.sessions++;
+    changed_locked(false);
+    xSemaphoreGive(telemetry_mutex);
+
+    ESP_LOGI(TAG, "Target %08lX%08lX: %lu sessions, %lu flashes (%lu failed), %lu page erases, most worn page %u x%u",
+             id1, id0, current->stats.sessions, current->stats.flash_count,
+             current->stats.flash_failures, current->stats.page_erases,
+             current->stats.max_page_index, current->stats.max_page_erases);
+    return ESP_OK;
+}
+
+void flash_telemetry_page_erased(uint32_t addr, bool success) {
+    if (!success) {
+        error_log_record(ERROR_LOG_FLASH, ESP_FAIL, addr);
+    }
+    if (current_slot < 0) {
+        return;
+    }
+
+    xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    uint32_t index = addr == UICR_BASE ? FLASH_TELEMETRY_PAGES - 1 : addr / NRF52_FLASH_PAGE_SIZE;
+    if (success && index < FLASH_TELEMETRY_PAGES) {
+        current->stats.page_erases++;
+        count_page(index);
+        pending_erases++;
+    } else if (!success) {
+        current->stats.erase_failures++;
+    }
+    changed_locked(!success);
+    xSemaphoreGive(telemetry_mutex);
+}
+
+void flash_telemetry_mass_erased(bool success) {
+    if (current_slot < 0) {
+        return;
+    }
+
+    xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    if (success) {
+        current->stats.mass_erases++;
+        current->stats.page_erases += FLASH_TELEMETRY_PAGES;
+        for (uint32_t i = 0; i < FLASH_TELEMETRY_PAGES; i++) {
+            count_page(i);
+        }
+    } else {
+        current->stats.erase_failures++;
+    }
+    // Rare and expensive, always saved
+    changed_locked(true);
+    xSemaphoreGive(telemetry_mutex);
+}
+
+void flash_telemetry_verify_failed(uint32_t addr) {
+    error_log_record(ERROR_LOG_FLASH, ESP_ERR_INVALID_CRC, addr);
+    if (current_slot < 0) {
+        return;
+    }
+
+    xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    current->stats.verify_failures++;
+    changed_locked(true);
+    xSemaphoreGive(telemetry_mutex);
+    ESP_LOGW(TAG, "Verify failure at 0x%08lX, %lu on this target", addr, current->stats.verify_failures);
+}
+
+void flash_telemetry_flash_done(bool success, uint32_t duration_ms) {
+    if (current_slot < 0) {
+        return;
+    }
+
+    time_t now = time(NULL);
+    xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    current->stats.flash_count++;
+    current->stats.last_flash_time = now >= TELEMETRY_VALID_TIME ? (uint32_t)now :
+                                     (uint32_t)(esp_timer_get_time() / 1000000);
+    current->stats.last_flash_ms = duration_ms;
+    current->stats.total_flash_ms += duration_ms;
+    if (!success) {
+        current->stats.flash_failures++;
+    }
+    changed_locked(!success);
+    xSemaphoreGive(telemetry_mutex);
+}
+
+esp_err_t flash_telemetry_flush(void) {
+    if (!telemetry_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    esp_err_t ret = flush_locked();
+    xSemaphoreGive(telemetry_mutex);
+    return ret;
+}
+
+esp_err_t flash_telemetry_current(flash_target_stats_t *stats) {
+    if (current_slot < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    *stats = current->stats;
+    xSemaphoreGive(telemetry_mutex);
+    return ESP_OK;
+}
+
+esp_err_t flash_telemetry_page_counts(uint16_t counts[FLASH_TELEMETRY_PAGES]) {
+    if (current_slot < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    memcpy(counts, current->page_erases, sizeof(current->page_erases));
+    xSemaphoreGive(telemetry_mutex);
+    return ESP_OK;
+}
+
+int flash_telemetry_list(flash_target_stats_t *targets, int max) {
+    if (!telemetry_mutex) {
+        return 0;
+    }
+
+    telemetry_record_t *rec = malloc(sizeof(*rec));
+    if (!rec) {
+        return 0;
+    }
+
+    int count = 0;
+    uint32_t order[FLASH_TELEMETRY_MAX_TARGETS];
+    xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    for (int i = 0; i < FLASH_TELEMETRY_MAX_TARGETS; i++) {
+        uint32_t last = index_data.slots[i].last_attach;
+        if (!last) {
+            continue;
+        }
+
+        flash_target_stats_t stats;
+        if (i == current_slot) {
+            stats = current->stats;
+        } else if (load_record(i, rec)) {
+            stats = rec->stats;
+        } else {
+            continue;
+        }
+
+        // Insertion sort, most recently attached first
+        int j = count < max ? count++ : max;
+        while (j > 0 && order[j - 1] < last) {
+            if (j < max) {
+                targets[j] = targets[j - 1];
+                order[j] = order[j - 1];
+            }
+            j--;
+        }
+        if (j < max) {
+            targets[j] = stats;
+            order[j] = last;
+        }
+    }
+    xSemaphoreGive(telemetry_mutex);
+
+    free(rec);
+    return count;
+}
@@ -53,6 +53,8 @@ esp_err_t swd_dp_read(uint8_t addr, uint32_t *data);
 esp_err_t swd_dp_write(uint8_t addr, uint32_t data);
 esp_err_t swd_dp_disconnect(void);
 esp_err_t swd_ap_read(uint8_t addr, uint32_t *data);
+// Posted read, returns the previous AP read's data (RDBUFF has the last)
+esp_err_t swd_ap_read_posted(uint8_t addr, uint32_t *data);
 esp_err_t swd_ap_write(uint8_t addr, uint32_t data);
 
 // Raw transfer (single attempt, no retry)
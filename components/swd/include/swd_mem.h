@@ -51,6 +51,7 @@ bool swd_is_halted(void);
 
 // Add this line to components/swd/include/swd_mem.h
 esp_err_t swd_mem_write_block32(uint32_t addr, const uint32_t *data, uint32_t count);
+esp_err_t swd_mem_read_block32(uint32_t addr, uint32_t *data, uint32_t count);
 
 // System control registers
 #define DHCSR_ADDR      0xE000EDF0  // Debug Halting Control and Status
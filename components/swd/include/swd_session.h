@@ -0,0 +1,48 @@
+// swd_session.h - Bus ownership and arbitration above the per-transfer lock
+#ifndef SWD_SESSION_H
+#define SWD_SESSION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// A session is a token rather than a task lock: the flash pipeline task
+// works on behalf of the upload that holds it. Everything that drives the
+// target (connect, reset, erase, program, register dumps) runs inside one.
+// When the bus is released the highest priority waiter gets it next.
+typedef enum {
+    SWD_PRIO_STATUS = 0,    // Read-only status polling
+    SWD_PRIO_NORMAL,        // Short interactive operations
+    SWD_PRIO_FLASH          // Uploads, erases and jobs
+} swd_prio_t;
+
+#define SWD_SESSION_FOREVER     UINT32_MAX
+
+// Create the lock, call before any session is started
+esp_err_t swd_session_init(void);
+
+// Wait up to timeout_ms for the bus. owner must be a string literal.
+// ESP_ERR_TIMEOUT if another owner kept it, see swd_session_owner().
+esp_err_t swd_session_begin(const char *owner, swd_prio_t prio, uint32_t timeout_ms);
+
+// Release the bus
+void swd_session_end(void);
+
+// Current owner, NULL when the bus is free
+const char *swd_session_owner(void);
+
+// How long the current owner has held the bus
+uint32_t swd_session_held_ms(void);
+
+// Fills result with a status snapshot, at most len bytes
+typedef esp_err_t (*swd_status_fn)(char *result, size_t len);
+
+// Read-only status with coalescing. A snapshot taken after the caller
+// arrived, or at most max_age_ms old, is shared instead of touching the bus
+// again. If the bus stays busy for timeout_ms the last snapshot is copied
+// and ESP_ERR_TIMEOUT returned (ESP_ERR_NOT_FOUND if there is none).
+esp_err_t swd_session_status(swd_status_fn fn, char *result, size_t len,
+                             uint32_t max_age_ms, uint32_t timeout_ms);
+
+#endif // SWD_SESSION_H
@@ -2,6 +2,7 @@
 #include "swd_core.h"
 #include "swd_mem.h"
 #include "nrf52_hal.h"
+#include "error_log.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "soc/gpio_struct.h"
@@ -302,6 +303,9 @@ swd_ack_t swd_transfer_raw(uint8_t addr, bool ap, bool read, uint32_t *data) {
     return (swd_ack_t)ack;
 }
 
+// Error log arg of a failed transfer: 0x100 AP, 0x200 write, low byte the register
+#define SWD_ERROR_ARG(ap, write, addr)  (((ap) ? 0x100 : 0) | ((write) ? 0x200 : 0) | (addr))
+
 // DP read with retry
 esp_err_t swd_dp_read(uint8_t addr, uint32_t *data) {
     if (!initialized || !data) {
@@ -322,6 +326,7 @@ esp_err_t swd_dp_read(uint8_t addr, uint32_t *data) {
     }
     
     ESP_LOGE(TAG, "DP read failed: addr=0x%02X", addr);
+    error_log_record(ERROR_LOG_SWD, ESP_FAIL, SWD_ERROR_ARG(false, false, addr));
     return ESP_FAIL;
 }
 
@@ -344,6 +349,7 @@ esp_err_t swd_dp_write(uint8_t addr, uint32_t data) {
     }
     
     ESP_LOGE(TAG, "DP write failed: addr=0x%02X data=0x%08lX", addr, data);
+    error_log_record(ERROR_LOG_SWD, ESP_FAIL, SWD_ERROR_ARG(false, true, addr));
     return ESP_FAIL;
 }
 
@@ -414,6 +420,33 @@ esp_err_t swd_ap_read(uint8_t addr, uint32_t *data) {
     }
     
     ESP_LOGE(TAG, "AP read failed: addr=0x%02X", addr);
+    error_log_record(ERROR_LOG_SWD, ESP_FAIL, SWD_ERROR_ARG(true, false, addr));
+    return ESP_FAIL;
+}
+
+// Posted AP read with retry. Returns the result of the previous AP read,
+// the caller collects the last one of a run from RDBUFF.
+esp_err_t swd_ap_read_posted(uint8_t addr, uint32_t *data) {
+    if (!initialized || !data) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    for (int retry = 0; retry < 10; retry++) {
+        swd_ack_t ack = swd_transfer_raw(addr, true, true, data);
+
+        if (ack == SWD_ACK_OK) {
+            return ESP_OK;
+        } else if (ack == SWD_ACK_WAIT) {
+            vTaskDelay(1);
+        } else if (ack == SWD_ACK_FAULT) {
+            // The posted value is lost, the run has to start over
+            swd_clear_errors();
+            break;
+        }
+    }
+
+    ESP_LOGE(TAG, "Posted AP read failed: addr=0x%02X", addr);
+    error_log_record(ERROR_LOG_SWD, ESP_FAIL, SWD_ERROR_ARG(true, false, addr));
     return ESP_FAIL;
 }
 
@@ -436,6 +469,7 @@ esp_err_t swd_ap_write(uint8_t addr, uint32_t data) {
     }
     
     ESP_LOGE(TAG, "AP write failed: addr=0x%02X data=0x%08lX", addr, data);
+    error_log_record(ERROR_LOG_SWD, ESP_FAIL, SWD_ERROR_ARG(true, true, addr));
     return ESP_FAIL;
 }
 
@@ -268,11 +268,15 @@ esp_err_t swd_flash_write_buffer(uint32_t addr, const uint8_t *data, uint32_t si
             words_in_chunk = max_words;
         }
         
-        // Copy data to aligned word buffer
-        memcpy(word_buffer, data, words_in_chunk * 4);
+        // Word-aligned sources (e.g. memory-mapped flash) are sent without a copy
+        const uint32_t *words = (const uint32_t *)data;
+        if ((uintptr_t)data & 0x3) {
+            memcpy(word_buffer, data, words_in_chunk * 4);
+            words = word_buffer;
+        }
         
         // This is the key optimization - writes many words in one transaction
-        ret = swd_mem_write_block32(addr, word_buffer, words_in_chunk);
+        ret = swd_mem_write_block32(addr, words, words_in_chunk);
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "Block write failed at 0x%08lX", addr);
             free(word_buffer);
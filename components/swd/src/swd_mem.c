@@ -106,7 +106,17 @@ esp_err_t swd_mem_read_buffer(uint32_t addr, uint8_t *buffer, uint32_t size) {
         size -= bytes_to_copy;
     }
     
-    // Read aligned words
+    // Read aligned words, in blocks when the buffer is word aligned too
+    if (size >= 8 && ((uintptr_t)buffer & 0x3) == 0) {
+        uint32_t words = size / 4;
+        ret = swd_mem_read_block32(addr, (uint32_t*)buffer, words);
+        if (ret != ESP_OK) return ret;
+        
+        addr += words * 4;
+        buffer += words * 4;
+        size -= words * 4;
+    }
+    
     while (size >= 4) {
         uint32_t word;
         ret = swd_mem_read32(addr, &word);
@@ -444,4 +454,56 @@ esp_err_t swd_mem_write_block32(uint32_t addr, const uint32_t *data, uint32_t co
     }
     
     return ESP_OK;
-}
\ No newline at end of file
+}
+// Read words with auto-increment. Posted DRW reads each return the previous
+// word and RDBUFF delivers the last one of a run, one transfer per word.
+// swd_ap_read() already reads RDBUFF itself, so it can't pipeline.
+esp_err_t swd_mem_read_block32(uint32_t addr, uint32_t *data, uint32_t count) {
+    if (!data || count == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Must be word-aligned
+    if (addr & 0x3) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = swd_ap_write(AP_CSW, CSW_ADDRINC_ON | CSW_SIZE_32BIT | CSW_DEVICE_EN | CSW_MASTER_DBG);
+    if (ret != ESP_OK) return ret;
+
+    // Same 1KB auto-increment boundary as block writes
+    uint32_t auto_inc_size = 0x400;
+
+    while (count > 0) {
+        uint32_t offset_in_page = addr & (auto_inc_size - 1);
+        uint32_t words_in_page = (auto_inc_size - offset_in_page) / 4;
+        if (words_in_page > count) {
+            words_in_page = count;
+        }
+
+        ret = swd_ap_write(AP_TAR, addr);
+        if (ret != ESP_OK) return ret;
+
+        // First read only starts the transfer
+        uint32_t dummy;
+        ret = swd_ap_read_posted(AP_DRW, &dummy);
+        if (ret != ESP_OK) return ret;
+
+        for (uint32_t i = 1; i < words_in_page; i++) {
+            ret = swd_ap_read_posted(AP_DRW, &data[i - 1]);
+            if (ret != ESP_OK) return ret;
+        }
+
+        ret = swd_dp_read(DP_RDBUFF, &data[words_in_page - 1]);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Block read failed at 0x%08lX", addr);
+            return ret;
+        }
+
+        addr += words_in_page * 4;
+        data += words_in_page;
+        count -= words_in_page;
+    }
+
+    return ESP_OK;
+}
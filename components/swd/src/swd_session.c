@@ -0,0 +1,207 @@
+// swd_session.c - Bus ownership and arbitration above the per-transfer lock
+#include "swd_session.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "SWD_SESSION";
+
+#define BUS_FREE_BIT        BIT0
+#define STATUS_DONE_BIT     BIT1
+#define STATUS_BUFFER_SIZE  4096
+
+static SemaphoreHandle_t state_mutex = NULL;
+static EventGroupHandle_t bus_events = NULL;
+static const char *owner = NULL;
+static int64_t owner_since_us = 0;
+static uint16_t waiting[SWD_PRIO_FLASH + 1];
+
+// Last status snapshot, shared by requests that arrive while it is fresh
+static char *status_cache = NULL;
+static size_t status_len = 0;
+static int64_t status_time_us = 0;
+static bool status_running = false;
+
+static bool higher_waiting(swd_prio_t prio) {
+    for (int p = prio + 1; p <= SWD_PRIO_FLASH; p++) {
+        if (waiting[p]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static TickType_t ticks_left(uint32_t timeout_ms, int64_t start_us) {
+    if (timeout_ms == SWD_SESSION_FOREVER) {
+        return portMAX_DELAY;
+    }
+    int64_t left_ms = timeout_ms - (esp_timer_get_time() - start_us) / 1000;
+    return left_ms > 0 ? pdMS_TO_TICKS(left_ms) : 0;
+}
+
+esp_err_t swd_session_init(void) {
+    if (state_mutex) {
+        return ESP_OK;
+    }
+
+    state_mutex = xSemaphoreCreateMutex();
+    bus_events = xEventGroupCreate();
+    if (!state_mutex || !bus_events) {
+        return ESP_ERR_NO_MEM;
+    }
+    xEventGroupSetBits(bus_events, BUS_FREE_BIT);
+    return ESP_OK;
+}
+
+esp_err_t swd_session_begin(const char *name, swd_prio_t prio, uint32_t timeout_ms) {
+    if (!state_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    xSemaphoreTake(state_mutex, portMAX_DELAY);
+    waiting[prio]++;
+
+    while (1) {
+        if (!owner && !higher_waiting(prio)) {
+            waiting[prio]--;
+            owner = name;
+            owner_since_us = esp_timer_get_time();
+            xEventGroupClearBits(bus_events, BUS_FREE_BIT);
+            xSemaphoreGive(state_mutex);
+
+            uint32_t waited_ms = (uint32_t)((owner_since_us - start_us) / 1000);
+            if (waited_ms > 100) {
+                ESP_LOGI(TAG, "%s got the bus after %lu ms", name, waited_ms);
+            }
+            return ESP_OK;
+        }
+        bool yielding = !owner;
+        xSemaphoreGive(state_mutex);
+
+        TickType_t ticks = ticks_left(timeout_ms, start_us);
+        if (ticks == 0) {
+            xSemaphoreTake(state_mutex, portMAX_DELAY);
+            waiting[prio]--;
+            xSemaphoreGive(state_mutex);
+            ESP_LOGW(TAG, "%s gave up waiting, bus held by %s", name, owner ? owner : "none");
+            return ESP_ERR_TIMEOUT;
+        }
+
+        if (yielding) {
+            // Free but promised to a higher priority waiter, let it run
+            vTaskDelay(1);
+        } else {
+            xEventGroupWaitBits(bus_events, BUS_FREE_BIT, pdFALSE, pdFALSE, ticks);
+        }
+        xSemaphoreTake(state_mutex, portMAX_DELAY);
+    }
+}
+
+void swd_session_end(void) {
+    if (!state_mutex) {
+        return;
+    }
+
+    xSemaphoreTake(state_mutex, portMAX_DELAY);
+    if (!owner) {
+        xSemaphoreGive(state_mutex);
+        ESP_LOGW(TAG, "Session ended twice");
+        return;
+    }
+    ESP_LOGD(TAG, "%s released the bus after %lu ms", owner,
+             (uint32_t)((esp_timer_get_time() - owner_since_us) / 1000));
+    owner = NULL;
+    xEventGroupSetBits(bus_events, BUS_FREE_BIT);
+    xSemaphoreGive(state_mutex);
+}
+
+const char *swd_session_owner(void) {
+    return owner;
+}
+
+uint32_t swd_session_held_ms(void) {
+    const char *current = owner;
+    return current ? (uint32_t)((esp_timer_get_time() - owner_since_us) / 1000) : 0;
+}
+
+// Copy the snapshot if it is new enough for a caller that arrived at arrival_us
+static bool copy_status(char *result, size_t len, int64_t arrival_us, uint32_t max_age_ms) {
+    if (!status_cache || !status_time_us ||
+        (status_time_us < arrival_us &&
+         esp_timer_get_time() - status_time_us > (int64_t)max_age_ms * 1000)) {
+        return false;
+    }
+    size_t n = status_len < len ? status_len : len - 1;
+    memcpy(result, status_cache, n);
+    result[n] = '\0';
+    return true;
+}
+
+esp_err_t swd_session_status(swd_status_fn fn, char *result, size_t len,
+                             uint32_t max_age_ms, uint32_t timeout_ms) {
+    if (!state_mutex || len == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t arrival_us = esp_timer_get_time();
+    xSemaphoreTake(state_mutex, portMAX_DELAY);
+    if (copy_status(result, len, arrival_us, max_age_ms)) {
+        xSemaphoreGive(state_mutex);
+        return ESP_OK;
+    }
+
+    // Another caller is reading right now, share its result
+    if (status_running) {
+        xSemaphoreGive(state_mutex);
+        xEventGroupWaitBits(bus_events, STATUS_DONE_BIT, pdFALSE, pdFALSE,
+                            ticks_left(timeout_ms, arrival_us));
+        xSemaphoreTake(state_mutex, portMAX_DELAY);
+        bool fresh = copy_status(result, len, arrival_us, max_age_ms);
+        xSemaphoreGive(state_mutex);
+        if (fresh) {
+            return ESP_OK;
+        }
+        xSemaphoreTake(state_mutex, portMAX_DELAY);
+    }
+    status_running = true;
+    xEventGroupClearBits(bus_events, STATUS_DONE_BIT);
+    xSemaphoreGive(state_mutex);
+
+    esp_err_t ret = swd_session_begin("status", SWD_PRIO_STATUS,
+                                      timeout_ms == SWD_SESSION_FOREVER ? timeout_ms :
+                                      (uint32_t)(ticks_left(timeout_ms, arrival_us) * portTICK_PERIOD_MS));
+    if (ret == ESP_OK) {
+        ret = fn(result, len);
+        swd_session_end();
+    }
+
+    xSemaphoreTake(state_mutex, portMAX_DELAY);
+    if (ret == ESP_OK) {
+        if (!status_cache) {
+            status_cache = malloc(STATUS_BUFFER_SIZE);
+        }
+        if (status_cache) {
+            status_len = strnlen(result, len);
+            status_len = status_len < STATUS_BUFFER_SIZE ? status_len : STATUS_BUFFER_SIZE - 1;
+            memcpy(status_cache, result, status_len);
+            status_time_us = esp_timer_get_time();
+        }
+    } else if (ret == ESP_ERR_TIMEOUT) {
+        // Bus stayed busy, hand out the last snapshot marked stale by the return code
+        if (!status_cache || !status_time_us) {
+            ret = ESP_ERR_NOT_FOUND;
+        } else {
+            copy_status(result, len, 0, UINT32_MAX);
+        }
+    }
+    status_running = false;
+    xEventGroupSetBits(bus_events, STATUS_DONE_BIT);
+    xSemaphoreGive(state_mutex);
+    return ret;
+}
@@ -0,0 +1,67 @@
+#ifndef ERROR_LOG_H
+#define ERROR_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Error ring in RTC memory. Recording is a few stores, so it is safe on hot
+// error paths; the ring survives deep sleep and soft resets and is copied
+// to NVS lazily (error_log_flush_if_due) or on restart.
+#define ERROR_LOG_ENTRIES       64
+#define ERROR_LOG_FLUSH_SEC     300     // Oldest unsaved record waits at most this long
+#define ERROR_LOG_FLUSH_COUNT   16      // Or until this many are unsaved
+
+typedef enum {
+    ERROR_LOG_SYSTEM = 0,
+    ERROR_LOG_SWD,
+    ERROR_LOG_FLASH,
+    ERROR_LOG_POWER,
+    ERROR_LOG_WIFI,
+    ERROR_LOG_BLE,
+    ERROR_LOG_WEB,
+    ERROR_LOG_RECOVERY,
+    ERROR_LOG_SUBSYSTEM_COUNT
+} error_log_subsystem_t;
+
+#define ERROR_LOG_FLAG_WALL_TIME    0x01    // time is Unix seconds, otherwise ms since boot
+
+typedef struct {
+    uint32_t seq;               // Increases across boots
+    uint32_t time;
+    uint16_t boot;              // Boot the record was made in
+    uint8_t subsystem;
+    uint8_t flags;
+    int32_t code;               // esp_err_t
+    uint32_t arg;               // Subsystem specific, e.g. an address
+} error_log_entry_t;
+
+// Validate the RTC ring, falling back to the NVS copy after power loss
+esp_err_t error_log_init(void);
+
+// Append a record, the oldest is overwritten when full
+void error_log_record(error_log_subsystem_t subsystem, esp_err_t code, uint32_t arg);
+
+// Stable 32-bit id of a message, for arg where the text itself isn't stored.
+// Log the id next to the text so records can be matched to it.
+uint32_t error_log_text_id(const char *text);
+
+// Copy unsaved records to NVS
+esp_err_t error_log_flush(void);
+
+// Flush if enough records are waiting or the oldest is old enough, call periodically
+void error_log_flush_if_due(void);
+
+// Walk records oldest first. Start with *cursor = 0, returns false when done.
+bool error_log_next(uint32_t *cursor, error_log_entry_t *entry);
+
+// One line of text for a record, returns the length as snprintf does
+int error_log_format(const error_log_entry_t *entry, char *buffer, size_t size);
+
+const char *error_log_subsystem_name(uint8_t subsystem);
+
+// Drop every record, in RTC memory and NVS
+void error_log_clear(void);
+
+#endif
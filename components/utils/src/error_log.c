@@ -0,0 +1,228 @@
+// error_log.c - RTC memory error ring with deferred NVS copy
+#include "error_log.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static const char *TAG = "ERROR_LOG";
+
+#define ERROR_LOG_MAGIC         0x45524C47  // "ERLG"
+#define ERROR_LOG_VERSION       1
+#define ERROR_LOG_NVS_NAMESPACE "error_log"
+#define ERROR_LOG_NVS_KEY       "ring"
+#define ERROR_LOG_VALID_TIME    1600000000  // Earlier clock values were never set
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t next_seq;          // Seq of the next record, ring slot is seq % ERROR_LOG_ENTRIES
+    uint32_t saved_seq;         // Records below this are in NVS
+    uint16_t boot;
+    uint16_t reserved;
+    error_log_entry_t entries[ERROR_LOG_ENTRIES];
+} error_ring_t;
+
+static RTC_NOINIT_ATTR error_ring_t ring;
+static portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool ring_ready = false;
+static int64_t first_unsaved_us = 0;
+
+static const char *subsystem_names[ERROR_LOG_SUBSYSTEM_COUNT] = {
+    "system", "swd", "flash", "power", "wifi", "ble", "web", "recovery"
+};
+
+static bool ring_valid(const error_ring_t *r) {
+    return r->magic == ERROR_LOG_MAGIC && r->version == ERROR_LOG_VERSION &&
+           r->saved_seq <= r->next_seq;
+}
+
+static void ring_reset(void) {
+    memset(&ring, 0, sizeof(ring));
+    ring.magic = ERROR_LOG_MAGIC;
+    ring.version = ERROR_LOG_VERSION;
+}
+
+static void shutdown_flush(void) {
+    error_log_flush();
+}
+
+esp_err_t error_log_init(void) {
+    if (ring_ready) {
+        return ESP_OK;
+    }
+
+    // RTC memory is only trustworthy if it was retained through the reset
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool retained = reason != ESP_RST_POWERON && reason != ESP_RST_BROWNOUT;
+
+    if (!retained || !ring_valid(&ring)) {
+        nvs_handle_t handle;
+        size_t len = sizeof(ring);
+        esp_err_t ret = nvs_open(ERROR_LOG_NVS_NAMESPACE, NVS_READONLY, &handle);
+        if (ret == ESP_OK) {
+            ret = nvs_get_blob(handle, ERROR_LOG_NVS_KEY, &ring, &len);
+            nvs_close(handle);
+        }
+        if (ret != ESP_OK || len != sizeof(ring) || !ring_valid(&ring)) {
+            ring_reset();
+        }
+        ring.saved_seq = ring.next_seq;
+    }
+
+    ring.boot++;
+    if (ring.saved_seq != ring.next_seq) {
+        first_unsaved_us = esp_timer_get_time();
+    }
+    ring_ready = true;
+    esp_register_shutdown_handler(shutdown_flush);
+
+    ESP_LOGI(TAG, "Boot %u, %lu errors logged, %lu not yet saved", ring.boot,
+             ring.next_seq, ring.next_seq - ring.saved_seq);
+    return ESP_OK;
+}
+
+void error_log_record(error_log_subsystem_t subsystem, esp_err_t code, uint32_t arg) {
+    if (!ring_ready) {
+        return;
+    }
+
+    error_log_entry_t entry = {
+        .subsystem = subsystem,
+        .code = code,
+        .arg = arg
+    };
+    time_t now = time(NULL);
+    if (now >= ERROR_LOG_VALID_TIME) {
+        entry.time = (uint32_t)now;
+        entry.flags = ERROR_LOG_FLAG_WALL_TIME;
+    } else {
+        entry.time = (uint32_t)(esp_timer_get_time() / 1000);
+    }
+
+    portENTER_CRITICAL(&ring_lock);
+    entry.seq = ring.next_seq;
+    entry.boot = ring.boot;
+    ring.entries[entry.seq % ERROR_LOG_ENTRIES] = entry;
+    ring.next_seq++;
+    if (!first_unsaved_us) {
+        first_unsaved_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&ring_lock);
+}
+
+// FNV-1a, same id for the same text on every build and boot
+uint32_t error_log_text_id(const char *text) {
+    uint32_t hash = 2166136261u;
+    while (text && *text) {
+        hash = (hash ^ (uint8_t)*text++) * 16777619u;
+    }
+    return hash;
+}
+
+esp_err_t error_log_flush(void) {
+    if (!ring_ready || ring.saved_seq == ring.next_seq) {
+        return ESP_OK;
+    }
+
+    // Snapshot so records arriving during the NVS write are not half saved
+    static error_ring_t copy;
+    portENTER_CRITICAL(&ring_lock);
+    copy = ring;
+    first_unsaved_us = 0;
+    portEXIT_CRITICAL(&ring_lock);
+    copy.saved_seq = copy.next_seq;
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(ERROR_LOG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(handle, ERROR_LOG_NVS_KEY, &copy, sizeof(copy));
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    portENTER_CRITICAL(&ring_lock);
+    if (ret == ESP_OK) {
+        ring.saved_seq = copy.next_seq;
+    }
+    if (ring.saved_seq != ring.next_seq && !first_unsaved_us) {
+        first_unsaved_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&ring_lock);
+    return ret;
+}
+
+void error_log_flush_if_due(void) {
+    if (!ring_ready || ring.saved_seq == ring.next_seq) {
+        return;
+    }
+
+    if (ring.next_seq - ring.saved_seq >= ERROR_LOG_FLUSH_COUNT ||
+        esp_timer_get_time() - first_unsaved_us >= (int64_t)ERROR_LOG_FLUSH_SEC * 1000000) {
+        esp_err_t ret = error_log_flush();
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to save error log: %s", esp_err_to_name(ret));
+        }
+    }
+}
+
+bool error_log_next(uint32_t *cursor, error_log_entry_t *entry) {
+    if (!ring_ready) {
+        return false;
+    }
+
+    bool found = false;
+    portENTER_CRITICAL(&ring_lock);
+    uint32_t oldest = ring.next_seq > ERROR_LOG_ENTRIES ? ring.next_seq - ERROR_LOG_ENTRIES : 0;
+    uint32_t seq = *cursor > oldest ? *cursor : oldest;
+    if (seq < ring.next_seq) {
+        *entry = ring.entries[seq % ERROR_LOG_ENTRIES];
+        *cursor = seq + 1;
+        found = true;
+    }
+    portEXIT_CRITICAL(&ring_lock);
+    return found;
+}
+
+const char *error_log_subsystem_name(uint8_t subsystem) {
+    return subsystem < ERROR_LOG_SUBSYSTEM_COUNT ? subsystem_names[subsystem] : "unknown";
+}
+
+int error_log_format(const error_log_entry_t *entry, char *buffer, size_t size) {
+    char when[24];
+    if (entry->flags & ERROR_LOG_FLAG_WALL_TIME) {
+        time_t t = entry->time;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+    } else {
+        snprintf(when, sizeof(when), "boot %u +%lu.%03lus", entry->boot,
+                 entry->time / 1000, entry->time % 1000);
+    }
+    return snprintf(buffer, size, "#%lu %s %s: %s (0x%lX)", entry->seq, when,
+                    error_log_subsystem_name(entry->subsystem),
+                    esp_err_to_name(entry->code), entry->arg);
+}
+
+void error_log_clear(void) {
+    portENTER_CRITICAL(&ring_lock);
+    uint16_t boot = ring.boot;
+    ring_reset();
+    ring.boot = boot;
+    first_unsaved_us = 0;
+    portEXIT_CRITICAL(&ring_lock);
+
+    nvs_handle_t handle;
+    if (nvs_open(ERROR_LOG_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_key(handle, ERROR_LOG_NVS_KEY);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
@@ -1,4 +1,5 @@
 #include "recovery.h"
+#include "error_log.h"
 #include "esp_log.h"
 
 static const char *TAG = "RECOVERY";
@@ -10,4 +11,35 @@ esp_err_t recovery_init(void) {
 
 recovery_trigger_t recovery_check_trigger(void) {
     return RECOVERY_TRIGGER_NONE;
+}
+
+esp_err_t recovery_log_error(const char *context, esp_err_t error) {
+    uint32_t id = error_log_text_id(context);
+    ESP_LOGE(TAG, "[%08lX] %s: %s", id, context ? context : "?", esp_err_to_name(error));
+    error_log_record(ERROR_LOG_RECOVERY, error, id);
+    return ESP_OK;
+}
+
+esp_err_t recovery_get_last_errors(char *buffer, size_t size) {
+    if (!buffer || size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Most recent record only
+    uint32_t cursor = 0;
+    error_log_entry_t entry;
+    bool found = false;
+    while (error_log_next(&cursor, &entry)) {
+        found = true;
+    }
+    if (!found) {
+        buffer[0] = '\0';
+        return ESP_ERR_NOT_FOUND;
+    }
+    error_log_format(&entry, buffer, size);
+    return ESP_OK;
+}
+
+void recovery_clear_errors(void) {
+    error_log_clear();
 }
\ No newline at end of file
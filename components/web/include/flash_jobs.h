@@ -0,0 +1,71 @@
+#ifndef FLASH_JOBS_H
+#define FLASH_JOBS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Long SWD operations run as jobs on a dedicated task so HTTP handlers
+// return immediately. Jobs run one at a time in submit order, finished
+// jobs stay readable until their slot is reused.
+#define FLASH_JOB_SLOTS         8
+#define FLASH_JOB_ARG_LEN       72
+#define FLASH_JOB_MSG_LEN       96
+#define FLASH_JOB_TASK_STACK    6144
+#define FLASH_JOB_TASK_PRIO     4       // Same as the flash pipeline, below httpd
+
+typedef enum {
+    FLASH_JOB_QUEUED = 0,
+    FLASH_JOB_RUNNING,
+    FLASH_JOB_DONE,
+    FLASH_JOB_FAILED,
+    FLASH_JOB_CANCELLED
+} flash_job_state_t;
+
+// Runs on the job task with the argument copied at submit time,
+// message receives the text shown to the user
+typedef esp_err_t (*flash_job_fn)(const char *arg, char *message, size_t message_len);
+
+typedef struct {
+    uint32_t id;
+    const char *name;
+    flash_job_state_t state;
+    bool cancel_requested;
+    esp_err_t result;
+    uint32_t wait_ms;           // Time spent queued
+    uint32_t run_ms;            // Time spent running, so far while running
+    uint32_t current;           // Last reported progress
+    uint32_t total;
+    const char *phase;
+    char message[FLASH_JOB_MSG_LEN];
+} flash_job_info_t;
+
+// Create the job task and queue
+esp_err_t flash_jobs_init(void);
+
+// Queue a job, returns its id or 0 when every slot is taken.
+// name must be a string literal, arg may be NULL.
+uint32_t flash_jobs_submit(const char *name, flash_job_fn fn, const char *arg);
+
+// Queued jobs are dropped, a running job sees flash_job_cancelled()
+esp_err_t flash_jobs_cancel(uint32_t id);
+
+// Snapshot of one job
+esp_err_t flash_jobs_get(uint32_t id, flash_job_info_t *info);
+
+// Snapshots of all known jobs, oldest first, returns the count
+int flash_jobs_list(flash_job_info_t *infos, int max);
+
+// True while a job is queued or running
+bool flash_jobs_busy(void);
+
+// For job functions: cancel was requested for the running job
+bool flash_job_cancelled(void);
+
+// Progress callback for job functions, also pushed to WebSocket viewers
+void flash_job_progress(uint32_t current, uint32_t total, const char *operation);
+
+const char *flash_job_state_name(flash_job_state_t state);
+
+#endif
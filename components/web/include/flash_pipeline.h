@@ -0,0 +1,66 @@
+#ifndef FLASH_PIPELINE_H
+#define FLASH_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "swd_flash.h"
+
+// Upload data is assembled into page buffers by the HTTP handler and
+// programmed by a separate SWD task, so erases and writes overlap with
+// receiving. When every buffer is queued the producer blocks, which closes
+// the TCP window until the target catches up.
+#define FLASH_PIPELINE_PAGE_SIZE    NRF52_FLASH_PAGE_SIZE
+#define FLASH_PIPELINE_DEPTH        4       // Page buffers in flight
+#define FLASH_PIPELINE_TASK_STACK   4096
+#define FLASH_PIPELINE_TASK_PRIO    4       // Below httpd so receive wins the CPU
+#define FLASH_PIPELINE_REPORT_MS    250     // Progress interval while draining
+#define FLASH_PIPELINE_VERIFY_RETRIES 2     // Erase and rewrite attempts for a bad page
+
+typedef struct {
+    uint32_t flashed_bytes;     // Payload bytes programmed
+    uint32_t pages_written;
+    uint32_t pages_erased;
+    uint32_t pages_verified;    // Read back and matched
+    uint32_t verify_retries;
+    uint32_t busy_ms;           // Time the SWD task spent erasing and writing
+    uint32_t stall_ms;          // Time the producer waited for a free buffer
+    uint32_t flash_kbps;        // Programming rate while busy
+    uint32_t error_addr;        // Page that failed, valid when error is set
+    esp_err_t error;
+    const char *phase;          // "erase", "write", "verify" or "idle"
+} flash_pipeline_stats_t;
+
+typedef struct {
+    uint32_t addr;
+    uint32_t crc32;             // CRC32 of the whole page as programmed
+} flash_pipeline_page_t;
+
+// Allocate the page buffers and start the SWD task, target must be connected.
+// With verify each page is read back after programming.
+esp_err_t flash_pipeline_start(bool verify);
+
+// Queue data for a flash or UICR address, blocks while all buffers are busy
+esp_err_t flash_pipeline_write(uint32_t addr, const uint8_t *data, size_t len);
+
+// Queue an erase of the page holding addr, pages are only erased once per upload
+esp_err_t flash_pipeline_erase(uint32_t addr);
+
+// Submit the partial page and wait until everything queued is programmed,
+// progress (optional) gets the flashed byte count and phase while waiting
+esp_err_t flash_pipeline_finish(flash_progress_cb progress);
+
+// Drop queued work, the SWD task skips whatever is still pending
+void flash_pipeline_abort(void);
+
+// Stop the SWD task and free the buffers, stats stay readable
+void flash_pipeline_stop(void);
+
+// Counters of the running or last pipeline
+void flash_pipeline_get_stats(flash_pipeline_stats_t *stats);
+
+// Pages programmed so far in address order, returns the count
+int flash_pipeline_get_committed(flash_pipeline_page_t *pages, int max);
+
+#endif
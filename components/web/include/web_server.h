@@ -1,6 +1,8 @@
 #ifndef WEB_SERVER_H
 #define WEB_SERVER_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 #include "esp_http_server.h"
 
@@ -16,10 +18,16 @@ esp_err_t register_power_handlers(httpd_handle_t server);
 
 // WebSocket support for real-time updates
 typedef void (*ws_callback_t)(const char *data, size_t len);
+esp_err_t register_ws_handlers(httpd_handle_t server);
 esp_err_t ws_send_to_all(const char *data, size_t len);
 esp_err_t ws_register_callback(ws_callback_t callback);
 
-// Progress reporting
+// Progress reporting, pushed to WebSocket viewers as JSON:
+//   {"type":"progress","phase":..,"current":..,"total":..,"rx_kbps":..,"flash_kbps":..}
+//   {"type":"result","success":..,"message":..}
 void report_flash_progress(uint32_t current, uint32_t total, const char *operation);
+void report_flash_status(const char *phase, uint32_t current, uint32_t total,
+                         uint32_t rx_kbps, uint32_t flash_kbps);
+void report_flash_result(bool success, const char *message);
 
 #endif // WEB_SERVER_H
\ No newline at end of file
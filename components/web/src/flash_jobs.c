@@ -0,0 +1,279 @@
+#include "flash_jobs.h"
+#include "web_server.h"
+#include "swd_session.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = "FLASH_JOBS";
+
+// Ids of jobs cancelled while queued stay in the queue until the task skips them
+#define JOB_QUEUE_LEN (FLASH_JOB_SLOTS * 2)
+
+typedef struct {
+    flash_job_info_t info;
+    flash_job_fn fn;
+    char arg[FLASH_JOB_ARG_LEN];
+    int64_t queued_us;
+    int64_t started_us;
+    bool used;
+} job_slot_t;
+
+static job_slot_t slots[FLASH_JOB_SLOTS];
+static SemaphoreHandle_t jobs_mutex = NULL;
+static QueueHandle_t job_queue = NULL;     // Job ids in submit order
+static TaskHandle_t job_task = NULL;
+static uint32_t next_id = 1;
+static int running_slot = -1;
+
+static bool is_finished(flash_job_state_t state) {
+    return state == FLASH_JOB_DONE || state == FLASH_JOB_FAILED || state == FLASH_JOB_CANCELLED;
+}
+
+static job_slot_t *find_slot(uint32_t id) {
+    for (int i = 0; i < FLASH_JOB_SLOTS; i++) {
+        if (slots[i].used && slots[i].info.id == id) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+// Fill in the live run time, caller holds the mutex
+static void snapshot(const job_slot_t *slot, flash_job_info_t *info) {
+    *info = slot->info;
+    if (info->state == FLASH_JOB_RUNNING) {
+        info->run_ms = (uint32_t)((esp_timer_get_time() - slot->started_us) / 1000);
+    } else if (info->state == FLASH_JOB_QUEUED) {
+        info->wait_ms = (uint32_t)((esp_timer_get_time() - slot->queued_us) / 1000);
+    }
+}
+
+static void job_task_fn(void *arg) {
+    uint32_t id;
+
+    while (1) {
+        xQueueReceive(job_queue, &id, portMAX_DELAY);
+
+        xSemaphoreTake(jobs_mutex, portMAX_DELAY);
+        job_slot_t *slot = find_slot(id);
+        if (!slot || slot->info.state != FLASH_JOB_QUEUED) {
+            // Cancelled while waiting
+            xSemaphoreGive(jobs_mutex);
+            continue;
+        }
+        slot->started_us = esp_timer_get_time();
+        slot->info.wait_ms = (uint32_t)((slot->started_us - slot->queued_us) / 1000);
+        slot->info.state = FLASH_JOB_RUNNING;
+        running_slot = slot - slots;
+        xSemaphoreGive(jobs_mutex);
+
+        ESP_LOGI(TAG, "Job %lu (%s) started after %lu ms queued",
+                 slot->info.id, slot->info.name, slot->info.wait_ms);
+
+        // Waits out an upload or inline operation holding the bus
+        char message[FLASH_JOB_MSG_LEN] = {0};
+        esp_err_t ret = swd_session_begin(slot->info.name, SWD_PRIO_FLASH, SWD_SESSION_FOREVER);
+        if (ret == ESP_OK) {
+            ret = slot->fn(slot->arg[0] ? slot->arg : NULL, message, sizeof(message));
+            swd_session_end();
+        }
+
+        xSemaphoreTake(jobs_mutex, portMAX_DELAY);
+        slot->info.run_ms = (uint32_t)((esp_timer_get_time() - slot->started_us) / 1000);
+        slot->info.result = ret;
+        slot->info.state = ret == ESP_OK ? FLASH_JOB_DONE :
+                           slot->info.cancel_requested ? FLASH_JOB_CANCELLED : FLASH_JOB_FAILED;
+        strcpy(slot->info.message, message[0] ? message : esp_err_to_name(ret));
+        running_slot = -1;
+        xSemaphoreGive(jobs_mutex);
+
+        ESP_LOGI(TAG, "Job %lu (%s) %s in %lu ms: %s", slot->info.id, slot->info.name,
+                 flash_job_state_name(slot->info.state), slot->info.run_ms, slot->info.message);
+    }
+}
+
+esp_err_t flash_jobs_init(void) {
+    if (job_task) {
+        return ESP_OK;
+    }
+
+    jobs_mutex = xSemaphoreCreateMutex();
+    job_queue = xQueueCreate(JOB_QUEUE_LEN, sizeof(uint32_t));
+    if (!jobs_mutex || !job_queue) {
+        ESP_LOGE(TAG, "Out of memory for job queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreate(job_task_fn, "flash_jobs", FLASH_JOB_TASK_STACK, NULL,
+                    FLASH_JOB_TASK_PRIO, &job_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create job task");
+        job_task = NULL;
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Job queue ready (%d slots)", FLASH_JOB_SLOTS);
+    return ESP_OK;
+}
+
+uint32_t flash_jobs_submit(const char *name, flash_job_fn fn, const char *arg) {
+    if (!job_task || !fn) {
+        return 0;
+    }
+
+    xSemaphoreTake(jobs_mutex, portMAX_DELAY);
+
+    // Prefer a free slot, otherwise reuse the oldest finished job
+    int index = -1;
+    for (int i = 0; i < FLASH_JOB_SLOTS; i++) {
+        if (!slots[i].used) {
+            index = i;
+            break;
+        }
+        if (is_finished(slots[i].info.state) &&
+            (index < 0 || slots[i].info.id < slots[index].info.id)) {
+            index = i;
+        }
+    }
+    if (index < 0) {
+        xSemaphoreGive(jobs_mutex);
+        ESP_LOGW(TAG, "Job queue full, rejecting %s", name);
+        return 0;
+    }
+
+    job_slot_t *slot = &slots[index];
+    memset(slot, 0, sizeof(*slot));
+    slot->used = true;
+    slot->fn = fn;
+    if (arg) {
+        strncpy(slot->arg, arg, sizeof(slot->arg) - 1);
+    }
+    slot->queued_us = esp_timer_get_time();
+    slot->info.id = next_id++;
+    slot->info.name = name;
+    slot->info.state = FLASH_JOB_QUEUED;
+    slot->info.phase = "queued";
+    uint32_t id = slot->info.id;
+
+    if (xQueueSend(job_queue, &id, 0) != pdTRUE) {
+        slot->used = false;
+        xSemaphoreGive(jobs_mutex);
+        ESP_LOGW(TAG, "Job queue full, rejecting %s", name);
+        return 0;
+    }
+    xSemaphoreGive(jobs_mutex);
+
+    ESP_LOGI(TAG, "Job %lu (%s) queued", id, name);
+    return id;
+}
+
+esp_err_t flash_jobs_cancel(uint32_t id) {
+    if (!jobs_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(jobs_mutex, portMAX_DELAY);
+    job_slot_t *slot = find_slot(id);
+    if (!slot) {
+        ret = ESP_ERR_NOT_FOUND;
+    } else if (slot->info.state == FLASH_JOB_QUEUED) {
+        slot->info.state = FLASH_JOB_CANCELLED;
+        slot->info.result = ESP_ERR_INVALID_STATE;
+        slot->info.wait_ms = (uint32_t)((esp_timer_get_time() - slot->queued_us) / 1000);
+        strcpy(slot->info.message, "Cancelled before start");
+    } else if (slot->info.state == FLASH_JOB_RUNNING) {
+        slot->info.cancel_requested = true;
+    } else {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreGive(jobs_mutex);
+    return ret;
+}
+
+esp_err_t flash_jobs_get(uint32_t id, flash_job_info_t *info) {
+    if (!jobs_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(jobs_mutex, portMAX_DELAY);
+    job_slot_t *slot = find_slot(id);
+    if (slot) {
+        snapshot(slot, info);
+    }
+    xSemaphoreGive(jobs_mutex);
+    return slot ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+int flash_jobs_list(flash_job_info_t *infos, int max) {
+    if (!jobs_mutex) {
+        return 0;
+    }
+
+    int count = 0;
+    xSemaphoreTake(jobs_mutex, portMAX_DELAY);
+    for (int i = 0; i < FLASH_JOB_SLOTS && count < max; i++) {
+        if (slots[i].used) {
+            snapshot(&slots[i], &infos[count++]);
+        }
+    }
+    xSemaphoreGive(jobs_mutex);
+
+    // Insertion sort by id, at most FLASH_JOB_SLOTS entries
+    for (int i = 1; i < count; i++) {
+        flash_job_info_t tmp = infos[i];
+        int j = i - 1;
+        while (j >= 0 && infos[j].id > tmp.id) {
+            infos[j + 1] = infos[j];
+            j--;
+        }
+        infos[j + 1] = tmp;
+    }
+    return count;
+}
+
+bool flash_jobs_busy(void) {
+    if (!jobs_mutex) {
+        return false;
+    }
+
+    bool busy = false;
+    xSemaphoreTake(jobs_mutex, portMAX_DELAY);
+    for (int i = 0; i < FLASH_JOB_SLOTS && !busy; i++) {
+        busy = slots[i].used && !is_finished(slots[i].info.state);
+    }
+    xSemaphoreGive(jobs_mutex);
+    return busy;
+}
+
+bool flash_job_cancelled(void) {
+    int index = running_slot;
+    return index >= 0 && slots[index].info.cancel_requested;
+}
+
+void flash_job_progress(uint32_t current, uint32_t total, const char *operation) {
+    xSemaphoreTake(jobs_mutex, portMAX_DELAY);
+    if (running_slot >= 0) {
+        slots[running_slot].info.current = current;
+        slots[running_slot].info.total = total;
+        slots[running_slot].info.phase = operation;
+    }
+    xSemaphoreGive(jobs_mutex);
+
+    report_flash_progress(current, total, operation);
+}
+
+const char *flash_job_state_name(flash_job_state_t state) {
+    switch (state) {
+        case FLASH_JOB_QUEUED:    return "queued";
+        case FLASH_JOB_RUNNING:   return "running";
+        case FLASH_JOB_DONE:      return "done";
+        case FLASH_JOB_FAILED:    return "failed";
+        case FLASH_JOB_CANCELLED: return "cancelled";
+    }
+    return "unknown";
+}
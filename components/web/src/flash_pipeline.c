@@ -0,0 +1,474 @@
+#include "flash_pipeline.h"
+#include "nrf52_hal.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_crc.h"
+#include "swd_mem.h"
+#include "flash_telemetry.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+static const char *TAG = "FLASH_PIPE";
+
+#define PIPELINE_PAGE_COUNT (NRF52_FLASH_SIZE / FLASH_PIPELINE_PAGE_SIZE)
+#define PIPELINE_UICR_INDEX PIPELINE_PAGE_COUNT
+#define WORK_QUEUE_LEN      (FLASH_PIPELINE_DEPTH + 8)   // Room for erase requests
+
+typedef struct {
+    uint32_t addr;              // Page address
+    uint16_t start;             // Dirty span within the page
+    uint16_t end;
+    uint32_t data_bytes;        // Payload bytes copied in, for progress
+    uint8_t data[FLASH_PIPELINE_PAGE_SIZE];
+} pipeline_page_t;
+
+typedef enum {
+    JOB_WRITE,
+    JOB_ERASE,
+    JOB_SYNC,
+    JOB_QUIT
+} job_kind_t;
+
+typedef struct {
+    job_kind_t kind;
+    uint32_t addr;
+    pipeline_page_t *page;
+} pipeline_job_t;
+
+typedef struct {
+    TaskHandle_t task;
+    QueueHandle_t free_queue;   // pipeline_page_t* ready for the producer
+    QueueHandle_t work_queue;   // pipeline_job_t for the SWD task
+    SemaphoreHandle_t sync;
+    pipeline_page_t *pages;
+    pipeline_page_t *current;   // Page the producer is filling
+    uint8_t *scratch;           // Readback buffer of the SWD task
+    bool verify;
+
+    // Owned by the SWD task while running
+    uint8_t erased_pages[PIPELINE_PAGE_COUNT / 8];
+    bool uicr_erased;
+    int64_t busy_us;
+    uint8_t committed[(PIPELINE_PAGE_COUNT + 1 + 7) / 8];
+    uint32_t page_crc[PIPELINE_PAGE_COUNT + 1];
+
+    volatile bool aborted;
+    int64_t stall_us;
+    flash_pipeline_stats_t stats;
+} flash_pipeline_t;
+
+static flash_pipeline_t pl;
+
+static bool page_is_erased(uint32_t page) {
+    if (page >= UICR_BASE) {
+        return pl.uicr_erased;
+    }
+    uint32_t idx = page / FLASH_PIPELINE_PAGE_SIZE;
+    if (idx >= PIPELINE_PAGE_COUNT) {
+        return false;   // Out of range, the erase reports it
+    }
+    return (pl.erased_pages[idx / 8] & (1 << (idx % 8))) != 0;
+}
+
+// Pages erased during this upload are never erased again, so data that
+// revisits a page (or a pre-erased page) is written without losing anything
+static esp_err_t erase_page_once(uint32_t page) {
+    if (page_is_erased(page)) {
+        return ESP_OK;
+    }
+
+    pl.stats.phase = "erase";
+    esp_err_t ret = swd_flash_erase_page(page);
+    flash_telemetry_page_erased(page, ret == ESP_OK);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase page 0x%08lX", page);
+        return ret;
+    }
+
+    if (page >= UICR_BASE) {
+        pl.uicr_erased = true;
+    } else {
+        uint32_t idx = page / FLASH_PIPELINE_PAGE_SIZE;
+        pl.erased_pages[idx / 8] |= 1 << (idx % 8);
+    }
+    pl.stats.pages_erased++;
+    return ESP_OK;
+}
+
+static int page_index(uint32_t page) {
+    if (page == UICR_BASE) {
+        return PIPELINE_UICR_INDEX;
+    }
+    return page < NRF52_FLASH_SIZE ? (int)(page / FLASH_PIPELINE_PAGE_SIZE) : -1;
+}
+
+static bool page_is_committed(int idx) {
+    return (pl.committed[idx / 8] & (1 << (idx % 8))) != 0;
+}
+
+// Contents the page must hold once this write lands. Writes only clear bits,
+// so a page that earlier data already programmed keeps what it has.
+static esp_err_t build_expected(pipeline_page_t *page, int idx) {
+    if (idx < 0 || !page_is_committed(idx)) {
+        return ESP_OK;      // Freshly erased, the buffer is the whole image
+    }
+
+    esp_err_t ret = swd_mem_read_buffer(page->addr, pl.scratch, FLASH_PIPELINE_PAGE_SIZE);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    for (int i = 0; i < FLASH_PIPELINE_PAGE_SIZE; i++) {
+        page->data[i] &= pl.scratch[i];
+    }
+    return ESP_OK;
+}
+
+static esp_err_t write_range(const pipeline_page_t *page, uint32_t start, uint32_t end) {
+    pl.stats.phase = "write";
+    return swd_flash_write_buffer(page->addr + start, page->data + start, end - start, NULL);
+}
+
+static esp_err_t verify_page(const pipeline_page_t *page) {
+    pl.stats.phase = "verify";
+    esp_err_t ret = swd_mem_read_buffer(page->addr, pl.scratch, FLASH_PIPELINE_PAGE_SIZE);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    for (int i = 0; i < FLASH_PIPELINE_PAGE_SIZE; i++) {
+        if (pl.scratch[i] != page->data[i]) {
+            ESP_LOGW(TAG, "Verify mismatch at 0x%08lX: 0x%02X != 0x%02X",
+                     page->addr + i, pl.scratch[i], page->data[i]);
+            flash_telemetry_verify_failed(page->addr + i);
+            return ESP_ERR_INVALID_CRC;
+        }
+    }
+    return ESP_OK;
+}
+
+// Start the page over: erase it and write the expected image, blank ends skipped
+static esp_err_t rewrite_page(const pipeline_page_t *page) {
+    uint32_t start = 0;
+    uint32_t end = FLASH_PIPELINE_PAGE_SIZE;
+    while (start < end && page->data[start] == 0xFF) {
+        start++;
+    }
+    while (end > start && page->data[end - 1] == 0xFF) {
+        end--;
+    }
+
+    pl.stats.phase = "erase";
+    esp_err_t ret = swd_flash_erase_page(page->addr);
+    flash_telemetry_page_erased(page->addr, ret == ESP_OK);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    pl.stats.pages_erased++;
+
+    start &= ~(NRF52_FLASH_WORD_SIZE - 1);
+    end = (end + NRF52_FLASH_WORD_SIZE - 1) & ~(NRF52_FLASH_WORD_SIZE - 1);
+    return start < end ? write_range(page, start, end) : ESP_OK;
+}
+
+// Erase once, write the dirty span and check the whole page while the
+// producer keeps filling the next buffers. A failed write or readback gets
+// the page erased and rewritten a few times before the upload fails.
+static esp_err_t program_page(pipeline_page_t *page) {
+    int idx = page_index(page->addr);
+    esp_err_t ret = erase_page_once(page->addr);
+    if (ret == ESP_OK) {
+        ret = build_expected(page, idx);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = write_range(page, page->start, page->end);
+
+    int retries = 0;
+    while (pl.verify) {
+        if (ret == ESP_OK) {
+            ret = verify_page(page);
+            if (ret == ESP_OK) {
+                pl.stats.pages_verified++;
+                break;
+            }
+        }
+        if (retries++ == FLASH_PIPELINE_VERIFY_RETRIES) {
+            break;
+        }
+        ESP_LOGW(TAG, "Page 0x%08lX failed (%s), retry %d",
+                 page->addr, esp_err_to_name(ret), retries);
+        pl.stats.verify_retries++;
+        ret = rewrite_page(page);
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to program page 0x%08lX: %s", page->addr, esp_err_to_name(ret));
+        return ret;
+    }
+
+    pl.stats.pages_written++;
+    pl.stats.flashed_bytes += page->data_bytes;
+
+    // Remember what each programmed page holds for resumed sessions
+    if (idx >= 0) {
+        pl.page_crc[idx] = esp_crc32_le(0, page->data, FLASH_PIPELINE_PAGE_SIZE);
+        pl.committed[idx / 8] |= 1 << (idx % 8);
+    }
+    return ESP_OK;
+}
+
+static void record_error(uint32_t addr, esp_err_t err) {
+    if (pl.stats.error == ESP_OK) {
+        pl.stats.error_addr = addr;
+        pl.stats.error = err;
+    }
+}
+
+static void pipeline_task(void *arg) {
+    pipeline_job_t job;
+
+    for (;;) {
+        xQueueReceive(pl.work_queue, &job, portMAX_DELAY);
+
+        // After a failure or abort jobs are drained without touching the target
+        bool skip = pl.aborted || pl.stats.error != ESP_OK;
+        int64_t t0 = esp_timer_get_time();
+        esp_err_t ret = ESP_OK;
+
+        switch (job.kind) {
+            case JOB_WRITE:
+                if (!skip) {
+                    ret = program_page(job.page);
+                }
+                xQueueSend(pl.free_queue, &job.page, portMAX_DELAY);
+                break;
+
+            case JOB_ERASE:
+                if (!skip) {
+                    ret = erase_page_once(job.addr);
+                }
+                break;
+
+            case JOB_SYNC:
+                xSemaphoreGive(pl.sync);
+                continue;
+
+            case JOB_QUIT:
+                xSemaphoreGive(pl.sync);
+                vTaskDelete(NULL);
+                return;
+        }
+
+        pl.stats.phase = "idle";
+        if (!skip) {
+            pl.busy_us += esp_timer_get_time() - t0;
+            pl.stats.busy_ms = (uint32_t)(pl.busy_us / 1000);
+        }
+        if (ret != ESP_OK) {
+            record_error(job.addr, ret);
+        }
+    }
+}
+
+static esp_err_t post_job(job_kind_t kind, uint32_t addr, pipeline_page_t *page) {
+    pipeline_job_t job = { .kind = kind, .addr = addr, .page = page };
+    return xQueueSend(pl.work_queue, &job, portMAX_DELAY) == pdTRUE ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t submit_current(void) {
+    if (!pl.current) {
+        return ESP_OK;
+    }
+    pipeline_page_t *page = pl.current;
+    pl.current = NULL;
+    return post_job(JOB_WRITE, page->addr, page);
+}
+
+esp_err_t flash_pipeline_start(bool verify) {
+    if (pl.task) {
+        ESP_LOGW(TAG, "Pipeline already running");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(&pl, 0, sizeof(pl));
+    pl.stats.phase = "idle";
+    pl.verify = verify;
+    pl.pages = malloc(FLASH_PIPELINE_DEPTH * sizeof(pipeline_page_t));
+    pl.scratch = malloc(FLASH_PIPELINE_PAGE_SIZE);
+    pl.free_queue = xQueueCreate(FLASH_PIPELINE_DEPTH, sizeof(pipeline_page_t*));
+    pl.work_queue = xQueueCreate(WORK_QUEUE_LEN, sizeof(pipeline_job_t));
+    pl.sync = xSemaphoreCreateBinary();
+    if (!pl.pages || !pl.scratch || !pl.free_queue || !pl.work_queue || !pl.sync) {
+        ESP_LOGE(TAG, "Out of memory for %d page buffers", FLASH_PIPELINE_DEPTH);
+        flash_pipeline_stop();
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < FLASH_PIPELINE_DEPTH; i++) {
+        pipeline_page_t *page = &pl.pages[i];
+        xQueueSend(pl.free_queue, &page, 0);
+    }
+
+    if (xTaskCreate(pipeline_task, "flash_pipe", FLASH_PIPELINE_TASK_STACK, NULL,
+                    FLASH_PIPELINE_TASK_PRIO, &pl.task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create pipeline task");
+        pl.task = NULL;
+        flash_pipeline_stop();
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Pipeline started with %d x %u byte buffers%s",
+             FLASH_PIPELINE_DEPTH, (unsigned)FLASH_PIPELINE_PAGE_SIZE, verify ? ", verifying" : "");
+    return ESP_OK;
+}
+
+esp_err_t flash_pipeline_write(uint32_t addr, const uint8_t *data, size_t len) {
+    if (!pl.task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    while (len > 0) {
+        if (pl.stats.error != ESP_OK) {
+            return pl.stats.error;
+        }
+
+        uint32_t page_addr = addr & ~(FLASH_PIPELINE_PAGE_SIZE - 1);
+        if (pl.current && pl.current->addr != page_addr) {
+            esp_err_t ret = submit_current();
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+
+        if (!pl.current) {
+            // Blocking here is the backpressure, count it so stalls show up in the stats
+            if (xQueueReceive(pl.free_queue, &pl.current, 0) != pdTRUE) {
+                int64_t t0 = esp_timer_get_time();
+                xQueueReceive(pl.free_queue, &pl.current, portMAX_DELAY);
+                pl.stall_us += esp_timer_get_time() - t0;
+                pl.stats.stall_ms = (uint32_t)(pl.stall_us / 1000);
+            }
+            memset(pl.current->data, 0xFF, FLASH_PIPELINE_PAGE_SIZE);
+            pl.current->addr = page_addr;
+            pl.current->start = FLASH_PIPELINE_PAGE_SIZE;
+            pl.current->end = 0;
+            pl.current->data_bytes = 0;
+        }
+
+        uint32_t offset = addr - page_addr;
+        size_t chunk = FLASH_PIPELINE_PAGE_SIZE - offset;
+        if (chunk > len) {
+            chunk = len;
+        }
+
+        memcpy(pl.current->data + offset, data, chunk);
+        if (offset < pl.current->start) {
+            pl.current->start = offset;
+        }
+        if (offset + chunk > pl.current->end) {
+            pl.current->end = offset + chunk;
+        }
+        pl.current->data_bytes += chunk;
+
+        addr += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t flash_pipeline_erase(uint32_t addr) {
+    if (!pl.task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (pl.stats.error != ESP_OK) {
+        return pl.stats.error;
+    }
+    return post_job(JOB_ERASE, addr & ~(FLASH_PIPELINE_PAGE_SIZE - 1), NULL);
+}
+
+esp_err_t flash_pipeline_finish(flash_progress_cb progress) {
+    if (!pl.task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = submit_current();
+    if (ret == ESP_OK) {
+        ret = post_job(JOB_SYNC, 0, NULL);
+    }
+    if (ret == ESP_OK) {
+        while (xSemaphoreTake(pl.sync, pdMS_TO_TICKS(FLASH_PIPELINE_REPORT_MS)) != pdTRUE) {
+            if (progress) {
+                progress(pl.stats.flashed_bytes, 0, pl.stats.phase);
+            }
+        }
+        ret = pl.stats.error;
+    }
+
+    flash_pipeline_stats_t stats;
+    flash_pipeline_get_stats(&stats);
+    ESP_LOGI(TAG, "Pipeline drained: %lu bytes in %lu pages, %lu erases, busy %lu ms (%lu KB/s), producer stalled %lu ms",
+             stats.flashed_bytes, stats.pages_written, stats.pages_erased,
+             stats.busy_ms, stats.flash_kbps, stats.stall_ms);
+    if (pl.verify) {
+        ESP_LOGI(TAG, "Verified %lu pages, %lu retries", stats.pages_verified, stats.verify_retries);
+    }
+    return ret;
+}
+
+void flash_pipeline_abort(void) {
+    pl.aborted = true;
+    pl.current = NULL;
+}
+
+void flash_pipeline_stop(void) {
+    if (pl.task) {
+        pl.aborted = true;
+        post_job(JOB_QUIT, 0, NULL);
+        xSemaphoreTake(pl.sync, portMAX_DELAY);
+        pl.task = NULL;
+    }
+
+    if (pl.work_queue) {
+        vQueueDelete(pl.work_queue);
+        pl.work_queue = NULL;
+    }
+    if (pl.free_queue) {
+        vQueueDelete(pl.free_queue);
+        pl.free_queue = NULL;
+    }
+    if (pl.sync) {
+        vSemaphoreDelete(pl.sync);
+        pl.sync = NULL;
+    }
+    free(pl.pages);
+    pl.pages = NULL;
+    free(pl.scratch);
+    pl.scratch = NULL;
+    pl.current = NULL;
+}
+
+void flash_pipeline_get_stats(flash_pipeline_stats_t *stats) {
+    *stats = pl.stats;
+    stats->flash_kbps = stats->busy_ms ? (stats->flashed_bytes / stats->busy_ms) * 1000 / 1024 : 0;
+}
+
+int flash_pipeline_get_committed(flash_pipeline_page_t *pages, int max) {
+    int count = 0;
+    for (int idx = 0; idx <= PIPELINE_UICR_INDEX && count < max; idx++) {
+        if (page_is_committed(idx)) {
+            pages[count].addr = idx == PIPELINE_UICR_INDEX ? UICR_BASE : idx * FLASH_PIPELINE_PAGE_SIZE;
+            pages[count].crc32 = pl.page_crc[idx];
+            count++;
+        }
+    }
+    return count;
+}
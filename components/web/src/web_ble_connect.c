@@ -1,6 +1,7 @@
 #include "esp_http_server.h"
 #include "esp_log.h"
 #include "ble_proxy.h"
+#include "host/ble_hs.h"
 #include "cJSON.h"
 #include <string.h>
 #include <stdlib.h>
@@ -11,6 +12,17 @@
 
 static const char *TAG = "WEB_BLE_CONN";
 
+// Link named by ?link=N, -1 when absent
+static int query_link(httpd_req_t *req) {
+    char query[64] = {0};
+    char value[8] = {0};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "link", value, sizeof(value)) != ESP_OK) {
+        return -1;
+    }
+    return atoi(value);
+}
+
 // Connect to device handler
 static esp_err_t ble_connect_handler(httpd_req_t *req) {
     char content[128];
@@ -107,9 +119,11 @@ static esp_err_t ble_connect_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
-// Disconnect handler
+// Disconnect handler, ?link=N for one radio, otherwise all of them
 static esp_err_t ble_disconnect_handler(httpd_req_t *req) {
-    esp_err_t ret = ble_proxy_disconnect(0);
+    int link = query_link(req);
+    esp_err_t ret = link >= 0 ? ble_proxy_disconnect_link(link) :
+                                ble_proxy_disconnect(BLE_HS_CONN_HANDLE_NONE);
 
     cJSON *json = cJSON_CreateObject();
     cJSON_AddBoolToObject(json, "success", ret == ESP_OK);
@@ -123,22 +137,158 @@ static esp_err_t ble_disconnect_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
-// Connection status handler
+static void add_peer(cJSON *json, const ble_connection_t *conn_info) {
+    char mac_str[18];
+    snprintf(mac_str, sizeof(mac_str), "%02X:%02X:%02X:%02X:%02X:%02X",
+            conn_info->peer_addr[5], conn_info->peer_addr[4],
+            conn_info->peer_addr[3], conn_info->peer_addr[2],
+            conn_info->peer_addr[1], conn_info->peer_addr[0]);
+    cJSON_AddStringToObject(json, "peer_addr", mac_str);
+}
+
+// Proxy, cache and radio link counters of one link
+static void add_link_stats(cJSON *json, uint8_t index) {
+    tcp_proxy_stats_t proxy;
+    tcp_proxy_get_stats(index, &proxy);
+    cJSON *tcp = cJSON_AddObjectToObject(json, "tcp");
+    cJSON_AddNumberToObject(tcp, "port", proxy.port);
+    cJSON_AddBoolToObject(tcp, "listening", proxy.listening);
+    cJSON_AddNumberToObject(tcp, "clients", proxy.clients);
+    cJSON_AddNumberToObject(tcp, "backlog", proxy.backlog);
+    cJSON_AddNumberToObject(tcp, "notifications", proxy.notifications);
+    cJSON_AddNumberToObject(tcp, "bytes_sent", proxy.bytes_sent);
+    cJSON_AddNumberToObject(tcp, "pool_drops", proxy.pool_drops);
+    cJSON_AddNumberToObject(tcp, "client_drops", proxy.client_drops);
+    cJSON_AddNumberToObject(tcp, "slow_closes", proxy.slow_closes);
+    ble_conn_snapshot_t snap;
+    ble_proxy_get_snapshot(index, &snap);
+    cJSON_AddStringToObject(tcp, "framing", snap.meshtastic ? "meshtastic" : "raw");
+    cJSON_AddNumberToObject(tcp, "frames_in", proxy.frames_in);
+    cJSON_AddNumberToObject(tcp, "frames_out", proxy.frames_out);
+    cJSON_AddNumberToObject(tcp, "resync_bytes", proxy.resync_bytes);
+
+    mesh_cache_stats_t cache;
+    mesh_cache_get_stats(index, &cache);
+    cJSON *cfg = cJSON_AddObjectToObject(json, "config_cache");
+    cJSON_AddBoolToObject(cfg, "valid", cache.valid);
+    cJSON_AddBoolToObject(cfg, "capturing", cache.capturing);
+    cJSON_AddNumberToObject(cfg, "records", cache.records);
+    cJSON_AddNumberToObject(cfg, "bytes", cache.bytes);
+    cJSON_AddNumberToObject(cfg, "readers", cache.readers);
+    cJSON_AddNumberToObject(cfg, "hits", cache.hits);
+    cJSON_AddNumberToObject(cfg, "captures", cache.captures);
+    cJSON_AddNumberToObject(cfg, "overflow_drops", cache.overflow_drops);
+    cJSON_AddNumberToObject(cfg, "age_s", cache.age_s);
+
+    ble_link_info_t link;
+    ble_proxy_get_link_info(index, &link);
+    cJSON *lnk = cJSON_AddObjectToObject(json, "link");
+    cJSON_AddStringToObject(lnk, "profile", ble_link_profile_name(link.profile));
+    cJSON_AddStringToObject(lnk, "active", ble_link_profile_name(link.active));
+    cJSON_AddNumberToObject(lnk, "tx_phy", link.tx_phy);
+    cJSON_AddNumberToObject(lnk, "rx_phy", link.rx_phy);
+    cJSON_AddNumberToObject(lnk, "tx_octets", link.tx_octets);
+    cJSON_AddNumberToObject(lnk, "rx_octets", link.rx_octets);
+    cJSON_AddNumberToObject(lnk, "mtu", link.mtu);
+    cJSON_AddNumberToObject(lnk, "interval_ms", link.interval_us / 1000.0);
+    cJSON_AddNumberToObject(lnk, "latency", link.latency);
+    cJSON_AddNumberToObject(lnk, "supervision_ms", link.supervision_ms);
+    cJSON_AddStringToObject(lnk, "handles", link.handles_cached ? "cached" : "discovered");
+    cJSON_AddNumberToObject(lnk, "discovery_ms", link.discovery_ms);
+    cJSON_AddBoolToObject(lnk, "reconnecting", link.reconnecting);
+    cJSON_AddNumberToObject(lnk, "reconnect_attempts", link.reconnect_attempts);
+    cJSON_AddNumberToObject(lnk, "reconnect_ms", link.reconnect_ms);
+    cJSON_AddNumberToObject(lnk, "oversize_drops", link.oversize_drops);
+
+    ble_tx_stats_t uplink;
+    ble_proxy_get_tx_stats(index, &uplink);
+    cJSON *up = cJSON_AddObjectToObject(json, "uplink");
+    cJSON_AddNumberToObject(up, "bytes", uplink.bytes);
+    cJSON_AddNumberToObject(up, "bytes_per_sec", uplink.bytes_per_sec);
+    cJSON_AddNumberToObject(up, "stalls", uplink.stalls);
+    cJSON_AddNumberToObject(up, "credits", uplink.credits);
+}
+
+// Connection status handler. The top level describes the first connected
+// link (or the one connecting) as before; "links" has every link.
 static esp_err_t ble_conn_status_handler(httpd_req_t *req) {
-    ble_connection_t conn_info;
-    ble_proxy_get_connection_info(&conn_info);
+    ble_connection_t infos[BLE_PROXY_MAX_LINKS];
+    int primary = -1;
+    for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+        ble_proxy_get_connection_info(i, &infos[i]);
+        if (infos[i].state != BLE_STATE_IDLE &&
+            (primary < 0 || (infos[i].state == BLE_STATE_CONNECTED && infos[primary].state != BLE_STATE_CONNECTED))) {
+            primary = i;
+        }
+    }
+    if (primary < 0) {
+        primary = 0;
+    }
+    ble_connection_t *conn_info = &infos[primary];
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddBoolToObject(json, "connected", ble_proxy_is_connected());
+    cJSON_AddNumberToObject(json, "state", conn_info->state);
+    cJSON_AddNumberToObject(json, "max_links", BLE_PROXY_MAX_LINKS);
+
+    if (conn_info->state == BLE_STATE_CONNECTED) {
+        add_peer(json, conn_info);
+    }
+    add_link_stats(json, primary);
+
+    cJSON *list = cJSON_AddArrayToObject(json, "links");
+    for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "link", i);
+        cJSON_AddBoolToObject(item, "connected", infos[i].state == BLE_STATE_CONNECTED);
+        cJSON_AddNumberToObject(item, "state", infos[i].state);
+        // A link waiting for its radio to come back still names it
+        ble_link_info_t link;
+        ble_proxy_get_link_info(i, &link);
+        if (infos[i].state != BLE_STATE_IDLE || link.reconnecting) {
+            add_peer(item, &infos[i]);
+        }
+        add_link_stats(item, i);
+        cJSON_AddItemToArray(list, item);
+    }
+
+    char *json_str = cJSON_Print(json);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json_str, strlen(json_str));
+
+    free(json_str);
+    cJSON_Delete(json);
+    return ESP_OK;
+}
+
+// Select the link tuning profile, ?profile=auto|bulk|interactive|low_power
+// for ?link=N, every link when absent
+static esp_err_t ble_link_profile_handler(httpd_req_t *req) {
+    char query[64] = {0};
+    char name[16] = {0};
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    httpd_query_key_value(query, "profile", name, sizeof(name));
+    int link = query_link(req);
+
+    esp_err_t ret = ESP_ERR_INVALID_ARG;
+    for (int p = BLE_LINK_AUTO; p <= BLE_LINK_LOW_POWER; p++) {
+        if (strcmp(name, ble_link_profile_name(p)) != 0) {
+            continue;
+        }
+        if (link >= 0) {
+            ret = ble_proxy_set_link_profile(link, p);
+        } else {
+            for (int i = 0; i < BLE_PROXY_MAX_LINKS; i++) {
+                ret = ble_proxy_set_link_profile(i, p);
+            }
+        }
+        break;
+    }
 
     cJSON *json = cJSON_CreateObject();
-    cJSON_AddBoolToObject(json, "connected", conn_info.state == BLE_STATE_CONNECTED);
-    cJSON_AddNumberToObject(json, "state", conn_info.state);
-
-    if (conn_info.state == BLE_STATE_CONNECTED) {
-        char mac_str[18];
-        snprintf(mac_str, sizeof(mac_str), "%02X:%02X:%02X:%02X:%02X:%02X",
-                conn_info.peer_addr[5], conn_info.peer_addr[4],
-                conn_info.peer_addr[3], conn_info.peer_addr[2],
-                conn_info.peer_addr[1], conn_info.peer_addr[0]);
-        cJSON_AddStringToObject(json, "peer_addr", mac_str);
+    cJSON_AddBoolToObject(json, "success", ret == ESP_OK);
+    if (ret != ESP_OK) {
+        cJSON_AddStringToObject(json, "error", ret == ESP_ERR_INVALID_ARG ? "Unknown profile" : esp_err_to_name(ret));
     }
 
     char *json_str = cJSON_Print(json);
@@ -197,6 +347,19 @@ esp_err_t register_ble_connect_handlers(httpd_handle_t server) {
         .handler = ble_conn_status_handler
     };
 
+    // Same report, under the name the link tuning docs use
+    httpd_uri_t link_status_uri = {
+        .uri = "/ble/status",
+        .method = HTTP_GET,
+        .handler = ble_conn_status_handler
+    };
+
+    httpd_uri_t link_profile_uri = {
+        .uri = "/ble/link_profile",
+        .method = HTTP_POST,
+        .handler = ble_link_profile_handler
+    };
+
     httpd_uri_t passkey_uri = {
         .uri = "/ble/passkey",
         .method = HTTP_POST,
@@ -207,6 +370,8 @@ esp_err_t register_ble_connect_handlers(httpd_handle_t server) {
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &disconnect_uri));
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &status_uri));
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &passkey_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &link_status_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &link_profile_uri));
 
     ESP_LOGI(TAG, "BLE connection handlers registered");
     return ESP_OK;
@@ -1,6 +1,7 @@
 #include "web_server.h"
 #include "esp_log.h"
 #include "power_mgmt.h"
+#include "error_log.h"
 #include "cJSON.h"
 #include "host/ble_store.h"
 
@@ -176,6 +177,43 @@ static esp_err_t clear_bonds_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+// Persistent error log as a JSON array, oldest first, ?since=<seq> for newer records only.
+// Sent a record at a time so the log never has to fit in one buffer.
+static esp_err_t errors_handler(httpd_req_t *req) {
+    char query[32] = {0};
+    char since[12] = {0};
+    uint32_t cursor = 0;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "since", since, sizeof(since)) == ESP_OK) {
+        cursor = strtoul(since, NULL, 10);
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr_chunk(req, "[");
+
+    error_log_entry_t entry;
+    bool first = true;
+    while (error_log_next(&cursor, &entry)) {
+        char text[96];
+        char chunk[224];
+        error_log_format(&entry, text, sizeof(text));
+        int len = snprintf(chunk, sizeof(chunk),
+                           "%s{\"seq\":%lu,\"boot\":%u,\"time\":%lu,\"wall_time\":%s,"
+                           "\"subsystem\":\"%s\",\"code\":%ld,\"arg\":%lu,\"text\":\"%s\"}",
+                           first ? "" : ",", entry.seq, entry.boot, entry.time,
+                           (entry.flags & ERROR_LOG_FLAG_WALL_TIME) ? "true" : "false",
+                           error_log_subsystem_name(entry.subsystem), (long)entry.code,
+                           entry.arg, text);
+        if (httpd_resp_send_chunk(req, chunk, len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        first = false;
+    }
+
+    httpd_resp_sendstr_chunk(req, "]");
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
 esp_err_t register_power_handlers(httpd_handle_t server) {
     httpd_uri_t power_status_uri = {
         .uri = "/power_status",
@@ -219,6 +257,13 @@ esp_err_t register_power_handlers(httpd_handle_t server) {
         .user_ctx = NULL
     };
 
+    httpd_uri_t errors_uri = {
+        .uri = "/errors",
+        .method = HTTP_GET,
+        .handler = errors_handler,
+        .user_ctx = NULL
+    };
+
     httpd_uri_t clear_bonds_uri = {
         .uri = "/clear_bonds",
         .method = HTTP_POST,
@@ -228,6 +273,7 @@ esp_err_t register_power_handlers(httpd_handle_t server) {
 
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &battery_status_uri));
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &clear_bonds_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &errors_uri));
 
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &power_status_uri));
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &power_on_uri));
@@ -1,10 +1,202 @@
 #include "web_server.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
 
 static const char *TAG = "WEB_SERVER";
 
+#define WS_MAX_CLIENT_FDS       8       // Matches httpd max_open_sockets headroom
+#define WS_MAX_RX_FRAME         128
+#define WS_PROGRESS_INTERVAL_MS 250     // Progress pushes are throttled to this rate
+
+static httpd_handle_t ws_server = NULL;
+static SemaphoreHandle_t ws_mutex = NULL;
+static ws_callback_t ws_rx_callback = NULL;
+
+// Last pushed message, replayed to viewers that connect mid-job
+static char ws_last_msg[256];
+static size_t ws_last_len = 0;
+
+static int64_t last_push_us = 0;
+
 esp_err_t web_server_init(void) {
     ESP_LOGI(TAG, "Web server initialized");
     // TODO: Implement
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+
+static esp_err_t ws_send_frame(int fd, const char *data, size_t len) {
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t*)data,
+        .len = len
+    };
+    return httpd_ws_send_frame_async(ws_server, fd, &frame);
+}
+
+// Handshake and incoming frames on /ws
+static esp_err_t ws_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) {
+        int fd = httpd_req_to_sockfd(req);
+        ESP_LOGI(TAG, "WebSocket client connected (fd %d)", fd);
+        if (ws_last_len > 0) {
+            xSemaphoreTake(ws_mutex, portMAX_DELAY);
+            ws_send_frame(fd, ws_last_msg, ws_last_len);
+            xSemaphoreGive(ws_mutex);
+        }
+        return ESP_OK;
+    }
+
+    uint8_t buf[WS_MAX_RX_FRAME + 1];
+    httpd_ws_frame_t frame = {0};
+    esp_err_t ret = httpd_ws_recv_frame(req, &frame, 0);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (frame.len == 0 || frame.len > WS_MAX_RX_FRAME) {
+        ESP_LOGW(TAG, "Ignoring WebSocket frame of %u bytes", (unsigned)frame.len);
+        return ESP_OK;
+    }
+
+    frame.payload = buf;
+    ret = httpd_ws_recv_frame(req, &frame, frame.len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    buf[frame.len] = '\0';
+
+    if (frame.type == HTTPD_WS_TYPE_TEXT && ws_rx_callback) {
+        ws_rx_callback((const char*)buf, frame.len);
+    }
+    return ESP_OK;
+}
+
+esp_err_t register_ws_handlers(httpd_handle_t server) {
+    if (!ws_mutex) {
+        ws_mutex = xSemaphoreCreateMutex();
+        if (!ws_mutex) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    httpd_uri_t ws_uri = {
+        .uri = "/ws",
+        .method = HTTP_GET,
+        .handler = ws_handler,
+        .user_ctx = NULL,
+        .is_websocket = true
+    };
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &ws_uri));
+
+    ws_server = server;
+    ESP_LOGI(TAG, "WebSocket push registered on /ws");
+    return ESP_OK;
+}
+
+// Sends directly on each socket, so it also works while the httpd task is
+// busy inside a long upload handler and cannot run queued work
+esp_err_t ws_send_to_all(const char *data, size_t len) {
+    if (!ws_server || !ws_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int fds[WS_MAX_CLIENT_FDS];
+    size_t count = WS_MAX_CLIENT_FDS;
+    esp_err_t ret = httpd_get_client_list(ws_server, &count, fds);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    xSemaphoreTake(ws_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < count; i++) {
+        if (httpd_ws_get_fd_info(ws_server, fds[i]) != HTTPD_WS_CLIENT_WEBSOCKET) {
+            continue;
+        }
+        if (ws_send_frame(fds[i], data, len) != ESP_OK) {
+            ESP_LOGW(TAG, "Dropping WebSocket client (fd %d)", fds[i]);
+            httpd_sess_trigger_close(ws_server, fds[i]);
+        }
+    }
+    xSemaphoreGive(ws_mutex);
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t register_ws_handlers(httpd_handle_t server) {
+    ESP_LOGW(TAG, "CONFIG_HTTPD_WS_SUPPORT is off, progress push disabled");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t ws_send_to_all(const char *data, size_t len) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif // CONFIG_HTTPD_WS_SUPPORT
+
+esp_err_t ws_register_callback(ws_callback_t callback) {
+    ws_rx_callback = callback;
+    return ESP_OK;
+}
+
+// Serialize a push message, remember it for late viewers and send it
+static void ws_push_json(cJSON *json) {
+    char *msg = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    if (!msg) {
+        return;
+    }
+
+    size_t len = strlen(msg);
+    if (len < sizeof(ws_last_msg)) {
+        memcpy(ws_last_msg, msg, len + 1);
+        ws_last_len = len;
+    }
+    ws_send_to_all(msg, len);
+    free(msg);
+}
+
+void report_flash_status(const char *phase, uint32_t current, uint32_t total,
+                         uint32_t rx_kbps, uint32_t flash_kbps) {
+    if (!ws_server) {
+        return;
+    }
+
+    // Completion always goes out, everything else is throttled
+    int64_t now = esp_timer_get_time();
+    if (current != total && now - last_push_us < WS_PROGRESS_INTERVAL_MS * 1000) {
+        return;
+    }
+    last_push_us = now;
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "type", "progress");
+    cJSON_AddStringToObject(json, "phase", phase);
+    cJSON_AddNumberToObject(json, "current", current);
+    cJSON_AddNumberToObject(json, "total", total);
+    cJSON_AddNumberToObject(json, "rx_kbps", rx_kbps);
+    cJSON_AddNumberToObject(json, "flash_kbps", flash_kbps);
+    ws_push_json(json);
+}
+
+void report_flash_progress(uint32_t current, uint32_t total, const char *operation) {
+    report_flash_status(operation, current, total, 0, 0);
+}
+
+void report_flash_result(bool success, const char *message) {
+    if (!ws_server) {
+        return;
+    }
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "type", "result");
+    cJSON_AddBoolToObject(json, "success", success);
+    cJSON_AddStringToObject(json, "message", message);
+    ws_push_json(json);
+}
@@ -1,10 +1,24 @@
 #include "web_upload.h"
+#include "web_server.h"
 #include "esp_log.h"
 #include "hex_parser.h"
+#include "elf_parser.h"
+#include "decomp_stream.h"
+#include "bin_parser.h"
+#include "tar_parser.h"
+#include "fw_stage.h"
+#include "fw_cache.h"
+#include "fw_backup.h"
+#include "flash_telemetry.h"
+#include "flash_pipeline.h"
+#include "flash_jobs.h"
+#include "cJSON.h"
 #include "swd_flash.h"
 #include "swd_mem.h"
 #include "swd_core.h"
+#include "swd_session.h"
 #include "nrf52_hal.h"
+#include "esp_timer.h"
 #include <string.h>
 
 static const char *TAG = "WEB_UPLOAD";
@@ -13,10 +27,26 @@ static const char *TAG = "WEB_UPLOAD";
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #endif
 
-#define PAGE_BUFFER_SIZE (16 * 1024)
 #define NRF52_PAGE_SIZE 4096
+#define UPLOAD_RECV_SIZE 4096
+#define UPLOAD_MAX_TIMEOUTS 3       // Receive timeouts in a row before a session pauses
+#define UPLOAD_PAUSE_MAX_MS 120000  // A paused session holding the target is dropped after this
+#define UPLOAD_SESSION_LEN 16
+#define UPLOAD_MAX_PAGES ((NRF52_FLASH_SIZE / NRF52_PAGE_SIZE) + 1)
+#define SWD_STATUS_MAX_AGE_MS 1000  // Status polls within this window share one read
+#define SWD_STATUS_WAIT_MS 250      // Then the last snapshot is returned as stale
+#define SWD_INLINE_WAIT_MS 2000     // Synchronous endpoints wait this long for the bus
 
 // Type definitions
+typedef enum {
+    UPLOAD_FORMAT_AUTO = 0,
+    UPLOAD_FORMAT_HEX,
+    UPLOAD_FORMAT_ELF,
+    UPLOAD_FORMAT_BIN,
+    UPLOAD_FORMAT_TAR,          // Bundle of images, always staged
+    UPLOAD_FORMAT_RAW           // Bundle member at a fixed address
+} upload_format_t;
+
 typedef struct {
     bool in_progress;
     uint32_t total_bytes;
@@ -24,15 +54,35 @@ typedef struct {
     uint32_t flashed_bytes;
     uint32_t start_addr;
     uint32_t current_addr;
+    upload_format_t format;
     hex_stream_parser_t *parser;
-    uint8_t *page_buffer;
-    uint32_t buffer_start_addr;
-    uint32_t buffer_data_len;
+    elf_stream_parser_t *elf_parser;
+    bin_stream_parser_t *bin_parser;
+    decomp_stream_t *decomp;
+    tar_stream_parser_t *tar_parser;
+    upload_format_t member_format;  // Format of the current bundle member
+    uint32_t member_addr;           // Load address of a raw member
+    uint32_t member_offset;
+    uint16_t bundle_images;
+    uint32_t skipped_bytes;
+    uint32_t image_bytes;       // Known up front for framed binary uploads
+    int64_t start_us;
+    uint32_t rx_ms;             // Receive time, set once the body is read
+    uint32_t rx_base;           // Bytes received before the current request
+    char session[UPLOAD_SESSION_LEN + 1];   // Client chosen ID, empty if not resumable
+    bool paused;                // Connection lost, waiting for the session to resume
+    bool expired;               // Paused session was discarded, the resume token is dead
+    int64_t paused_us;
+    bool staging;               // Image goes to the stage area, target untouched until validated
+    bool allow_protected;       // Staged image may write MBR, SoftDevice or UICR
     char status_msg[128];
     bool error;
 } upload_context_t;
 
 static upload_context_t *g_upload_ctx = NULL;
+static bool upload_holds_bus = false;      // Direct upload session, kept while paused
+static httpd_handle_t upload_server = NULL;
+static esp_timer_handle_t pause_timer = NULL;
 
 // Helper function to ensure SWD is ready
 static esp_err_t ensure_swd_ready(void) {
@@ -69,6 +119,8 @@ static esp_err_t ensure_swd_ready(void) {
         }
     }
     
+    // Counters go to whichever target is on the other end this time
+    flash_telemetry_attach();
     return ESP_OK;
 }
 
@@ -97,99 +149,562 @@ static esp_err_t check_and_reconnect_swd(void) {
     return ret;
 }
 
-// Flush buffer to flash
-static esp_err_t flush_buffer(upload_context_t *ctx) {
-    if (ctx->buffer_data_len == 0) {
-        return ESP_OK;
+// Staged uploads go to the stage area, direct ones to the flash pipeline
+static esp_err_t buffer_data(upload_context_t *ctx, uint32_t addr, const uint8_t *data, size_t len) {
+    ctx->current_addr = addr + len;
+    if (ctx->staging) {
+        return fw_stage_write(addr, data, len);
     }
-    
-    ESP_LOGI(TAG, "Flushing buffer: addr=0x%08lX, len=%lu", 
-             ctx->buffer_start_addr, ctx->buffer_data_len);
-    
-    // Erase pages
-    uint32_t start_page = ctx->buffer_start_addr & ~(NRF52_PAGE_SIZE - 1);
-    uint32_t end_addr = ctx->buffer_start_addr + ctx->buffer_data_len - 1;
-    uint32_t end_page = end_addr & ~(NRF52_PAGE_SIZE - 1);
-    
-    for (uint32_t page = start_page; page <= end_page; page += NRF52_PAGE_SIZE) {
-        ESP_LOGI(TAG, "Erasing page 0x%08lX", page);
-        esp_err_t ret = swd_flash_erase_page(page);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to erase page 0x%08lX", page);
-            return ret;
+    return flash_pipeline_write(addr, data, len);
+}
+
+// Receive rate over the receive phase, flash rate over SWD busy time
+static void get_upload_rates(upload_context_t *ctx, uint32_t *flashed,
+                             uint32_t *rx_kbps, uint32_t *flash_kbps) {
+    uint32_t rx_ms = ctx->rx_ms ? ctx->rx_ms :
+                     (uint32_t)((esp_timer_get_time() - ctx->start_us) / 1000);
+    *rx_kbps = rx_ms ? ((ctx->received_bytes - ctx->rx_base) / rx_ms) * 1000 / 1024 : 0;
+    *flashed = ctx->flashed_bytes;
+    *flash_kbps = 0;
+
+    if (!ctx->staging) {
+        flash_pipeline_stats_t stats;
+        flash_pipeline_get_stats(&stats);
+        *flashed = stats.flashed_bytes;
+        *flash_kbps = stats.flash_kbps;
+    }
+}
+
+// Push progress to WebSocket viewers, report_flash_status throttles it
+static void push_upload_progress(upload_context_t *ctx) {
+    uint32_t flashed, rx_kbps, flash_kbps;
+    get_upload_rates(ctx, &flashed, &rx_kbps, &flash_kbps);
+
+    const char *phase = "receive";
+    if (!ctx->staging) {
+        flash_pipeline_stats_t stats;
+        flash_pipeline_get_stats(&stats);
+        if (strcmp(stats.phase, "idle") != 0) {
+            phase = stats.phase;
         }
     }
-    
-    // Write data
-    esp_err_t ret = swd_flash_write_buffer(ctx->buffer_start_addr, 
-                                           ctx->page_buffer, 
-                                           ctx->buffer_data_len, NULL);
+    report_flash_status(phase, flashed, ctx->image_bytes ? ctx->image_bytes : ctx->total_bytes,
+                        rx_kbps, flash_kbps);
+}
+
+static void drain_progress(uint32_t current, uint32_t total, const char *operation) {
+    if (g_upload_ctx) {
+        push_upload_progress(g_upload_ctx);
+    }
+}
+
+static void stage_flash_progress(uint32_t current, uint32_t total, const char *operation) {
+    if (g_upload_ctx) {
+        g_upload_ctx->flashed_bytes = current;
+        g_upload_ctx->image_bytes = total;
+    }
+    report_flash_progress(current, total, operation);
+}
+
+// Validate and commit the staged image, then program it at full SWD speed
+static void finish_staged_upload(upload_context_t *ctx) {
+    uint32_t bad_lines = hex_stream_get_error_count(ctx->parser);
+    if (bad_lines > 0) {
+        fw_stage_abort();
+        ctx->error = true;
+        snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                "Error: %lu bad hex lines, target not touched", bad_lines);
+        return;
+    }
+
+    esp_err_t ret = fw_stage_commit(ctx->allow_protected);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to write buffer");
-        return ret;
+        ctx->error = true;
+        if (ret == ESP_ERR_NOT_ALLOWED) {
+            snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                    "Error: Image writes the %s region, target not touched",
+                    fw_stage_get_reject_reason());
+        } else {
+            snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                    "Error: Staging failed (%s), target not touched", esp_err_to_name(ret));
+        }
+        return;
+    }
+
+    ret = ensure_swd_ready();
+    if (ret == ESP_OK) {
+        ret = fw_stage_flash(stage_flash_progress);
+    }
+    if (ret != ESP_OK) {
+        ctx->error = true;
+        snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                "Error: Flashing staged image failed (%s)", esp_err_to_name(ret));
+        swd_shutdown();
+        return;
+    }
+
+    fw_stage_info_t info;
+    fw_stage_get_info(&info);
+    ESP_LOGI(TAG, "Staged image flashed, performing reset sequence...");
+    swd_flash_reset_and_run();
+    swd_shutdown();
+
+    // Keep the image so the next radio can be flashed without an upload
+    uint8_t sha[FW_CACHE_SHA_LEN];
+    char sha_hex[2 * FW_CACHE_SHA_LEN + 1] = "";
+    if (fw_cache_add_staged(sha, false) == ESP_OK) {
+        fw_cache_sha_to_hex(sha, sha_hex);
+    }
+    snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+            "Success: Flashed %lu bytes (%u pages) from stage%s%.16s", info.image_bytes, info.page_count,
+            sha_hex[0] ? ", cached as " : "", sha_hex);
+}
+
+// Flush remaining data, then reset and release the target
+static void finish_upload(upload_context_t *ctx) {
+    if (ctx->staging) {
+        finish_staged_upload(ctx);
+        return;
+    }
+
+    esp_err_t ret = flash_pipeline_finish(drain_progress);
+    flash_pipeline_stats_t stats;
+    flash_pipeline_get_stats(&stats);
+    ctx->flashed_bytes = stats.flashed_bytes;
+    if (ret != ESP_OK) {
+        ctx->error = true;
+        snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                "Error: %s at 0x%08lX (%s)", ret == ESP_ERR_INVALID_CRC ? "Verify failed" : "Flash failed",
+                stats.error_addr, esp_err_to_name(ret));
+        return;
+    }
+
+    ESP_LOGI(TAG, "Upload complete: %lu bytes flashed", ctx->flashed_bytes);
+    if (stats.pages_verified > 0) {
+        snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                "Success: Flashed %lu bytes, %lu pages verified", ctx->flashed_bytes, stats.pages_verified);
+    } else {
+        snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                "Success: Flashed %lu bytes", ctx->flashed_bytes);
+    }
+    ESP_LOGI(TAG, "Flashing complete, performing reset sequence...");
+    swd_flash_reset_and_run();
+    swd_shutdown();
+    ESP_LOGI(TAG, "Target released - should now boot normally");
+}
+
+static void set_flash_error(upload_context_t *ctx, uint32_t addr, esp_err_t err) {
+    if (!ctx->error) {
+        ctx->error = true;
+        snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                "Error: Flash failed near 0x%08lX (%s)", addr, esp_err_to_name(err));
     }
-    
-    ctx->flashed_bytes += ctx->buffer_data_len;
-    
-    // Clear buffer
-    memset(ctx->page_buffer, 0xFF, PAGE_BUFFER_SIZE);
-    ctx->buffer_data_len = 0;
-    
-    return ESP_OK;
 }
 
 // Hex record callback
 static void hex_flash_callback(hex_record_t *record, uint32_t abs_addr, void *ctx) {
     upload_context_t *uctx = (upload_context_t*)ctx;
+
+    if (uctx->error) {
+        return;
+    }
     
     switch (record->type) {
         case HEX_TYPE_DATA: {
-            // Check if this data fits in current buffer
-            uint32_t offset_in_buffer = abs_addr - uctx->buffer_start_addr;
-            
-            if (uctx->buffer_data_len == 0) {
-                // First data - initialize buffer
-                uctx->buffer_start_addr = abs_addr;
-                offset_in_buffer = 0;
-            } else if (abs_addr < uctx->buffer_start_addr || 
-                      offset_in_buffer + record->byte_count > PAGE_BUFFER_SIZE) {
-                // Data doesn't fit - flush current buffer
-                flush_buffer(uctx);
-                uctx->buffer_start_addr = abs_addr;
-                offset_in_buffer = 0;
+            // Nothing may follow the EOF record of a plain hex file
+            if (uctx->format == UPLOAD_FORMAT_HEX && hex_stream_is_complete(uctx->parser)) {
+                uctx->error = true;
+                snprintf(uctx->status_msg, sizeof(uctx->status_msg),
+                        "Error: Data after the hex EOF record%s", uctx->staging ? ", target not touched" : "");
+                break;
             }
-            
-            // Copy data to buffer
-            memcpy(uctx->page_buffer + offset_in_buffer, record->data, record->byte_count);
-            
-            // Update buffer length
-            uint32_t new_end = offset_in_buffer + record->byte_count;
-            if (new_end > uctx->buffer_data_len) {
-                uctx->buffer_data_len = new_end;
+            esp_err_t ret = buffer_data(uctx, abs_addr, record->data, record->byte_count);
+            if (ret != ESP_OK) {
+                set_flash_error(uctx, abs_addr, ret);
             }
-            
-            uctx->current_addr = abs_addr + record->byte_count;
             break;
         }
         
-        case HEX_TYPE_EOF:
-            flush_buffer(uctx);
-            ESP_LOGI(TAG, "Upload complete: %lu bytes flashed", uctx->flashed_bytes);
-            snprintf(uctx->status_msg, sizeof(uctx->status_msg),
-                    "Success: Flashed %lu bytes", uctx->flashed_bytes);
-            ESP_LOGI(TAG, "Flashing complete, performing reset sequence...");
-            swd_flash_reset_and_run();
-            swd_shutdown();
-            ESP_LOGI(TAG, "Target released - should now boot normally");
+        default:
+            // Address records need nothing here, data is queued by page address.
+            // EOF is only noted by the parser: the upload finishes in upload_end,
+            // once the decompressor has checked the rest of the body.
             break;
-            
-        case HEX_TYPE_EXT_LIN_ADDR:
-            // Flush buffer before address change
-            if (uctx->buffer_data_len > 0) {
-                flush_buffer(uctx);
+    }
+}
+
+// ELF segment data callback
+static void elf_flash_callback(uint32_t addr, const uint8_t *data, size_t len, void *ctx) {
+    upload_context_t *uctx = (upload_context_t*)ctx;
+
+    if (uctx->error) {
+        return;
+    }
+
+    // Only flash and UICR are programmable, skip RAM-only segments
+    bool in_flash = (addr + len) <= NRF52_FLASH_SIZE;
+    bool in_uicr = addr >= UICR_BASE && (addr + len) <= UICR_BASE + NRF52_PAGE_SIZE;
+    if (!in_flash && !in_uicr) {
+        uctx->skipped_bytes += len;
+        return;
+    }
+
+    esp_err_t ret = buffer_data(uctx, addr, data, len);
+    if (ret != ESP_OK) {
+        set_flash_error(uctx, addr, ret);
+    }
+}
+
+// Framed binary: the whole page set is known, so queue its erases ahead of the data
+static esp_err_t bin_plan_callback(const bin_extent_t *extents, uint16_t count,
+                                   uint32_t total_bytes, void *ctx) {
+    upload_context_t *uctx = (upload_context_t*)ctx;
+    uint32_t pages = 0;
+
+    for (int i = 0; i < count; i++) {
+        uint32_t start = extents[i].addr;
+        uint32_t end = start + extents[i].len;
+        bool in_flash = end <= NRF52_FLASH_SIZE;
+        bool in_uicr = start >= UICR_BASE && end <= UICR_BASE + NRF52_PAGE_SIZE;
+        if (!in_flash && !in_uicr) {
+            ESP_LOGE(TAG, "Extent 0x%08lX+%lu is outside flash", start, extents[i].len);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    if (uctx->format != UPLOAD_FORMAT_TAR) {
+        uctx->image_bytes = total_bytes;
+    }
+    if (uctx->staging) {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Pre-erasing pages for %u extents (%lu bytes)", count, total_bytes);
+
+    for (int i = 0; i < count; i++) {
+        uint32_t first = extents[i].addr & ~(NRF52_PAGE_SIZE - 1);
+        uint32_t last = (extents[i].addr + extents[i].len - 1) & ~(NRF52_PAGE_SIZE - 1);
+        for (uint32_t page = first; page <= last; page += NRF52_PAGE_SIZE) {
+            esp_err_t ret = flash_pipeline_erase(page);
+            if (ret != ESP_OK) {
+                set_flash_error(uctx, page, ret);
+                return ret;
+            }
+            pages++;
+        }
+    }
+
+    ESP_LOGI(TAG, "Queued erase of %lu pages", pages);
+    return ESP_OK;
+}
+
+static void bin_flash_callback(uint32_t addr, const uint8_t *data, size_t len, void *ctx) {
+    upload_context_t *uctx = (upload_context_t*)ctx;
+
+    if (uctx->error) {
+        return;
+    }
+
+    esp_err_t ret = buffer_data(uctx, addr, data, len);
+    if (ret != ESP_OK) {
+        set_flash_error(uctx, addr, ret);
+    }
+}
+
+// Feed one image to the parser for its format
+static esp_err_t parse_image(upload_context_t *ctx, upload_format_t format,
+                             const uint8_t *data, size_t len) {
+    if (format == UPLOAD_FORMAT_RAW) {
+        esp_err_t ret = buffer_data(ctx, ctx->member_addr + ctx->member_offset, data, len);
+        ctx->member_offset += len;
+        return ret;
+    }
+
+    if (format == UPLOAD_FORMAT_BIN) {
+        if (!ctx->bin_parser) {
+            ESP_LOGI(TAG, "Streaming framed binary upload");
+            ctx->bin_parser = bin_stream_create(bin_plan_callback, bin_flash_callback, ctx);
+            if (!ctx->bin_parser) {
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        return bin_stream_parse(ctx->bin_parser, data, len);
+    }
+
+    if (format == UPLOAD_FORMAT_ELF) {
+        if (!ctx->elf_parser) {
+            ESP_LOGI(TAG, "Streaming ELF upload");
+            ctx->elf_parser = elf_stream_create(elf_flash_callback, ctx);
+            if (!ctx->elf_parser) {
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        return elf_stream_parse(ctx->elf_parser, data, len);
+    }
+
+    if (!ctx->parser) {
+        ctx->parser = hex_stream_create(hex_flash_callback, ctx);
+        if (!ctx->parser) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return hex_stream_parse(ctx->parser, data, len);
+}
+
+static void free_image_parsers(upload_context_t *ctx) {
+    if (ctx->parser) {
+        hex_stream_free(ctx->parser);
+        ctx->parser = NULL;
+    }
+    if (ctx->elf_parser) {
+        elf_stream_free(ctx->elf_parser);
+        ctx->elf_parser = NULL;
+    }
+    if (ctx->bin_parser) {
+        bin_stream_free(ctx->bin_parser);
+        ctx->bin_parser = NULL;
+    }
+}
+
+// Bundle members are picked by extension. Plain binaries carry their load
+// address in the name (app@0x26000.bin), DFU init packets and manifests are
+// skipped.
+static esp_err_t bundle_begin(const char *name, uint32_t size, void *ctx) {
+    upload_context_t *uctx = (upload_context_t*)ctx;
+    const char *base = strrchr(name, '/') ? strrchr(name, '/') + 1 : name;
+    const char *ext = strrchr(base, '.');
+    const char *at = strchr(base, '@');
+
+    free_image_parsers(uctx);
+    uctx->member_offset = 0;
+
+    if (ext && (strcasecmp(ext, ".hex") == 0 || strcasecmp(ext, ".ihex") == 0)) {
+        uctx->member_format = UPLOAD_FORMAT_HEX;
+    } else if (ext && strcasecmp(ext, ".elf") == 0) {
+        uctx->member_format = UPLOAD_FORMAT_ELF;
+    } else if (ext && strcasecmp(ext, ".bin") == 0 && at) {
+        uctx->member_format = UPLOAD_FORMAT_RAW;
+        uctx->member_addr = strtoul(at + 1, NULL, 16);
+    } else if (ext && strcasecmp(ext, ".bin") == 0) {
+        uctx->member_format = UPLOAD_FORMAT_BIN;
+    } else {
+        ESP_LOGI(TAG, "Bundle: skipping %s", base);
+        uctx->member_format = UPLOAD_FORMAT_AUTO;
+        return ESP_OK;
+    }
+
+    uctx->bundle_images++;
+    if (uctx->member_format == UPLOAD_FORMAT_RAW) {
+        ESP_LOGI(TAG, "Bundle image %u: %s, %lu bytes at 0x%08lX",
+                 uctx->bundle_images, base, size, uctx->member_addr);
+    } else {
+        ESP_LOGI(TAG, "Bundle image %u: %s, %lu bytes", uctx->bundle_images, base, size);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t bundle_data(const uint8_t *data, size_t len, void *ctx) {
+    upload_context_t *uctx = (upload_context_t*)ctx;
+    if (uctx->member_format == UPLOAD_FORMAT_AUTO) {
+        return ESP_OK;
+    }
+    return parse_image(uctx, uctx->member_format, data, len);
+}
+
+static esp_err_t bundle_end(void *ctx) {
+    upload_context_t *uctx = (upload_context_t*)ctx;
+    esp_err_t ret = ESP_OK;
+
+    switch (uctx->member_format) {
+        case UPLOAD_FORMAT_HEX:
+            if (hex_stream_get_error_count(uctx->parser) > 0 || !hex_stream_is_complete(uctx->parser)) {
+                ret = ESP_ERR_INVALID_STATE;
             }
             break;
+        case UPLOAD_FORMAT_ELF:
+            ret = elf_stream_finish(uctx->elf_parser);
+            break;
+        case UPLOAD_FORMAT_BIN:
+            ret = bin_stream_finish(uctx->bin_parser);
+            break;
+        default:
+            break;
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Bundle image %u is incomplete or corrupt", uctx->bundle_images);
+    }
+    free_image_parsers(uctx);
+    uctx->member_format = UPLOAD_FORMAT_AUTO;
+    return ret;
+}
+
+// Route upload data to the parser for its format
+static esp_err_t parse_data(upload_context_t *ctx, const uint8_t *data, size_t len) {
+    if (len == 0) {
+        return ESP_OK;
+    }
+
+    if (ctx->format == UPLOAD_FORMAT_AUTO) {
+        // Intel HEX starts with ':', ELF with 0x7F 'E' 'L' 'F', framed binary with "MRFB"
+        if (data[0] == 0x7F) {
+            ctx->format = UPLOAD_FORMAT_ELF;
+        } else if (data[0] == BIN_MAGIC[0]) {
+            ctx->format = UPLOAD_FORMAT_BIN;
+        } else {
+            ctx->format = UPLOAD_FORMAT_HEX;
+        }
+    }
+
+    if (ctx->format == UPLOAD_FORMAT_TAR) {
+        if (!ctx->tar_parser) {
+            static const tar_callbacks_t bundle_callbacks = {
+                .begin = bundle_begin,
+                .data = bundle_data,
+                .end = bundle_end
+            };
+            ESP_LOGI(TAG, "Streaming image bundle");
+            ctx->tar_parser = tar_stream_create(&bundle_callbacks, ctx);
+            if (!ctx->tar_parser) {
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        return tar_stream_parse(ctx->tar_parser, data, len);
+    }
+
+    return parse_image(ctx, ctx->format, data, len);
+}
+
+// Parse decoded upload data, recording parse failures in the status
+static esp_err_t upload_feed(upload_context_t *ctx, const uint8_t *data, size_t len) {
+    esp_err_t ret = parse_data(ctx, data, len);
+    if (ret != ESP_OK && !ctx->error) {
+        ESP_LOGE(TAG, "Firmware parse failed: %s", esp_err_to_name(ret));
+        ctx->error = true;
+        snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                "Error: Invalid %s file (%s)",
+                ctx->format == UPLOAD_FORMAT_ELF ? "ELF" :
+                ctx->format == UPLOAD_FORMAT_BIN ? "binary" :
+                ctx->format == UPLOAD_FORMAT_TAR ? "bundle" : "hex",
+                esp_err_to_name(ret));
+    }
+    return ctx->error ? ESP_FAIL : ESP_OK;
+}
+
+// Decompressed output goes straight to the format parser
+static esp_err_t decomp_output_callback(const uint8_t *data, size_t len, void *ctx) {
+    return upload_feed((upload_context_t*)ctx, data, len);
+}
+
+// Set up streaming decompression from the query flag or Content-Encoding
+static esp_err_t setup_decompression(upload_context_t *ctx, httpd_req_t *req,
+                                     const char *query, const uint8_t *first, size_t first_len) {
+    decomp_config_t cfg = {0};
+    char value[16];
+
+    if (httpd_query_key_value(query, "compress", value, sizeof(value)) == ESP_OK) {
+        cfg.type = decomp_type_from_name(value);
+    } else if (httpd_req_get_hdr_value_str(req, "Content-Encoding", value, sizeof(value)) == ESP_OK) {
+        cfg.type = decomp_type_from_name(value);
+    } else if (first_len >= 2 && first[0] == 0x1F && first[1] == 0x8B) {
+        // Gzip magic, e.g. a .hex.gz picked in the browser
+        cfg.type = DECOMP_GZIP;
+    }
+
+    if (cfg.type == DECOMP_NONE) {
+        return ESP_OK;
+    }
+
+    if (httpd_query_key_value(query, "hs_w", value, sizeof(value)) == ESP_OK) {
+        cfg.hs_window_bits = atoi(value);
+    }
+    if (httpd_query_key_value(query, "hs_l", value, sizeof(value)) == ESP_OK) {
+        cfg.hs_lookahead_bits = atoi(value);
+    }
+
+    ctx->decomp = decomp_stream_create(&cfg, decomp_output_callback, ctx);
+    if (!ctx->decomp) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Upload is %s compressed", decomp_type_name(cfg.type));
+    return ESP_OK;
+}
+
+// Free an upload context and everything it owns
+static void free_upload_context(upload_context_t *ctx) {
+    if (!ctx) {
+        return;
+    }
+    free_image_parsers(ctx);
+    if (ctx->tar_parser) {
+        tar_stream_free(ctx->tar_parser);
+    }
+    if (ctx->decomp) {
+        decomp_stream_free(ctx->decomp);
+    }
+    free(ctx);
+}
+
+// Finish format-specific processing once all data has been received
+static void upload_end(upload_context_t *ctx) {
+    if (ctx->decomp && !ctx->error) {
+        esp_err_t ret = decomp_stream_finish(ctx->decomp);
+        if (ret != ESP_OK) {
+            ctx->error = true;
+            snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                    "Error: Incomplete compressed upload (%s)", esp_err_to_name(ret));
+            return;
+        }
+    }
+
+    if (ctx->error) {
+        return;
+    }
+
+    if (ctx->format == UPLOAD_FORMAT_HEX) {
+        // A last line without a newline is parsed too, trailing garbage then
+        // counts as a bad line and a bare EOF record still ends the file
+        if (ctx->parser) {
+            hex_stream_parse(ctx->parser, (const uint8_t *)"\n", 1);
+        }
+        if (ctx->error) {
+            return;
+        }
+        if (!hex_stream_is_complete(ctx->parser)) {
+            ctx->error = true;
+            snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                    "Error: Hex file has no EOF record%s", ctx->staging ? ", target not touched" : "");
+            return;
+        }
+        finish_upload(ctx);
+        return;
+    }
+
+    esp_err_t ret = (ctx->format == UPLOAD_FORMAT_ELF) ? elf_stream_finish(ctx->elf_parser) :
+                    (ctx->format == UPLOAD_FORMAT_TAR) ? tar_stream_finish(ctx->tar_parser) :
+                    bin_stream_finish(ctx->bin_parser);
+    if (ret == ESP_OK && ctx->format == UPLOAD_FORMAT_TAR && ctx->bundle_images == 0) {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+    if (ret != ESP_OK) {
+        ctx->error = true;
+        snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                "Error: Incomplete %s file (%s)",
+                ctx->format == UPLOAD_FORMAT_ELF ? "ELF" :
+                ctx->format == UPLOAD_FORMAT_TAR ? "bundle" : "binary", esp_err_to_name(ret));
+        return;
     }
+
+    if (ctx->format == UPLOAD_FORMAT_TAR) {
+        ESP_LOGI(TAG, "Bundle of %u images merged", ctx->bundle_images);
+    }
+
+    if (ctx->skipped_bytes > 0) {
+        ESP_LOGW(TAG, "Skipped %lu bytes of non-flash segments", ctx->skipped_bytes);
+    }
+
+    finish_upload(ctx);
 }
 
 // Dump NRF52 registers for diagnostics
@@ -246,9 +761,40 @@ static void dump_nrf52_registers(char *buffer, size_t max_len) {
     ESP_LOGI(TAG, "=== Register Dump Complete ===");
 }
 
-// Check SWD connection handler
-esp_err_t check_swd_handler(httpd_req_t *req) {
-    char resp[4096];  // Increased buffer size
+// Refuse SWD work while a job owns the target
+static bool reject_if_jobs_busy(httpd_req_t *req) {
+    if (!flash_jobs_busy()) {
+        return false;
+    }
+    httpd_resp_set_status(req, "409 Conflict");
+    httpd_resp_sendstr(req, "A flash job is queued or running");
+    return true;
+}
+
+// Take the bus for a synchronous endpoint, 409 naming the owner if it stays busy
+static bool begin_inline_session(httpd_req_t *req, const char *name, swd_prio_t prio) {
+    if (swd_session_begin(name, prio, SWD_INLINE_WAIT_MS) == ESP_OK) {
+        return true;
+    }
+
+    char msg[64];
+    const char *owner = swd_session_owner();
+    snprintf(msg, sizeof(msg), "SWD busy: %s", owner ? owner : "unknown");
+    httpd_resp_set_status(req, "409 Conflict");
+    httpd_resp_sendstr(req, msg);
+    return false;
+}
+
+static void send_op_result(httpd_req_t *req, esp_err_t ret, const char *message) {
+    char resp[256];
+    snprintf(resp, sizeof(resp), "{\"success\":%s,\"message\":\"%s\"}",
+             ret == ESP_OK ? "true" : "false", message);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, resp, strlen(resp));
+}
+
+// Connect, dump the registers and release the target, runs in a status session
+static esp_err_t read_swd_status(char *resp, size_t resp_len) {
     ESP_LOGI(TAG, "=== SWD Status Check Requested ===");
 
     // Check and try to reconnect if needed
@@ -362,7 +908,7 @@ esp_err_t check_swd_handler(httpd_req_t *req) {
         bool core_halted = (dhcsr & DHCSR_S_HALT) != 0;
 
         // Build JSON response with ALL register data
-        snprintf(resp, sizeof(resp),
+        snprintf(resp, resp_len,
             "{"
             "\"connected\":true,"
             "\"status\":\"Connected\","
@@ -431,7 +977,7 @@ esp_err_t check_swd_handler(httpd_req_t *req) {
 
     } else {
         ESP_LOGE(TAG, "SWD Not Connected");
-        snprintf(resp, sizeof(resp),
+        snprintf(resp, resp_len,
             "{\"connected\":false,\"status\":\"Disconnected\",\"error\":\"%s\"}",
             esp_err_to_name(ret));
     }
@@ -442,157 +988,502 @@ esp_err_t check_swd_handler(httpd_req_t *req) {
     }
 
     ESP_LOGI(TAG, "=== SWD Status Check Complete ===");
+    return ESP_OK;
+}
+
+// Check SWD connection handler. Polls arriving together share one bus
+// session; while a job or upload holds the bus the last snapshot is
+// returned marked stale rather than reconnecting under it.
+esp_err_t check_swd_handler(httpd_req_t *req) {
+    char resp[4096];  // Increased buffer size
+    esp_err_t ret = swd_session_status(read_swd_status, resp, sizeof(resp) - 96,
+                                       SWD_STATUS_MAX_AGE_MS, SWD_STATUS_WAIT_MS);
+
+    const char *owner = swd_session_owner();
+    if (ret == ESP_ERR_TIMEOUT) {
+        // Snapshot ends with the closing brace, append the busy fields
+        size_t n = strlen(resp);
+        snprintf(resp + n - 1, sizeof(resp) - n + 1, ",\"stale\":true,\"busy\":\"%s\",\"busy_ms\":%lu}",
+                 owner ? owner : "unknown", swd_session_held_ms());
+    } else if (ret != ESP_OK) {
+        snprintf(resp, sizeof(resp),
+            "{\"connected\":false,\"status\":\"Busy\",\"busy\":\"%s\",\"busy_ms\":%lu}",
+            owner ? owner : "unknown", swd_session_held_ms());
+    }
 
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, resp, strlen(resp));
     return ESP_OK;
 }
 
-// Mass erase handler
-esp_err_t mass_erase_handler(httpd_req_t *req) {
-    ESP_LOGI(TAG, "=== Mass Erase Request from Web Interface ===");
-    
-    char resp[256];
-    
-    // First check SWD connection
-    esp_err_t ret = ensure_swd_ready();
+// Long SWD operations. Each runs on the job task, the older synchronous
+// endpoints queue them too and answer with the job.
 
-    // Perform mass erase (which also handles APPROTECT)
-    ret = swd_flash_disable_approtect();
-    
+// The fwstore loops stop between pages once the running job is cancelled
+static bool stopped_by_cancel(esp_err_t ret) {
+    return ret == ESP_ERR_INVALID_STATE && flash_job_cancelled();
+}
+
+// Mass erase through the NVMC, which also clears APPROTECT
+static esp_err_t op_mass_erase(const char *arg, char *message, size_t len) {
+    ensure_swd_ready();
+    if (flash_job_cancelled()) {
+        snprintf(message, len, "Cancelled before erase");
+        swd_shutdown();
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Polls for up to 15 s while the chip erases
+    esp_err_t ret = swd_flash_disable_approtect();
+    if (ret == ESP_OK) {
+        flash_telemetry_attach();   // A locked target only shows its DEVICEID now
+    }
+    flash_telemetry_mass_erased(ret == ESP_OK);
     if (ret == ESP_OK) {
         ESP_LOGI(TAG, "Mass erase successful, APPROTECT disabled");
-        strcpy(resp, "{\"success\":true,\"message\":\"Mass erase complete, APPROTECT disabled\"}");
+        snprintf(message, len, "Mass erase complete, APPROTECT disabled");
     } else {
         ESP_LOGE(TAG, "Mass erase failed: %s", esp_err_to_name(ret));
-        snprintf(resp, sizeof(resp), 
-            "{\"success\":false,\"message\":\"Mass erase failed: %s\"}", 
-            esp_err_to_name(ret));
+        snprintf(message, len, "Mass erase failed: %s", esp_err_to_name(ret));
     }
-    
+
     ESP_LOGI(TAG, "Mass erase complete, releasing target...");
     swd_release_target();
     swd_shutdown();
-    
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, resp, strlen(resp));
-    return ESP_OK;
+    return ret;
 }
 
-// Upload handler
-static esp_err_t upload_post_handler(httpd_req_t *req) {
-    char buf[1024];
-    int remaining = req->content_len;
-
-    ESP_LOGI(TAG, "Starting hex upload: %d bytes", remaining);
-
-    // Ensure SWD is ready at the start
-    esp_err_t ret = ensure_swd_ready();
-    if (ret != ESP_OK) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "SWD not ready");
-        return ESP_FAIL;
+// ERASEALL through CTRL-AP, works on a locked device
+static esp_err_t op_erase_all(const char *arg, char *message, size_t len) {
+    if (!swd_is_connected()) {
+        ESP_LOGE(TAG, "SWD not connected");
+        snprintf(message, len, "SWD not connected");
+        return ESP_ERR_INVALID_STATE;
     }
-
-    // Clean up any previous context
-    if (g_upload_ctx) {
-        if (g_upload_ctx->parser) {
-            hex_stream_free(g_upload_ctx->parser);
-        }
-        free(g_upload_ctx->page_buffer);
-        free(g_upload_ctx);
+    if (flash_job_cancelled()) {
+        snprintf(message, len, "Cancelled before erase");
+        return ESP_ERR_INVALID_STATE;
     }
 
-    // Allocate new context
-    g_upload_ctx = calloc(1, sizeof(upload_context_t));
-    if (!g_upload_ctx) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
-        return ESP_FAIL;
+    esp_err_t ret = swd_flash_mass_erase_ctrl_ap();
+    if (ret == ESP_OK) {
+        flash_telemetry_attach();
     }
+    flash_telemetry_mass_erased(ret == ESP_OK);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "✓ Chip erase successful");
+        snprintf(message, len, "Chip erased successfully. All memory cleared.");
+    } else {
+        ESP_LOGE(TAG, "✗ Chip erase failed: %s", esp_err_to_name(ret));
+        snprintf(message, len, "Chip erase failed: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
 
-    g_upload_ctx->page_buffer = malloc(PAGE_BUFFER_SIZE);
-    if (!g_upload_ctx->page_buffer) {
-        free(g_upload_ctx);
-        g_upload_ctx = NULL;
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
-        return ESP_FAIL;
+// Program the staged image again without re-uploading it
+static esp_err_t op_stage_flash(const char *arg, char *message, size_t len) {
+    fw_stage_info_t info;
+    esp_err_t ret = fw_stage_get_info(&info);
+    if (ret == ESP_OK) {
+        ret = ensure_swd_ready();
+    }
+    if (ret == ESP_OK && flash_job_cancelled()) {
+        swd_shutdown();
+        snprintf(message, len, "Cancelled before flashing");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (ret == ESP_OK) {
+        int64_t start_us = esp_timer_get_time();
+        ret = fw_stage_flash(flash_job_progress);
+        flash_telemetry_flash_done(ret == ESP_OK, (uint32_t)((esp_timer_get_time() - start_us) / 1000));
+        if (ret == ESP_OK) {
+            swd_flash_reset_and_run();
+        }
+        swd_shutdown();
     }
 
-    memset(g_upload_ctx->page_buffer, 0xFF, PAGE_BUFFER_SIZE);
+    if (ret == ESP_OK) {
+        snprintf(message, len, "Flashed %lu bytes (%u pages) from stage",
+                 info.image_bytes, info.page_count);
+    } else if (stopped_by_cancel(ret)) {
+        snprintf(message, len, "Cancelled, target only partly programmed");
+    } else {
+        snprintf(message, len, "Stage flash failed: %s", esp_err_to_name(ret));
+    }
+    report_flash_result(ret == ESP_OK, message);
+    return ret;
+}
 
-    // Parse query string for target type
-    char query[64] = {0};
-    httpd_req_get_url_query_str(req, query, sizeof(query));
+// Flash a cached image, arg is the full hash or a unique prefix
+static esp_err_t cache_flash(const char *arg, bool changed_only, char *message, size_t len) {
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t ret = ensure_swd_ready();
+    if (ret == ESP_OK && flash_job_cancelled()) {
+        swd_shutdown();
+        snprintf(message, len, "Cancelled before flashing");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (ret == ESP_OK) {
+        ret = fw_cache_flash_range(arg, 0, UINT32_MAX, changed_only, flash_job_progress);
+        flash_telemetry_flash_done(ret == ESP_OK, (uint32_t)((esp_timer_get_time() - start_us) / 1000));
+        if (ret == ESP_OK) {
+            swd_flash_reset_and_run();
+        }
+        swd_shutdown();
+    }
+    ESP_LOGI(TAG, "Cache flash of %s took %lu ms: %s", arg,
+             (uint32_t)((esp_timer_get_time() - start_us) / 1000), esp_err_to_name(ret));
 
-    if (strstr(query, "type=bootloader")) {
-        ESP_LOGI(TAG, "Flashing bootloader");
-        g_upload_ctx->start_addr = 0xFFFFFFFF;
-    } else if (strstr(query, "type=app")) {
-        g_upload_ctx->start_addr = 0x26000;
-        ESP_LOGI(TAG, "Flashing application at 0x26000");
-    } else if (strstr(query, "type=softdevice")) {
-        g_upload_ctx->start_addr = 0x1000;
-        ESP_LOGI(TAG, "Flashing SoftDevice at 0x1000");
+    if (ret == ESP_OK) {
+        snprintf(message, len, "Flashed %.16s", arg);
+    } else if (stopped_by_cancel(ret)) {
+        snprintf(message, len, "Cancelled, target only partly programmed");
     } else {
-        g_upload_ctx->start_addr = 0xFFFFFFFF;
-        ESP_LOGI(TAG, "Flashing at addresses from hex file");
+        snprintf(message, len, "%s",
+                 ret == ESP_ERR_NOT_FOUND ? "Image not in cache" :
+                 ret == ESP_ERR_INVALID_ARG ? "Hash prefix is ambiguous" : esp_err_to_name(ret));
+    }
+    report_flash_result(ret == ESP_OK, ret == ESP_OK ? "Flashed cached image" :
+                        stopped_by_cancel(ret) ? "Cache flash cancelled" : "Cache flash failed");
+    return ret;
+}
+
+static esp_err_t op_cache_flash(const char *arg, char *message, size_t len) {
+    return cache_flash(arg, false, message, len);
+}
+
+// Rewrite only the pages whose target CRC differs from the cached image
+static esp_err_t op_cache_update(const char *arg, char *message, size_t len) {
+    return cache_flash(arg, true, message, len);
+}
+
+// Read target flash into a new backup, arg is "addr size [force]" or NULL for
+// all of flash. force drops a staged image, which the read would overwrite.
+static esp_err_t op_backup(const char *arg, char *message, size_t len) {
+    uint32_t addr = 0;
+    uint32_t size = NRF52_FLASH_SIZE;
+    bool force = false;
+    if (arg) {
+        char *end;
+        addr = strtoul(arg, &end, 0);
+        size = strtoul(end, &end, 0);
+        force = strstr(end, "force") != NULL;
     }
 
-    // Create hex parser
-    g_upload_ctx->parser = hex_stream_create(hex_flash_callback, g_upload_ctx);
-    g_upload_ctx->in_progress = true;
-    g_upload_ctx->total_bytes = remaining;
-    g_upload_ctx->received_bytes = 0;  // Initialize to 0
-    g_upload_ctx->flashed_bytes = 0;   // Initialize to 0
+    esp_err_t ret = force ? fw_stage_clear() : ESP_OK;
+    if (ret == ESP_OK) {
+        ret = ensure_swd_ready();
+    }
+    if (ret == ESP_OK && flash_job_cancelled()) {
+        swd_shutdown();
+        snprintf(message, len, "Cancelled before reading");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    fw_backup_info_t info;
+    if (ret == ESP_OK) {
+        ret = fw_backup_create(addr, size, "Web backup", flash_job_progress, &info);
+        swd_shutdown();
+    }
+
+    if (ret == ESP_OK) {
+        snprintf(message, len, "Backed up %lu KB, %lu bytes stored (%u pages shared, %u blank)",
+                 size / 1024, info.stored_bytes, info.shared_pages, info.blank_pages);
+    } else if (stopped_by_cancel(ret)) {
+        snprintf(message, len, "Cancelled, no backup stored");
+    } else {
+        snprintf(message, len, "Backup failed: %s",
+                 ret == ESP_ERR_INVALID_STATE ? "stage holds an image, use force=1 to replace it" :
+                 ret == ESP_ERR_INVALID_ARG ? "range is not whole flash pages" :
+                 ret == ESP_ERR_NO_MEM ? "cache full" : esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+// Program a backup back to the target, arg is "index [addr size]"
+static esp_err_t op_backup_restore(const char *arg, char *message, size_t len) {
+    int index = 0;
+    uint32_t addr = 0;
+    uint32_t size = UINT32_MAX;
+    if (arg) {
+        char *end;
+        index = strtol(arg, &end, 10);
+        if (*end) {
+            addr = strtoul(end, &end, 0);
+            size = strtoul(end, NULL, 0);
+        }
+    }
+
+    esp_err_t ret = ensure_swd_ready();
+    if (ret == ESP_OK && flash_job_cancelled()) {
+        swd_shutdown();
+        snprintf(message, len, "Cancelled before restoring");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (ret == ESP_OK) {
+        int64_t start_us = esp_timer_get_time();
+        ret = fw_backup_restore_range(index, addr, size, flash_job_progress);
+        flash_telemetry_flash_done(ret == ESP_OK, (uint32_t)((esp_timer_get_time() - start_us) / 1000));
+        if (ret == ESP_OK) {
+            swd_flash_reset_and_run();
+        }
+        swd_shutdown();
+    }
+
+    if (ret == ESP_OK) {
+        snprintf(message, len, "Restored backup %d", index);
+    } else if (stopped_by_cancel(ret)) {
+        snprintf(message, len, "Cancelled, target only partly restored");
+    } else {
+        snprintf(message, len, "Restore failed: %s",
+                 ret == ESP_ERR_NOT_FOUND ? "no such backup" : esp_err_to_name(ret));
+    }
+    report_flash_result(ret == ESP_OK, message);
+    return ret;
+}
+
+static void discard_paused_upload(void);
+
+static esp_err_t submit_job(httpd_req_t *req, const char *name, flash_job_fn fn, const char *arg);
+
+// Mass erase handler, queued like /jobs?op=mass_erase
+esp_err_t mass_erase_handler(httpd_req_t *req) {
+    ESP_LOGI(TAG, "=== Mass Erase Request from Web Interface ===");
+    return submit_job(req, "mass_erase", op_mass_erase, NULL);
+}
+
+static void end_upload_session(void) {
+    if (upload_holds_bus) {
+        upload_holds_bus = false;
+        swd_session_end();
+    }
+}
+
+// A paused session keeps the target halted and the pipeline running until
+// it is resumed or replaced by a new upload
+static void discard_paused_upload(void) {
+    if (!g_upload_ctx || !g_upload_ctx->paused) {
+        return;
+    }
+
+    ESP_LOGW(TAG, "Discarding paused upload session %s at %lu bytes",
+             g_upload_ctx->session, g_upload_ctx->received_bytes);
+    esp_timer_stop(pause_timer);
+    if (g_upload_ctx->staging) {
+        fw_stage_abort();
+    } else {
+        flash_pipeline_abort();
+        flash_pipeline_stop();
+        swd_shutdown();
+        end_upload_session();
+    }
+    g_upload_ctx->paused = false;
+    g_upload_ctx->expired = true;
+    snprintf(g_upload_ctx->status_msg, sizeof(g_upload_ctx->status_msg),
+             "Session %s discarded at %lu bytes, upload again from the start",
+             g_upload_ctx->session, g_upload_ctx->received_bytes);
+}
+
+// Queued by the pause timer so it runs on the server task like the handlers
+static void expire_paused_upload(void *arg) {
+    upload_context_t *ctx = g_upload_ctx;
+    if (!ctx || !ctx->paused ||
+        esp_timer_get_time() - ctx->paused_us < (int64_t)UPLOAD_PAUSE_MAX_MS * 1000) {
+        return;  // Resumed, and maybe paused again, since the timer fired
+    }
+
+    ESP_LOGW(TAG, "Upload session %s idle for %d s, releasing the target",
+             ctx->session, UPLOAD_PAUSE_MAX_MS / 1000);
+    discard_paused_upload();
+    snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+             "Session %s expired after %d s paused, upload again from the start",
+             ctx->session, UPLOAD_PAUSE_MAX_MS / 1000);
+    report_flash_result(false, ctx->status_msg);
+}
+
+static void pause_timer_cb(void *arg) {
+    if (httpd_queue_work(upload_server, expire_paused_upload, NULL) != ESP_OK) {
+        // Server queue full, try again shortly
+        esp_timer_start_once(pause_timer, 1000 * 1000);
+    }
+}
+
+// Parse "bytes START-END/TOTAL"
+static bool parse_content_range(const char *value, uint32_t *start, uint32_t *end, uint32_t *total) {
+    unsigned long s, e, t;
+    if (sscanf(value, "bytes %lu-%lu/%lu", &s, &e, &t) != 3 || s > e || e >= t) {
+        return false;
+    }
+    *start = s;
+    *end = e;
+    *total = t;
+    return true;
+}
+
+// Receive the request body into the parsers. skip drops bytes a resumed
+// request repeats from before the point the session already reached.
+static void receive_upload(httpd_req_t *req, upload_context_t *ctx, const char *query,
+                           int remaining, uint32_t skip) {
+    char *buf = malloc(UPLOAD_RECV_SIZE);
+    int timeouts = 0;
+    esp_err_t ret;
+
+    if (!buf) {
+        ctx->error = true;
+        snprintf(ctx->status_msg, sizeof(ctx->status_msg), "Error: Out of memory");
+        return;
+    }
 
-    // Process upload
     while (remaining > 0) {
-        int recv_len = httpd_req_recv(req, buf, MIN(remaining, sizeof(buf)));
+        int recv_len = httpd_req_recv(req, buf, MIN(remaining, UPLOAD_RECV_SIZE));
 
         if (recv_len <= 0) {
-            if (recv_len == HTTPD_SOCK_ERR_TIMEOUT) {
+            if (recv_len == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < UPLOAD_MAX_TIMEOUTS) {
                 continue;
             }
+            if (ctx->session[0]) {
+                // Keep everything parsed so far, the client continues with Content-Range
+                ESP_LOGW(TAG, "Upload session %s paused at %lu bytes",
+                         ctx->session, ctx->received_bytes);
+                ctx->paused = true;
+                snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                        "Paused at %lu bytes, resume session %s", ctx->received_bytes, ctx->session);
+                break;
+            }
             ESP_LOGE(TAG, "Upload receive failed");
-            g_upload_ctx->error = true;
-            snprintf(g_upload_ctx->status_msg, sizeof(g_upload_ctx->status_msg),
+            ctx->error = true;
+            snprintf(ctx->status_msg, sizeof(ctx->status_msg),
                     "Error: Upload failed");
             break;
         }
+        timeouts = 0;
+        remaining -= recv_len;
+
+        const char *data = buf;
+        if (skip > 0) {
+            uint32_t drop = MIN(skip, (uint32_t)recv_len);
+            skip -= drop;
+            data += drop;
+            recv_len -= drop;
+            if (recv_len == 0) {
+                continue;
+            }
+        }
 
         // Update received bytes BEFORE parsing
-        g_upload_ctx->received_bytes += recv_len;
-        remaining -= recv_len;
+        ctx->received_bytes += recv_len;
+
+        if (ctx->received_bytes == (uint32_t)recv_len) {
+            ret = setup_decompression(ctx, req, query, (const uint8_t*)data, recv_len);
+            if (ret != ESP_OK) {
+                ctx->error = true;
+                snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                        "Error: Cannot decompress upload (%s)", esp_err_to_name(ret));
+                break;
+            }
+        }
 
-        // Parse hex data
-        ret = hex_stream_parse(g_upload_ctx->parser, (uint8_t*)buf, recv_len);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "Hex parse failed");
-            g_upload_ctx->error = true;
-            snprintf(g_upload_ctx->status_msg, sizeof(g_upload_ctx->status_msg),
-                    "Error: Invalid hex file");
+        // Decompress and parse firmware data
+        if (ctx->decomp) {
+            ret = decomp_stream_feed(ctx->decomp, (const uint8_t*)data, recv_len);
+        } else {
+            ret = upload_feed(ctx, (const uint8_t*)data, recv_len);
+        }
+
+        if (ret != ESP_OK && !ctx->error) {
+            ctx->error = true;
+            snprintf(ctx->status_msg, sizeof(ctx->status_msg),
+                    "Error: Corrupt compressed upload (%s)", esp_err_to_name(ret));
+        }
+
+        if (ctx->error) {
+            ESP_LOGE(TAG, "Aborting upload: %s", ctx->status_msg);
             break;
         }
 
+        push_upload_progress(ctx);
+
         // Log progress every 4KB
-        if ((g_upload_ctx->received_bytes % 4096) == 0) {
-            int percent = (g_upload_ctx->received_bytes * 100) / g_upload_ctx->total_bytes;
+        if ((ctx->received_bytes % 4096) == 0) {
+            int percent = (ctx->received_bytes * 100) / ctx->total_bytes;
             ESP_LOGI(TAG, "Upload: %d%% (%lu/%lu bytes)",
-                    percent, g_upload_ctx->received_bytes, g_upload_ctx->total_bytes);
+                    percent, ctx->received_bytes, ctx->total_bytes);
+        }
+    }
+
+    free(buf);
+    ctx->rx_ms = (uint32_t)((esp_timer_get_time() - ctx->start_us) / 1000);
+}
+
+// Finish or pause the upload and send the response
+static esp_err_t complete_upload(httpd_req_t *req, upload_context_t *ctx, int64_t start_us) {
+    if (ctx->paused) {
+        ctx->in_progress = false;
+        ctx->paused_us = esp_timer_get_time();
+        esp_timer_stop(pause_timer);
+        esp_timer_start_once(pause_timer, (uint64_t)UPLOAD_PAUSE_MAX_MS * 1000);
+        report_flash_result(false, ctx->status_msg);
+        // The connection is most likely gone, but answer in case it is not
+        char resp[192];
+        snprintf(resp, sizeof(resp),
+                "{\"status\":\"paused\",\"session\":\"%s\",\"resume_from\":%lu,\"total\":%lu}",
+                ctx->session, ctx->received_bytes, ctx->total_bytes);
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, resp, strlen(resp));
+        return ESP_OK;
+    }
+
+    if (ctx->received_bytes == ctx->total_bytes && !ctx->error) {
+        upload_end(ctx);
+    }
+
+    if (ctx->staging) {
+        // Releases the stage buffers if the image never got committed
+        fw_stage_abort();
+    } else {
+        if (ctx->error) {
+            flash_pipeline_abort();
         }
+        flash_pipeline_stop();
+        end_upload_session();
+    }
+
+    flash_pipeline_stats_t stats = {0};
+    if (!ctx->staging) {
+        flash_pipeline_get_stats(&stats);
+    }
+    uint32_t rx_bytes = ctx->received_bytes - ctx->rx_base;
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    ESP_LOGI(TAG, "Upload took %lu ms, %lu bytes received in %lu ms (%lu KB/s)",
+             elapsed_ms, rx_bytes, ctx->rx_ms,
+             ctx->rx_ms ? (rx_bytes / ctx->rx_ms) * 1000 / 1024 : 0);
+    if (!ctx->staging) {
+        ESP_LOGI(TAG, "Flash busy %lu ms (%lu KB/s), receive stalled %lu ms waiting for the target",
+                 stats.busy_ms, stats.flash_kbps, stats.stall_ms);
+    }
+    if (ctx->decomp) {
+        ESP_LOGI(TAG, "Decompressed %lu -> %lu bytes",
+                 decomp_stream_get_in_bytes(ctx->decomp),
+                 decomp_stream_get_out_bytes(ctx->decomp));
     }
 
-    g_upload_ctx->in_progress = false;
+    ctx->in_progress = false;
+    ctx->session[0] = '\0';
+    if (!ctx->staging) {
+        flash_telemetry_flash_done(!ctx->error, elapsed_ms);
+    }
+    report_flash_result(!ctx->error, ctx->status_msg);
 
     // Send response
     char resp[256];
-    if (!g_upload_ctx->error) {
+    if (!ctx->error) {
         snprintf(resp, sizeof(resp),
                 "{\"status\":\"success\",\"message\":\"%s\"}",
-                g_upload_ctx->status_msg);
+                ctx->status_msg);
     } else {
         snprintf(resp, sizeof(resp),
                 "{\"status\":\"error\",\"message\":\"%s\"}",
-                g_upload_ctx->status_msg);
+                ctx->status_msg);
     }
 
     httpd_resp_set_type(req, "application/json");
@@ -601,22 +1492,222 @@ static esp_err_t upload_post_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+// Continue a paused session. The range must run to the end of the file and
+// may start anywhere up to the byte the session reached.
+static esp_err_t resume_upload(httpd_req_t *req, const char *query,
+                               const char *session, const char *range) {
+    upload_context_t *ctx = g_upload_ctx;
+    uint32_t start, end, total;
+    int64_t start_us = esp_timer_get_time();
+
+    if (!ctx || !ctx->paused || strcmp(ctx->session, session) != 0) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, ctx && ctx->expired && strcmp(ctx->session, session) == 0 ?
+                           "Upload session expired" : "No paused upload for this session");
+        return ESP_OK;
+    }
+    if (!parse_content_range(range, &start, &end, &total) || total != ctx->total_bytes ||
+        end + 1 != total || start > ctx->received_bytes || req->content_len != end - start + 1) {
+        ESP_LOGE(TAG, "Bad resume range '%s' for session %s at %lu/%lu",
+                 range, session, ctx->received_bytes, ctx->total_bytes);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Range must continue the paused upload");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Resuming session %s at %lu bytes (request starts at %lu)",
+             session, ctx->received_bytes, start);
+
+    esp_timer_stop(pause_timer);
+    ctx->paused = false;
+    ctx->in_progress = true;
+    ctx->start_us = start_us;
+    ctx->rx_base = ctx->received_bytes;
+    ctx->rx_ms = 0;
+    snprintf(ctx->status_msg, sizeof(ctx->status_msg), "Resumed at %lu bytes", ctx->received_bytes);
+
+    receive_upload(req, ctx, query, req->content_len, ctx->received_bytes - start);
+    return complete_upload(req, ctx, start_us);
+}
+
+// Upload handler
+static esp_err_t upload_post_handler(httpd_req_t *req) {
+    int remaining = req->content_len;
+    int64_t start_us = esp_timer_get_time();
+
+    // Parse query string for target type
+    char query[128] = {0};
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    bool bundle = req->user_ctx == (void*)UPLOAD_FORMAT_TAR || strstr(query, "format=tar");
+    // Bundles are merged in the stage area so every page is erased once and
+    // the images go to the target in a single address-ordered pass
+    bool staging = bundle || strstr(query, "stage=1") != NULL;
+
+    char session[UPLOAD_SESSION_LEN + 1] = {0};
+    char range[64];
+    httpd_query_key_value(query, "session", session, sizeof(session));
+    if (session[0] &&
+        httpd_req_get_hdr_value_str(req, "Content-Range", range, sizeof(range)) == ESP_OK) {
+        return resume_upload(req, query, session, range);
+    }
+
+    if (reject_if_jobs_busy(req)) {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Starting firmware upload: %d bytes", remaining);
+    discard_paused_upload();
+
+    // Staged uploads only need the target once the image has been validated.
+    // The pipeline task programs on behalf of this session until it completes.
+    if (!staging) {
+        if (!begin_inline_session(req, "upload", SWD_PRIO_FLASH)) {
+            return ESP_OK;
+        }
+        upload_holds_bus = true;
+    }
+    esp_err_t ret = staging ? fw_stage_begin() : ensure_swd_ready();
+    if (ret != ESP_OK) {
+        end_upload_session();
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR,
+                            !staging ? "SWD not ready" :
+                            ret == ESP_ERR_INVALID_STATE ? "Staging area busy" : "Staging area not available");
+        return ESP_FAIL;
+    }
+
+    // Direct uploads are programmed by the pipeline task while we keep receiving
+    if (!staging && flash_pipeline_start(!strstr(query, "verify=0")) != ESP_OK) {
+        end_upload_session();
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    // Clean up any previous context
+    free_upload_context(g_upload_ctx);
+    g_upload_ctx = NULL;
+
+    // Allocate new context
+    g_upload_ctx = calloc(1, sizeof(upload_context_t));
+    if (!g_upload_ctx) {
+        fw_stage_abort();
+        flash_pipeline_stop();
+        end_upload_session();
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    // Only application images are kept out of MBR, SoftDevice and UICR unless forced
+    g_upload_ctx->staging = staging;
+    g_upload_ctx->allow_protected = !strstr(query, "type=app") || strstr(query, "force=1");
+    strcpy(g_upload_ctx->session, session);
+
+    if (strstr(query, "type=bootloader")) {
+        ESP_LOGI(TAG, "Flashing bootloader");
+        g_upload_ctx->start_addr = 0xFFFFFFFF;
+    } else if (strstr(query, "type=app")) {
+        g_upload_ctx->start_addr = 0x26000;
+        ESP_LOGI(TAG, "Flashing application at 0x26000");
+    } else if (strstr(query, "type=softdevice")) {
+        g_upload_ctx->start_addr = 0x1000;
+        ESP_LOGI(TAG, "Flashing SoftDevice at 0x1000");
+    } else {
+        g_upload_ctx->start_addr = 0xFFFFFFFF;
+        ESP_LOGI(TAG, "Flashing at addresses from hex file");
+    }
+
+    // Format is detected from the first bytes unless given explicitly
+    if (req->user_ctx) {
+        g_upload_ctx->format = (upload_format_t)(intptr_t)req->user_ctx;
+    } else if (bundle) {
+        g_upload_ctx->format = UPLOAD_FORMAT_TAR;
+    } else if (strstr(query, "format=bin")) {
+        g_upload_ctx->format = UPLOAD_FORMAT_BIN;
+    } else if (strstr(query, "format=elf")) {
+        g_upload_ctx->format = UPLOAD_FORMAT_ELF;
+    } else if (strstr(query, "format=hex")) {
+        g_upload_ctx->format = UPLOAD_FORMAT_HEX;
+    }
+
+    g_upload_ctx->in_progress = true;
+    g_upload_ctx->total_bytes = remaining;
+    g_upload_ctx->received_bytes = 0;  // Initialize to 0
+    g_upload_ctx->flashed_bytes = 0;   // Initialize to 0
+    g_upload_ctx->start_us = start_us;
+
+    receive_upload(req, g_upload_ctx, query, remaining, 0);
+    return complete_upload(req, g_upload_ctx, start_us);
+}
+
+// Where a paused session stands and which pages it has programmed
+static esp_err_t upload_session_handler(httpd_req_t *req) {
+    char query[64] = {0};
+    char session[UPLOAD_SESSION_LEN + 1] = {0};
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    httpd_query_key_value(query, "session", session, sizeof(session));
+    if (!g_upload_ctx || !session[0] || strcmp(g_upload_ctx->session, session) != 0) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown upload session");
+        return ESP_FAIL;
+    }
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "session", session);
+    cJSON_AddStringToObject(json, "state", g_upload_ctx->paused ? "paused" :
+                            g_upload_ctx->expired ? "expired" :
+                            g_upload_ctx->in_progress ? "receiving" : "done");
+    cJSON_AddNumberToObject(json, "resume_from", g_upload_ctx->received_bytes);
+    cJSON_AddNumberToObject(json, "total", g_upload_ctx->total_bytes);
+    cJSON_AddStringToObject(json, "message", g_upload_ctx->status_msg);
+    if (g_upload_ctx->paused) {
+        int64_t left_ms = UPLOAD_PAUSE_MAX_MS - (esp_timer_get_time() - g_upload_ctx->paused_us) / 1000;
+        cJSON_AddNumberToObject(json, "expires_in_ms", left_ms > 0 ? left_ms : 0);
+    }
+
+    if (!g_upload_ctx->staging) {
+        flash_pipeline_page_t *pages = malloc(UPLOAD_MAX_PAGES * sizeof(flash_pipeline_page_t));
+        int count = pages ? flash_pipeline_get_committed(pages, UPLOAD_MAX_PAGES) : 0;
+        cJSON *list = cJSON_AddArrayToObject(json, "committed");
+        for (int i = 0; i < count; i++) {
+            cJSON *page = cJSON_CreateObject();
+            cJSON_AddNumberToObject(page, "addr", pages[i].addr);
+            cJSON_AddNumberToObject(page, "crc", pages[i].crc32);
+            cJSON_AddItemToArray(list, page);
+        }
+        free(pages);
+    }
+
+    char *json_str = cJSON_PrintUnformatted(json);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json_str, strlen(json_str));
+
+    free(json_str);
+    cJSON_Delete(json);
+    return ESP_OK;
+}
+
 static esp_err_t progress_handler(httpd_req_t *req) {
     char resp[512];
+    uint32_t flashed, rx_kbps, flash_kbps;
 
     if (g_upload_ctx && g_upload_ctx->in_progress) {
+        get_upload_rates(g_upload_ctx, &flashed, &rx_kbps, &flash_kbps);
         snprintf(resp, sizeof(resp),
-                "{\"in_progress\":true,\"received\":%lu,\"flashed\":%lu,\"total\":%lu}",
+                "{\"in_progress\":true,\"received\":%lu,\"flashed\":%lu,\"total\":%lu,\"image_total\":%lu,"
+                "\"rx_kbps\":%lu,\"flash_kbps\":%lu}",
                 g_upload_ctx->received_bytes,
-                g_upload_ctx->flashed_bytes,
-                g_upload_ctx->total_bytes);
+                flashed,
+                g_upload_ctx->total_bytes,
+                g_upload_ctx->image_bytes,
+                rx_kbps, flash_kbps);
     } else if (g_upload_ctx) {
+        get_upload_rates(g_upload_ctx, &flashed, &rx_kbps, &flash_kbps);
         snprintf(resp, sizeof(resp),
-                "{\"in_progress\":false,\"message\":\"%s\",\"received\":%lu,\"flashed\":%lu,\"total\":%lu}",
+                "{\"in_progress\":false,\"message\":\"%s\",\"received\":%lu,\"flashed\":%lu,\"total\":%lu,"
+                "\"rx_kbps\":%lu,\"flash_kbps\":%lu}",
                 g_upload_ctx->status_msg,
                 g_upload_ctx->received_bytes,
-                g_upload_ctx->flashed_bytes,
-                g_upload_ctx->total_bytes);
+                flashed,
+                g_upload_ctx->total_bytes,
+                rx_kbps, flash_kbps);
     } else {
         strcpy(resp, "{\"in_progress\":false,\"message\":\"Ready\"}");
     }
@@ -626,76 +1717,431 @@ static esp_err_t progress_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
-// In components/web/src/web_upload.c, replace the existing disable_protection_handler with:
-
 esp_err_t disable_protection_handler(httpd_req_t *req) {
     ESP_LOGI(TAG, "=== Mass Erase Request from Web Interface ===");
-    
+    return submit_job(req, "erase_all", op_erase_all, NULL);
+}
+
+esp_err_t erase_all_handler(httpd_req_t *req) {
+    ESP_LOGI(TAG, "=== Full Chip Erase Request ===");
+    return submit_job(req, "erase_all", op_erase_all, NULL);
+}
+
+// Describe the image held in the stage area
+static esp_err_t stage_status_handler(httpd_req_t *req) {
     char resp[256];
-    
-    // Check connection first
-    if (!swd_is_connected()) {
-        ESP_LOGE(TAG, "SWD not connected");
-        strcpy(resp, "{\"success\":false,\"message\":\"SWD not connected\"}");
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_send(req, resp, strlen(resp));
-        return ESP_OK;
-    }
-    
-    // Call the new CTRL-AP mass erase function
-    esp_err_t ret = swd_flash_mass_erase_ctrl_ap();
-    
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "✓ Mass erase successful");
-        strcpy(resp, "{\"success\":true,\"message\":\"Mass erase complete. Device fully erased and unlocked.\"}");
+    fw_stage_info_t info;
+
+    if (fw_stage_get_info(&info) == ESP_OK) {
+        snprintf(resp, sizeof(resp),
+                "{\"valid\":true,\"pages\":%u,\"bytes\":%lu,"
+                "\"start\":\"0x%08lX\",\"end\":\"0x%08lX\",\"crc\":\"0x%08lX\"}",
+                info.page_count, info.image_bytes, info.min_addr, info.max_addr, info.image_crc);
     } else {
-        ESP_LOGE(TAG, "✗ Mass erase failed: %s", esp_err_to_name(ret));
-        snprintf(resp, sizeof(resp), 
-                "{\"success\":false,\"message\":\"Mass erase failed: %s\"}", 
-                esp_err_to_name(ret));
+        strcpy(resp, "{\"valid\":false}");
     }
-    
+
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, resp, strlen(resp));
     return ESP_OK;
 }
 
-// Also in components/web/src/web_upload.c, update erase_all_handler:
+// Program the staged image again without re-uploading it
+static esp_err_t stage_flash_handler(httpd_req_t *req) {
+    return submit_job(req, "stage_flash", op_stage_flash, NULL);
+}
 
-esp_err_t erase_all_handler(httpd_req_t *req) {
-    ESP_LOGI(TAG, "=== Full Chip Erase Request ===");
-    
+// List cached images
+static esp_err_t cache_list_handler(httpd_req_t *req) {
+    fw_cache_info_t entries[FW_CACHE_MAX_ENTRIES];
+    int count = fw_cache_list(entries, FW_CACHE_MAX_ENTRIES);
+    uint32_t total, free_bytes;
+    fw_cache_get_space(&total, &free_bytes);
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "total", total);
+    cJSON_AddNumberToObject(json, "free", free_bytes);
+    cJSON *images = cJSON_AddArrayToObject(json, "images");
+
+    for (int i = 0; i < count; i++) {
+        char sha_hex[2 * FW_CACHE_SHA_LEN + 1];
+        fw_cache_sha_to_hex(entries[i].sha256, sha_hex);
+
+        cJSON *image = cJSON_CreateObject();
+        cJSON_AddStringToObject(image, "sha256", sha_hex);
+        cJSON_AddNumberToObject(image, "pages", entries[i].page_count);
+        cJSON_AddNumberToObject(image, "bytes", entries[i].image_bytes);
+        cJSON_AddNumberToObject(image, "stored", entries[i].stored_bytes);
+        cJSON_AddNumberToObject(image, "last_used", entries[i].last_used);
+        cJSON_AddNumberToObject(image, "shared_pages", entries[i].shared_pages);
+        cJSON_AddBoolToObject(image, "backup", entries[i].backup);
+        cJSON_AddItemToArray(images, image);
+    }
+
+    char *json_str = cJSON_PrintUnformatted(json);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json_str, strlen(json_str));
+
+    free(json_str);
+    cJSON_Delete(json);
+    return ESP_OK;
+}
+
+// Flash or delete a cached image, ?sha= takes the full hash or a unique prefix
+static esp_err_t cache_action_handler(httpd_req_t *req) {
+    char query[128] = {0};
+    char sha_hex[2 * FW_CACHE_SHA_LEN + 1] = {0};
     char resp[256];
-    
-    // Check connection first
-    if (!swd_is_connected()) {
-        ESP_LOGE(TAG, "SWD not connected");
-        strcpy(resp, "{\"success\":false,\"message\":\"SWD not connected\"}");
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_send(req, resp, strlen(resp));
+    bool flash = req->user_ctx != NULL;
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (httpd_query_key_value(query, "sha", sha_hex, sizeof(sha_hex)) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing sha parameter");
+        return ESP_FAIL;
+    }
+
+    if (flash) {
+        return submit_job(req, "cache_flash", op_cache_flash, sha_hex);
+    }
+
+    // Like every other mutating endpoint. The cache keeps a flashing entry
+    // pinned anyway, this just answers with the job instead of hiding it.
+    if (reject_if_jobs_busy(req)) {
         return ESP_OK;
     }
-    
-    // Use the same CTRL-AP mass erase for full chip erase
-    esp_err_t ret = swd_flash_mass_erase_ctrl_ap();
-    
+    esp_err_t ret = fw_cache_delete(sha_hex);
     if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "✓ Chip erase successful");
-        strcpy(resp, "{\"success\":true,\"message\":\"Chip erased successfully. All memory cleared.\"}");
+        snprintf(resp, sizeof(resp), "{\"success\":true,\"message\":\"Deleted %.16s\"}", sha_hex);
     } else {
-        ESP_LOGE(TAG, "✗ Chip erase failed: %s", esp_err_to_name(ret));
-        snprintf(resp, sizeof(resp), 
-                "{\"success\":false,\"message\":\"Chip erase failed: %s\"}", 
-                esp_err_to_name(ret));
+        snprintf(resp, sizeof(resp), "{\"success\":false,\"message\":\"%s\"}",
+                 ret == ESP_ERR_NOT_FOUND ? "Image not in cache" :
+                 ret == ESP_ERR_INVALID_ARG ? "Hash prefix is ambiguous" :
+                 ret == ESP_ERR_NOT_ALLOWED ? "Image belongs to a backup" : esp_err_to_name(ret));
     }
-    
+
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, resp, strlen(resp));
     return ESP_OK;
 }
 
+static cJSON *job_to_json(const flash_job_info_t *info) {
+    cJSON *job = cJSON_CreateObject();
+    cJSON_AddNumberToObject(job, "id", info->id);
+    cJSON_AddStringToObject(job, "op", info->name);
+    cJSON_AddStringToObject(job, "state", flash_job_state_name(info->state));
+    cJSON_AddStringToObject(job, "phase", info->phase ? info->phase : "");
+    cJSON_AddNumberToObject(job, "current", info->current);
+    cJSON_AddNumberToObject(job, "total", info->total);
+    cJSON_AddNumberToObject(job, "wait_ms", info->wait_ms);
+    cJSON_AddNumberToObject(job, "run_ms", info->run_ms);
+    cJSON_AddBoolToObject(job, "cancel_requested", info->cancel_requested);
+    if (info->state != FLASH_JOB_QUEUED && info->state != FLASH_JOB_RUNNING) {
+        cJSON_AddBoolToObject(job, "success", info->state == FLASH_JOB_DONE);
+        cJSON_AddStringToObject(job, "message", info->message);
+    }
+    return job;
+}
+
+static esp_err_t send_json(httpd_req_t *req, cJSON *json) {
+    char *resp = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    if (!resp) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, resp, strlen(resp));
+    free(resp);
+    return ESP_OK;
+}
+
+// Queue a job and answer 202 with it. The older synchronous endpoints come here too.
+static esp_err_t submit_job(httpd_req_t *req, const char *name, flash_job_fn fn, const char *arg) {
+    // Paused uploads belong to the httpd task, drop them here rather than on the job task
+    discard_paused_upload();
+    uint32_t id = flash_jobs_submit(name, fn, arg);
+    if (id == 0) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_sendstr(req, "Job queue full");
+        return ESP_OK;
+    }
+
+    flash_job_info_t info;
+    flash_jobs_get(id, &info);
+    httpd_resp_set_status(req, "202 Accepted");
+    return send_json(req, job_to_json(&info));
+}
+
+// Queue a long operation: ?op=mass_erase|erase_all|stage_flash|cache_flash|cache_update[&sha=]
+// |backup[&addr=&size=&force=1]|backup_restore[&index=&addr=&size=]
+static esp_err_t job_submit_handler(httpd_req_t *req) {
+    char query[128] = {0};
+    char op[16] = {0};
+    char sha_hex[2 * FW_CACHE_SHA_LEN + 1] = {0};
+    char param[24] = {0};
+    char range[FLASH_JOB_ARG_LEN] = {0};
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    httpd_query_key_value(query, "op", op, sizeof(op));
+
+    flash_job_fn fn = NULL;
+    const char *name = NULL;
+    const char *arg = NULL;
+    if (strcmp(op, "mass_erase") == 0) {
+        fn = op_mass_erase;
+        name = "mass_erase";
+    } else if (strcmp(op, "erase_all") == 0) {
+        fn = op_erase_all;
+        name = "erase_all";
+    } else if (strcmp(op, "stage_flash") == 0) {
+        fn = op_stage_flash;
+        name = "stage_flash";
+    } else if (strcmp(op, "cache_flash") == 0 || strcmp(op, "cache_update") == 0) {
+        if (httpd_query_key_value(query, "sha", sha_hex, sizeof(sha_hex)) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing sha parameter");
+            return ESP_FAIL;
+        }
+        bool update = strcmp(op, "cache_update") == 0;
+        fn = update ? op_cache_update : op_cache_flash;
+        name = update ? "cache_update" : "cache_flash";
+        arg = sha_hex;
+    } else if (strcmp(op, "backup") == 0) {
+        // The read goes through the stage, so don't quietly throw a staged image away
+        fw_stage_info_t staged;
+        bool force = strstr(query, "force=1") != NULL;
+        if (!force && fw_stage_get_info(&staged) == ESP_OK) {
+            httpd_resp_set_status(req, "409 Conflict");
+            httpd_resp_sendstr(req, "Backup would overwrite the staged image, add force=1 to replace it");
+            return ESP_OK;
+        }
+        char addr_str[16] = "0";
+        snprintf(param, sizeof(param), "%u", NRF52_FLASH_SIZE);
+        httpd_query_key_value(query, "addr", addr_str, sizeof(addr_str));
+        bool ranged = httpd_query_key_value(query, "size", param, sizeof(param)) == ESP_OK;
+        if (ranged || force) {
+            snprintf(range, sizeof(range), "%s %s%s", addr_str, param, force ? " force" : "");
+            arg = range;
+        }
+        fn = op_backup;
+        name = "backup";
+    } else if (strcmp(op, "backup_restore") == 0) {
+        char addr_str[16] = "0";
+        char size_str[16] = {0};
+        httpd_query_key_value(query, "index", param, sizeof(param));
+        httpd_query_key_value(query, "addr", addr_str, sizeof(addr_str));
+        if (httpd_query_key_value(query, "size", size_str, sizeof(size_str)) == ESP_OK) {
+            snprintf(range, sizeof(range), "%d %s %s", atoi(param), addr_str, size_str);
+        } else {
+            snprintf(range, sizeof(range), "%d", atoi(param));
+        }
+        arg = range;
+        fn = op_backup_restore;
+        name = "backup_restore";
+    } else {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown op");
+        return ESP_FAIL;
+    }
+
+    return submit_job(req, name, fn, arg);
+}
+
+// One job with ?id=, otherwise every job still held
+static esp_err_t job_status_handler(httpd_req_t *req) {
+    char query[32] = {0};
+    char id_str[12] = {0};
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (httpd_query_key_value(query, "id", id_str, sizeof(id_str)) == ESP_OK) {
+        flash_job_info_t info;
+        if (flash_jobs_get(strtoul(id_str, NULL, 10), &info) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown job");
+            return ESP_FAIL;
+        }
+        return send_json(req, job_to_json(&info));
+    }
+
+    flash_job_info_t infos[FLASH_JOB_SLOTS];
+    int count = flash_jobs_list(infos, FLASH_JOB_SLOTS);
+    cJSON *json = cJSON_CreateObject();
+    cJSON *list = cJSON_AddArrayToObject(json, "jobs");
+    for (int i = 0; i < count; i++) {
+        cJSON_AddItemToArray(list, job_to_json(&infos[i]));
+    }
+    return send_json(req, json);
+}
+
+static esp_err_t job_cancel_handler(httpd_req_t *req) {
+    char query[32] = {0};
+    char id_str[12] = {0};
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (httpd_query_key_value(query, "id", id_str, sizeof(id_str)) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing id parameter");
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = flash_jobs_cancel(strtoul(id_str, NULL, 10));
+    send_op_result(req, ret, ret == ESP_OK ? "Cancel requested" :
+                   ret == ESP_ERR_NOT_FOUND ? "Unknown job" : "Job already finished");
+    return ESP_OK;
+}
+
+// Pages of a cached image that differ from the target, ?sha= as for /cache/flash
+static esp_err_t cache_diff_handler(httpd_req_t *req) {
+    char query[128] = {0};
+    char sha_hex[2 * FW_CACHE_SHA_LEN + 1] = {0};
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (httpd_query_key_value(query, "sha", sha_hex, sizeof(sha_hex)) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing sha parameter");
+        return ESP_FAIL;
+    }
+    if (reject_if_jobs_busy(req)) {
+        return ESP_OK;
+    }
+
+    discard_paused_upload();
+    if (!begin_inline_session(req, "cache_diff", SWD_PRIO_NORMAL)) {
+        return ESP_OK;
+    }
+
+    fw_page_crc_t *changed = calloc(FW_STAGE_PAGES, sizeof(fw_page_crc_t));
+    if (!changed) {
+        swd_session_end();
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    uint16_t count = 0;
+    esp_err_t ret = ensure_swd_ready();
+    if (ret == ESP_OK) {
+        ret = fw_cache_diff_target(sha_hex, changed, FW_STAGE_PAGES, &count, NULL);
+        swd_shutdown();
+    }
+    swd_session_end();
+    if (ret != ESP_OK) {
+        free(changed);
+        send_op_result(req, ret, ret == ESP_ERR_NOT_FOUND ? "Image not in cache" :
+                       ret == ESP_ERR_INVALID_ARG ? "Hash prefix is ambiguous" : esp_err_to_name(ret));
+        return ESP_OK;
+    }
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddBoolToObject(json, "success", true);
+    cJSON_AddNumberToObject(json, "changed_count", count);
+    cJSON *pages = cJSON_AddArrayToObject(json, "changed");
+    for (int i = 0; i < count && i < FW_STAGE_PAGES; i++) {
+        cJSON *page = cJSON_CreateObject();
+        cJSON_AddNumberToObject(page, "addr", changed[i].addr);
+        cJSON_AddNumberToObject(page, "target_crc", changed[i].crc32);
+        cJSON_AddItemToArray(pages, page);
+    }
+    free(changed);
+    return send_json(req, json);
+}
+
+static cJSON *target_stats_to_json(const flash_target_stats_t *t) {
+    char id[17];
+    snprintf(id, sizeof(id), "%08lX%08lX", (uint32_t)(t->device_id >> 32), (uint32_t)t->device_id);
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "device_id", id);
+    cJSON_AddNumberToObject(json, "sessions", t->sessions);
+    cJSON_AddNumberToObject(json, "flashes", t->flash_count);
+    cJSON_AddNumberToObject(json, "flash_failures", t->flash_failures);
+    cJSON_AddNumberToObject(json, "page_erases", t->page_erases);
+    cJSON_AddNumberToObject(json, "erase_failures", t->erase_failures);
+    cJSON_AddNumberToObject(json, "verify_failures", t->verify_failures);
+    cJSON_AddNumberToObject(json, "mass_erases", t->mass_erases);
+    cJSON_AddNumberToObject(json, "last_flash_time", t->last_flash_time);
+    cJSON_AddNumberToObject(json, "last_flash_ms", t->last_flash_ms);
+    cJSON_AddNumberToObject(json, "total_flash_ms", t->total_flash_ms);
+    cJSON_AddNumberToObject(json, "max_page_erases", t->max_page_erases);
+    cJSON_AddNumberToObject(json, "max_page_index", t->max_page_index);
+    return json;
+}
+
+// Wear and history of known targets, per-page erase counts of the attached one
+static esp_err_t telemetry_handler(httpd_req_t *req) {
+    flash_target_stats_t targets[FLASH_TELEMETRY_MAX_TARGETS];
+    int count = flash_telemetry_list(targets, FLASH_TELEMETRY_MAX_TARGETS);
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON *list = cJSON_AddArrayToObject(json, "targets");
+    for (int i = 0; i < count; i++) {
+        cJSON_AddItemToArray(list, target_stats_to_json(&targets[i]));
+    }
+
+    flash_target_stats_t current;
+    uint16_t *pages = malloc(FLASH_TELEMETRY_PAGES * sizeof(uint16_t));
+    if (pages && flash_telemetry_current(&current) == ESP_OK &&
+        flash_telemetry_page_counts(pages) == ESP_OK) {
+        cJSON *attached = target_stats_to_json(&current);
+        cJSON *erases = cJSON_AddArrayToObject(attached, "page_erase_counts");
+        for (int i = 0; i < FLASH_TELEMETRY_PAGES; i++) {
+            cJSON_AddItemToArray(erases, cJSON_CreateNumber(pages[i]));
+        }
+        cJSON_AddItemToObject(json, "attached", attached);
+    }
+    free(pages);
+    return send_json(req, json);
+}
+
+// Target backups, newest first
+static esp_err_t backup_list_handler(httpd_req_t *req) {
+    fw_backup_info_t backups[FW_BACKUP_MAX];
+    int count = fw_backup_list(backups, FW_BACKUP_MAX);
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON *list = cJSON_AddArrayToObject(json, "backups");
+    for (int i = 0; i < count; i++) {
+        char sha_hex[2 * FW_CACHE_SHA_LEN + 1];
+        fw_cache_sha_to_hex(backups[i].sha256, sha_hex);
+
+        cJSON *backup = cJSON_CreateObject();
+        cJSON_AddNumberToObject(backup, "index", i);
+        cJSON_AddNumberToObject(backup, "sequence", backups[i].sequence);
+        cJSON_AddStringToObject(backup, "description", backups[i].description);
+        cJSON_AddStringToObject(backup, "sha256", sha_hex);
+        cJSON_AddNumberToObject(backup, "addr", backups[i].addr);
+        cJSON_AddNumberToObject(backup, "size", backups[i].size);
+        cJSON_AddNumberToObject(backup, "crc32", backups[i].crc32);
+        cJSON_AddNumberToObject(backup, "stored", backups[i].stored_bytes);
+        cJSON_AddNumberToObject(backup, "pages", backups[i].page_count);
+        cJSON_AddNumberToObject(backup, "shared_pages", backups[i].shared_pages);
+        cJSON_AddNumberToObject(backup, "blank_pages", backups[i].blank_pages);
+        cJSON_AddItemToArray(list, backup);
+    }
+    return send_json(req, json);
+}
+
+static esp_err_t backup_delete_handler(httpd_req_t *req) {
+    char query[32] = {0};
+    char index_str[8] = {0};
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (httpd_query_key_value(query, "index", index_str, sizeof(index_str)) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing index parameter");
+        return ESP_FAIL;
+    }
+    if (reject_if_jobs_busy(req)) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = fw_backup_delete(atoi(index_str));
+    send_op_result(req, ret, ret == ESP_OK ? "Backup deleted" :
+                   ret == ESP_ERR_NOT_FOUND ? "No such backup" : esp_err_to_name(ret));
+    return ESP_OK;
+}
+
 // Register all handlers
 esp_err_t register_upload_handlers(httpd_handle_t server) {
+    upload_server = server;
+    if (!pause_timer) {
+        const esp_timer_create_args_t args = { .callback = pause_timer_cb, .name = "upload_pause" };
+        ESP_ERROR_CHECK(esp_timer_create(&args, &pause_timer));
+    }
+
     httpd_uri_t upload_uri = {
         .uri = "/upload",
         .method = HTTP_POST,
@@ -703,6 +2149,29 @@ esp_err_t register_upload_handlers(httpd_handle_t server) {
         .user_ctx = NULL
     };
     
+    // Framed binary produced by the web UI converter
+    httpd_uri_t upload_bin_uri = {
+        .uri = "/upload_bin",
+        .method = HTTP_POST,
+        .handler = upload_post_handler,
+        .user_ctx = (void*)UPLOAD_FORMAT_BIN
+    };
+    
+    // Tar of hex/ELF/binary images flashed with one erase plan
+    httpd_uri_t upload_bundle_uri = {
+        .uri = "/upload_bundle",
+        .method = HTTP_POST,
+        .handler = upload_post_handler,
+        .user_ctx = (void*)UPLOAD_FORMAT_TAR
+    };
+    
+    httpd_uri_t upload_session_uri = {
+        .uri = "/upload/session",
+        .method = HTTP_GET,
+        .handler = upload_session_handler,
+        .user_ctx = NULL
+    };
+
     httpd_uri_t progress_uri = {
         .uri = "/progress",
         .method = HTTP_GET,
@@ -725,9 +2194,107 @@ esp_err_t register_upload_handlers(httpd_handle_t server) {
     };
     
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &upload_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &upload_bin_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &upload_bundle_uri));
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &progress_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &upload_session_uri));
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &check_swd_uri));
+    httpd_uri_t stage_status_uri = {
+        .uri = "/stage/status",
+        .method = HTTP_GET,
+        .handler = stage_status_handler,
+        .user_ctx = NULL
+    };
+    
+    httpd_uri_t stage_flash_uri = {
+        .uri = "/stage/flash",
+        .method = HTTP_POST,
+        .handler = stage_flash_handler,
+        .user_ctx = NULL
+    };
+    
+    httpd_uri_t cache_list_uri = {
+        .uri = "/cache/list",
+        .method = HTTP_GET,
+        .handler = cache_list_handler,
+        .user_ctx = NULL
+    };
+    
+    httpd_uri_t cache_flash_uri = {
+        .uri = "/cache/flash",
+        .method = HTTP_POST,
+        .handler = cache_action_handler,
+        .user_ctx = (void*)1
+    };
+    
+    httpd_uri_t cache_delete_uri = {
+        .uri = "/cache/delete",
+        .method = HTTP_POST,
+        .handler = cache_action_handler,
+        .user_ctx = NULL
+    };
+    
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &mass_erase_uri));
+
+    // Asynchronous jobs for erase and flash operations
+    ESP_ERROR_CHECK(flash_jobs_init());
+    fw_stage_set_cancel_check(flash_job_cancelled);
+
+    httpd_uri_t job_submit_uri = {
+        .uri = "/jobs",
+        .method = HTTP_POST,
+        .handler = job_submit_handler,
+        .user_ctx = NULL
+    };
+    httpd_uri_t job_status_uri = {
+        .uri = "/jobs",
+        .method = HTTP_GET,
+        .handler = job_status_handler,
+        .user_ctx = NULL
+    };
+    httpd_uri_t job_cancel_uri = {
+        .uri = "/jobs/cancel",
+        .method = HTTP_POST,
+        .handler = job_cancel_handler,
+        .user_ctx = NULL
+    };
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &job_submit_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &job_status_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &job_cancel_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &stage_status_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &stage_flash_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &cache_list_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &cache_flash_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &cache_delete_uri));
+
+    httpd_uri_t cache_diff_uri = {
+        .uri = "/cache/diff",
+        .method = HTTP_GET,
+        .handler = cache_diff_handler,
+        .user_ctx = NULL
+    };
+    httpd_uri_t telemetry_uri = {
+        .uri = "/telemetry",
+        .method = HTTP_GET,
+        .handler = telemetry_handler,
+        .user_ctx = NULL
+    };
+    httpd_uri_t backup_list_uri = {
+        .uri = "/backup/list",
+        .method = HTTP_GET,
+        .handler = backup_list_handler,
+        .user_ctx = NULL
+    };
+    httpd_uri_t backup_delete_uri = {
+        .uri = "/backup/delete",
+        .method = HTTP_POST,
+        .handler = backup_delete_handler,
+        .user_ctx = NULL
+    };
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &cache_diff_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &telemetry_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &backup_list_uri));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &backup_delete_uri));
     
     ESP_LOGI(TAG, "All handlers registered");
     return ESP_OK;
@@ -23,8 +23,14 @@
 #include "swd_core.h"
 #include "swd_mem.h"
 #include "swd_flash.h"
+#include "swd_session.h"
 #include "power_mgmt.h"
 #include "flash_safety.h"
+#include "flash_telemetry.h"
+#include "error_log.h"
+#include "fw_stage.h"
+#include "fw_cache.h"
+#include "fw_backup.h"
 #include "ble_proxy.h"
 #include "web_ble.h"
 
@@ -313,15 +319,34 @@ static esp_err_t root_handler(httpd_req_t *req) {
         "<option value='app'>Application (0x26000)</option>"
         "<option value='softdevice'>SoftDevice (0x1000)</option>"
         "<option value='bootloader'>Bootloader (0xF4000)</option>"
-        "<option value='full'>Full Image (from hex)</option>"
+        "<option value='full'>Full Image (from hex/elf)</option>"
         "</select><br><br>"
-        "<input type='file' id='hexFile' accept='.hex' style='margin-bottom:10px;'/><br>"
+        "<input type='file' id='hexFile' accept='.hex,.uf2,.elf,.gz,.tar,.tgz' style='margin-bottom:10px;'/><br>"
+        "<label style='display:block;margin-bottom:10px;'><input type='checkbox' id='stageFw' checked/> Validate in staging area before flashing</label>"
+        "<label style='display:block;margin-bottom:10px;'><input type='checkbox' id='verifyFw' checked/> Read back each page after writing</label>"
         "<button id='uploadBtn' class='btn' onclick='uploadFirmware()'>Upload & Flash</button>"
         "<div style='margin-top:20px;'>"
         "<div class='progress-bar'><div id='progressBar' class='progress-fill' style='width:0%;'></div></div>"
         "<div id='status' style='margin-top:10px;font-weight:500;'>Ready</div>"
         "</div>"
         "</div>"
+        "<div class='info-card'>"
+        "<h3>Cached Images</h3>"
+        "<button class='btn' onclick='loadCache()'>Refresh</button>"
+        "<div id='cacheList' style='margin-top:10px;'>Not loaded</div>"
+        "</div>"
+        "<div class='info-card'>"
+        "<h3>Target Backups</h3>"
+        "<button class='btn' onclick='createBackup()'>Back Up Target</button> "
+        "<button class='btn' onclick='loadBackups()'>Refresh</button>"
+        "<div id='backupStatus' style='margin-top:10px;'></div>"
+        "<div id='backupList' style='margin-top:10px;'>Not loaded</div>"
+        "</div>"
+        "<div class='info-card'>"
+        "<h3>Target Wear</h3>"
+        "<button class='btn' onclick='loadTelemetry()'>Refresh</button>"
+        "<div id='telemetryList' style='margin-top:10px;'>Not loaded</div>"
+        "</div>"
         "</div>";
 
     httpd_resp_send_chunk(req, other_tabs, strlen(other_tabs));
@@ -332,6 +357,7 @@ static esp_err_t root_handler(httpd_req_t *req) {
         "<script>"
         "console.log('=== SCRIPT START ===');"
         "let progressTimer = null;"
+        "let progressSocket = null;"
         "console.log('progressTimer declared');"
         ""
         "function openTab(evt, tabName) {"
@@ -432,6 +458,9 @@ static esp_err_t root_handler(httpd_req_t *req) {
         "    document.getElementById('core-state').textContent = 'N/A';"
         "    document.getElementById('nvmc-state').textContent = 'N/A';"
         "  }"
+        "  if (data.busy) {"
+        "    document.getElementById('swd-status').innerHTML += ' <span style=\"color:#fd7e14;\">(' + data.busy + ' holds the bus' + (data.stale ? ', last known' : '') + ')</span>';"
+        "  }"
         "  "
         "  document.getElementById('last-check').textContent = new Date().toLocaleTimeString();"
         "      updateBatteryStatus();"
@@ -539,15 +568,32 @@ static esp_err_t root_handler(httpd_req_t *req) {
         "  });"
         "}"
         ""
+        "function runJob(op, extra, statusId, done) {"
+        "  const el = document.getElementById(statusId);"
+        "  fetch('/jobs?op=' + op + extra, {method: 'POST'})"
+        "    .then(r => r.ok ? r.json() : r.text().then(t => { throw new Error(t); }))"
+        "    .then(job => {"
+        "      const poll = function() {"
+        "        fetch('/jobs?id=' + job.id).then(r => r.json()).then(j => {"
+        "          if (j.state === 'queued' || j.state === 'running') {"
+        "            el.innerText = op + ': ' + j.state + ' ' + Math.round(j.run_ms / 1000) + ' s' +"
+        "              (j.total ? ' (' + Math.round(j.current * 100 / j.total) + '%)' : '');"
+        "            setTimeout(poll, 1000);"
+        "            return;"
+        "          }"
+        "          el.innerText = j.message;"
+        "          if (done) done(j);"
+        "        });"
+        "      };"
+        "      poll();"
+        "    })"
+        "    .catch(err => { el.innerText = op + ' failed: ' + err.message; });"
+        "}"
+        ""
         "function massErase() {"
         "  if (!confirm('This will ERASE EVERYTHING on the chip. Continue?')) return;"
         "  document.getElementById('protStatus').innerText = 'Performing mass erase...';"
-        "  fetch('/mass_erase')"
-        "    .then(r => r.json())"
-        "    .then(data => {"
-        "      document.getElementById('protStatus').innerText = data.message;"
-        "      setTimeout(checkSWD, 2000);"
-        "    });"
+        "  runJob('mass_erase', '', 'protStatus', function() { setTimeout(checkSWD, 2000); });"
         "}"
         ""
         "function checkPowerStatus() {"
@@ -656,15 +702,20 @@ static esp_err_t root_handler(httpd_req_t *req) {
         "    .then(data => {"
         "      if (data.in_progress) {"
         "        let pct = 0;"
-        "        if (data.total > 0) {"
+        "        const total = data.image_total || data.total;"
+        "        if (total > 0) {"
         "          if (data.flashed > 0) {"
-        "            pct = Math.round((data.flashed * 100) / data.total);"
+        "            pct = Math.round((data.flashed * 100) / total);"
         "          } else if (data.received > 0) {"
         "            pct = Math.round((data.received * 50) / data.total);"
         "          }"
         "        }"
         "        document.getElementById('progressBar').style.width = pct + '%';"
-        "        document.getElementById('status').innerText = 'Progress: ' + pct + '%';"
+        "        let rates = '';"
+        "        if (data.rx_kbps || data.flash_kbps) {"
+        "          rates = ' (receive ' + data.rx_kbps + ' KB/s, flash ' + data.flash_kbps + ' KB/s)';"
+        "        }"
+        "        document.getElementById('status').innerText = 'Progress: ' + pct + '%' + rates;"
         "      } else {"
         "        if (progressTimer) {"
         "          clearInterval(progressTimer);"
@@ -677,23 +728,295 @@ static esp_err_t root_handler(httpd_req_t *req) {
         "    });"
         "}"
         ""
+        "const CRC_TABLE = (function() {"
+        "  const t = new Uint32Array(256);"
+        "  for (let n = 0; n < 256; n++) {"
+        "    let c = n;"
+        "    for (let k = 0; k < 8; k++) {"
+        "      c = (c & 1) ? (0xEDB88320 ^ (c >>> 1)) : (c >>> 1);"
+        "    }"
+        "    t[n] = c >>> 0;"
+        "  }"
+        "  return t;"
+        "})();"
+        ""
+        "function crc32(buf) {"
+        "  let c = 0xFFFFFFFF;"
+        "  for (let i = 0; i < buf.length; i++) {"
+        "    c = CRC_TABLE[(c ^ buf[i]) & 0xFF] ^ (c >>> 8);"
+        "  }"
+        "  return (c ^ 0xFFFFFFFF) >>> 0;"
+        "}"
+        ""
+        "function parseIntelHex(text) {"
+        "  const recs = [];"
+        "  const lines = text.split('\\n');"
+        "  let base = 0;"
+        "  for (let n = 0; n < lines.length; n++) {"
+        "    const l = lines[n].trim();"
+        "    if (!l) continue;"
+        "    if (l[0] !== ':' || (l.length % 2) !== 1) throw new Error('Bad hex line ' + (n + 1));"
+        "    const b = new Uint8Array((l.length - 1) / 2);"
+        "    let sum = 0;"
+        "    for (let i = 0; i < b.length; i++) {"
+        "      b[i] = parseInt(l.substr(1 + i * 2, 2), 16);"
+        "      sum = (sum + b[i]) & 0xFF;"
+        "    }"
+        "    if (sum !== 0 || b.length < 5 || b[0] + 5 !== b.length) throw new Error('Checksum error on hex line ' + (n + 1));"
+        "    const data = b.subarray(4, 4 + b[0]);"
+        "    if (b[3] === 0) recs.push([base + ((b[1] << 8) | b[2]), data]);"
+        "    else if (b[3] === 1) break;"
+        "    else if (b[3] === 2) base = ((data[0] << 8) | data[1]) * 16;"
+        "    else if (b[3] === 4) base = ((data[0] << 8) | data[1]) * 65536;"
+        "  }"
+        "  return recs;"
+        "}"
+        ""
+        "function parseUF2(buf) {"
+        "  const recs = [];"
+        "  const dv = new DataView(buf);"
+        "  for (let off = 0; off + 512 <= buf.byteLength; off += 512) {"
+        "    if (dv.getUint32(off, true) !== 0x0A324655 || dv.getUint32(off + 4, true) !== 0x9E5D5157 ||"
+        "        dv.getUint32(off + 508, true) !== 0x0AB16F30) throw new Error('Bad UF2 block at ' + off);"
+        "    if (dv.getUint32(off + 8, true) & 1) continue;"
+        "    recs.push([dv.getUint32(off + 12, true), new Uint8Array(buf, off + 32, dv.getUint32(off + 16, true))]);"
+        "  }"
+        "  return recs;"
+        "}"
+        ""
+        "function buildFramedImage(recs) {"
+        "  if (recs.length === 0) throw new Error('No data in file');"
+        "  recs.sort((a, b) => a[0] - b[0]);"
+        "  const ext = [];"
+        "  for (const r of recs) {"
+        "    const last = ext[ext.length - 1];"
+        "    const end = r[0] + r[1].length;"
+        "    if (last && r[0] <= last.end + 256) last.end = Math.max(last.end, end);"
+        "    else ext.push({addr: r[0], end: end});"
+        "  }"
+        "  if (ext.length > 256) throw new Error('Too many extents (' + ext.length + ')');"
+        "  let total = 0;"
+        "  for (const x of ext) {"
+        "    x.data = new Uint8Array(x.end - x.addr).fill(0xFF);"
+        "    total += x.data.length;"
+        "  }"
+        "  let e = 0;"
+        "  for (const r of recs) {"
+        "    while (r[0] >= ext[e].end) e++;"
+        "    ext[e].data.set(r[1], r[0] - ext[e].addr);"
+        "  }"
+        "  const tableLen = ext.length * 12;"
+        "  const out = new Uint8Array(16 + tableLen + total);"
+        "  const dv = new DataView(out.buffer);"
+        "  out.set([0x4D, 0x52, 0x46, 0x42], 0);"
+        "  out[4] = 1;"
+        "  dv.setUint16(6, ext.length, true);"
+        "  dv.setUint32(8, total, true);"
+        "  let pos = 16 + tableLen;"
+        "  ext.forEach((x, i) => {"
+        "    dv.setUint32(16 + i * 12, x.addr, true);"
+        "    dv.setUint32(20 + i * 12, x.data.length, true);"
+        "    dv.setUint32(24 + i * 12, crc32(x.data), true);"
+        "    out.set(x.data, pos);"
+        "    pos += x.data.length;"
+        "  });"
+        "  dv.setUint32(12, crc32(out.subarray(16, 16 + tableLen)), true);"
+        "  return out;"
+        "}"
+        ""
+        "function connectProgressSocket() {"
+        "  const ws = new WebSocket('ws://' + location.host + '/ws');"
+        "  ws.onopen = function() { progressSocket = ws; };"
+        "  ws.onclose = function() {"
+        "    progressSocket = null;"
+        "    setTimeout(connectProgressSocket, 5000);"
+        "  };"
+        "  ws.onmessage = function(ev) { showPushedProgress(JSON.parse(ev.data)); };"
+        "}"
+        ""
+        "function showPushedProgress(msg) {"
+        "  if (msg.type === 'progress') {"
+        "    const pct = msg.total > 0 ? Math.min(100, Math.round((msg.current * 100) / msg.total)) : 0;"
+        "    let rates = '';"
+        "    if (msg.rx_kbps || msg.flash_kbps) {"
+        "      rates = ' (receive ' + msg.rx_kbps + ' KB/s, flash ' + msg.flash_kbps + ' KB/s)';"
+        "    }"
+        "    document.getElementById('progressBar').style.width = pct + '%';"
+        "    document.getElementById('status').innerText = msg.phase + ': ' + pct + '%' + rates;"
+        "  } else if (msg.type === 'result') {"
+        "    document.getElementById('progressBar').style.width = '100%';"
+        "    document.getElementById('status').innerText = msg.message;"
+        "  }"
+        "}"
+        ""
+        "function sendFirmware(url, body) {"
+        "  const session = Math.random().toString(16).slice(2, 10);"
+        "  url += (url.indexOf('?') < 0 ? '?' : '&') + 'session=' + session;"
+        "  if (!progressSocket) {"
+        "    progressTimer = setInterval(updateProgress, 500);"
+        "  }"
+        "  postFirmware(url, new Blob([body]), session, 0, 0);"
+        "}"
+        ""
+        "function postFirmware(url, blob, session, offset, retries) {"
+        "  const xhr = new XMLHttpRequest();"
+        "  xhr.onload = function() {"
+        "    updateProgress();"
+        "  };"
+        "  xhr.onerror = function() {"
+        "    if (retries >= 5) {"
+        "      updateProgress();"
+        "      return;"
+        "    }"
+        "    document.getElementById('status').innerText = 'Connection lost, resuming...';"
+        "    setTimeout(function() { resumeFirmware(url, blob, session, retries + 1); }, 2000);"
+        "  };"
+        "  xhr.open('POST', url);"
+        "  if (offset > 0) {"
+        "    xhr.setRequestHeader('Content-Range', 'bytes ' + offset + '-' + (blob.size - 1) + '/' + blob.size);"
+        "  }"
+        "  xhr.send(offset > 0 ? blob.slice(offset) : blob);"
+        "}"
+        ""
+        "function resumeFirmware(url, blob, session, retries) {"
+        "  const retry = function() {"
+        "    if (retries < 5) {"
+        "      setTimeout(function() { resumeFirmware(url, blob, session, retries + 1); }, 2000);"
+        "    } else {"
+        "      updateProgress();"
+        "    }"
+        "  };"
+        "  fetch('/upload/session?session=' + session)"
+        "    .then(r => r.json())"
+        "    .then(s => {"
+        "      if (s.state === 'paused') {"
+        "        postFirmware(url, blob, session, s.resume_from, retries);"
+        "      } else if (s.state === 'receiving') {"
+        "        retry();"
+        "      } else {"
+        "        updateProgress();"
+        "      }"
+        "    })"
+        "    .catch(retry);"
+        "}"
+        ""
         "function uploadFirmware() {"
         "  const file = document.getElementById('hexFile').files[0];"
         "  const type = document.getElementById('fwType').value;"
+        "  const query = '?type=' + type + (document.getElementById('stageFw').checked ? '&stage=1' : '') +"
+        "    (document.getElementById('verifyFw').checked ? '' : '&verify=0');"
         "  if (!file) {"
-        "    alert('Please select a hex file');"
+        "    alert('Please select a hex, uf2, elf or tar bundle file');"
         "    return;"
         "  }"
         "  document.querySelector('#uploadBtn').disabled = true;"
-        "  document.getElementById('status').innerText = 'Starting upload...';"
         "  document.getElementById('progressBar').style.width = '0%';"
-        "  progressTimer = setInterval(updateProgress, 500);"
-        "  const xhr = new XMLHttpRequest();"
-        "  xhr.onload = function() {"
-        "    updateProgress();"
+        "  const name = file.name.toLowerCase();"
+        "  if (name.endsWith('.tar') || name.endsWith('.tar.gz') || name.endsWith('.tgz')) {"
+        "    document.getElementById('status').innerText = 'Uploading bundle...';"
+        "    sendFirmware('/upload_bundle' + query, file);"
+        "    return;"
+        "  }"
+        "  if (!name.endsWith('.hex') && !name.endsWith('.uf2')) {"
+        "    document.getElementById('status').innerText = 'Starting upload...';"
+        "    sendFirmware('/upload' + query, file);"
+        "    return;"
+        "  }"
+        "  document.getElementById('status').innerText = 'Converting...';"
+        "  const reader = new FileReader();"
+        "  reader.onload = function() {"
+        "    try {"
+        "      const recs = name.endsWith('.uf2') ? parseUF2(reader.result) : parseIntelHex(new TextDecoder().decode(reader.result));"
+        "      const img = buildFramedImage(recs);"
+        "      document.getElementById('status').innerText = 'Uploading ' + img.length + ' bytes (' + Math.round(img.length * 100 / file.size) + '% of file)...';"
+        "      sendFirmware('/upload_bin' + query, img);"
+        "    } catch (err) {"
+        "      document.getElementById('status').innerText = 'Conversion failed: ' + err.message;"
+        "      document.querySelector('#uploadBtn').disabled = false;"
+        "    }"
         "  };"
-        "  xhr.open('POST', '/upload?type=' + type);"
-        "  xhr.send(file);"
+        "  reader.readAsArrayBuffer(file);"
+        "}"
+        ""
+        "function loadCache() {"
+        "  fetch('/cache/list').then(r => r.json()).then(data => {"
+        "    let html = '<p>' + Math.round(data.free / 1024) + ' of ' + Math.round(data.total / 1024) + ' KB free</p>';"
+        "    data.images.forEach(img => {"
+        "      const id = img.sha256.substring(0, 16);"
+        "      html += '<div style=\"margin:6px 0;font-family:monospace;\">' + id + ' ' + Math.round(img.bytes / 1024) + ' KB ';"
+        "      html += '<button class=\"btn\" onclick=\"cacheAction(\\'flash\\', \\'' + id + '\\')\">Flash</button> ';"
+        "      html += '<button class=\"btn\" onclick=\"cacheAction(\\'update\\', \\'' + id + '\\')\">Update Changed</button> ';"
+        "      html += '<button class=\"btn\" onclick=\"cacheAction(\\'diff\\', \\'' + id + '\\')\">Compare</button> ';"
+        "      html += '<button class=\"btn btn-danger\" onclick=\"cacheAction(\\'delete\\', \\'' + id + '\\')\">Delete</button></div>';"
+        "    });"
+        "    document.getElementById('cacheList').innerHTML = data.images.length ? html : html + '<p>No cached images</p>';"
+        "  });"
+        "}"
+        ""
+        "function cacheAction(action, sha) {"
+        "  document.getElementById('status').innerText = (action === 'delete' ? 'Deleting ' : action === 'diff' ? 'Comparing ' : 'Flashing ') + sha + '...';"
+        "  if (action === 'flash' || action === 'update') {"
+        "    runJob('cache_' + action, '&sha=' + sha, 'status', loadCache);"
+        "    return;"
+        "  }"
+        "  if (action === 'diff') {"
+        "    fetch('/cache/diff?sha=' + sha).then(r => r.json()).then(data => {"
+        "      document.getElementById('status').innerText = !data.success ? data.message :"
+        "        data.changed_count + ' pages differ from the target' +"
+        "        (data.changed_count ? ': ' + data.changed.map(p => '0x' + p.addr.toString(16)).join(' ') : '');"
+        "    });"
+        "    return;"
+        "  }"
+        "  fetch('/cache/' + action + '?sha=' + sha, {method: 'POST'}).then(r => r.json()).then(data => {"
+        "    document.getElementById('status').innerText = data.message;"
+        "    loadCache();"
+        "  });"
+        "}"
+        ""
+        "function loadBackups() {"
+        "  fetch('/backup/list').then(r => r.json()).then(data => {"
+        "    let html = '';"
+        "    data.backups.forEach(b => {"
+        "      html += '<div style=\"margin:6px 0;font-family:monospace;\">#' + b.sequence + ' ' + b.description + ' ' +"
+        "        Math.round(b.size / 1024) + ' KB, ' + Math.round(b.stored / 1024) + ' KB stored ';"
+        "      html += '<button class=\"btn\" onclick=\"restoreBackup(' + b.index + ')\">Restore</button> ';"
+        "      html += '<button class=\"btn btn-danger\" onclick=\"deleteBackup(' + b.index + ')\">Delete</button></div>';"
+        "    });"
+        "    document.getElementById('backupList').innerHTML = html || '<p>No backups</p>';"
+        "  });"
+        "}"
+        ""
+        "function loadTelemetry() {"
+        "  fetch('/telemetry').then(r => r.json()).then(data => {"
+        "    let html = '';"
+        "    data.targets.forEach(t => {"
+        "      const attached = data.attached && data.attached.device_id === t.device_id;"
+        "      html += '<div style=\"margin:6px 0;font-family:monospace;\">' + t.device_id + (attached ? ' (attached)' : '') +"
+        "        ': ' + t.flashes + ' flashes, ' + t.flash_failures + ' failed, ' + t.page_erases + ' page erases, ' +"
+        "        t.verify_failures + ' verify failures, worst page ' + t.max_page_index + ' erased ' + t.max_page_erases + 'x</div>';"
+        "    });"
+        "    document.getElementById('telemetryList').innerHTML = html || '<p>No targets seen yet</p>';"
+        "  });"
+        "}"
+        ""
+        "function createBackup() {"
+        "  fetch('/stage/status').then(r => r.json()).then(stage => {"
+        "    if (stage.valid && !confirm('The backup replaces the staged image. Continue?')) return;"
+        "    document.getElementById('backupStatus').innerText = 'Reading target flash...';"
+        "    runJob('backup', stage.valid ? '&force=1' : '', 'backupStatus', function() { loadBackups(); loadCache(); });"
+        "  });"
+        "}"
+        ""
+        "function restoreBackup(index) {"
+        "  if (!confirm('Overwrite the target with this backup?')) return;"
+        "  runJob('backup_restore', '&index=' + index, 'backupStatus', null);"
+        "}"
+        ""
+        "function deleteBackup(index) {"
+        "  fetch('/backup/delete?index=' + index, {method: 'POST'}).then(r => r.json()).then(data => {"
+        "    document.getElementById('backupStatus').innerText = data.message;"
+        "    loadBackups();"
+        "  });"
         "}"
         ""
         "console.log('=== BEFORE BLE FUNCTIONS ===');"
@@ -704,6 +1027,7 @@ static esp_err_t root_handler(httpd_req_t *req) {
         "  refreshStatus();"
         "  checkPowerStatus();"
         "  updateBatteryStatus();"
+        "  connectProgressSocket();"
         "  setInterval(refreshStatus, 10000);"
         "  setInterval(checkPowerStatus, 5000);"
         "  setInterval(updateBatteryStatus, 5000);"
@@ -979,7 +1303,7 @@ static esp_err_t root_handler(httpd_req_t *req) {
 static esp_err_t start_webserver(void) {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
-    config.max_uri_handlers = 30;
+    config.max_uri_handlers = 48;
     config.recv_wait_timeout = 10;
     config.stack_size = 8192;
     
@@ -1010,6 +1334,9 @@ static esp_err_t start_webserver(void) {
         // Register BLE handlers
         register_ble_handlers(web_server);
 
+        // Progress push for flash jobs
+        register_ws_handlers(web_server);
+
         ESP_LOGI(TAG, "Web server started successfully");
         return ESP_OK;
     }
@@ -1345,6 +1672,7 @@ static void system_health_task(void *arg) {
     // Now just monitor for critical issues
     while (1) {
         vTaskDelay(pdMS_TO_TICKS(5000));  // Check every 5 seconds
+        error_log_flush_if_due();
         
         // Only check for critical heap issues
         free_heap = esp_get_free_heap_size();
@@ -1359,9 +1687,7 @@ static void handle_critical_error(const char *context, esp_err_t error) {
     ESP_LOGE(TAG, "Critical error in %s: %s", context, esp_err_to_name(error));
     recovery_count++;
     
-    char error_msg[128];
-    snprintf(error_msg, sizeof(error_msg), "%s: %s", context, esp_err_to_name(error));
-    power_log_error(error_msg);
+    error_log_record(ERROR_LOG_SYSTEM, error, recovery_count);
     
     if (recovery_count > 3) {
         ESP_LOGE(TAG, "Too many recovery attempts");
@@ -1381,9 +1707,18 @@ static void init_system(void) {
     }
     ESP_ERROR_CHECK(ret);
     ESP_LOGI(TAG, "NVS Flash initialized");
+    error_log_init();
     
     init_config();
     system_events = xEventGroupCreate();
+    swd_session_init();
+    flash_telemetry_init();
+
+    // Staging is optional, uploads without ?stage=1 still flash directly
+    if (fw_stage_init() == ESP_OK) {
+        fw_cache_init();
+        fw_backup_init();
+    }
     
     power_config_t power_cfg = {
         .target_power_gpio = 10,
@@ -1406,7 +1741,10 @@ static void init_system(void) {
     init_wifi();
     
     ESP_LOGI(TAG, "Initializing SWD connection...");
-    try_swd_connection();
+    if (swd_session_begin("boot", SWD_PRIO_NORMAL, SWD_SESSION_FOREVER) == ESP_OK) {
+        try_swd_connection();
+        swd_session_end();
+    }
     
     // DON'T initialize BLE here - let the delayed task do it
     ESP_LOGI(TAG, "BLE initialization will start in 10 seconds...");
@@ -1416,10 +1754,21 @@ static void init_system(void) {
 
 static esp_err_t release_swd_handler(httpd_req_t *req) {
     ESP_LOGI(TAG, "Manual SWD release requested");
+
+    // Releasing under a running flash would leave the target half written
+    if (swd_session_begin("release", SWD_PRIO_NORMAL, 2000) != ESP_OK) {
+        char msg[64];
+        const char *owner = swd_session_owner();
+        snprintf(msg, sizeof(msg), "SWD busy: %s", owner ? owner : "unknown");
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, msg);
+        return ESP_OK;
+    }
     if (swd_is_connected()) {
         swd_release_target();
         swd_shutdown();
     }
+    swd_session_end();
     httpd_resp_send(req, "Released", 8);
     return ESP_OK;
 }
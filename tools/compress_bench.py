@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+"""
+Host benchmark for compressed firmware uploads.
+
+Reports compression ratio and host-side decompression throughput for
+gzip, zlib, raw deflate and heatshrink on real firmware images (.hex,
+.elf or .bin), plus the upload time at a given link speed. Optionally
+writes the compressed files for uploading with ?compress=<name>.
+
+    python3 tools/compress_bench.py firmware.hex [--link-kbps 40] [--out DIR]
+
+Heatshrink output uses the `heatshrink` CLI when it is on PATH and the
+pure Python encoder below otherwise (slow, but byte-compatible).
+"""
+
+import argparse
+import gzip
+import os
+import shutil
+import subprocess
+import time
+import zlib
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.cur = 0
+        self.count = 0
+
+    def put(self, value, bits):
+        for i in range(bits - 1, -1, -1):
+            self.cur = (self.cur << 1) | ((value >> i) & 1)
+            self.count += 1
+            if self.count == 8:
+                self.out.append(self.cur)
+                self.cur = 0
+                self.count = 0
+
+    def finish(self):
+        if self.count:
+            self.out.append(self.cur << (8 - self.count))
+        return bytes(self.out)
+
+
+def heatshrink_encode(data, window_bits, lookahead_bits):
+    """Greedy LZSS producing the heatshrink bit stream format."""
+    max_offset = 1 << window_bits
+    max_len = 1 << lookahead_bits
+    # A back-reference costs 1 + W + L bits, a literal 9 bits
+    min_len = (1 + window_bits + lookahead_bits) // 9 + 1
+    chains = {}
+    bits = BitWriter()
+    n = len(data)
+    i = 0
+
+    def insert(pos):
+        if pos + 1 < n:
+            chains.setdefault(data[pos:pos + 2], []).append(pos)
+
+    while i < n:
+        best_len = 0
+        best_off = 0
+        candidates = chains.get(data[i:i + 2], [])
+        for p in reversed(candidates[-32:]):
+            off = i - p
+            if off > max_offset:
+                break
+            length = 0
+            while length < max_len and i + length < n and data[p + length] == data[i + length]:
+                length += 1
+            if length > best_len:
+                best_len, best_off = length, off
+                if length == max_len:
+                    break
+
+        if best_len >= min_len:
+            bits.put(0, 1)
+            bits.put(best_off - 1, window_bits)
+            bits.put(best_len - 1, lookahead_bits)
+            for k in range(best_len):
+                insert(i + k)
+            i += best_len
+        else:
+            bits.put(1, 1)
+            bits.put(data[i], 8)
+            insert(i)
+            i += 1
+
+    return bits.finish()
+
+
+def heatshrink_decode(data, window_bits, lookahead_bits):
+    out = bytearray()
+    total_bits = len(data) * 8
+    pos = 0
+
+    def get(bits):
+        nonlocal pos
+        value = 0
+        for _ in range(bits):
+            value = (value << 1) | ((data[pos >> 3] >> (7 - (pos & 7))) & 1)
+            pos += 1
+        return value
+
+    while True:
+        if pos + 1 > total_bits:
+            break
+        if get(1):
+            if pos + 8 > total_bits:
+                break
+            out.append(get(8))
+        else:
+            if pos + window_bits + lookahead_bits > total_bits:
+                break
+            offset = get(window_bits) + 1
+            count = get(lookahead_bits) + 1
+            for _ in range(count):
+                out.append(out[-offset] if offset <= len(out) else 0)
+    return bytes(out)
+
+
+def heatshrink_cli(data, window_bits, lookahead_bits):
+    tool = shutil.which("heatshrink")
+    if not tool:
+        return None
+    proc = subprocess.run([tool, "-e", "-w", str(window_bits), "-l", str(lookahead_bits)],
+                          input=data, stdout=subprocess.PIPE, check=True)
+    return proc.stdout
+
+
+def raw_deflate(data, level=9):
+    c = zlib.compressobj(level, zlib.DEFLATED, -15)
+    return c.compress(data) + c.flush()
+
+
+def raw_inflate(data):
+    return zlib.decompress(data, -15)
+
+
+def timed(fn, data, repeat=5):
+    best = None
+    for _ in range(repeat):
+        start = time.perf_counter()
+        fn(data)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def bench_file(path, args):
+    data = open(path, "rb").read()
+    name = os.path.basename(path)
+    print(f"\n{name}: {len(data)} bytes")
+    print(f"  {'encoding':<12}{'size':>10}{'ratio':>8}{'host MB/s':>11}{'upload s':>10}")
+
+    def row(label, size, seconds):
+        mbps = f"{len(data) / seconds / 1e6:.1f}" if seconds else "-"
+        upload = size / (args.link_kbps * 1024)
+        print(f"  {label:<12}{size:>10}{size / len(data):>8.3f}{mbps:>11}{upload:>10.1f}")
+
+    row("none", len(data), 0)
+
+    results = {
+        "gzip": (gzip.compress(data, 9), gzip.decompress),
+        "zlib": (zlib.compress(data, 9), zlib.decompress),
+        "deflate": (raw_deflate(data), raw_inflate),
+    }
+
+    w, l = args.hs_window, args.hs_lookahead
+    hs = heatshrink_cli(data, w, l)
+    if hs is None:
+        hs = heatshrink_encode(data, w, l)
+    results["heatshrink"] = (hs, lambda d: heatshrink_decode(d, w, l))
+
+    for label, (packed, unpack) in results.items():
+        if unpack(packed)[:len(data)] != data:
+            print(f"  {label:<12} round trip FAILED")
+            continue
+        # The Python heatshrink decoder is only a correctness check
+        seconds = timed(unpack, packed) if label != "heatshrink" else 0
+        row(label, len(packed), seconds)
+
+        if args.out:
+            os.makedirs(args.out, exist_ok=True)
+            ext = {"gzip": "gz", "zlib": "zz", "deflate": "deflate", "heatshrink": "hs"}[label]
+            with open(os.path.join(args.out, f"{name}.{ext}"), "wb") as f:
+                f.write(packed)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("files", nargs="+", help="firmware images (.hex, .elf, .bin)")
+    parser.add_argument("--link-kbps", type=float, default=40.0,
+                        help="effective upload speed in KB/s (default 40)")
+    parser.add_argument("--hs-window", type=int, default=11, help="heatshrink -w (default 11)")
+    parser.add_argument("--hs-lookahead", type=int, default=4, help="heatshrink -l (default 4)")
+    parser.add_argument("--out", help="directory to write compressed files to")
+    args = parser.parse_args()
+
+    for path in args.files:
+        bench_file(path, args)
+
+
+if __name__ == "__main__":
+    main()